@@ -0,0 +1,121 @@
+#ifndef BATCH_COMPRESSOR_H
+#define BATCH_COMPRESSOR_H
+
+#include "etca_format.h"
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+namespace etca {
+
+/**
+ * @brief One image to compress in a batch
+ */
+struct BatchJob {
+    std::string input_path;
+    std::string output_path;
+    uint64_t pixels = 0;        // Filled in by BatchCompressor::run from the image header
+    uint64_t input_bytes = 0;   // Size of the input file
+};
+
+/**
+ * @brief Settings shared by every image of a batch
+ */
+struct BatchOptions {
+    bool lossless = false;
+    float variance_threshold = 10.0f;
+    EtcaMetadata metadata;
+    uint8_t region_depth = EtcaDirectory::AUTO_DEPTH;
+    unsigned workers = 0;           // Compression threads (0 = hardware concurrency)
+    size_t write_queue_depth = 0;   // Encoded files waiting to be written (0 = 2 per worker)
+};
+
+/**
+ * @brief An image the batch could not compress
+ */
+struct BatchFailure {
+    std::string input_path;
+    std::string message;
+};
+
+/**
+ * @brief Aggregate results of a batch run
+ */
+struct BatchStatistics {
+    size_t images_done = 0;
+    size_t images_failed = 0;
+    uint64_t input_bytes = 0;    // Input file bytes of the images done
+    uint64_t output_bytes = 0;   // .etca bytes written
+    uint64_t pixels = 0;         // Pixels of the images done
+    double seconds = 0.0;        // Wall-clock time of the whole run
+    unsigned workers = 0;
+    std::vector<BatchFailure> failures;
+    
+    double images_per_second() const { return seconds > 0.0 ? static_cast<double>(images_done) / seconds : 0.0; }
+    double megabytes_per_second() const { return seconds > 0.0 ? static_cast<double>(input_bytes) / (1024.0 * 1024.0) / seconds : 0.0; }
+    double megapixels_per_second() const { return seconds > 0.0 ? static_cast<double>(pixels) / 1e6 / seconds : 0.0; }
+};
+
+/**
+ * @brief Compresses many images in one process with a pipelined pool of workers
+ *
+ * Each worker takes one whole image at a time through load and compress,
+ * so small images cost no per-image thread start-up or parallel-region
+ * overhead; each worker compresses with a serial ExecutionContext. Encoded files
+ * go through a bounded queue to a dedicated writer thread, so disk writes
+ * overlap with loading and compressing the next images and at most
+ * workers + write_queue_depth encoded files are held at once. Images are
+ * handed out largest first (by pixel count from their headers), which keeps
+ * one late large image from leaving the other workers idle at the end.
+ */
+class BatchCompressor {
+public:
+    /**
+     * @brief Called on the writer thread after each image is written or fails
+     * @param job The image just finished
+     * @param error Empty on success, otherwise the failure message
+     * @param finished Images finished so far, including this one
+     * @param total Images in the batch
+     */
+    using ProgressCallback = std::function<void(const BatchJob& job, const std::string& error,
+                                                size_t finished, size_t total)>;
+    
+    /**
+     * @brief Build the job list for a directory or a list file
+     *
+     * A directory is scanned recursively for .ppm and .png files, and its
+     * layout is mirrored under output_dir. Any other path is read as a list
+     * file with one image path per line (blank lines and lines starting with
+     * '#' are skipped); those outputs keep their place below the deepest
+     * directory all listed images share. With an empty output_dir each
+     * output is written next to its input.
+     *
+     * @param input Directory or list file
+     * @param output_dir Directory for the .etca files (may be empty)
+     * @return Jobs in discovery order
+     * @throws std::runtime_error if the input cannot be read, or two inputs
+     *         (e.g. photo.png and photo.ppm) map to the same output
+     */
+    static std::vector<BatchJob> collect_jobs(const std::string& input, const std::string& output_dir);
+    
+    /**
+     * @brief Compress every job
+     *
+     * Failures are recorded in the statistics and do not stop the batch.
+     *
+     * @param jobs Images to compress
+     * @param options Compression and pool settings
+     * @param progress Optional per-image callback
+     * @return Aggregate throughput and failures
+     */
+    static BatchStatistics run(
+        std::vector<BatchJob> jobs,
+        const BatchOptions& options,
+        const ProgressCallback& progress = ProgressCallback()
+    );
+};
+
+} // namespace etca
+
+#endif // BATCH_COMPRESSOR_H
@@ -0,0 +1,58 @@
+#ifndef BYTE_SPAN_H
+#define BYTE_SPAN_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace spectre {
+
+/**
+ * @brief Non-owning view of a contiguous byte range
+ *
+ * Lets decoders read straight from a memory-mapped file or any buffer
+ * without copying it into a vector first. The viewed bytes must outlive
+ * the span.
+ */
+class ByteSpan {
+public:
+    ByteSpan() = default;
+    ByteSpan(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+    /**
+     * @brief View a vector's contents (implicit, so vectors pass wherever spans are taken)
+     */
+    ByteSpan(const std::vector<uint8_t>& bytes) : data_(bytes.data()), size_(bytes.size()) {}
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    const uint8_t* begin() const { return data_; }
+    const uint8_t* end() const { return data_ + size_; }
+
+    uint8_t operator[](size_t index) const { return data_[index]; }
+
+    /**
+     * @brief View of the bytes from offset to the end (empty if offset is past it)
+     */
+    ByteSpan subspan(size_t offset) const {
+        return offset < size_ ? ByteSpan(data_ + offset, size_ - offset) : ByteSpan();
+    }
+
+    /**
+     * @brief View of up to count bytes starting at offset
+     */
+    ByteSpan subspan(size_t offset, size_t count) const {
+        ByteSpan tail = subspan(offset);
+        return ByteSpan(tail.data_, count < tail.size_ ? count : tail.size_);
+    }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+} // namespace spectre
+
+#endif // BYTE_SPAN_H
@@ -1,6 +1,7 @@
 #ifndef COLOR_DATA_H
 #define COLOR_DATA_H
 
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 #include <string>
@@ -16,6 +17,155 @@ struct Color {
     Color(uint8_t r = 0, uint8_t g = 0, uint8_t b = 0) : r(r), g(g), b(b) {}
 };
 
+// Rows are handed to libpng, PPM streams and the pixel kernels as packed RGB bytes
+static_assert(sizeof(Color) == 3, "Color must be packed RGB24");
+
+/**
+ * @brief Non-owning, strided view over a rectangle of pixels
+ * 
+ * Points into a parent buffer (usually a ColorData) and never copies it.
+ * The parent must outlive the view.
+ */
+class ImageView {
+public:
+    /**
+     * @brief Constructor for a view
+     * @param origin Pointer to the top-left pixel of the region
+     * @param width Region width in pixels
+     * @param height Region height in pixels
+     * @param stride Distance between rows of the parent buffer, in pixels
+     */
+    ImageView(const Color* origin, uint32_t width, uint32_t height, size_t stride)
+        : origin_(origin), width_(width), height_(height), stride_(stride) {}
+    
+    /**
+     * @brief Get view width
+     */
+    uint32_t get_width() const { return width_; }
+    
+    /**
+     * @brief Get view height
+     */
+    uint32_t get_height() const { return height_; }
+    
+    /**
+     * @brief Get row stride of the parent buffer, in pixels
+     */
+    size_t get_stride() const { return stride_; }
+    
+    /**
+     * @brief Check if the view covers no pixels
+     */
+    bool empty() const { return width_ == 0 || height_ == 0; }
+    
+    /**
+     * @brief Get a pointer to the first pixel of a row
+     * @param y Row within the view (must be < height)
+     */
+    const Color* row(uint32_t y) const { return origin_ + static_cast<size_t>(y) * stride_; }
+    
+    /**
+     * @brief Get a pixel color (black outside the view)
+     * @param x X coordinate within the view
+     * @param y Y coordinate within the view
+     */
+    Color get_pixel(uint32_t x, uint32_t y) const {
+        return (x < width_ && y < height_) ? row(y)[x] : Color(0, 0, 0);
+    }
+    
+    /**
+     * @brief Get a view of a sub-region (clamped to this view)
+     * @param x Starting X coordinate within this view
+     * @param y Starting Y coordinate within this view
+     * @param width Region width
+     * @param height Region height
+     */
+    ImageView subview(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const;
+    
+    /**
+     * @brief Calculate the average color over the view
+     */
+    Color calculate_average_color() const;
+
+private:
+    const Color* origin_;
+    uint32_t width_, height_;
+    size_t stride_;
+};
+
+/**
+ * @brief Non-owning, strided, writable view over a rectangle of pixels
+ *
+ * What the decoders paint into, so they can write straight into a buffer
+ * they do not own (a ColorData, or a caller's frame). The parent must
+ * outlive the view.
+ */
+class MutableImageView {
+public:
+    /**
+     * @brief Constructor for a writable view
+     * @param origin Pointer to the top-left pixel of the region
+     * @param width Region width in pixels
+     * @param height Region height in pixels
+     * @param stride Distance between rows of the parent buffer, in pixels
+     */
+    MutableImageView(Color* origin, uint32_t width, uint32_t height, size_t stride)
+        : origin_(origin), width_(width), height_(height), stride_(stride) {}
+    
+    /**
+     * @brief Get view width
+     */
+    uint32_t get_width() const { return width_; }
+    
+    /**
+     * @brief Get view height
+     */
+    uint32_t get_height() const { return height_; }
+    
+    /**
+     * @brief Get a writable pointer to the first pixel of a row
+     * @param y Row within the view (must be < height)
+     */
+    Color* row(uint32_t y) const { return origin_ + static_cast<size_t>(y) * stride_; }
+    
+    /**
+     * @brief Get a read-only view of the same pixels
+     */
+    ImageView view() const { return ImageView(origin_, width_, height_, stride_); }
+    
+    /**
+     * @brief Get a writable view of a sub-region (clamped to this view)
+     * @param x Starting X coordinate within this view
+     * @param y Starting Y coordinate within this view
+     * @param width Region width
+     * @param height Region height
+     */
+    MutableImageView subview(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const;
+    
+    /**
+     * @brief Fill a rectangular region (clamped to the view) row by row
+     * @param x Starting X coordinate
+     * @param y Starting Y coordinate
+     * @param width Region width
+     * @param height Region height
+     * @param color Fill color
+     */
+    void fill_region(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const Color& color) const;
+    
+    /**
+     * @brief Copy a view's pixels into this one (clamped to this view)
+     * @param source Pixels to copy
+     * @param x Destination X coordinate of the source's top-left pixel
+     * @param y Destination Y coordinate of the source's top-left pixel
+     */
+    void copy_region(const ImageView& source, uint32_t x, uint32_t y) const;
+
+private:
+    Color* origin_;
+    uint32_t width_, height_;
+    size_t stride_;
+};
+
 /**
  * @brief Manages image data and provides analysis methods
  */
@@ -65,6 +215,33 @@ public:
      */
     const std::vector<Color>& get_pixels() const { return pixels_; }
     
+    /**
+     * @brief Get a writable pointer to the first pixel of a row
+     * @param y Row index (must be < height)
+     */
+    Color* row(uint32_t y) { return pixels_.data() + xy_to_index(0, y); }
+    
+    /**
+     * @brief Get a non-owning view of the entire image
+     */
+    ImageView view() const { return ImageView(pixels_.data(), width_, height_, width_); }
+    
+    /**
+     * @brief Get a writable non-owning view of the entire image
+     */
+    MutableImageView mutable_view() { return MutableImageView(pixels_.data(), width_, height_, width_); }
+    
+    /**
+     * @brief Get a non-owning view of a sub-region (clamped to the image)
+     * @param x Starting X coordinate
+     * @param y Starting Y coordinate
+     * @param width Region width
+     * @param height Region height
+     */
+    ImageView view(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const {
+        return view().subview(x, y, width, height);
+    }
+    
     /**
      * @brief Extract a sub-region of the image
      * @param x Starting X coordinate
@@ -84,6 +261,24 @@ public:
      */
     void fill(const Color& color);
     
+    /**
+     * @brief Fill a rectangular region (clamped to the image) row by row
+     * @param x Starting X coordinate
+     * @param y Starting Y coordinate
+     * @param width Region width
+     * @param height Region height
+     * @param color Fill color
+     */
+    void fill_region(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const Color& color);
+    
+    /**
+     * @brief Copy a view's pixels into this image (clamped to the image)
+     * @param source Pixels to copy
+     * @param x Destination X coordinate of the view's top-left pixel
+     * @param y Destination Y coordinate of the view's top-left pixel
+     */
+    void copy_region(const ImageView& source, uint32_t x, uint32_t y);
+    
     /**
      * @brief Save image to file (PPM or PNG)
      * @param file_path Output file path
@@ -99,7 +294,7 @@ private:
      * @brief Helper to convert (x,y) to linear index
      */
     size_t xy_to_index(uint32_t x, uint32_t y) const {
-        return y * width_ + x;
+        return static_cast<size_t>(y) * width_ + x;
     }
 };
 
@@ -4,6 +4,9 @@
 #include "spectre_tree.h"
 #include "color_data.h"
 #include "entropy_coding.h"
+#include "tree_stream.h"
+#include "tile_color_coder.h"
+#include "execution_context.h"
 #include <vector>
 #include <cstdint>
 
@@ -18,8 +21,22 @@ struct CompressionConfig {
     bool enable_mipmap = true;
     bool prefer_speed = false;  // If true, skip slower entropy codecs
     bool use_adaptive_encoding = true;  // Use best-fit codec selection
+    int compression_level = DeflateCodec::DEFAULT_LEVEL;  // LZ77 effort: 1 = fastest, 9 = smallest
+    ZlibStrategy zlib_strategy = ZlibStrategy::DEFAULT;  // Strategy for the zlib codec
+    CodecSelection codec_selection = CodecSelection::SAMPLED;  // How the adaptive encoder picks a codec
+    uint8_t tree_stream_version = TreeStream::VERSION_PROGRESSIVE;  // VERSION_IMPLICIT, _PREDICTED, _PROGRESSIVE or _LOSSLESS
+    uint64_t parallel_cutoff_pixels = SpectreTree::DEFAULT_PARALLEL_CUTOFF;  // Tiles smaller than this build serially
+    size_t entropy_block_size = AdaptiveEncoder::DEFAULT_BLOCK_SIZE;  // Longer byte-coded streams go in CHUNKED blocks (0 = one block)
     
     CompressionConfig() = default;
+    
+    /**
+     * @brief Settings for bit-exact compression
+     *
+     * A modest tree is coded as the base layer of a lossless stream, and
+     * per-pixel residuals make the image exact (see ResidualCoder).
+     */
+    static CompressionConfig lossless();
 };
 
 /**
@@ -38,6 +55,18 @@ struct CompressedImage {
  * 1. Build a Spectre-Tree from the input image
  * 2. Store tile hierarchy and color data
  * 3. Apply entropy coding to reduce size
+ *
+ * A Compressor keeps the statistics of its last call, so concurrent calls
+ * need one Compressor (and one ExecutionContext) each.
+ *
+ * With VERSION_LOSSLESS, compress() and compress_into() append the
+ * residuals of the image to a progressive stream of its tree. Calls that
+ * are given only a tree (encode_tree(), serialize_tree()) have no pixels
+ * to take residuals of and write the progressive stream alone.
+ *
+ * The compress_into() calls write into a caller's buffer and keep the tree
+ * and serialization buffers in the compressor, so a long-lived compressor
+ * and context compress a stream of similar images without allocating.
  */
 class Compressor {
 public:
@@ -54,6 +83,87 @@ public:
      */
     CompressedImage compress(const ColorData& image);
     
+    /**
+     * @brief Compress a region of an image without copying it out
+     * @param image View of the pixels to compress
+     * @return A compressed representation of the region
+     */
+    CompressedImage compress(const ImageView& image);
+    
+    /**
+     * @brief Compress a region within a caller's thread budget and scratch memory
+     *
+     * Compressors sharing nothing but their input may run concurrently, each
+     * with its own context.
+     *
+     * @param image View of the pixels to compress
+     * @param context Threads and reusable buffers for this call
+     * @return A compressed representation of the region
+     */
+    CompressedImage compress(const ImageView& image, ExecutionContext& context);
+    
+    /**
+     * @brief Compress an image into a caller's buffer, reusing the compressor's own context
+     * @param image The input image data
+     * @param output Receives the compressed payload, as CompressedImage::data (cleared first)
+     */
+    void compress_into(const ColorData& image, std::vector<uint8_t>& output);
+    
+    /**
+     * @brief Compress a region into a caller's buffer within a caller's context
+     *
+     * Produces the same bytes as compress(). Once the output, the
+     * compressor and the context have held the largest image, further
+     * calls do not allocate (apart from the task buffers of a parallel
+     * tree build).
+     *
+     * @param image View of the pixels to compress
+     * @param output Receives the compressed payload, as CompressedImage::data (cleared first)
+     * @param context Threads and reusable buffers for this call
+     */
+    void compress_into(const ImageView& image, std::vector<uint8_t>& output, ExecutionContext& context);
+    
+    /**
+     * @brief Serialize a built tree into a tree stream (before entropy coding)
+     *
+     * The middle stage of compress(), exposed so it can be driven and timed
+     * on its own; the stream version comes from the config.
+     *
+     * @param tree The built tree (its dimensions go into the header)
+     * @param output Receives the stream (cleared first)
+     */
+    void serialize_tree(const SpectreTree& tree, std::vector<uint8_t>& output) const;
+    
+    /**
+     * @brief Serialize and entropy code a tree that is already built
+     *
+     * The last two stages of compress(), for callers that build or prune
+     * the tree themselves (see RateController). Statistics are updated as
+     * by compress().
+     *
+     * @param tree The tree to encode
+     * @param context Threads for the entropy trials
+     * @return A compressed representation of the tree's image
+     */
+    CompressedImage encode_tree(const SpectreTree& tree, ExecutionContext& context);
+    
+    /**
+     * @brief Serialize and entropy code a built tree into a caller's buffer
+     * @param tree The tree to encode
+     * @param output Receives the compressed payload (cleared first)
+     * @param context Threads and reusable buffers for this call
+     */
+    void encode_tree_into(const SpectreTree& tree, std::vector<uint8_t>& output, ExecutionContext& context);
+    
+    /**
+     * @brief Apply entropy coding to reduce further
+     *
+     * The last stage of compress(); range-coded streams only get the NONE
+     * marker. Also used for streams built outside the compressor (see
+     * SequenceEncoder). Codecs and the staged stream live in the context.
+     */
+    void apply_entropy_coding(std::vector<uint8_t>& data, ExecutionContext& context);
+    
     /**
      * @brief Get compression statistics (tree size, depth, etc.)
      */
@@ -61,7 +171,8 @@ public:
         size_t tile_count;
         int max_depth;
         uint32_t leaf_count;
-        double compression_ratio;  // Original size / Compressed size
+        size_t compressed_size;    // Bytes of the finished stream
+        double compression_ratio;  // Original RGB size / compressed_size
     };
     
     /**
@@ -80,18 +191,90 @@ private:
     CompressionStats entropy_stats_;
     
     /**
-     * @brief Serialize the tree into a byte stream
+     * @brief A split tile whose children are coded at the next depth
      */
-    void serialize_tree(
+    struct ProgressiveTile {
+        SpectreTile::ID id;
+        uint32_t width, height;
+        Color color;  // As decoders will see it
+    };
+    
+    /**
+     * @brief Buffers of a serialization, kept for the next one
+     */
+    struct SerializeScratch {
+        std::vector<SpectreTile::ID> pending;
+        std::vector<uint8_t> level_bytes;
+        std::vector<ProgressiveTile> frontier;
+        std::vector<ProgressiveTile> next_frontier;
+        std::vector<uint8_t> base_layer;  // Progressive payload of a lossless stream
+        ColorData base_image{0, 0};       // What the base layer paints
+    };
+    
+    SpectreTree tree_;                           // Reused by compress_into()
+    ExecutionContext context_;                   // Used by compress_into() without a context
+    mutable SerializeScratch serialize_scratch_;
+    
+    /**
+     * @brief Tree stream version of a tree on its own (VERSION_LOSSLESS gives progressive)
+     */
+    uint8_t stream_version() const;
+    
+    /**
+     * @brief Serialize and entropy code a tree, with the residuals of its image if given
+     * @param image Pixels the tree was built from, for lossless streams (nullptr = none)
+     */
+    void encode_into(const SpectreTree& tree, const ImageView* image, std::vector<uint8_t>& output,
+                     ExecutionContext& context);
+    
+    /**
+     * @brief Adaptive encoder settings from the config
+     */
+    AdaptiveOptions adaptive_options(const ExecutionContext& context) const;
+    
+    /**
+     * @brief Append a tree stream to output
+     */
+    void append_tree(const SpectreTree& tree, std::vector<uint8_t>& output) const;
+    
+    /**
+     * @brief Append a lossless stream: the tree as the base layer, then the image's residuals
+     */
+    void append_lossless(const SpectreTree& tree, const ImageView& image, std::vector<uint8_t>& output,
+                         int threads) const;
+    
+    /**
+     * @brief Report tiles per depth and variance evaluations of a built tree
+     */
+    void record_tree_counters(const SpectreTree& tree, Profiler& profiler) const;
+    
+    /**
+     * @brief Range code split flags and parent-predicted colors of all tiles
+     */
+    static void encode_predicted_tiles(const SpectreTree& tree, std::vector<uint8_t>& output);
+    
+    /**
+     * @brief Code one tile's subtree in pre-order
+     * @param prediction Predicted color for this tile
+     * @param last_child Whether the tile is its parent's last child
+     * @return The color decoders will see for this tile
+     */
+    static Color encode_predicted_tile(
         const SpectreTree& tree,
-        const ColorData& image,
-        std::vector<uint8_t>& output
+        SpectreTile::ID id,
+        uint32_t width, uint32_t height,
+        const Color& prediction,
+        bool last_child,
+        RangeEncoder& encoder,
+        TileColorCoder& coder
     );
     
     /**
-     * @brief Apply entropy coding to reduce further
+     * @brief Range code the tree one depth at a time (breadth-first)
      */
-    void apply_entropy_coding(std::vector<uint8_t>& data);
+    static void encode_progressive_tiles(const SpectreTree& tree, std::vector<uint8_t>& output,
+                                         SerializeScratch& scratch);
+
 };
 
 } // namespace spectre
@@ -0,0 +1,46 @@
+#ifndef DEBLOCKING_FILTER_H
+#define DEBLOCKING_FILTER_H
+
+#include "color_data.h"
+#include <cstdint>
+
+namespace spectre {
+
+/**
+ * @brief Settings for DeblockingFilter
+ */
+struct DeblockingConfig {
+    uint32_t radius = 4;          // Most pixels smoothed on each side of a tile edge
+    uint8_t edge_threshold = 32;  // Steps larger than this (any channel) are kept as real edges
+};
+
+/**
+ * @brief Smooths the seams between decoded tiles
+ *
+ * Every decoded leaf is a flat rectangle, so the leaf bounds are exactly
+ * where neighbouring pixels differ; the filter finds them with a chunked
+ * compare of each row against its neighbour (identical chunks, i.e. tile
+ * interiors, are skipped wholesale) and blends a linear ramp across each
+ * edge. The ramp spans at most `radius` pixels and half of each adjoining
+ * run, so small (detailed) tiles are only touched at their edges and
+ * ramps never overlap, and steps above `edge_threshold` are left sharp.
+ *
+ * Two separable passes run in place: a column pass swept row by row
+ * (parallel over column stripes), then a row pass (parallel over rows).
+ * Only pixels within `radius` of an edge are written; no copy of the
+ * image is made.
+ */
+class DeblockingFilter {
+public:
+    /**
+     * @brief Deblock an image in place
+     * @param image Decoded image (piecewise-flat tiles)
+     * @param config Filter radius and edge threshold
+     * @param threads Threads for each pass (0 = the OpenMP default)
+     */
+    static void apply(ColorData& image, const DeblockingConfig& config = DeblockingConfig(), int threads = 0);
+};
+
+} // namespace spectre
+
+#endif // DEBLOCKING_FILTER_H
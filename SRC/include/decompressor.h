@@ -3,7 +3,10 @@
 
 #include "color_data.h"
 #include "compressor.h"
+#include "byte_span.h"
 #include "entropy_coding.h"
+#include "tile_color_coder.h"
+#include "execution_context.h"
 #include <vector>
 #include <cstdint>
 #include <memory>
@@ -19,7 +22,14 @@ namespace spectre {
  * 1. Deserialize the tile tree structure
  * 2. Reconstruct the hierarchical tile arrangement
  * 3. Paint each tile with its average color
- * 4. Optionally apply interpolation for smooth gradients
+ * 4. Optionally deblock tile boundaries for smooth gradients
+ *
+ * A max_depth limit paints tiles at that depth with their own average
+ * instead of their subtrees. Progressive streams stop reading there;
+ * predicted streams are still walked in full. Implicit and legacy streams,
+ * whose internal tiles carry no colors, always decode at full depth.
+ * Lossless streams add their residuals only when the whole base layer is
+ * painted; a shallower limit gives a lossy preview of the base layer.
  */
 class Decompressor {
 public:
@@ -34,36 +44,241 @@ public:
      * @brief Decompress with quality options
      * @param compressed The compressed image data
      * @param apply_interpolation Apply interpolation between tiles
-     * @param max_depth Limit decompression depth (for LOD)
+     * @param max_depth Limit decompression depth (for LOD, -1 = full depth)
      */
     static ColorData decompress(
         const CompressedImage& compressed,
         bool apply_interpolation,
         int max_depth = -1
     );
+    
+    /**
+     * @brief Decompress from a view of compressed bytes (e.g. a mapped file)
+     *
+     * Streams stored without an entropy layer are decoded in place, so the
+     * payload is never copied.
+     *
+     * @param data Compressed payload, starting at the entropy codec marker
+     * @param width Image width
+     * @param height Image height
+     * @param apply_interpolation Apply interpolation between tiles
+     * @param max_depth Limit decompression depth (for LOD, -1 = full depth)
+     */
+    static ColorData decompress(
+        ByteSpan data,
+        uint32_t width,
+        uint32_t height,
+        bool apply_interpolation = false,
+        int max_depth = -1
+    );
+    
+    /**
+     * @brief Decompress within a caller's thread budget and scratch memory
+     *
+     * Concurrent calls are independent as long as each has its own context.
+     *
+     * @param data Compressed payload, starting at the entropy codec marker
+     * @param width Image width
+     * @param height Image height
+     * @param apply_interpolation Apply interpolation between tiles
+     * @param max_depth Limit decompression depth (for LOD, -1 = full depth)
+     * @param context Threads and reusable buffers for this call
+     */
+    static ColorData decompress(
+        ByteSpan data,
+        uint32_t width,
+        uint32_t height,
+        bool apply_interpolation,
+        int max_depth,
+        ExecutionContext& context
+    );
+    
+    /**
+     * @brief Decompress into a caller's image, reusing its pixels and the context's scratch
+     *
+     * The image is reallocated only if its size differs, so a long-lived
+     * image and context decode a stream of same-sized images without
+     * allocating. Every pixel is painted by a well-formed stream.
+     *
+     * @param data Compressed payload, starting at the entropy codec marker
+     * @param width Image width
+     * @param height Image height
+     * @param image Receives the reconstructed image
+     * @param context Threads and reusable buffers for this call
+     * @param apply_interpolation Apply interpolation between tiles
+     * @param max_depth Limit decompression depth (for LOD, -1 = full depth)
+     * @return false if the stream is malformed or truncated (pixels it did not reach keep their values)
+     */
+    static bool decompress_into(
+        ByteSpan data,
+        uint32_t width,
+        uint32_t height,
+        ColorData& image,
+        ExecutionContext& context,
+        bool apply_interpolation = false,
+        int max_depth = -1
+    );
+    
+    /**
+     * @brief Decompress into pixels the caller owns, such as a frame buffer
+     *
+     * The view's size is the image's size. Tree streams are painted straight
+     * into it, so no image is allocated; legacy indexed streams are decoded
+     * into one and copied. No interpolation is applied.
+     *
+     * @param data Compressed payload, starting at the entropy codec marker
+     * @param image Receives the reconstructed image
+     * @param context Threads and reusable buffers for this call
+     * @param max_depth Limit decompression depth (for LOD, -1 = full depth)
+     * @return false if the stream is malformed or truncated (pixels it did not reach keep their values)
+     */
+    static bool decompress_into(
+        ByteSpan data,
+        const MutableImageView& image,
+        ExecutionContext& context,
+        int max_depth = -1
+    );
+    
+    /**
+     * @brief Undo the entropy coding layer (or a legacy RLE wrapper)
+     * @param data Compressed payload
+     * @param storage Receives the decoded bytes when they cannot alias `data` (cleared first)
+     * @return The decoded stream, viewing either `data` or `storage`
+     */
+    static ByteSpan decode_entropy_layer(ByteSpan data, std::vector<uint8_t>& storage);
+    
+    /**
+     * @brief Undo the entropy coding layer with codecs kept in a scratch
+     * @param threads Threads for the blocks of a CHUNKED layer (0 = the OpenMP default)
+     */
+    static ByteSpan decode_entropy_layer(ByteSpan data, std::vector<uint8_t>& storage, EntropyScratch& scratch,
+                                         int threads = 0);
 
 private:
     /**
-     * @brief Deserialize tree from compressed data
+     * @brief Read position in an implicit-topology tree stream
+     */
+    struct StreamCursor {
+        const uint8_t* split_flags;
+        const uint8_t* colors;  // Next leaf color
+        uint64_t tile_count;
+        uint64_t next_tile;     // Pre-order index of the next split flag
+        int max_depth;
+    };
+    
+    /**
+     * @brief Decoding state for a predicted (range-coded) tree stream
+     */
+    struct PredictedCursor {
+        RangeDecoder decoder;
+        TileColorCoder coder;
+        uint64_t tile_count;
+        uint64_t next_tile;
+        int max_depth;
+        int lod_depth;          // Deepest tile that is painted
+    };
+    
+    /**
+     * @brief A decoded split tile whose children come at the next depth
+     */
+    struct ProgressiveTile {
+        uint32_t x, y;
+        uint32_t width, height;
+        Color color;
+    };
+    
+    /**
+     * @brief Deserialize a tree from a legacy indexed stream
      */
     static std::unique_ptr<SpectreTree> deserialize_tree(
-        const std::vector<uint8_t>& data,
+        ByteSpan decoded_data,
         uint32_t width,
         uint32_t height
     );
     
+    /**
+     * @brief Paint an implicit-topology or predicted stream (see tree_stream.h) into an image
+     *
+     * Walks the split flags recursively, carrying each tile's bounds down,
+     * and fills every leaf row by row. No tree is built.
+     *
+     * @param max_depth Deepest tile to paint (-1 = no limit)
+     * @param threads Threads for the residual strips of a lossless stream
+     * @return false if the stream is malformed (image holds what was decoded)
+     */
+    static bool rasterize_stream(ByteSpan stream, int max_depth, const MutableImageView& image,
+                                 int threads);
+    
+    /**
+     * @brief Paint a lossless stream: its progressive base layer, then the residuals
+     * @param payload Bytes after the stream header
+     */
+    static bool rasterize_lossless(
+        ByteSpan payload,
+        const TreeStream::Header& header,
+        int max_depth,
+        const MutableImageView& image,
+        int threads
+    );
+    
+    /**
+     * @brief Paint a progressive stream depth by depth
+     *
+     * Stops after max_depth, or at the first depth whose block is missing
+     * or damaged; split tiles left at that point are painted with their
+     * own color, so the image is always a complete coarser version.
+     *
+     * @param payload Bytes after the stream header
+     * @return false if the stream ended early or is malformed
+     */
+    static bool rasterize_progressive(
+        ByteSpan payload,
+        const TreeStream::Header& header,
+        int max_depth,
+        const MutableImageView& image
+    );
+    
+    /**
+     * @brief Paint one tile's subtree from a predicted stream
+     * @param prediction Predicted color for this tile
+     * @param last_child Whether the tile is its parent's last child
+     * @param decoded_color Receives this tile's color
+     */
+    static bool rasterize_predicted_tile(
+        PredictedCursor& cursor,
+        uint32_t x, uint32_t y,
+        uint32_t width, uint32_t height,
+        int depth,
+        const Color& prediction,
+        bool last_child,
+        Color& decoded_color,
+        const MutableImageView& image
+    );
+    
+    /**
+     * @brief Paint one tile's subtree and advance the cursor past it
+     */
+    static bool rasterize_tile(
+        StreamCursor& cursor,
+        uint32_t x, uint32_t y,
+        uint32_t width, uint32_t height,
+        int depth,
+        const MutableImageView& image
+    );
+    
     /**
      * @brief Reconstruct image from tree
      */
     static ColorData reconstruct_image(
         const SpectreTree& tree,
-        bool apply_interpolation
+        bool apply_interpolation,
+        int threads
     );
     
     /**
-     * @brief Apply bilinear or other interpolation between tile boundaries
+     * @brief Smooth tile boundaries with the default DeblockingFilter
      */
-    static void apply_interpolation(ColorData& image);
+    static void apply_interpolation(ColorData& image, int threads);
 };
 
 } // namespace spectre
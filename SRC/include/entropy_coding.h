@@ -1,13 +1,16 @@
 #ifndef ENTROPY_CODING_H
 #define ENTROPY_CODING_H
 
+#include "byte_span.h"
 #include <vector>
 #include <cstdint>
+#include <cstddef>
 #include <memory>
-#include <map>
 
 namespace spectre {
 
+class Profiler;
+
 /**
  * @brief Entropy coding format types
  */
@@ -15,7 +18,25 @@ enum class EntropyCodec : uint8_t {
     NONE = 0x00,           ///< No compression
     RLE = 0x01,            ///< Run-Length Encoding (legacy)
     DEFLATE = 0x02,        ///< LZ77 + Huffman (streaming)
-    ADVANCED = 0x03        ///< LZ77 + Delta + Huffman adaptive
+    ADVANCED = 0x03,       ///< LZ77 + Delta + Huffman adaptive
+    HUFFMAN = 0x04,        ///< Canonical Huffman, length-limited
+    ZLIB = 0x05,           ///< zlib deflate stream
+    CHUNKED = 0x06         ///< Independently coded blocks (see AdaptiveEncoder)
+};
+
+/**
+ * @brief Lower-case codec name ("rle", "zlib", ...; "none" for unknown values)
+ */
+const char* entropy_codec_name(EntropyCodec codec);
+
+/**
+ * @brief zlib match-finding strategy (see deflateInit2)
+ */
+enum class ZlibStrategy : uint8_t {
+    DEFAULT,       ///< Z_DEFAULT_STRATEGY
+    FILTERED,      ///< Z_FILTERED: favor Huffman coding over short matches
+    HUFFMAN_ONLY,  ///< Z_HUFFMAN_ONLY: no string matching
+    RLE            ///< Z_RLE: matches of distance one only
 };
 
 /**
@@ -34,15 +55,101 @@ struct CompressionStats {
 };
 
 /**
- * @brief Huffman tree node for encoding/decoding
+ * @brief Writes variable-length codes MSB-first through a 64-bit buffer
  */
-struct HuffmanNode {
-    uint8_t value;
-    uint32_t frequency;
-    std::shared_ptr<HuffmanNode> left;
-    std::shared_ptr<HuffmanNode> right;
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& output) : output_(output) {}
+    
+    /**
+     * @brief Append the low `length` bits of `code` (length 1-32)
+     */
+    void write(uint32_t code, int length) {
+        buffer_ = (buffer_ << length) | code;
+        count_ += length;
+        if (count_ >= 32) {
+            count_ -= 32;
+            uint32_t word = static_cast<uint32_t>(buffer_ >> count_);
+            output_.push_back(static_cast<uint8_t>(word >> 24));
+            output_.push_back(static_cast<uint8_t>(word >> 16));
+            output_.push_back(static_cast<uint8_t>(word >> 8));
+            output_.push_back(static_cast<uint8_t>(word));
+        }
+    }
     
-    HuffmanNode(uint8_t v, uint32_t f) : value(v), frequency(f), left(nullptr), right(nullptr) {}
+    /**
+     * @brief Write out pending bits, zero-padding the last byte
+     */
+    void flush() {
+        while (count_ >= 8) {
+            count_ -= 8;
+            output_.push_back(static_cast<uint8_t>(buffer_ >> count_));
+        }
+        if (count_ > 0) {
+            output_.push_back(static_cast<uint8_t>(buffer_ << (8 - count_)));
+        }
+        buffer_ = 0;
+        count_ = 0;
+    }
+
+private:
+    std::vector<uint8_t>& output_;
+    uint64_t buffer_ = 0;
+    int count_ = 0;  // Pending bits in the low end of buffer_
+};
+
+/**
+ * @brief Reads MSB-first bit codes through a 64-bit buffer
+ *
+ * Reading past the end yields zero bits and sets exhausted().
+ */
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+    
+    /**
+     * @brief Look at the next `length` bits without consuming them (length 1-32)
+     */
+    uint32_t peek(int length) {
+        if (count_ < length) {
+            refill();
+        }
+        return static_cast<uint32_t>(buffer_ >> (64 - length));
+    }
+    
+    /**
+     * @brief Drop bits previously returned by peek()
+     */
+    void consume(int length) {
+        buffer_ <<= length;
+        count_ -= length;
+    }
+    
+    /**
+     * @brief True once consumed bits run past the end of the data
+     */
+    bool exhausted() const { return count_ < padding_bits_; }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t position_ = 0;
+    uint64_t buffer_ = 0;   // Unread bits, left-aligned
+    int count_ = 0;
+    int padding_bits_ = 0;  // Zero bits appended past the end
+    
+    void refill() {
+        while (count_ <= 56) {
+            uint64_t byte = 0;
+            if (position_ < size_) {
+                byte = data_[position_++];
+            } else {
+                padding_bits_ += 8;
+            }
+            buffer_ |= byte << (56 - count_);
+            count_ += 8;
+        }
+    }
 };
 
 /**
@@ -57,14 +164,36 @@ public:
      * @param input Raw input data
      * @return Compressed data with codec type prepended
      */
-    virtual std::vector<uint8_t> encode(const std::vector<uint8_t>& input) = 0;
+    std::vector<uint8_t> encode(const std::vector<uint8_t>& input) {
+        std::vector<uint8_t> encoded;
+        encode_into(input, encoded);
+        return encoded;
+    }
+    
+    /**
+     * @brief Encode into a caller's buffer, reusing its capacity
+     * @param input Raw input data
+     * @param output Receives the compressed data with codec type prepended (cleared first)
+     */
+    virtual void encode_into(const std::vector<uint8_t>& input, std::vector<uint8_t>& output) = 0;
     
     /**
      * @brief Decode/decompress data (expects codec type byte prefix)
      * @param input Compressed data with codec type
      * @return Original uncompressed data
      */
-    virtual std::vector<uint8_t> decode(const std::vector<uint8_t>& input) = 0;
+    std::vector<uint8_t> decode(ByteSpan input) {
+        std::vector<uint8_t> decoded;
+        decode_into(input, decoded);
+        return decoded;
+    }
+    
+    /**
+     * @brief Decode into a caller's buffer, reusing its capacity
+     * @param input Compressed data with codec type
+     * @param output Receives the original data (cleared first; empty if the input is malformed)
+     */
+    virtual void decode_into(ByteSpan input, std::vector<uint8_t>& output) = 0;
     
     /**
      * @brief Get compression statistics from last operation
@@ -77,8 +206,8 @@ public:
  */
 class RLECodec : public EntropyCodec_Base {
 public:
-    std::vector<uint8_t> encode(const std::vector<uint8_t>& input) override;
-    std::vector<uint8_t> decode(const std::vector<uint8_t>& input) override;
+    void encode_into(const std::vector<uint8_t>& input, std::vector<uint8_t>& output) override;
+    void decode_into(ByteSpan input, std::vector<uint8_t>& output) override;
     const CompressionStats& get_stats() const override { return stats_; }
 
 private:
@@ -86,99 +215,253 @@ private:
 };
 
 /**
- * @brief Huffman Coding
- * Single-pass Huffman encoder for high entropy reduction
+ * @brief Canonical Huffman coding of bytes
+ *
+ * Stream: HUFFMAN(1) | original_size(8) | code lengths (256 x 4 bits) | codes
+ *
+ * Code lengths are limited to MAX_CODE_LENGTH, so the decoder resolves each
+ * code with one table lookup; table entries also carry the following code
+ * when both fit in the looked-up bits, so short codes decode two at a time.
  */
 class HuffmanCodec : public EntropyCodec_Base {
 public:
-    std::vector<uint8_t> encode(const std::vector<uint8_t>& input) override;
-    std::vector<uint8_t> decode(const std::vector<uint8_t>& input) override;
+    static constexpr int MAX_CODE_LENGTH = 12;
+    
+    void encode_into(const std::vector<uint8_t>& input, std::vector<uint8_t>& output) override;
+    void decode_into(ByteSpan input, std::vector<uint8_t>& output) override;
     const CompressionStats& get_stats() const override { return stats_; }
 
 private:
+    static constexpr size_t SYMBOL_COUNT = 256;
+    static constexpr size_t HEADER_SIZE = 1 + 8 + SYMBOL_COUNT / 2;
+    
     CompressionStats stats_;
-    std::map<uint8_t, std::string> huffman_codes_;
     
     /**
-     * @brief Build Huffman tree from frequency analysis
+     * @brief One decode table slot, indexed by the next MAX_CODE_LENGTH bits
      */
-    std::shared_ptr<HuffmanNode> build_tree(const std::vector<uint32_t>& frequencies);
+    struct DecodeEntry {
+        uint8_t symbols[2];
+        uint8_t first_length;   // Bits of the first code (0 = invalid code)
+        uint8_t total_length;   // Bits of both codes when symbol_count is 2
+        uint8_t symbol_count;
+    };
     
     /**
-     * @brief Generate bit codes for each byte value
+     * @brief Compute Huffman code lengths, limited to MAX_CODE_LENGTH
      */
-    void generate_codes(const std::shared_ptr<HuffmanNode>& node, 
-                        const std::string& code,
-                        std::map<uint8_t, std::string>& codes);
+    static std::vector<uint8_t> build_code_lengths(const std::vector<uint64_t>& frequencies);
+    
+    /**
+     * @brief Assign canonical codes (shorter codes first, then by symbol)
+     * @return false if the lengths over-subscribe the code space
+     */
+    static bool build_canonical_codes(const std::vector<uint8_t>& lengths, std::vector<uint32_t>& codes);
 };
 
 /**
  * @brief Deflate-like compression (LZ77 + Huffman)
  * Combines sliding window pattern matching with Huffman coding
+ *
+ * Matches are found through hash chains over 3-byte prefixes. The level
+ * trades speed for ratio by bounding how many chain entries are searched
+ * and whether lazy matching defers a match when the next byte starts a
+ * longer one.
  */
 class DeflateCodec : public EntropyCodec_Base {
 public:
-    DeflateCodec(uint16_t window_size = 32768, uint16_t max_match_len = 258);
+    static constexpr int MIN_LEVEL = 1;      ///< Fastest
+    static constexpr int MAX_LEVEL = 9;      ///< Smallest output
+    static constexpr int DEFAULT_LEVEL = 6;
+    
+    DeflateCodec(uint16_t window_size = 32768, uint16_t max_match_len = 258,
+                 int level = DEFAULT_LEVEL);
     
-    std::vector<uint8_t> encode(const std::vector<uint8_t>& input) override;
-    std::vector<uint8_t> decode(const std::vector<uint8_t>& input) override;
+    void encode_into(const std::vector<uint8_t>& input, std::vector<uint8_t>& output) override;
+    void decode_into(ByteSpan input, std::vector<uint8_t>& output) override;
     const CompressionStats& get_stats() const override { return stats_; }
 
 private:
+    // A match token takes 5 bytes, so shorter matches would not pay off
+    static constexpr uint16_t MIN_MATCH_LENGTH = 6;
+    static constexpr int HASH_BITS = 15;
+    
     CompressionStats stats_;
     uint16_t window_size_;
     uint16_t max_match_len_;
+    uint32_t max_chain_;      // Chain entries searched per position
+    uint16_t nice_length_;    // Stop searching once a match is this long
+    bool lazy_matching_;
+    
+    std::vector<int64_t> hash_head_;  // Most recent position per hash (-1 if none)
+    std::vector<int64_t> hash_prev_;  // Previous position with the same hash, by pos % window
+    
+    /**
+     * @brief Hash the 3 bytes starting at pos
+     */
+    static uint32_t hash_at(const std::vector<uint8_t>& data, size_t pos);
     
     /**
-     * @brief Find the best match in sliding window
+     * @brief Add pos to the hash chains (needs 3 bytes of lookahead)
+     */
+    void insert_position(const std::vector<uint8_t>& data, size_t pos);
+    
+    /**
+     * @brief Find the best match in sliding window by walking the hash chain
      * @return {length, distance} of best match, or {0, 0} if no match found
      */
     std::pair<uint16_t, uint16_t> find_match(
         const std::vector<uint8_t>& data,
-        size_t pos,
-        uint16_t window_size
+        size_t pos
     );
 };
 
+/**
+ * @brief DEFLATE through zlib
+ *
+ * Stream: ZLIB(1) | original_size(8) | zlib stream
+ */
+class ZlibCodec : public EntropyCodec_Base {
+public:
+    /**
+     * @param level zlib compression level (1 = fastest, 9 = smallest)
+     * @param strategy zlib strategy
+     */
+    explicit ZlibCodec(int level = DeflateCodec::DEFAULT_LEVEL,
+                       ZlibStrategy strategy = ZlibStrategy::DEFAULT);
+    
+    void encode_into(const std::vector<uint8_t>& input, std::vector<uint8_t>& output) override;
+    void decode_into(ByteSpan input, std::vector<uint8_t>& output) override;
+    const CompressionStats& get_stats() const override { return stats_; }
+
+private:
+    static constexpr size_t HEADER_SIZE = 1 + 8;
+    
+    CompressionStats stats_;
+    int level_;
+    ZlibStrategy strategy_;
+};
+
 /**
  * @brief Advanced codec with Delta encoding + LZ77 + Huffman
  * Optimized for tile-based image data with adaptive encoding
  */
 class AdvancedCodec : public EntropyCodec_Base {
 public:
-    std::vector<uint8_t> encode(const std::vector<uint8_t>& input) override;
-    std::vector<uint8_t> decode(const std::vector<uint8_t>& input) override;
+    /**
+     * @param level LZ77 effort passed to the inner DeflateCodec
+     */
+    explicit AdvancedCodec(int level = DeflateCodec::DEFAULT_LEVEL) : deflate_(32768, 258, level) {}
+    
+    void encode_into(const std::vector<uint8_t>& input, std::vector<uint8_t>& output) override;
+    void decode_into(ByteSpan input, std::vector<uint8_t>& output) override;
     const CompressionStats& get_stats() const override { return stats_; }
 
 private:
     CompressionStats stats_;
+    DeflateCodec deflate_;
+    std::vector<uint8_t> staging_;  // Delta-coded bytes between the two stages
     
     /**
      * @brief Apply delta encoding to tile color data
      * Reduces entropy by storing differences instead of absolute values
      */
-    std::vector<uint8_t> delta_encode(const std::vector<uint8_t>& input);
+    static void delta_encode(const std::vector<uint8_t>& input, std::vector<uint8_t>& output);
     
     /**
      * @brief Reverse delta encoding
      */
-    std::vector<uint8_t> delta_decode(const std::vector<uint8_t>& input);
+    static void delta_decode(const std::vector<uint8_t>& input, std::vector<uint8_t>& output);
 };
 
+/**
+ * @brief How AdaptiveEncoder chooses among candidate codecs
+ */
+enum class CodecSelection : uint8_t {
+    EXHAUSTIVE,  ///< Encode the whole input with every candidate
+    SAMPLED      ///< Rank candidates on sampled blocks, then fully encode the front-runners
+};
+
+/**
+ * @brief Options for one AdaptiveEncoder::encode call
+ */
+struct AdaptiveOptions {
+    bool prefer_speed = false;  // Skip the slower LZ77-based codecs
+    int level = DeflateCodec::DEFAULT_LEVEL;  // LZ77 effort (1-9)
+    ZlibStrategy zlib_strategy = ZlibStrategy::DEFAULT;
+    CodecSelection selection = CodecSelection::SAMPLED;
+    int threads = 0;  // Trials (or blocks) run side by side (0 = the OpenMP default)
+    size_t block_size = 0;  // Inputs longer than this are coded as CHUNKED blocks (0 = never)
+    Profiler* profiler = nullptr;  // Times each trial and counts its bytes in and out
+};
+
+class EntropyScratch;
+
 /**
  * @brief Adaptive entropy encoder - tries multiple codecs and picks the best
+ *
+ * Full trials run in parallel. With CodecSelection::SAMPLED, inputs of at
+ * least SAMPLING_MIN_SIZE bytes are first encoded as a handful of evenly
+ * spaced blocks; only codecs whose sampled ratio is close to the best one
+ * are then run on the whole input.
+ *
+ * Inputs longer than AdaptiveOptions::block_size are cut into blocks of
+ * that size, and each block picks its own codec. Blocks are coded, and
+ * decoded, in parallel instead of their trials; the bytes never depend
+ * on the thread count.
+ *   CHUNKED(1) | original_size(8) | block_size(4)
+ *   encoded_size(4) per block, big-endian
+ *   blocks: each an encode() result with its own codec marker
+ * The block count follows from the two sizes.
  */
 class AdaptiveEncoder {
 public:
+    static constexpr size_t SAMPLING_MIN_SIZE = 256 * 1024;
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 256 * 1024;
+    static constexpr size_t MAX_BLOCK_SIZE = size_t(1) << 30;
+    static constexpr size_t SAMPLE_BLOCK_COUNT = 16;
+    static constexpr size_t SAMPLE_BLOCK_SIZE = 4096;
+    
     /**
      * @brief Encode data using the best available codec
      * @param input Raw data to compress
-     * @param prefer_speed If true, skips slower codecs like Huffman
+     * @param options Candidate and selection settings
+     * @param stats Receives the statistics of the chosen codec
      * @return Compressed data with codec type prefix
      */
     static std::vector<uint8_t> encode(
         const std::vector<uint8_t>& input,
-        bool prefer_speed = false
+        const AdaptiveOptions& options,
+        CompressionStats& stats
+    );
+    
+    /**
+     * @brief Encode data using the best available codec
+     * @param input Raw data to compress
+     * @param prefer_speed If true, skips the slower LZ77-based codecs
+     * @param level LZ77 effort for the Deflate-based codecs (1-9)
+     * @return Compressed data with codec type prefix (statistics are discarded)
+     */
+    static std::vector<uint8_t> encode(
+        const std::vector<uint8_t>& input,
+        bool prefer_speed = false,
+        int level = DeflateCodec::DEFAULT_LEVEL
+    );
+    
+    /**
+     * @brief Encode into a caller's buffer with codecs and trial buffers kept in a scratch
+     *
+     * Produces the bytes encode() produces. Once the scratch and `output`
+     * have seen an input of this size, the call allocates nothing.
+     *
+     * @param output Receives the compressed data with codec type prefix (cleared first)
+     */
+    static void encode_into(
+        const std::vector<uint8_t>& input,
+        const AdaptiveOptions& options,
+        CompressionStats& stats,
+        std::vector<uint8_t>& output,
+        EntropyScratch& scratch
     );
     
     /**
@@ -186,15 +469,142 @@ public:
      * @param input Compressed data with codec type prefix
      * @return Original uncompressed data
      */
-    static std::vector<uint8_t> decode(const std::vector<uint8_t>& input);
+    static std::vector<uint8_t> decode(ByteSpan input);
+    
+    /**
+     * @brief Decode into a caller's buffer with codecs kept in a scratch
+     * @param output Receives the original data (cleared first; left empty if a CHUNKED stream is malformed)
+     * @param threads Threads for CHUNKED blocks (0 = the OpenMP default)
+     */
+    static void decode_into(ByteSpan input, std::vector<uint8_t>& output, EntropyScratch& scratch, int threads = 0);
+    
+    /**
+     * @brief Create an encoder for a codec ID (nullptr for NONE or unknown IDs)
+     */
+    static std::unique_ptr<EntropyCodec_Base> create_codec(
+        EntropyCodec codec,
+        int level,
+        ZlibStrategy zlib_strategy = ZlibStrategy::DEFAULT
+    );
+
+private:
+    // Sampled ratio below best * (1 - margin) drops a codec from full trials
+    static constexpr float SAMPLE_MARGIN = 0.05f;
+    
+    static constexpr size_t MAX_CANDIDATES = 5;
+    
+    /**
+     * @brief Keep the candidates whose ratio on sampled blocks is near the best
+     * @param candidates Candidate codecs, compacted in place
+     * @param count Number of candidates, updated to the shortlist's
+     */
+    static void shortlist_by_sampling(
+        const std::vector<uint8_t>& input,
+        EntropyCodec* candidates,
+        size_t& count,
+        const AdaptiveOptions& options,
+        EntropyScratch& scratch
+    );
+    
+    static constexpr size_t CHUNKED_HEADER_SIZE = 1 + 8 + 4;
+    
+    /**
+     * @brief Code each block of the input on its own (see the class comment)
+     */
+    static void encode_chunked(
+        const std::vector<uint8_t>& input,
+        const AdaptiveOptions& options,
+        CompressionStats& stats,
+        std::vector<uint8_t>& output,
+        EntropyScratch& scratch
+    );
+    
+    static void decode_chunked(ByteSpan input, std::vector<uint8_t>& output, EntropyScratch& scratch, int threads);
+};
+
+/**
+ * @brief Codec instances and buffers that AdaptiveEncoder reuses between calls
+ *
+ * Codecs keep their working tables (e.g. Deflate's hash chains), and each
+ * codec has one trial buffer, so parallel trials never share anything.
+ * Copies start out empty: scratch is never shared between owners.
+ */
+class EntropyScratch {
+public:
+    EntropyScratch() = default;
+    EntropyScratch(const EntropyScratch&) {}
+    EntropyScratch& operator=(const EntropyScratch&) { return *this; }
+    EntropyScratch(EntropyScratch&&) = default;
+    EntropyScratch& operator=(EntropyScratch&&) = default;
+    
+    /**
+     * @brief The kept encoder for a codec ID, (re)created for a new level or strategy
+     * @return nullptr for NONE or unknown IDs
+     */
+    EntropyCodec_Base* encoder(EntropyCodec codec, int level, ZlibStrategy zlib_strategy);
+    
+    /**
+     * @brief The kept codec for a codec ID, at whatever level it has (levels do not affect decoding)
+     * @return nullptr for NONE or unknown IDs
+     */
+    EntropyCodec_Base* decoder(EntropyCodec codec);
+    
+    /**
+     * @brief Output buffer for a codec's trials
+     */
+    std::vector<uint8_t>& trial_buffer(EntropyCodec codec) { return slots_[slot_of(codec)].trial; }
     
     /**
-     * @brief Get statistics from last encoding
+     * @brief Blocks sampled from the input for candidate ranking
      */
-    static const CompressionStats& get_stats();
+    std::vector<uint8_t>& sample_buffer() { return sample_; }
+    
+    /**
+     * @brief One scratch per thread for CHUNKED blocks (grown to at least `count`)
+     */
+    std::vector<EntropyScratch>& workers(size_t count);
+    
+    /**
+     * @brief Coded blocks of a CHUNKED stream, one buffer each
+     */
+    std::vector<std::vector<uint8_t>>& block_buffers() { return blocks_; }
+    
+    /**
+     * @brief A worker's copy of the block it is coding, or the block it decoded
+     */
+    std::vector<uint8_t>& block_buffer() { return block_; }
+    
+    /**
+     * @brief Start offsets of the blocks of a CHUNKED stream being decoded
+     */
+    std::vector<uint64_t>& block_offsets() { return offsets_; }
+    
+    /**
+     * @brief Free all codecs and buffers
+     */
+    void release();
 
 private:
-    static CompressionStats last_stats_;
+    static constexpr size_t SLOT_COUNT = static_cast<size_t>(EntropyCodec::ZLIB) + 1;
+    
+    struct Slot {
+        std::unique_ptr<EntropyCodec_Base> codec;
+        int level = 0;
+        ZlibStrategy zlib_strategy = ZlibStrategy::DEFAULT;
+        std::vector<uint8_t> trial;
+    };
+    
+    Slot slots_[SLOT_COUNT];
+    std::vector<uint8_t> sample_;
+    std::vector<EntropyScratch> workers_;
+    std::vector<std::vector<uint8_t>> blocks_;
+    std::vector<uint8_t> block_;
+    std::vector<uint64_t> offsets_;
+    
+    static size_t slot_of(EntropyCodec codec) {
+        size_t slot = static_cast<size_t>(codec);
+        return slot < SLOT_COUNT ? slot : 0;
+    }
 };
 
 } // namespace spectre
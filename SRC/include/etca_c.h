@@ -0,0 +1,139 @@
+#ifndef ETCA_C_H
+#define ETCA_C_H
+
+/**
+ * @brief C API of the etca_c shared library: .etca files in memory
+ *
+ * Encodes from and decodes into pixel buffers the caller owns, without
+ * touching the filesystem. Pixels are packed RGB24 rows, `stride` bytes
+ * apart. When the stride is a multiple of 3 the library reads and writes
+ * the caller's rows directly; other strides go through one internal copy.
+ *
+ * No C++ type or exception crosses this interface: every call reports a
+ * status code, and etca_last_error() describes the last failure. Calls
+ * on different threads are independent.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#  if defined(ETCA_C_BUILD)
+#    define ETCA_API __declspec(dllexport)
+#  else
+#    define ETCA_API __declspec(dllimport)
+#  endif
+#else
+#  define ETCA_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Version of this interface; bumped only for incompatible changes
+ */
+#define ETCA_C_API_VERSION 1
+
+/**
+ * @brief etca_encode_options::region_depth that picks the depth from the image size
+ *
+ * One region below about 1 MP, then regions of at least 256x256 pixels.
+ */
+#define ETCA_REGION_DEPTH_AUTO 255u
+
+/**
+ * @brief Result of a call
+ */
+typedef enum etca_status {
+    ETCA_OK = 0,
+    ETCA_ERROR_INVALID_ARGUMENT = 1,  /* Null pointer, zero size, stride too small, ... */
+    ETCA_ERROR_CORRUPT_DATA = 2,      /* Not a .etca file, or a damaged one */
+    ETCA_ERROR_OUT_OF_MEMORY = 3,
+    ETCA_ERROR_INTERNAL = 4
+} etca_status;
+
+/**
+ * @brief Encoder settings; fill with etca_encode_options_init() first
+ *
+ * struct_size lets later versions add fields without breaking callers
+ * built against this header.
+ */
+typedef struct etca_encode_options {
+    uint32_t struct_size;   /* sizeof(etca_encode_options) */
+    int lossless;           /* Non-zero: bit-exact output */
+    float quality;          /* Lossy subdivision threshold, as the CLI's --quality (default 10) */
+    uint32_t region_depth;  /* Depth of the region directory (0 = one region, default ETCA_REGION_DEPTH_AUTO) */
+    int threads;            /* Worker threads (0 = all available) */
+} etca_encode_options;
+
+/**
+ * @brief Compressed bytes owned by the library; release with etca_buffer_free()
+ */
+typedef struct etca_buffer {
+    uint8_t* data;
+    size_t size;
+    void* internal;         /* Owner of data; do not touch */
+} etca_buffer;
+
+/**
+ * @brief Set options to the defaults (lossy, quality 10, region depth from the image size)
+ */
+ETCA_API void etca_encode_options_init(etca_encode_options* options);
+
+/**
+ * @brief Compress packed RGB24 pixels into the bytes of a .etca file
+ * @param rgb First pixel of the top row
+ * @param width Image width in pixels
+ * @param height Image height in pixels
+ * @param stride Distance between rows in bytes (at least width * 3)
+ * @param options Settings (NULL = defaults)
+ * @param out Receives the file; set to empty on failure
+ */
+ETCA_API etca_status etca_encode(const uint8_t* rgb, uint32_t width, uint32_t height, size_t stride,
+                                 const etca_encode_options* options, etca_buffer* out);
+
+/**
+ * @brief Release a buffer from etca_encode() (an empty buffer is ignored)
+ */
+ETCA_API void etca_buffer_free(etca_buffer* buffer);
+
+/**
+ * @brief Read the image size from the header of a .etca file
+ * @param data The file's bytes
+ * @param size Number of bytes (the header alone is enough)
+ * @param width Receives the width in pixels
+ * @param height Receives the height in pixels
+ */
+ETCA_API etca_status etca_get_info(const uint8_t* data, size_t size, uint32_t* width, uint32_t* height);
+
+/**
+ * @brief Decompress a .etca file into packed RGB24 pixels
+ *
+ * The buffer must hold height rows of stride bytes (the last needs only
+ * width * 3), with the size etca_get_info() reports. A truncated file
+ * still decodes to a coarser image and returns ETCA_OK.
+ *
+ * @param data The file's bytes
+ * @param size Number of bytes
+ * @param rgb Receives the pixels, top row first
+ * @param stride Distance between rows in bytes (at least width * 3)
+ */
+ETCA_API etca_status etca_decode(const uint8_t* data, size_t size, uint8_t* rgb, size_t stride);
+
+/**
+ * @brief Describe a status code
+ */
+ETCA_API const char* etca_status_string(etca_status status);
+
+/**
+ * @brief Message of the last failed call on this thread ("" if none)
+ */
+ETCA_API const char* etca_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ETCA_C_H */
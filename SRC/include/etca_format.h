@@ -3,6 +3,9 @@
 
 #include "color_data.h"
 #include "compressor.h"
+#include "rate_control.h"
+#include "byte_span.h"
+#include "image_io.h"
 #include <string>
 #include <vector>
 #include <map>
@@ -14,7 +17,7 @@ namespace etca {
  */
 enum class CompressionMode : uint8_t {
     LOSSY = 0x00,       // Lossy compression using variance-based tile subdivision
-    LOSSLESS = 0x01     // Lossless compression with full-depth tree
+    LOSSLESS = 0x01     // Bit-exact: a tree base layer plus per-pixel residuals
 };
 
 /**
@@ -23,17 +26,23 @@ enum class CompressionMode : uint8_t {
  * Layout:
  *   Offset  Size    Field
  *   0       4       Magic bytes: "ETCA"
- *   4       1       Format version (0x01 for v1)
+ *   4       1       Format version (0x01 = single stream, 0x02 / 0x03 = region directory)
  *   5       1       Compression mode (0x00 = lossy, 0x01 = lossless)
  *   6       4       Original image width (uint32 big-endian)
  *   10      4       Original image height (uint32 big-endian)
  *   14      1       Color depth (0x18 = 24-bit RGB)
  *   15      4       Metadata section size in bytes (uint32 big-endian, 0 if no metadata)
  *   19      1       Reserved for future use
+ *
+ * The header is followed by the metadata section, then the payload: one
+ * compressed stream in v1, or an EtcaDirectory and its regions in v2 and v3.
  */
 struct EtcaHeader {
     static constexpr uint32_t MAGIC = 0x45544341;  // "ETCA" in big-endian
-    static constexpr uint8_t VERSION = 0x01;
+    static constexpr uint8_t VERSION_SINGLE_STREAM = 0x01;
+    static constexpr uint8_t VERSION_REGIONS = 0x02;       // Directory of uint64 offsets (read only)
+    static constexpr uint8_t VERSION_REGION_SIZES = 0x03;  // Directory of uint32 sizes
+    static constexpr uint8_t VERSION = VERSION_REGION_SIZES;  // Version written by EtcaWriter
     static constexpr uint8_t COLOR_DEPTH_RGB24 = 0x18;
     static constexpr size_t HEADER_SIZE = 20;
     
@@ -56,7 +65,108 @@ struct EtcaHeader {
      * @return EtcaHeader object
      * @throws std::runtime_error if data is invalid or magic bytes don't match
      */
-    static EtcaHeader deserialize(const std::vector<uint8_t>& data);
+    static EtcaHeader deserialize(spectre::ByteSpan data);
+};
+
+/**
+ * @brief Pixel rectangle of one directory region
+ */
+struct EtcaRegion {
+    uint32_t x, y;
+    uint32_t width, height;
+};
+
+/**
+ * @brief Directory of independently coded regions (.etca v2 and v3 payload)
+ *
+ * The image is split into the 4^depth tiles a tree reaches after `depth`
+ * full subdivisions (TileInflater geometry), and each tile is compressed as
+ * its own stream. Those tiles form a 2^depth x 2^depth grid; regions are
+ * stored row by row (raster order), so each band of 2^depth regions can be
+ * written as soon as its rows are read, and all bounds follow from the
+ * image size and depth alone.
+ *
+ * Every region starts its stream and color models afresh, so regions
+ * cost bytes; images below SINGLE_REGION_PIXELS get one region, and larger
+ * ones are split only until regions reach MIN_REGION_PIXELS (depth_for()).
+ *
+ * Layout (v3):
+ *   Offset  Size        Field
+ *   0       1           Region depth
+ *   1       4           Region count N, 4^depth (uint32 big-endian)
+ *   5       4*N         Region stream sizes (uint32 big-endian), in order
+ *                       from the end of the directory
+ *
+ * v2 files store N+1 region offsets (uint64 big-endian) instead of the
+ * sizes; region k spans [offset k, offset k+1).
+ *
+ * Regions without pixels have empty streams. Regions may reach past the end
+ * of a truncated file; the ones cut short decode as coarse previews
+ * (progressive streams) or stay black.
+ */
+struct EtcaDirectory {
+    static constexpr uint8_t AUTO_DEPTH = 0xFF;  // Pick the depth from the image size (depth_for())
+    static constexpr uint8_t MAX_DEPTH = 8;      // 65536 regions
+    static constexpr uint64_t SINGLE_REGION_PIXELS = uint64_t(1) << 20;  // Smaller images get one region
+    static constexpr uint64_t MIN_REGION_PIXELS = 256 * 256;
+    static constexpr size_t FIXED_SIZE = 5;
+    
+    uint8_t depth = 0;
+    std::vector<uint64_t> offsets;  // region_count() + 1 entries, from 0
+    bool wide_offsets = false;      // Stored as v2 uint64 offsets rather than uint32 sizes
+    
+    size_t region_count() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    
+    /**
+     * @brief Bytes the serialized directory occupies
+     */
+    size_t serialized_size() const {
+        return FIXED_SIZE + (wide_offsets ? offsets.size() * 8 : region_count() * 4);
+    }
+    
+    /**
+     * @brief Serialize directory to binary format
+     * @throws std::runtime_error if a v3 region stream does not fit its uint32 size
+     */
+    std::vector<uint8_t> serialize() const;
+    
+    /**
+     * @brief Deserialize directory from the start of a region payload
+     * @param data Payload bytes (directory followed by regions)
+     * @param format_version Version from the file header (v2 or v3 layout)
+     * @return EtcaDirectory object
+     * @throws std::runtime_error if the directory is malformed
+     */
+    static EtcaDirectory deserialize(spectre::ByteSpan data, uint8_t format_version = EtcaHeader::VERSION);
+    
+    /**
+     * @brief Region depth for an image: 0 below SINGLE_REGION_PIXELS, then
+     *        as deep as regions stay at or above MIN_REGION_PIXELS
+     * @param width Image width
+     * @param height Image height
+     */
+    static uint8_t depth_for(uint32_t width, uint32_t height);
+    
+    /**
+     * @brief A requested depth made usable: AUTO_DEPTH becomes depth_for(), others are capped at MAX_DEPTH
+     */
+    static uint8_t resolve_depth(uint8_t requested, uint32_t width, uint32_t height);
+    
+    /**
+     * @brief Bounds of every region in directory order
+     * @param width Image width
+     * @param height Image height
+     * @param depth Region depth
+     */
+    static std::vector<EtcaRegion> region_bounds(uint32_t width, uint32_t height, uint8_t depth);
+    
+    /**
+     * @brief Split one image axis the way `depth` tile subdivisions do
+     * @param length Image width or height
+     * @param depth Region depth
+     * @return 2^depth + 1 boundaries, from 0 to length
+     */
+    static std::vector<uint32_t> axis_bounds(uint32_t length, uint8_t depth);
 };
 
 /**
@@ -66,7 +176,7 @@ struct EtcaHeader {
 class EtcaMetadata {
 private:
     std::map<std::string, std::string> data_;
-    
+
 public:
     /**
      * @brief Set metadata key-value pair
@@ -95,7 +205,7 @@ public:
      * @param data Binary data containing key=value pairs
      * @return EtcaMetadata object
      */
-    static EtcaMetadata deserialize(const std::vector<uint8_t>& data);
+    static EtcaMetadata deserialize(spectre::ByteSpan data);
 };
 
 /**
@@ -109,6 +219,10 @@ struct EtcaFile {
 
 /**
  * @brief Writes images to .etca format
+ *
+ * Regions are compressed in parallel within the thread budget of the
+ * ExecutionContext passed in; calls with separate contexts share no
+ * mutable state and may run concurrently.
  */
 class EtcaWriter {
 public:
@@ -116,9 +230,11 @@ public:
      * @brief Compress image and write to .etca file
      * @param image The image to compress
      * @param output_path Output file path
-     * @param lossless If true, use lossless compression; otherwise use lossy
+     * @param lossless If true, use lossless compression (CompressionConfig::lossless()); otherwise use lossy
      * @param variance_threshold For lossy mode: only subdivide tiles with variance > threshold
-     * @param max_depth Maximum tree depth (0 = auto-determine for lossless)
+     * @param max_depth Maximum tree depth (0 = the default; for lossless, of the base layer)
+     * @param region_depth Depth of the region directory (0 = one region, AUTO_DEPTH = from the image size)
+     * @param context Threads and scratch memory for the call (nullptr = a default context)
      * @throws std::runtime_error if file cannot be written
      */
     static void write(
@@ -126,7 +242,9 @@ public:
         const std::string& output_path,
         bool lossless = false,
         float variance_threshold = 10.0f,
-        uint16_t max_depth = 0
+        uint16_t max_depth = 0,
+        uint8_t region_depth = EtcaDirectory::AUTO_DEPTH,
+        spectre::ExecutionContext* context = nullptr
     );
     
     /**
@@ -136,6 +254,8 @@ public:
      * @param lossless If true, use lossless compression
      * @param variance_threshold For lossy mode: subdivision threshold
      * @param metadata Additional metadata to store (optional)
+     * @param region_depth Depth of the region directory (0 = one region, AUTO_DEPTH = from the image size)
+     * @param context Threads and scratch memory for the call (nullptr = a default context)
      * @throws std::runtime_error if file cannot be read/written
      */
     static void write_from_file(
@@ -143,30 +263,235 @@ public:
         const std::string& output_path,
         bool lossless = false,
         float variance_threshold = 10.0f,
-        const EtcaMetadata& metadata = EtcaMetadata()
+        const EtcaMetadata& metadata = EtcaMetadata(),
+        uint8_t region_depth = EtcaDirectory::AUTO_DEPTH,
+        spectre::ExecutionContext* context = nullptr
+    );
+    
+    /**
+     * @brief Compress an image into the bytes of a .etca file
+     *
+     * Same settings as write_from_file, but the file is returned instead of
+     * written, so callers can overlap compression with their own I/O.
+     *
+     * @param image The image to compress
+     * @param lossless If true, use lossless compression
+     * @param variance_threshold For lossy mode: subdivision threshold
+     * @param metadata Additional metadata to store (optional)
+     * @param region_depth Depth of the region directory (0 = one region, AUTO_DEPTH = from the image size)
+     * @param context Threads and scratch memory for the call (nullptr = a default context)
+     * @return Complete .etca file contents
+     */
+    static std::vector<uint8_t> encode(
+        const spectre::ColorData& image,
+        bool lossless = false,
+        float variance_threshold = 10.0f,
+        const EtcaMetadata& metadata = EtcaMetadata(),
+        uint8_t region_depth = EtcaDirectory::AUTO_DEPTH,
+        spectre::ExecutionContext* context = nullptr
+    );
+    
+    /**
+     * @brief Compress pixels the caller owns into the bytes of a .etca file
+     *
+     * Regions are compressed straight from the view, so a caller's frame
+     * buffer is never copied into a ColorData.
+     *
+     * @see encode(const spectre::ColorData&, bool, float, const EtcaMetadata&, uint8_t, spectre::ExecutionContext*)
+     */
+    static std::vector<uint8_t> encode(
+        const spectre::ImageView& image,
+        bool lossless = false,
+        float variance_threshold = 10.0f,
+        const EtcaMetadata& metadata = EtcaMetadata(),
+        uint8_t region_depth = EtcaDirectory::AUTO_DEPTH,
+        spectre::ExecutionContext* context = nullptr
+    );
+    
+    /**
+     * @brief Compress an image into several .etca files from one tree build
+     *
+     * Every region's tree is built once at `variance_threshold` (the finest
+     * variant) and then pruned for each target, without another pass over
+     * the pixels (see spectre::RateController). All regions of a variant
+     * share one threshold, so a variant is the file encode() would produce
+     * at that threshold. Threshold targets use the library's 0.0-1.0 scale
+     * (quality / 255.0f reproduces encode() at that quality exactly); size
+     * targets count the whole file. A target no level meets gets its
+     * nearest level (see RateController::compress); callers compare the
+     * file size or `psnr` with the target to report it.
+     *
+     * @param image The image to compress
+     * @param lossless If true, start from the lossless settings (only the unpruned variant keeps its residuals)
+     * @param variance_threshold Quality of the finest variant
+     * @param targets One file is produced per target, in order
+     * @param metadata Additional metadata stored in every file (optional)
+     * @param region_depth Depth of the region directory (0 = one region, AUTO_DEPTH = from the image size)
+     * @param context Threads and scratch memory for the call (nullptr = a default context)
+     * @param psnr Receives each file's RGB PSNR in dB, from the pruned trees (optional; infinite if exact)
+     * @return Complete .etca file contents, one per target
+     */
+    static std::vector<std::vector<uint8_t>> encode_variants(
+        const spectre::ColorData& image,
+        bool lossless,
+        float variance_threshold,
+        const std::vector<spectre::RateTarget>& targets,
+        const EtcaMetadata& metadata = EtcaMetadata(),
+        uint8_t region_depth = EtcaDirectory::AUTO_DEPTH,
+        spectre::ExecutionContext* context = nullptr,
+        std::vector<double>* psnr = nullptr
+    );
+    
+    /**
+     * @brief Default pixel budget of one band in write_streaming (16 Mpx)
+     */
+    static constexpr uint64_t DEFAULT_BAND_PIXELS = uint64_t(16) << 20;
+    
+    /**
+     * @brief Compress an image file band by band without loading it whole
+     *
+     * Rows are read incrementally and compressed one horizontal band of
+     * directory regions at a time, each region as an independent subtree,
+     * and written out before the next band is read. The region depth is
+     * raised until a band fits in band_pixels, so peak memory is bounded by
+     * the band (about 3 bytes per pixel for the rows, plus the summed-area
+     * tables of the regions being compressed) instead of the image. Output
+     * is an ordinary region file, identical to write_from_file at that depth.
+     *
+     * A region is one stream, so a band cannot be thinner than one row of
+     * regions at EtcaDirectory::MAX_DEPTH: the band actually held is the
+     * larger of band_pixels and width x ceil(height / 256) pixels (e.g.
+     * 40000 x 157 for a 40000 x 40000 image). The return value reports it,
+     * so callers can tell when the budget was not met.
+     *
+     * @param input_file Input image file (PPM or PNG)
+     * @param output_path Output .etca file path
+     * @param lossless If true, use lossless compression
+     * @param variance_threshold For lossy mode: subdivision threshold
+     * @param metadata Additional metadata to store (optional)
+     * @param band_pixels Most pixels to hold in memory at once
+     * @param context Threads and scratch memory for the call (nullptr = a default context)
+     * @return Pixels in the tallest band; above band_pixels if the budget could not be met
+     * @throws std::runtime_error if file cannot be read/written
+     */
+    static uint64_t write_streaming(
+        const std::string& input_file,
+        const std::string& output_path,
+        bool lossless = false,
+        float variance_threshold = 10.0f,
+        const EtcaMetadata& metadata = EtcaMetadata(),
+        uint64_t band_pixels = DEFAULT_BAND_PIXELS,
+        spectre::ExecutionContext* context = nullptr
     );
 };
 
 /**
  * @brief Reads images from .etca format
+ *
+ * Files are memory-mapped (see MappedFile) and decoded in place, so the
+ * compressed payload is not copied on its way to the decompressor. In region
+ * files only the regions a request touches are paged in and decoded.
+ * As with EtcaWriter, concurrent calls need separate ExecutionContexts.
  */
 class EtcaReader {
 public:
     /**
      * @brief Read and decompress .etca file
      * @param input_path Input .etca file path
+     * @param max_depth Deepest tree level to decode (-1 = full detail)
+     * @param context Threads and scratch memory for the call (nullptr = a default context)
      * @return ColorData object with decompressed image
      * @throws std::runtime_error if file cannot be read or is corrupt
      */
-    static spectre::ColorData read(const std::string& input_path);
+    static spectre::ColorData read(const std::string& input_path, int max_depth = -1,
+                                   spectre::ExecutionContext* context = nullptr);
+    
+    /**
+     * @brief Decompress a .etca file held in memory
+     *
+     * A truncated file still decodes: whatever its progressive streams hold
+     * is painted at the depth reached.
+     *
+     * @param file_bytes The file's bytes, header first
+     * @param max_depth Deepest tree level to decode (-1 = full detail)
+     * @param context Threads and scratch memory for the call (nullptr = a default context)
+     * @return ColorData object with decompressed image
+     * @throws std::runtime_error if the data is corrupt
+     */
+    static spectre::ColorData read(spectre::ByteSpan file_bytes, int max_depth = -1,
+                                   spectre::ExecutionContext* context = nullptr);
+    
+    /**
+     * @brief Decompress a .etca file held in memory into pixels the caller owns
+     *
+     * Every region is painted straight into its rectangle of the view, so
+     * no image is allocated for the file; the view can be a frame buffer.
+     * As with read(), a truncated file still decodes.
+     *
+     * @param file_bytes The file's bytes, header first
+     * @param image Receives the image; must be the size in the file's header
+     * @param max_depth Deepest tree level to decode (-1 = full detail)
+     * @param context Threads and scratch memory for the call (nullptr = a default context)
+     * @throws std::runtime_error if the data is corrupt or the view is the wrong size
+     */
+    static void read_into(spectre::ByteSpan file_bytes, const spectre::MutableImageView& image, int max_depth = -1,
+                          spectre::ExecutionContext* context = nullptr);
+    
+    /**
+     * @brief Decompress only a rectangle of a .etca file
+     *
+     * For region files, decodes just the directory regions that overlap the
+     * rectangle, so the cost follows the rectangle's size rather than the
+     * image's. v1 files are decoded in full and cropped.
+     *
+     * @param input_path Input .etca file path
+     * @param x Left edge of the rectangle
+     * @param y Top edge of the rectangle
+     * @param width Rectangle width (clamped to the image)
+     * @param height Rectangle height (clamped to the image)
+     * @param max_depth Deepest tree level to decode (-1 = full detail)
+     * @param context Threads and scratch memory for the call (nullptr = a default context)
+     * @return ColorData holding the rectangle's pixels
+     * @throws std::runtime_error if the file cannot be read, is corrupt, or
+     *         the rectangle lies outside the image
+     */
+    static spectre::ColorData read_region(
+        const std::string& input_path,
+        uint32_t x, uint32_t y,
+        uint32_t width, uint32_t height,
+        int max_depth = -1,
+        spectre::ExecutionContext* context = nullptr
+    );
+    
+    /**
+     * @brief Decompress a rectangle of a .etca file held in memory
+     * @see read_region(const std::string&, uint32_t, uint32_t, uint32_t, uint32_t, int, spectre::ExecutionContext*)
+     */
+    static spectre::ColorData read_region(
+        spectre::ByteSpan file_bytes,
+        uint32_t x, uint32_t y,
+        uint32_t width, uint32_t height,
+        int max_depth = -1,
+        spectre::ExecutionContext* context = nullptr
+    );
     
     /**
      * @brief Read .etca file and export to image format
+     *
+     * Without interpolation, region files are decoded one band of directory
+     * regions at a time, and each band's rows go to the exporter before
+     * the next band is decoded; only one band is held in memory.
+     *
      * @param input_path Input .etca file path
      * @param output_file Output image file path (PPM or PNG)
+     * @param interpolate Smooth tile seams with the default DeblockingFilter
+     * @param context Threads and scratch memory for the call (nullptr = a default context)
+     * @param options Export settings (e.g. ExportOptions::fast())
      * @throws std::runtime_error if file cannot be read/written
      */
-    static void read_to_file(const std::string& input_path, const std::string& output_file);
+    static void read_to_file(const std::string& input_path, const std::string& output_file,
+                             bool interpolate = false, spectre::ExecutionContext* context = nullptr,
+                             const ExportOptions& options = ExportOptions());
     
     /**
      * @brief Read .etca header and metadata without decompressing
@@ -175,6 +500,14 @@ public:
      * @throws std::runtime_error if file cannot be read or is corrupt
      */
     static EtcaFile read_header_and_metadata(const std::string& input_path);
+    
+    /**
+     * @brief Parse header and metadata of a .etca file held in memory
+     * @param file_bytes The file's bytes, header first
+     * @return EtcaFile structure with header and metadata filled
+     * @throws std::runtime_error if the data is corrupt
+     */
+    static EtcaFile read_header_and_metadata(spectre::ByteSpan file_bytes);
 };
 
 } // namespace etca
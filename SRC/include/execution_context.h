@@ -0,0 +1,99 @@
+#ifndef EXECUTION_CONTEXT_H
+#define EXECUTION_CONTEXT_H
+
+#include "entropy_coding.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace spectre {
+
+class Profiler;
+
+/**
+ * @brief Per-call thread budget and reusable scratch memory
+ *
+ * Compressor, Decompressor and the .etca reader and writer take one of these
+ * instead of reading process-wide state: every parallel region they open
+ * asks for exactly get_threads() threads (an OpenMP num_threads clause), so
+ * the library never calls omp_set_num_threads and one caller's budget cannot
+ * leak into another's.
+ *
+ * A context also keeps the large buffers a call needs (summed-area tables,
+ * serialized and decoded streams, entropy codecs and their trial buffers)
+ * between calls, so a long-lived context stops allocating once it has seen
+ * its largest image.
+ *
+ * A context is used by one call at a time. Calls running concurrently each
+ * need their own context; they then share nothing mutable and never
+ * contend. Work that fans out internally (e.g. one stream per .etca region)
+ * gives each of its threads a serial context from worker_contexts().
+ */
+class ExecutionContext {
+public:
+    /**
+     * @brief Create a context
+     * @param threads Threads each parallel region may use (0 = the OpenMP default)
+     */
+    explicit ExecutionContext(int threads = 0);
+    
+    /**
+     * @brief Thread count that `threads` stands for (0 = the OpenMP default, 1 without OpenMP)
+     */
+    static int resolve_threads(int threads);
+    
+    /**
+     * @brief Threads each parallel region may use (at least 1)
+     */
+    int get_threads() const { return threads_; }
+    
+    /**
+     * @brief Storage for IntegralImage tables
+     */
+    std::vector<uint32_t>& integral_scratch() { return integral_scratch_; }
+    
+    /**
+     * @brief Storage for a decoded entropy layer, or a tree stream awaiting entropy coding
+     */
+    std::vector<uint8_t>& stream_scratch() { return stream_scratch_; }
+    
+    /**
+     * @brief Codecs and trial buffers for the entropy layer
+     */
+    EntropyScratch& entropy_scratch() { return entropy_scratch_; }
+    
+    /**
+     * @brief One serial context per thread of this context's budget
+     *
+     * Index by the OpenMP thread number inside a parallel region that uses
+     * get_threads() threads. Worker contexts, and their scratch, persist
+     * with this context.
+     */
+    std::vector<ExecutionContext>& worker_contexts();
+    
+    /**
+     * @brief Free all scratch memory, including that of worker contexts
+     */
+    void release_scratch();
+    
+    /**
+     * @brief Attach a profiler (nullptr = instrumentation off, the default)
+     *
+     * Worker contexts report to the same profiler. The profiler must outlive
+     * every call made with this context.
+     */
+    void set_profiler(Profiler* profiler);
+    Profiler* get_profiler() const { return profiler_; }
+
+private:
+    int threads_;
+    Profiler* profiler_ = nullptr;
+    std::vector<uint32_t> integral_scratch_;
+    std::vector<uint8_t> stream_scratch_;
+    EntropyScratch entropy_scratch_;
+    std::vector<ExecutionContext> workers_;
+};
+
+} // namespace spectre
+
+#endif // EXECUTION_CONTEXT_H
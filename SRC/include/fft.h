@@ -0,0 +1,64 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <cstddef>
+
+namespace spectre {
+
+/**
+ * @brief Precomputed fast Fourier transform of one length
+ *
+ * Power-of-two lengths use an iterative radix-2 transform with a table of
+ * twiddle factors and bit-reversed indices. Other lengths use Bluestein's
+ * algorithm: the transform becomes a convolution with a chirp, computed by
+ * radix-2 transforms of the next power of two at least 2N - 1. Both cost
+ * O(N log N) and call no trigonometric functions after the plan is made.
+ *
+ * A plan is immutable once built, so threads may share one as long as
+ * each passes its own scratch.
+ */
+class FFTPlan {
+public:
+    using Complex = std::complex<double>;
+    
+    /**
+     * @brief Plan transforms of a length (0 and 1 are identities)
+     */
+    explicit FFTPlan(size_t size);
+    
+    size_t size() const { return size_; }
+    
+    /**
+     * @brief Forward transform in place: X[k] = sum x[n] e^(-2 pi i k n / N)
+     * @param data size() values
+     * @param scratch Working memory for Bluestein lengths (resized as needed, reusable)
+     */
+    void forward(Complex* data, std::vector<Complex>& scratch) const;
+    
+    /**
+     * @brief Forward transform of a row-major image: every row, then every column
+     * @param data width * height values
+     * @param threads Threads for each pass (0 = the OpenMP default)
+     */
+    static void forward_2d(std::vector<Complex>& data, uint32_t width, uint32_t height, int threads = 0);
+
+private:
+    size_t size_;
+    size_t radix2_size_;                  // size_ for powers of two, else the Bluestein length
+    std::vector<uint32_t> bit_reverse_;   // Permutation of radix2_size_ indices
+    std::vector<Complex> twiddles_;       // e^(-2 pi i k / radix2_size_), k < radix2_size_ / 2
+    std::vector<Complex> chirp_;          // e^(-pi i k^2 / size_) (Bluestein only)
+    std::vector<Complex> chirp_spectrum_; // Transform of the conjugate chirp, wrapped (Bluestein only)
+    
+    /**
+     * @brief Radix-2 forward transform of radix2_size_ values in place
+     */
+    void radix2(Complex* data) const;
+};
+
+} // namespace spectre
+
+#endif // FFT_H
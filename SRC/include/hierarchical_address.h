@@ -4,25 +4,112 @@
 #include <vector>
 #include <string>
 #include <cstdint>
+#include <cstddef>
 
 namespace spectre {
 
+/**
+ * @brief A hierarchical address packed into one word
+ *
+ * Every tile has TileInflater::CHILDREN_PER_TILE (4) children, so a segment
+ * takes 2 bits. Level i occupies bits 63-2i and 62-2i (the first level is
+ * the most significant), and unused levels are zero, so comparing paths
+ * orders addresses lexicographically and a prefix is a masked path.
+ */
+struct PackedAddress {
+    static constexpr int BITS_PER_SEGMENT = 2;
+    static constexpr uint32_t MAX_SEGMENT = (1u << BITS_PER_SEGMENT) - 1;
+    static constexpr uint32_t MAX_DEPTH = 64 / BITS_PER_SEGMENT;
+    
+    uint64_t path = 0;
+    uint32_t depth = 0;
+    
+    /**
+     * @brief Segment at a level (0 = the root's child)
+     */
+    constexpr uint32_t segment(uint32_t level) const {
+        return static_cast<uint32_t>(path >> shift(level)) & MAX_SEGMENT;
+    }
+    
+    /**
+     * @brief Whether child() can add a level
+     */
+    constexpr bool has_room() const { return depth < MAX_DEPTH; }
+    
+    /**
+     * @brief Address of a child (requires has_room() and segment <= MAX_SEGMENT)
+     */
+    constexpr PackedAddress child(uint32_t child_segment) const {
+        return PackedAddress{path | (static_cast<uint64_t>(child_segment) << shift(depth)), depth + 1};
+    }
+    
+    /**
+     * @brief Address of the ancestor at a depth (requires level <= depth)
+     */
+    constexpr PackedAddress ancestor(uint32_t level) const {
+        return PackedAddress{path & prefix_mask(level), level};
+    }
+    
+    /**
+     * @brief Parent address (the root is its own parent)
+     */
+    constexpr PackedAddress parent() const { return depth == 0 ? *this : ancestor(depth - 1); }
+    
+    constexpr bool is_descendant_of(const PackedAddress& other) const {
+        return other.depth < depth && (path & prefix_mask(other.depth)) == other.path;
+    }
+    
+    constexpr bool operator==(const PackedAddress& other) const {
+        return path == other.path && depth == other.depth;
+    }
+    
+    constexpr bool operator!=(const PackedAddress& other) const { return !(*this == other); }
+    
+    constexpr bool operator<(const PackedAddress& other) const {
+        return path != other.path ? path < other.path : depth < other.depth;
+    }
+    
+    static constexpr int shift(uint32_t level) {
+        return 64 - BITS_PER_SEGMENT * (static_cast<int>(level) + 1);
+    }
+    
+    static constexpr uint64_t prefix_mask(uint32_t level) {
+        return level == 0 ? 0 : ~uint64_t(0) << (64 - BITS_PER_SEGMENT * static_cast<int>(level));
+    }
+};
+
 /**
  * @brief Represents a hierarchical address for Spectre tiles
- * 
+ *
  * Since aperiodic tiles don't align to a Cartesian (x,y) grid,
  * we use hierarchical addressing instead: e.g., "1.4.2.0"
  * Each segment represents a choice at each inflation level.
+ *
+ * Addresses of tiles up to PackedAddress::MAX_DEPTH levels deep are held
+ * as a PackedAddress, so they take no heap memory. Deeper addresses, or
+ * ones with segments above 3 (which no tree produces), keep their
+ * segments in a vector instead. Every address has exactly one of the two
+ * forms, so the forms never need to be compared with each other.
  */
 class HierarchicalAddress {
 public:
     using AddressSegment = uint32_t;
     
+    /**
+     * @brief The root address
+     */
+    HierarchicalAddress() = default;
+    
     /**
      * @brief Constructor for a hierarchical address
      * @param address Vector of address segments
      */
-    explicit HierarchicalAddress(const std::vector<AddressSegment>& address = {});
+    explicit HierarchicalAddress(const std::vector<AddressSegment>& address);
+    
+    /**
+     * @brief Wrap a packed address
+     */
+    explicit HierarchicalAddress(const PackedAddress& packed) : packed_(packed) {}
     
     /**
      * @brief Create an address from string representation (e.g., "1.4.2.0")
@@ -35,14 +122,31 @@ public:
     std::string to_string() const;
     
     /**
-     * @brief Get the complete address
+     * @brief Get the complete address (a copy of the segments)
      */
-    const std::vector<AddressSegment>& get_address() const { return address_; }
+    std::vector<AddressSegment> get_address() const;
+    
+    /**
+     * @brief Get the segment at a level (0 = the root's child)
+     */
+    AddressSegment get_segment(size_t level) const {
+        return is_packed() ? packed_.segment(static_cast<uint32_t>(level)) : overflow_[level];
+    }
     
     /**
      * @brief Get the depth of this address (number of segments)
      */
-    size_t get_depth() const { return address_.size(); }
+    size_t get_depth() const { return is_packed() ? packed_.depth : overflow_.size(); }
+    
+    /**
+     * @brief Check whether the address is held packed (see get_packed)
+     */
+    bool is_packed() const { return overflow_.empty(); }
+    
+    /**
+     * @brief Get the packed form (only meaningful if is_packed())
+     */
+    const PackedAddress& get_packed() const { return packed_; }
     
     /**
      * @brief Add a child segment to create a child address
@@ -58,7 +162,7 @@ public:
     /**
      * @brief Check if this is the root address
      */
-    bool is_root() const { return address_.empty(); }
+    bool is_root() const { return get_depth() == 0; }
     
     /**
      * @brief Check if this address is a descendant of another
@@ -76,7 +180,8 @@ public:
     bool operator<(const HierarchicalAddress& other) const;
 
 private:
-    std::vector<AddressSegment> address_;
+    PackedAddress packed_;
+    std::vector<AddressSegment> overflow_;  // All segments of an address that does not pack (else empty)
 };
 
 } // namespace spectre
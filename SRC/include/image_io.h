@@ -2,6 +2,7 @@
 #define IMAGE_IO_H
 
 #include "color_data.h"
+#include "entropy_coding.h"
 #include <string>
 #include <memory>
 #include <vector>
@@ -41,6 +42,106 @@ public:
     spectre::ColorData load(const std::string& file_path) const override;
 };
 
+/**
+ * @brief Sequential, row-at-a-time reader for an image file
+ *
+ * Only the rows being read are buffered, so images larger than memory can be
+ * processed in bands. Interlaced PNGs cannot be decoded row by row; their
+ * reader holds the whole image.
+ */
+class ImageRowReader {
+public:
+    virtual ~ImageRowReader() = default;
+    
+    uint32_t get_width() const { return width_; }
+    uint32_t get_height() const { return height_; }
+    
+    /**
+     * @brief Number of rows read so far
+     */
+    uint32_t get_rows_read() const { return rows_read_; }
+    
+    /**
+     * @brief Read the next rows, top to bottom
+     * @param out Receives count * width pixels
+     * @param count Number of rows
+     * @throws std::runtime_error on read errors or reading past the last row
+     */
+    virtual void read_rows(spectre::Color* out, uint32_t count) = 0;
+
+protected:
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    uint32_t rows_read_ = 0;
+};
+
+/**
+ * @brief PNG row filters an exporter may use (see png_set_filter)
+ */
+enum class PNGFilter : uint8_t {
+    ADAPTIVE,  ///< libpng picks a filter per row among all five (its default)
+    NONE,      ///< Rows stored as-is: fastest, largest
+    SUB,       ///< Difference from the pixel to the left
+    UP,        ///< Difference from the pixel above
+    AVERAGE,   ///< Difference from the mean of left and above
+    PAETH      ///< Difference from the Paeth predictor
+};
+
+/**
+ * @brief Settings for image exporters (PNG only; PPM has none)
+ */
+struct ExportOptions {
+    int zlib_level = -1;  // 0-9, or -1 for zlib's default (6)
+    PNGFilter filter = PNGFilter::ADAPTIVE;
+    spectre::ZlibStrategy zlib_strategy = spectre::ZlibStrategy::DEFAULT;  // DEFAULT leaves libpng's choice
+    
+    /**
+     * @brief Preset for exports where speed matters more than size
+     *
+     * zlib level 1 with the SUB filter, which costs one subtraction per
+     * byte and still lets flat tiles compress well.
+     */
+    static ExportOptions fast();
+};
+
+/**
+ * @brief Sequential, row-at-a-time writer for an image file
+ *
+ * Rows go to the file as they are written, so an image can be exported
+ * band by band while later bands are still being decoded.
+ */
+class ImageRowWriter {
+public:
+    virtual ~ImageRowWriter() = default;
+    
+    uint32_t get_width() const { return width_; }
+    uint32_t get_height() const { return height_; }
+    
+    /**
+     * @brief Number of rows written so far
+     */
+    uint32_t get_rows_written() const { return rows_written_; }
+    
+    /**
+     * @brief Write the next rows, top to bottom
+     * @param rows count * width pixels
+     * @param count Number of rows
+     * @throws std::runtime_error on write errors or writing past the last row
+     */
+    virtual void write_rows(const spectre::Color* rows, uint32_t count) = 0;
+    
+    /**
+     * @brief Complete the file once every row is written
+     * @throws std::runtime_error if rows are missing or the file cannot be completed
+     */
+    virtual void finish() = 0;
+
+protected:
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    uint32_t rows_written_ = 0;
+};
+
 /**
  * @brief Abstract base class for exporting images to file formats
  */
@@ -71,7 +172,12 @@ public:
  */
 class PNGExporter : public ImageExporter {
 public:
+    explicit PNGExporter(const ExportOptions& options = ExportOptions()) : options_(options) {}
+    
     void save(const spectre::ColorData& color_data, const std::string& file_path) const override;
+
+private:
+    ExportOptions options_;
 };
 
 /**
@@ -89,13 +195,44 @@ std::string detect_image_format(const std::string& file_path);
  */
 spectre::ColorData load_image(const std::string& file_path);
 
+/**
+ * @brief Open an image file for row-by-row reading with automatic format detection
+ * @param file_path File path to read from
+ * @return Reader positioned at the first row
+ * @throws std::runtime_error if format is unsupported or file cannot be read
+ */
+std::unique_ptr<ImageRowReader> open_image_rows(const std::string& file_path);
+
+/**
+ * @brief Read an image file's dimensions from its header without decoding pixels
+ * @param file_path File path to inspect
+ * @param width Receives the image width
+ * @param height Receives the image height
+ * @throws std::runtime_error if format is unsupported or the header is invalid
+ */
+void read_image_size(const std::string& file_path, uint32_t& width, uint32_t& height);
+
+/**
+ * @brief Create an image file for row-by-row writing with automatic format detection
+ * @param file_path File path to write to
+ * @param width Image width
+ * @param height Image height
+ * @param options Export settings
+ * @return Writer expecting the first row
+ * @throws std::runtime_error if format is unsupported or file cannot be created
+ */
+std::unique_ptr<ImageRowWriter> open_image_row_writer(const std::string& file_path, uint32_t width, uint32_t height,
+                                                      const ExportOptions& options = ExportOptions());
+
 /**
  * @brief Save image to file with automatic format detection
  * @param color_data ColorData object to save
  * @param file_path Output file path
+ * @param options Export settings
  * @throws std::runtime_error if format is unsupported or file cannot be written
  */
-void save_image(const spectre::ColorData& color_data, const std::string& file_path);
+void save_image(const spectre::ColorData& color_data, const std::string& file_path,
+                const ExportOptions& options = ExportOptions());
 
 } // namespace etca
 
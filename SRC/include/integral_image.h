@@ -0,0 +1,112 @@
+#ifndef INTEGRAL_IMAGE_H
+#define INTEGRAL_IMAGE_H
+
+#include "color_data.h"
+#include <cstdint>
+#include <vector>
+
+namespace spectre {
+
+/**
+ * @brief Summed-area tables of an image for constant-time region statistics
+ *
+ * Built once per image, it holds running sums and squared sums per channel so
+ * the mean and variance of any rectangle can be read from four table corners
+ * instead of rescanning its pixels.
+ *
+ * Table entries are 32-bit and accumulate modulo 2^32. A rectangle sum is
+ * exact as long as its true value fits in 32 bits, so large rectangles are
+ * queried as a few smaller blocks that each satisfy that bound.
+ */
+class IntegralImage {
+public:
+    /**
+     * @brief Sums over a rectangular region
+     */
+    struct RegionSums {
+        uint64_t count = 0;
+        uint64_t sum_r = 0, sum_g = 0, sum_b = 0;
+        uint64_t sq_r = 0, sq_g = 0, sq_b = 0;
+    };
+
+    /**
+     * @brief Build the tables for an image
+     * @param image The image data
+     */
+    explicit IntegralImage(const ColorData& image);
+    
+    /**
+     * @brief Build the tables for a region of an image without copying it
+     * @param view The image region; coordinates in queries are relative to it
+     */
+    explicit IntegralImage(const ImageView& view);
+    
+    /**
+     * @brief Build the tables into reused storage
+     * @param view The image region; coordinates in queries are relative to it
+     * @param threads Threads for the two summing passes (0 = the OpenMP default)
+     * @param storage Buffer to build the tables in (e.g. ExecutionContext::integral_scratch());
+     *        its capacity is kept, its contents are overwritten
+     */
+    IntegralImage(const ImageView& view, int threads, std::vector<uint32_t>&& storage);
+    
+    /**
+     * @brief Hand the table storage back for reuse, leaving this object empty
+     */
+    std::vector<uint32_t> release_storage();
+
+    /**
+     * @brief Get image width
+     */
+    uint32_t get_width() const { return width_; }
+
+    /**
+     * @brief Get image height
+     */
+    uint32_t get_height() const { return height_; }
+
+    /**
+     * @brief Get channel sums of a region (clamped to the image)
+     * @param x Starting X coordinate
+     * @param y Starting Y coordinate
+     * @param width Region width
+     * @param height Region height
+     */
+    RegionSums region_sums(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const;
+
+    /**
+     * @brief Calculate the average color of a region
+     *
+     * Matches ColorData::calculate_average_color() on the extracted region.
+     */
+    Color region_average_color(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const;
+
+private:
+    // Values per table cell: sum_r, sum_g, sum_b, sq_r, sq_g, sq_b
+    static constexpr size_t CELL_SIZE = 6;
+
+    // Largest area whose squared sums are guaranteed to fit in 32 bits
+    static constexpr uint64_t MAX_EXACT_AREA = 0xFFFFFFFFull / (255ull * 255ull);
+    
+    // Images smaller than this are summed on a single thread
+    static constexpr uint64_t PARALLEL_MIN_PIXELS = 1 << 18;
+    
+    // Table columns processed per task in the vertical pass
+    static constexpr size_t COLUMN_STRIP_CELLS = 256;
+
+    uint32_t width_, height_;
+    std::vector<uint32_t> table_;  // (width + 1) x (height + 1) cells, zero first row/column
+
+    /**
+     * @brief Accumulate sums of a region small enough to be exact
+     */
+    void add_block_sums(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, RegionSums& sums) const;
+
+    const uint32_t* cell(uint32_t x, uint32_t y) const {
+        return &table_[(static_cast<size_t>(y) * (width_ + 1) + x) * CELL_SIZE];
+    }
+};
+
+} // namespace spectre
+
+#endif // INTEGRAL_IMAGE_H
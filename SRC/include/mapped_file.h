@@ -0,0 +1,59 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include "byte_span.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace etca {
+
+/**
+ * @brief Read-only view of a whole file's contents
+ *
+ * Maps the file into memory where the platform supports it (POSIX mmap,
+ * Win32 file mappings). Where mapping is unavailable or fails, falls back to
+ * a single sized read into an owned buffer. Either way bytes() stays valid
+ * for the lifetime of the object; it is move-only.
+ */
+class MappedFile {
+public:
+    /**
+     * @brief Open and map (or read) a file
+     * @param path File to open
+     * @throws std::runtime_error if the path is not a regular file, or cannot be opened or read
+     */
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief The file's contents
+     */
+    spectre::ByteSpan bytes() const { return spectre::ByteSpan(data_, size_); }
+
+    size_t size() const { return size_; }
+
+    /**
+     * @brief Whether the contents are memory-mapped (false: read into a buffer)
+     */
+    bool is_mapped() const { return mapping_ != nullptr; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    void* mapping_ = nullptr;        // Base of the mapped view, if mapped
+    std::vector<uint8_t> buffer_;    // Fallback storage
+
+    bool map(const std::string& path);
+    void read(const std::string& path);
+    void release();
+};
+
+} // namespace etca
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,71 @@
+#ifndef PIXEL_KERNELS_H
+#define PIXEL_KERNELS_H
+
+#include "color_data.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace spectre {
+
+/**
+ * @brief Instruction set a PixelKernels table is built for
+ */
+enum class SimdLevel : uint8_t {
+    SCALAR,
+    SSE41,
+    AVX2,
+    NEON
+};
+
+/**
+ * @brief Vectorized loops over runs of packed RGB pixels
+ *
+ * Pixels stay in ColorData's packed 3-byte layout; the x86 kernels work on
+ * whole 48-byte (SSE4.1) or 96-byte (AVX2) periods, in which every byte
+ * position belongs to a fixed channel, and NEON uses its de-interleaving
+ * loads. All variants produce bit-identical results.
+ *
+ * The table is chosen once, on first use, from the CPU's features. Setting
+ * the ETCA_SIMD environment variable to scalar, sse4.1, avx2 or neon caps
+ * the choice (useful for benchmarking and checking the fallbacks).
+ */
+struct PixelKernels {
+    SimdLevel level;
+    
+    /**
+     * @brief Add the channel sums of `count` pixels to sums[0..2] (r, g, b)
+     */
+    void (*sum)(const Color* pixels, size_t count, uint64_t sums[3]);
+    
+    /**
+     * @brief Add channel sums to sums[0..2] and squared sums to sums[3..5]
+     */
+    void (*sum_squares)(const Color* pixels, size_t count, uint64_t sums[6]);
+    
+    /**
+     * @brief Set `count` pixels to one color
+     */
+    void (*fill)(Color* pixels, size_t count, Color color);
+    
+    /**
+     * @brief Running sums along a row, in IntegralImage cell layout
+     *
+     * Writes six uint32 values per pixel: the sums and squared sums of r, g
+     * and b over pixels [0, x], wrapping modulo 2^32.
+     */
+    void (*prefix_sums)(const Color* pixels, uint32_t count, uint32_t* cells);
+};
+
+/**
+ * @brief The kernels for the running CPU
+ */
+const PixelKernels& pixel_kernels();
+
+/**
+ * @brief Name of an instruction set, as accepted by ETCA_SIMD
+ */
+const char* simd_level_name(SimdLevel level);
+
+} // namespace spectre
+
+#endif // PIXEL_KERNELS_H
@@ -0,0 +1,129 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace spectre {
+
+/**
+ * @brief Collects phase timings and counters of compress/decompress calls
+ *
+ * Attach one to an ExecutionContext (set_profiler) to turn instrumentation
+ * on. Instrumented code opens a ProfileScope per phase, which costs a single
+ * null check while no profiler is attached. Counters that would sit on hot
+ * paths (variance evaluations, tiles per depth) are derived from the
+ * finished tree instead of being counted as the tree is built.
+ *
+ * Phases may be recorded from several threads at once (region workers,
+ * parallel codec trials); recording takes a lock, so scopes belong around
+ * whole phases, not per-tile work.
+ */
+class Profiler {
+public:
+    using Clock = std::chrono::steady_clock;
+    
+    /**
+     * @brief One timed phase
+     */
+    struct Event {
+        std::string name;
+        const char* category;
+        double start_us;     // Since the profiler was created
+        double duration_us;
+        int thread;          // Small per-profiler thread number, 0 = first thread seen
+    };
+    
+    Profiler();
+    
+    /**
+     * @brief Record a finished phase
+     */
+    void record(const std::string& name, const char* category, Clock::time_point start, Clock::time_point end);
+    
+    /**
+     * @brief Add to a named counter (created at zero)
+     */
+    void add(const std::string& counter, uint64_t value);
+    
+    /**
+     * @brief Count tiles of a built tree at one depth
+     */
+    void add_tiles_at_depth(int depth, uint64_t count);
+    
+    /**
+     * @brief Record the process's peak resident set size so far
+     */
+    void sample_peak_rss();
+    
+    std::vector<Event> get_events() const;
+    std::map<std::string, uint64_t> get_counters() const;
+    
+    /**
+     * @brief Print per-phase totals, counters, tiles per depth and peak memory
+     */
+    void print_summary(std::ostream& out) const;
+    
+    /**
+     * @brief Write the phases as Chrome trace_event JSON (chrome://tracing, Perfetto)
+     */
+    void write_chrome_trace(std::ostream& out) const;
+    
+    /**
+     * @brief Peak resident set size of the process in bytes (0 if unknown)
+     */
+    static uint64_t peak_rss_bytes();
+    
+    /**
+     * @brief Restart the peak resident set measurement where the OS allows it
+     * @return false if peaks can only be measured since process start (non-Linux)
+     */
+    static bool reset_peak_rss();
+
+private:
+    Clock::time_point origin_;
+    mutable std::mutex mutex_;
+    std::vector<Event> events_;
+    std::map<std::string, uint64_t> counters_;
+    std::vector<uint64_t> tiles_per_depth_;
+    std::map<std::thread::id, int> threads_;
+    uint64_t peak_rss_ = 0;
+};
+
+/**
+ * @brief Times the enclosing block as one phase (no-op without a profiler)
+ */
+class ProfileScope {
+public:
+    ProfileScope(Profiler* profiler, const char* name, const char* category = "etca")
+        : profiler_(profiler), name_(name), category_(category) {
+        if (profiler_ != nullptr) {
+            start_ = Profiler::Clock::now();
+        }
+    }
+    
+    ~ProfileScope() {
+        if (profiler_ != nullptr) {
+            profiler_->record(name_, category_, start_, Profiler::Clock::now());
+        }
+    }
+    
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    Profiler* profiler_;
+    const char* name_;
+    const char* category_;
+    Profiler::Clock::time_point start_;
+};
+
+} // namespace spectre
+
+#endif // PROFILER_H
@@ -0,0 +1,163 @@
+#ifndef RANGE_CODER_H
+#define RANGE_CODER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace spectre {
+
+/**
+ * @brief Adaptive probability of a binary decision (probability of 0, 11-bit)
+ */
+struct AdaptiveBit {
+    static constexpr int PRECISION_BITS = 11;
+    static constexpr int ADAPT_SHIFT = 5;
+    
+    uint16_t probability = 1 << (PRECISION_BITS - 1);
+};
+
+/**
+ * @brief Binary adaptive range encoder (LZMA-style carry handling)
+ */
+class RangeEncoder {
+public:
+    explicit RangeEncoder(std::vector<uint8_t>& output) : output_(output) {}
+    
+    /**
+     * @brief Code one bit and adapt its model
+     */
+    void encode_bit(AdaptiveBit& model, bool bit) {
+        uint32_t bound = (range_ >> AdaptiveBit::PRECISION_BITS) * model.probability;
+        if (!bit) {
+            range_ = bound;
+            model.probability = static_cast<uint16_t>(
+                model.probability + (((1 << AdaptiveBit::PRECISION_BITS) - model.probability) >> AdaptiveBit::ADAPT_SHIFT));
+        } else {
+            low_ += bound;
+            range_ -= bound;
+            model.probability = static_cast<uint16_t>(model.probability - (model.probability >> AdaptiveBit::ADAPT_SHIFT));
+        }
+        while (range_ < TOP) {
+            range_ <<= 8;
+            shift_low();
+        }
+    }
+    
+    /**
+     * @brief Code an 8-bit symbol MSB-first through a tree of 255 bit models
+     * @param tree Models indexed 1-255 (entry 0 unused)
+     */
+    void encode_byte(AdaptiveBit* tree, uint8_t symbol) {
+        size_t node = 1;
+        for (int i = 7; i >= 0; --i) {
+            bool bit = (symbol >> i) & 1;
+            encode_bit(tree[node], bit);
+            node = (node << 1) | static_cast<size_t>(bit);
+        }
+    }
+    
+    /**
+     * @brief Write out the remaining state; call once after the last symbol
+     */
+    void flush() {
+        for (int i = 0; i < 5; ++i) {
+            shift_low();
+        }
+    }
+
+private:
+    static constexpr uint32_t TOP = 1u << 24;
+    
+    std::vector<uint8_t>& output_;
+    uint64_t low_ = 0;
+    uint32_t range_ = 0xFFFFFFFF;
+    uint8_t cache_ = 0;
+    uint64_t cache_size_ = 1;
+    
+    void shift_low() {
+        // Hold back 0xFF bytes until we know whether a carry reaches them
+        if (static_cast<uint32_t>(low_) < 0xFF000000u || (low_ >> 32) != 0) {
+            uint8_t carry = static_cast<uint8_t>(low_ >> 32);
+            uint8_t pending = cache_;
+            do {
+                output_.push_back(static_cast<uint8_t>(pending + carry));
+                pending = 0xFF;
+            } while (--cache_size_ != 0);
+            cache_ = static_cast<uint8_t>(low_ >> 24);
+        }
+        cache_size_++;
+        low_ = (low_ & 0x00FFFFFF) << 8;
+    }
+};
+
+/**
+ * @brief Decoder matching RangeEncoder
+ *
+ * Reading past the end yields zero bytes and sets exhausted().
+ */
+class RangeDecoder {
+public:
+    RangeDecoder(const uint8_t* data, size_t size) : data_(data), size_(size) {
+        for (int i = 0; i < 5; ++i) {
+            code_ = (code_ << 8) | next_byte();
+        }
+    }
+    
+    /**
+     * @brief Decode one bit and adapt its model
+     */
+    bool decode_bit(AdaptiveBit& model) {
+        uint32_t bound = (range_ >> AdaptiveBit::PRECISION_BITS) * model.probability;
+        bool bit;
+        if (code_ < bound) {
+            range_ = bound;
+            model.probability = static_cast<uint16_t>(
+                model.probability + (((1 << AdaptiveBit::PRECISION_BITS) - model.probability) >> AdaptiveBit::ADAPT_SHIFT));
+            bit = false;
+        } else {
+            code_ -= bound;
+            range_ -= bound;
+            model.probability = static_cast<uint16_t>(model.probability - (model.probability >> AdaptiveBit::ADAPT_SHIFT));
+            bit = true;
+        }
+        while (range_ < TOP) {
+            range_ <<= 8;
+            code_ = (code_ << 8) | next_byte();
+        }
+        return bit;
+    }
+    
+    /**
+     * @brief Decode a symbol written by RangeEncoder::encode_byte
+     */
+    uint8_t decode_byte(AdaptiveBit* tree) {
+        size_t node = 1;
+        for (int i = 0; i < 8; ++i) {
+            node = (node << 1) | static_cast<size_t>(decode_bit(tree[node]));
+        }
+        return static_cast<uint8_t>(node - 256);
+    }
+    
+    /**
+     * @brief True once the decoder has needed bytes beyond the data
+     */
+    bool exhausted() const { return position_ > size_; }
+
+private:
+    static constexpr uint32_t TOP = 1u << 24;
+    
+    const uint8_t* data_;
+    size_t size_;
+    size_t position_ = 0;
+    uint32_t range_ = 0xFFFFFFFF;
+    uint32_t code_ = 0;
+    
+    uint32_t next_byte() {
+        return position_ < size_ ? data_[position_++] : (position_++, 0u);
+    }
+};
+
+} // namespace spectre
+
+#endif // RANGE_CODER_H
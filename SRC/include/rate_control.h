@@ -0,0 +1,173 @@
+#ifndef RATE_CONTROL_H
+#define RATE_CONTROL_H
+
+#include "compressor.h"
+#include "spectre_tree.h"
+#include "execution_context.h"
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace spectre {
+
+/**
+ * @brief What a rate-controlled encode aims for
+ */
+struct RateTarget {
+    enum class Kind : uint8_t {
+        THRESHOLD,  ///< A fixed variance threshold (0.0-1.0)
+        SIZE,       ///< Largest stream that fits in `value` bytes
+        PSNR        ///< Smallest stream with at least `value` dB of RGB PSNR
+    };
+    
+    Kind kind = Kind::THRESHOLD;
+    double value = 0.0;
+    
+    static RateTarget threshold(double variance_threshold) { return {Kind::THRESHOLD, variance_threshold}; }
+    static RateTarget size(uint64_t bytes) { return {Kind::SIZE, static_cast<double>(bytes)}; }
+    static RateTarget psnr(double decibels) { return {Kind::PSNR, decibels}; }
+};
+
+/**
+ * @brief Builds a tree once and prunes it to many sizes or qualities
+ *
+ * A tile is split exactly when its variance exceeds the threshold, and a
+ * tile's variance does not depend on the threshold. The tree built at the
+ * finest threshold therefore contains the tree of every coarser threshold:
+ * it is the same tree with every tile whose variance is at or below the
+ * coarser threshold turned into a leaf. build() keeps each tile's variance
+ * and the squared error it would leave as a leaf, so pruning, and the
+ * PSNR of any pruned tree, cost O(tiles) and never touch pixels again.
+ *
+ * Pruned trees are identical to the ones Compressor builds at the same
+ * threshold, so compress_at(t) produces the bytes Compressor::compress
+ * produces with variance_threshold = t.
+ *
+ * The thresholds at which the tree changes are get_levels(): level 0 is the
+ * config's threshold (the full tree), each later level collapses every
+ * tile up to that variance, and the last one leaves the root alone.
+ * Size and PSNR fall with the level, so targets are met by bisection.
+ */
+class RateController {
+public:
+    /**
+     * @param config Settings of every variant; variance_threshold is the finest quality
+     */
+    explicit RateController(const CompressionConfig& config);
+    
+    /**
+     * @brief Build the full tree and measure every tile (the only pass over the pixels)
+     */
+    void build(const ImageView& image, ExecutionContext& context);
+    
+    /**
+     * @brief Thresholds at which the pruned tree changes, ascending (empty before build)
+     */
+    const std::vector<double>& get_levels() const { return levels_; }
+    
+    /**
+     * @brief Tiles of the full tree
+     */
+    size_t get_tile_count() const { return tree_.get_tile_count(); }
+    
+    /**
+     * @brief Sum of squared RGB errors of the tree pruned at a threshold
+     */
+    uint64_t squared_error(double threshold) const;
+    
+    /**
+     * @brief RGB PSNR of the tree pruned at a threshold, in dB (infinite if exact)
+     */
+    double psnr_at(double threshold) const;
+    
+    /**
+     * @brief PSNR of a squared error summed over a number of pixels (3 channels each)
+     */
+    static double psnr(uint64_t squared_error, uint64_t pixel_count);
+    
+    /**
+     * @brief The tree as Compressor would build it at a (coarser) threshold
+     */
+    SpectreTree prune(double threshold) const;
+    
+    /**
+     * @brief Encode the tree pruned at a threshold
+     */
+    CompressedImage compress_at(double threshold, ExecutionContext& context) const;
+    
+    /**
+     * @brief Encode the variant that best meets a target
+     *
+     * A size target gets the finest level that fits (the coarsest if none
+     * does); a PSNR target gets the coarsest level that reaches it (the
+     * finest if none does). Size targets encode O(log levels) candidates.
+     */
+    CompressedImage compress(const RateTarget& target, ExecutionContext& context) const;
+    
+    /**
+     * @brief Encode one variant per target from the single build
+     */
+    std::vector<CompressedImage> compress_variants(const std::vector<RateTarget>& targets,
+                                                   ExecutionContext& context) const;
+    
+    /**
+     * @brief Level meeting a PSNR target given squared error per level (see compress)
+     */
+    template <typename ErrorAtLevel>
+    static size_t level_for_psnr(size_t level_count, double decibels, uint64_t pixel_count, ErrorAtLevel error) {
+        size_t failing = first_level(level_count, [&](size_t level) {
+            return psnr(error(level), pixel_count) < decibels;
+        });
+        return failing > 0 ? failing - 1 : 0;
+    }
+    
+    /**
+     * @brief First level in [0, count) for which `passes` holds (count if none)
+     *
+     * `passes` must be monotone: once true, true for every later level.
+     */
+    template <typename Predicate>
+    static size_t first_level(size_t count, Predicate passes) {
+        size_t low = 0, high = count;
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            if (passes(middle)) {
+                high = middle;
+            } else {
+                low = middle + 1;
+            }
+        }
+        return low;
+    }
+
+private:
+    CompressionConfig config_;
+    SpectreTree tree_;
+    
+    // Per tile, indexed by (ID - root ID)
+    std::vector<double> variance_;  // Split criterion (tiles split in the full tree only)
+    std::vector<uint64_t> error_;   // Squared RGB error if the tile were a leaf
+    
+    std::vector<double> levels_;
+    
+    /**
+     * @brief Fill variance_ and error_ for a subtree from the summed-area tables
+     */
+    void measure_subtree(const IntegralImage& integral, SpectreTile::ID id,
+                         uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+    
+    /**
+     * @brief Copy a subtree into `pruned`, stopping at tiles with variance <= threshold
+     */
+    void copy_pruned(SpectreTile::ID id, double threshold, SpectreTree& pruned, SpectreTile::ID pruned_id) const;
+    
+    bool split_at(SpectreTile::ID id, double threshold) const {
+        return tree_.is_subdivided(id) && variance_[index_of(id)] > threshold;
+    }
+    
+    size_t index_of(SpectreTile::ID id) const { return static_cast<size_t>(id - tree_.get_root_id()); }
+};
+
+} // namespace spectre
+
+#endif // RATE_CONTROL_H
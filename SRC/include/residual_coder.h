@@ -0,0 +1,178 @@
+#ifndef RESIDUAL_CODER_H
+#define RESIDUAL_CODER_H
+
+#include "color_data.h"
+#include "range_coder.h"
+#include "byte_span.h"
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace spectre {
+
+/**
+ * @brief Per-pixel residuals that make a tree stream lossless (see tree_stream.h)
+ *
+ * Each pixel is predicted from its left, upper and upper-left neighbours
+ * with the median edge detector of LOCO-I, and only the prediction error
+ * is range coded. Where neighbours are missing (the first row of a strip)
+ * the base layer, the image the tree paints, stands in for them. Taking
+ * residuals against the base layer everywhere would put a step into them
+ * at every tile edge, which costs more than the tree saves.
+ *
+ * As in TileColorCoder, the green and blue errors are coded relative to
+ * the error of the channel before them. Models are kept per channel and
+ * per level of local activity (how much the neighbours differ).
+ *
+ * Rows are coded in strips of STRIP_ROWS, each with its own range coder
+ * and models, so strips encode and decode in parallel.
+ *
+ * Section layout: strip_rows(varint) | size(varint) per strip | strips
+ */
+class ResidualCoder {
+public:
+    /**
+     * @brief Rows per independently coded strip
+     */
+    static constexpr uint32_t STRIP_ROWS = 64;
+    
+    /**
+     * @brief Append the residual section of an image
+     * @param image The exact pixels
+     * @param base What the tree paints, the same size as the image
+     * @param output Receives the section (appended)
+     * @param threads Threads for the strips (0 = the OpenMP default)
+     */
+    static void encode(const ImageView& image, const ColorData& base, std::vector<uint8_t>& output,
+                       int threads = 0);
+    
+    /**
+     * @brief Add a residual section to the base layer
+     * @param section Bytes written by encode()
+     * @param image Holds the base layer; receives the exact pixels
+     * @param threads Threads for the strips (0 = the OpenMP default)
+     * @return false if the section is malformed or truncated (damaged strips stay partly decoded)
+     */
+    static bool decode(ByteSpan section, const MutableImageView& image, int threads = 0);
+
+private:
+    static constexpr size_t CHANNELS = 3;
+    static constexpr size_t ACTIVITY_CONTEXTS = 8;
+    static constexpr size_t SYMBOL_BITS = 8;
+    
+    /**
+     * @brief Models of one symbol context: its bit length in unary, then the bits below the leading one
+     *
+     * Far fewer models than a full 8-bit tree, so a strip's models settle
+     * within its first rows.
+     */
+    struct SymbolModels {
+        std::array<AdaptiveBit, SYMBOL_BITS> length;
+        std::array<AdaptiveBit, (SYMBOL_BITS + 1) * SYMBOL_BITS> bits;  // By length, then bit position
+    };
+    
+    // Fixed-size, so a coder lives on the stack of the thread coding its strip
+    std::array<SymbolModels, ACTIVITY_CONTEXTS * CHANNELS> models_;
+    
+    /**
+     * @brief Pixels of the row above and of the current row, one int per channel
+     */
+    struct RowPair {
+        std::vector<int> above;
+        std::vector<int> current;
+        
+        explicit RowPair(uint32_t width)
+            : above(static_cast<size_t>(width) * CHANNELS, 0),
+              current(static_cast<size_t>(width) * CHANNELS, 0) {}
+    };
+    
+    /**
+     * @brief Left (a), upper (b) and upper-left (c) values of one channel
+     */
+    struct Neighbours {
+        int a, b, c;
+    };
+    
+    /**
+     * @brief Neighbours of pixel x, with the base layer standing in above a strip
+     * @param current Slot of pixel x in the current row
+     * @param above Slot of pixel x in the row above
+     * @param base The pixel's base layer value
+     */
+    static Neighbours neighbours(const int* current, const int* above, uint32_t x, bool first_row,
+                                 size_t channel, int base) {
+        int b = first_row ? base : above[channel];
+        if (x == 0) {
+            return {b, b, b};
+        }
+        const int* left = current - CHANNELS;
+        const int* above_left = above - CHANNELS;
+        return {left[channel], b, first_row ? base : above_left[channel]};
+    }
+    
+    SymbolModels& models(size_t activity, size_t channel) {
+        return models_[activity * CHANNELS + channel];
+    }
+    
+    static void encode_symbol(RangeEncoder& encoder, SymbolModels& models, uint8_t symbol);
+    static uint8_t decode_symbol(RangeDecoder& decoder, SymbolModels& models);
+    
+    void encode_strip(const ImageView& image, const ColorData& base, uint32_t y_begin, uint32_t y_end,
+                      std::vector<uint8_t>& output);
+    bool decode_strip(ByteSpan bytes, const MutableImageView& image, uint32_t y_begin, uint32_t y_end);
+    
+    /**
+     * @brief Median edge detector: a and b unless c suggests an edge between them
+     * @param a Left neighbour
+     * @param b Upper neighbour
+     * @param c Upper-left neighbour
+     */
+    static int predict(int a, int b, int c) {
+        int low = a < b ? a : b;
+        int high = a < b ? b : a;
+        if (c >= high) {
+            return low;
+        }
+        if (c <= low) {
+            return high;
+        }
+        return a + b - c;
+    }
+    
+    /**
+     * @brief Activity context of a pixel: the bit length of its neighbours' spread, capped
+     */
+    static size_t activity(int a, int b, int c) {
+        int spread = (a > c ? a - c : c - a) + (b > c ? b - c : c - b);
+        size_t context = 0;
+        while (spread > 0 && context + 1 < ACTIVITY_CONTEXTS) {
+            spread >>= 1;
+            ++context;
+        }
+        return context;
+    }
+    
+    /**
+     * @brief Map an error (mod 256) to a symbol where small magnitudes are small
+     */
+    static uint8_t to_symbol(int error) {
+        int8_t value = static_cast<int8_t>(static_cast<uint8_t>(error));
+        return static_cast<uint8_t>(value >= 0 ? value * 2 : -value * 2 - 1);
+    }
+    
+    static int from_symbol(uint8_t symbol) {
+        return (symbol & 1) ? -(symbol >> 1) - 1 : symbol >> 1;
+    }
+    
+    /**
+     * @brief An error reduced mod 256 to the range from_symbol() returns
+     */
+    static int wrap(int error) {
+        return static_cast<int8_t>(static_cast<uint8_t>(error));
+    }
+};
+
+} // namespace spectre
+
+#endif // RESIDUAL_CODER_H
@@ -0,0 +1,230 @@
+#ifndef SEQUENCE_CODEC_H
+#define SEQUENCE_CODEC_H
+
+#include "compressor.h"
+#include "spectre_tree.h"
+#include "color_data.h"
+#include "byte_span.h"
+#include "execution_context.h"
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace spectre {
+
+/**
+ * @brief Settings of a SequenceEncoder
+ */
+struct SequenceConfig {
+    CompressionConfig compression;   // Tree and entropy settings of every coded region
+    double change_threshold = 3.0;   // RMS change (0-255 levels) a block may drift before it is re-coded
+    double rebuild_fraction = 0.5;   // Changed share of a split tile above which its subtree is rebuilt
+    uint32_t keyframe_interval = 0;  // Frames per keyframe (0 = only the first frame)
+};
+
+/**
+ * @brief Layout of sequence frames (tree stream version 5)
+ *
+ * A frame stream carries the usual tree stream header (version 5; the tile
+ * count and depth are those of the frame's tree), then:
+ *   flags(1): FRAME_KEY for keyframes
+ *   op_count(varint) | coded_tile_count(varint)
+ *   ops: two bits per op (MSB first, padded to a byte)
+ *   split flags: one bit per coded tile in pre-order (padded to a byte)
+ *   leaf colors: r, g, b per coded leaf, in pre-order
+ *
+ * Ops walk the previous frame's tree in pre-order, carrying tile bounds:
+ * SKIP keeps a tile's whole subtree and its pixels, DESCEND keeps the split
+ * and continues with the tile's children, and REPLACE takes the next coded
+ * subtree (in the version 2 layout) in place of the tile's. A keyframe is a
+ * single REPLACE of the root with no previous tree. The stream then goes
+ * through the entropy layer like any other tree stream.
+ */
+class SequenceStream {
+public:
+    static constexpr uint8_t FRAME_KEY = 0x01;
+    
+    enum Op : uint8_t {
+        SKIP = 0,
+        DESCEND = 1,
+        REPLACE = 2
+    };
+    
+    /**
+     * @brief Side of the square blocks in which the encoder detects change
+     */
+    static constexpr uint32_t CHANGE_BLOCK_SIZE = 16;
+};
+
+/**
+ * @brief Compresses frame sequences, re-coding only what changed
+ *
+ * The encoder keeps the previous frame's tree and a reference frame: the
+ * pixels each region had when it was last coded. Every frame is compared
+ * with the reference in CHANGE_BLOCK_SIZE blocks; tiles touching no changed
+ * block are skipped, so their subtrees cost one op and are left untouched,
+ * and only changed tiles are rebuilt from the new frame and grafted into the
+ * tree in place (over their own region, so tree building, patching and
+ * reference updates scale with the changed area; change detection itself
+ * reads every pixel). Comparing with the reference rather than the previous
+ * frame keeps slow drift from piling up unnoticed.
+ *
+ * One encoder per stream; it is not safe to share between threads.
+ */
+class SequenceEncoder {
+public:
+    /**
+     * @brief What the last encode() did
+     */
+    struct FrameStats {
+        bool keyframe = false;
+        uint64_t tile_count = 0;        // Tiles of the frame's tree
+        uint64_t coded_tile_count = 0;  // Tiles in re-coded subtrees
+        uint64_t coded_pixels = 0;      // Pixels covered by re-coded subtrees
+        uint64_t changed_blocks = 0;    // Change blocks over the threshold
+        size_t stream_size = 0;         // Bytes of the frame, entropy layer included
+    };
+    
+    explicit SequenceEncoder(const SequenceConfig& config = SequenceConfig());
+    
+    /**
+     * @brief Compress the next frame
+     *
+     * The first frame, frames whose size differs from the previous one, and
+     * frames after request_keyframe() or keyframe_interval are keyframes.
+     */
+    std::vector<uint8_t> encode(const ImageView& frame);
+    
+    /**
+     * @brief Compress the next frame within a caller's thread budget and scratch memory
+     */
+    std::vector<uint8_t> encode(const ImageView& frame, ExecutionContext& context);
+    
+    /**
+     * @brief Make the next frame a keyframe (e.g. for a new subscriber)
+     */
+    void request_keyframe() { keyframe_requested_ = true; }
+    
+    const FrameStats& get_last_statistics() const { return last_stats_; }
+
+private:
+    SequenceConfig config_;
+    SpectreTree tree_;          // Patched in place; replaced subtrees linger until compacted
+    uint64_t live_tiles_ = 0;   // Tiles reachable from tree_'s root
+    ColorData reference_;
+    uint64_t frames_since_keyframe_ = 0;
+    bool keyframe_requested_ = true;
+    FrameStats last_stats_;
+    
+    /**
+     * @brief Changed-block counts as a summed-area table over the block grid
+     */
+    struct ChangeMap {
+        uint32_t blocks_x = 0, blocks_y = 0;
+        std::vector<uint32_t> table;  // (blocks_x + 1) * (blocks_y + 1) running counts
+        
+        uint64_t changed_blocks(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const;
+        uint64_t touched_blocks(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const;
+    };
+    
+    /**
+     * @brief Output sections of a frame, filled in pre-order
+     */
+    struct FrameWriter {
+        std::vector<uint8_t> ops;
+        std::vector<uint8_t> split_flags;
+        std::vector<uint8_t> colors;
+        uint64_t op_count = 0;
+        uint64_t coded_tile_count = 0;
+        
+        void write_op(SequenceStream::Op op);
+        void write_split(bool split);
+    };
+    
+    ChangeMap detect_changes(const ImageView& frame, int threads) const;
+    
+    /**
+     * @brief Walk a tile of the previous tree, writing ops and patching changed subtrees
+     */
+    void encode_tile(
+        const ImageView& frame,
+        const ChangeMap& changes,
+        SpectreTile::ID id,
+        uint32_t x, uint32_t y,
+        uint32_t width, uint32_t height,
+        FrameWriter& writer,
+        ExecutionContext& context
+    );
+    
+    /**
+     * @brief Build a fresh subtree over a region, code it and graft it onto a leaf of the tree
+     */
+    void code_subtree(
+        const ImageView& frame,
+        uint32_t x, uint32_t y,
+        uint32_t width, uint32_t height,
+        int depth,
+        SpectreTile::ID id,
+        FrameWriter& writer,
+        ExecutionContext& context
+    );
+    
+    std::vector<uint8_t> finish_frame(const FrameWriter& writer, bool keyframe, ExecutionContext& context);
+};
+
+/**
+ * @brief Decodes frames written by SequenceEncoder, patching the previous frame
+ *
+ * Skipped tiles are neither read nor painted, and replaced subtrees are
+ * patched into the tree in place, so decoding a frame costs the walk down
+ * to the changed tiles plus painting the changed area.
+ */
+class SequenceDecoder {
+public:
+    SequenceDecoder();
+    
+    /**
+     * @brief Decode the next frame into get_frame()
+     * @param data One frame as returned by SequenceEncoder::encode
+     * @return false if the frame is malformed or an inter frame arrives
+     *         without its reference; the frame then holds what was decoded
+     *         and the next keyframe resynchronizes the decoder
+     */
+    bool decode(ByteSpan data);
+    
+    /**
+     * @brief The current frame (empty before the first keyframe)
+     */
+    const ColorData& get_frame() const { return frame_; }
+
+private:
+    SpectreTree tree_;          // Patched in place, as in SequenceEncoder
+    uint64_t live_tiles_ = 0;   // Tiles reachable from tree_'s root
+    ColorData frame_;
+    bool has_reference_ = false;
+    std::vector<uint8_t> storage_;
+    
+    /**
+     * @brief Read position in a frame's sections
+     */
+    struct FrameCursor {
+        const uint8_t* ops;
+        uint64_t op_count;
+        uint64_t next_op;
+        const uint8_t* split_flags;
+        uint64_t coded_tile_count;
+        uint64_t next_coded_tile;
+        const uint8_t* colors;
+        const uint8_t* colors_end;
+        int max_depth;
+    };
+    
+    bool decode_tile(FrameCursor& cursor, SpectreTile::ID id, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+    
+    bool decode_subtree(FrameCursor& cursor, uint32_t x, uint32_t y, uint32_t width, uint32_t height, int depth,
+                        SpectreTile::ID id);
+};
+
+} // namespace spectre
+
+#endif // SEQUENCE_CODEC_H
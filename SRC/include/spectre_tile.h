@@ -13,6 +13,9 @@ namespace spectre {
  * - Non-Cartesian coordinate system
  * - Mathematical inflation rules for subdivision
  * - Hierarchical addressing instead of (x,y) coordinates
+ * 
+ * This is a standalone tile object. SpectreTree does not allocate one per
+ * tile; it keeps the same fields in flat per-tree arrays.
  */
 class SpectreTile {
 public:
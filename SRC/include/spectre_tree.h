@@ -4,8 +4,8 @@
 #include "spectre_tile.h"
 #include "hierarchical_address.h"
 #include "color_data.h"
-#include <map>
-#include <memory>
+#include "integral_image.h"
+#include "execution_context.h"
 #include <vector>
 
 namespace spectre {
@@ -16,9 +16,23 @@ namespace spectre {
  * Similar to a quadtree, but using Spectre tiles instead of squares.
  * The root is one giant Spectre tile covering the entire image.
  * Each node's variance is checked; if high, it's inflated into children.
+ * 
+ * Tiles live in flat, struct-of-arrays storage indexed by dense ID (the root
+ * is ID 1). Inflating a tile allocates its children as one consecutive block,
+ * so child k of a tile is simply get_first_child(id) + k.
  */
 class SpectreTree {
 public:
+    /**
+     * @brief Default tile area (in pixels) below which subtrees are built serially
+     */
+    static constexpr uint64_t DEFAULT_PARALLEL_CUTOFF = 128 * 128;
+    
+    /**
+     * @brief ID meaning "no tile" (parent of the root, first child of a leaf)
+     */
+    static constexpr SpectreTile::ID NO_TILE = 0;
+    
     /**
      * @brief Constructor for a Spectre-Tree
      * @param image_width Width of the image
@@ -32,29 +46,127 @@ public:
     SpectreTile::ID get_root_id() const { return root_id_; }
     
     /**
-     * @brief Get a tile by ID
+     * @brief Check if a tile ID exists in this tree
+     */
+    bool has_tile(SpectreTile::ID id) const {
+        return id >= root_id_ && id - root_id_ < depth_.size();
+    }
+    
+    /**
+     * @brief Get the depth of a tile (0 for root)
+     */
+    int get_depth(SpectreTile::ID id) const { return depth_[index_of(id)]; }
+    
+    /**
+     * @brief Get the parent tile ID (NO_TILE for root)
      */
-    SpectreTile* get_tile(SpectreTile::ID id);
-    const SpectreTile* get_tile(SpectreTile::ID id) const;
+    SpectreTile::ID get_parent_id(SpectreTile::ID id) const { return parent_[index_of(id)]; }
+    
+    /**
+     * @brief Get the ID of a tile's first child (NO_TILE for leaves)
+     * 
+     * Children are consecutive: child k has ID get_first_child(id) + k.
+     */
+    SpectreTile::ID get_first_child(SpectreTile::ID id) const { return first_child_[index_of(id)]; }
+    
+    /**
+     * @brief Check if a tile has been subdivided
+     */
+    bool is_subdivided(SpectreTile::ID id) const { return first_child_[index_of(id)] != NO_TILE; }
+    
+    /**
+     * @brief Get the stored color average of a tile
+     */
+    void get_color(SpectreTile::ID id, uint8_t& r, uint8_t& g, uint8_t& b) const {
+        size_t index = index_of(id);
+        r = color_r_[index];
+        g = color_g_[index];
+        b = color_b_[index];
+    }
+    
+    /**
+     * @brief Set the color average of a tile
+     */
+    void set_color(SpectreTile::ID id, uint8_t r, uint8_t g, uint8_t b) {
+        size_t index = index_of(id);
+        color_r_[index] = r;
+        color_g_[index] = g;
+        color_b_[index] = b;
+    }
     
     /**
-     * @brief Get a tile by hierarchical address
+     * @brief Get a tile by hierarchical address (O(depth))
+     * @return Tile ID, or NO_TILE if the address is not in the tree
      */
-    SpectreTile* get_tile_by_address(const HierarchicalAddress& address);
-    const SpectreTile* get_tile_by_address(const HierarchicalAddress& address) const;
+    SpectreTile::ID get_tile_by_address(const HierarchicalAddress& address) const;
     
     /**
-     * @brief Get the hierarchical address of a tile
+     * @brief Get a tile by packed address (O(depth), one child-block index per level)
+     * @return Tile ID, or NO_TILE if the address is not in the tree
+     */
+    SpectreTile::ID get_tile_by_address(const PackedAddress& address) const;
+    
+    /**
+     * @brief Get the hierarchical address of a tile (O(depth))
+     *
+     * Allocates only for tiles deeper than PackedAddress::MAX_DEPTH.
      */
     HierarchicalAddress get_address(SpectreTile::ID id) const;
     
     /**
      * @brief Build the tree structure from image data with adaptive subdivision
+     * 
+     * Child subtrees of tiles at least parallel_cutoff pixels large are built
+     * as parallel tasks. Tile IDs are assigned afterwards in a fixed order, so
+     * the resulting tree is identical for any thread count.
+     * 
      * @param image The image data
      * @param variance_threshold Threshold for subdivision (0.0-1.0)
      * @param max_depth Maximum tree depth
+     * @param parallel_cutoff Tile area (pixels) below which subtrees are built serially
+     */
+    void build(const ColorData& image, double variance_threshold, int max_depth,
+               uint64_t parallel_cutoff = DEFAULT_PARALLEL_CUTOFF);
+    
+    /**
+     * @brief Build the tree from a view over image data (no pixel copies)
+     * @param view The image region covered by the root tile
+     * @param variance_threshold Threshold for subdivision (0.0-1.0)
+     * @param max_depth Maximum tree depth
+     * @param parallel_cutoff Tile area (pixels) below which subtrees are built serially
      */
-    void build(const ColorData& image, double variance_threshold, int max_depth);
+    void build(const ImageView& view, double variance_threshold, int max_depth,
+               uint64_t parallel_cutoff = DEFAULT_PARALLEL_CUTOFF);
+    
+    /**
+     * @brief Build the tree within a caller's thread budget and scratch memory
+     * @param view The image region covered by the root tile
+     * @param variance_threshold Threshold for subdivision (0.0-1.0)
+     * @param max_depth Maximum tree depth
+     * @param parallel_cutoff Tile area (pixels) below which subtrees are built serially
+     * @param context Threads for the build and storage for the summed-area tables
+     */
+    void build(const ImageView& view, double variance_threshold, int max_depth,
+               uint64_t parallel_cutoff, ExecutionContext& context);
+    
+    /**
+     * @brief Build the tree from summed-area tables the caller already has
+     *
+     * For callers that need the tables again after the build (e.g. to
+     * measure tile errors); the root tile covers the whole table, and the
+     * tree takes the table's dimensions.
+     *
+     * Rebuilding a tree reuses its storage, so a long-lived tree stops
+     * allocating once it has held its largest build.
+     *
+     * @param integral Summed-area tables of the image
+     * @param variance_threshold Threshold for subdivision (0.0-1.0)
+     * @param max_depth Maximum tree depth
+     * @param parallel_cutoff Tile area (pixels) below which subtrees are built serially
+     * @param context Threads for the build
+     */
+    void build(const IntegralImage& integral, double variance_threshold, int max_depth,
+               uint64_t parallel_cutoff, ExecutionContext& context);
     
     /**
      * @brief Get all leaf nodes (tiles that weren't subdivided)
@@ -69,7 +181,7 @@ public:
     /**
      * @brief Get total number of tiles
      */
-    size_t get_tile_count() const { return tiles_.size(); }
+    size_t get_tile_count() const { return depth_.size(); }
     
     /**
      * @brief Get maximum depth reached
@@ -85,53 +197,78 @@ public:
     }
     
     /**
-     * @brief Add a deserialized tile to the tree (for deserialization)
-     * @param id Tile ID
-     * @param depth Tile depth
-     * @param parent_id Parent tile ID
-     * @param r,g,b Color values
-     * @param children IDs of child tiles
+     * @brief Inflate a leaf tile into a block of children (for deserialization)
+     * @param id Leaf tile to subdivide
+     * @return ID of the first child; children start out black
      */
-    void add_deserialized_tile(
-        SpectreTile::ID id,
-        int depth,
-        SpectreTile::ID parent_id,
-        uint8_t r, uint8_t g, uint8_t b,
-        const std::vector<SpectreTile::ID>& children
-    );
+    SpectreTile::ID subdivide(SpectreTile::ID id);
     
     /**
-     * @brief Set the hierarchical address of a tile (for deserialization)
-     * @param id Tile ID
-     * @param address Hierarchical address for the tile
+     * @brief Turn a tile back into a leaf, so a new subtree can be attached in its place
+     *
+     * Its descendants stay in storage, unreachable from the root: they still
+     * count in get_tile_count() and the tile lists until the tree is rebuilt
+     * or copied.
      */
-    void set_tile_address(SpectreTile::ID id, const HierarchicalAddress& address);
+    void collapse(SpectreTile::ID id) { first_child_[index_of(id)] = NO_TILE; }
 
 private:
     uint32_t image_width_, image_height_;
     SpectreTile::ID root_id_;
     int max_depth_;
     
-    // Map from tile ID to tile object
-    std::map<SpectreTile::ID, std::unique_ptr<SpectreTile>> tiles_;
+    // Struct-of-arrays tile storage, indexed by (ID - root_id_)
+    std::vector<SpectreTile::ID> parent_;
+    std::vector<SpectreTile::ID> first_child_;
+    std::vector<uint8_t> depth_;
+    std::vector<uint8_t> color_r_, color_g_, color_b_;
     
-    // Map from tile ID to hierarchical address
-    std::map<SpectreTile::ID, HierarchicalAddress> id_to_address_;
+    size_t index_of(SpectreTile::ID id) const { return static_cast<size_t>(id - root_id_); }
     
     /**
-     * @brief Recursively build the tree with variance-driven subdivision
+     * @brief Subdivision decision and color of one tile, recorded in pre-order
      */
-    void build_recursive(
-        SpectreTile& tile,
-        const ColorData& image,
-        const HierarchicalAddress& address,
+    struct BuildNode {
+        Color color;
+        bool subdivided;
+    };
+    
+    std::vector<BuildNode> build_nodes_;  // build() records, kept for the next build (empty between builds)
+    
+    /**
+     * @brief Recursively decide subdivision with variance-driven splitting
+     *
+     * Region statistics come from the image's summed-area tables, so each
+     * tile costs O(1) regardless of its pixel count. Only records tiles into
+     * `nodes` (pre-order) and touches no shared state, so subtrees can be
+     * built concurrently.
+     */
+    static void build_recursive(
+        const IntegralImage& integral,
+        uint32_t x, uint32_t y,
+        uint32_t width, uint32_t height,
         double variance_threshold,
         int current_depth,
-        int max_depth
+        int max_depth,
+        uint64_t parallel_cutoff,
+        std::vector<BuildNode>& nodes
+    );
+    
+    /**
+     * @brief Create tiles for a recorded subtree, assigning IDs in order
+     * @param nodes Pre-order records from build_recursive
+     * @param index Position of this tile's record
+     * @param id The tile the record describes
+     * @return Position just past this tile's subtree
+     */
+    size_t attach_subtree(
+        const std::vector<BuildNode>& nodes,
+        size_t index,
+        SpectreTile::ID id
     );
     
     /**
-     * @brief Create and register a new tile
+     * @brief Append a new leaf tile to the storage
      */
     SpectreTile::ID create_tile(int depth, SpectreTile::ID parent_id);
 };
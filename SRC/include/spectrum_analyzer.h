@@ -3,6 +3,7 @@
 
 #include "spectre_tree.h"
 #include "hierarchical_address.h"
+#include "color_data.h"
 #include <vector>
 #include <complex>
 #include <cstdint>
@@ -31,7 +32,7 @@ public:
         bool has_discrete_peaks = false;  // True for periodic, false for aperiodic
         uint32_t peak_count = 0;  // Number of distinct peaks
     };
-
+    
     /**
      * @brief Generate tile positions for aperiodic (Spectre) tiling
      * @param grid_size Size of the region to tile (grid_size x grid_size)
@@ -42,7 +43,7 @@ public:
         uint32_t grid_size,
         int depth
     );
-
+    
     /**
      * @brief Generate tile positions for periodic (square) tiling
      * @param grid_size Size of the region to tile (grid_size x grid_size)
@@ -53,7 +54,7 @@ public:
         uint32_t grid_size,
         uint32_t tile_size
     );
-
+    
     /**
      * @brief Compute 1D spatial frequency spectrum via Fourier analysis
      * @param tile_positions Vector of tile center positions
@@ -64,7 +65,28 @@ public:
         const std::vector<std::pair<double, double>>& tile_positions,
         uint32_t num_frequencies = 128
     );
-
+    
+    /**
+     * @brief Compute the radial spatial frequency spectrum of an image
+     *
+     * Takes the 2D FFT of the image's luma (mean removed, Hann windowed so
+     * the image edges add no spurious frequencies) and averages magnitudes
+     * over rings of equal radial frequency. Bin k covers frequencies from
+     * k / (2 num_frequencies) cycles per pixel up to the next bin, so the
+     * last bin ends at the Nyquist frequency 0.5. Periodic structure, such
+     * as moire from a block grid, shows up as discrete peaks.
+     *
+     * @param image Image to analyze (e.g. a decoded reconstruction)
+     * @param num_frequencies Number of radial frequency bins
+     * @param threads Threads for the transform (0 = the OpenMP default)
+     * @return Spectrum with magnitude, frequencies, and spectral characteristics
+     */
+    static Spectrum compute_spatial_spectrum(
+        const ColorData& image,
+        uint32_t num_frequencies = 128,
+        int threads = 0
+    );
+    
     /**
      * @brief Detect discrete peaks in the spectrum
      * @param spectrum The computed spectrum
@@ -75,14 +97,14 @@ public:
         const Spectrum& spectrum,
         double threshold = 0.3
     );
-
+    
     /**
      * @brief Calculate spectral entropy (continuous vs. discrete indicator)
      * @param spectrum The computed spectrum
      * @return Entropy value: high = continuous (aperiodic), low = discrete (periodic)
      */
     static double calculate_spectral_entropy(const Spectrum& spectrum);
-
+    
     /**
      * @brief Compare aperiodic vs periodic spectrum visually (text-based histogram)
      * @param aperiodic_spectrum Spectrum from Spectre tiling
@@ -92,7 +114,7 @@ public:
         const Spectrum& aperiodic_spectrum,
         const Spectrum& periodic_spectrum
     );
-
+    
     /**
      * @brief Export spectrum data to file for visualization
      * @param spectrum The computed spectrum
@@ -105,12 +127,12 @@ public:
 
 private:
     /**
-     * @brief Compute 1D Discrete Fourier Transform
+     * @brief Compute 1D Discrete Fourier Transform (by FFT, see FFTPlan)
      * @param data Input signal samples
      * @return Complex DFT values
      */
     static std::vector<std::complex<double>> dft_1d(const std::vector<double>& data);
-
+    
     /**
      * @brief Sample tile positions along a line to create 1D signal for FFT
      */
@@ -118,6 +140,11 @@ private:
         const std::vector<std::pair<double, double>>& positions,
         uint32_t num_samples
     );
+    
+    /**
+     * @brief Fill the peak and discrete-peak fields from the magnitudes
+     */
+    static void summarize(Spectrum& spectrum);
 };
 
 } // namespace spectre
@@ -0,0 +1,105 @@
+#ifndef TILE_COLOR_CODER_H
+#define TILE_COLOR_CODER_H
+
+#include "color_data.h"
+#include "range_coder.h"
+#include <array>
+#include <cstdint>
+
+namespace spectre {
+
+/**
+ * @brief Context models for the predicted tree stream (see tree_stream.h)
+ *
+ * Every tile's color is predicted by its parent's average color, and only
+ * the residual is range coded. The parent is the area-weighted mean of its
+ * children, so the last child is instead predicted from what the parent's
+ * total leaves after its siblings. Green and blue residuals are coded relative
+ * to the residual of the channel before them, since brightness changes move
+ * all three together. Models are kept per channel, per depth, per
+ * leaf/internal tile and for last versus other children; split flags have
+ * one model per depth.
+ *
+ * Encoder and decoder must make the same sequence of calls.
+ */
+class TileColorCoder {
+public:
+    /**
+     * @brief Depths from here on share one context
+     */
+    static constexpr int DEPTH_CONTEXTS = 16;
+    
+    TileColorCoder() = default;
+    
+    /**
+     * @brief Area-weighted color totals of the children coded so far
+     */
+    struct SiblingSums {
+        uint64_t area = 0;
+        uint64_t r = 0, g = 0, b = 0;
+        
+        void add(const Color& color, uint64_t tile_area) {
+            area += tile_area;
+            r += color.r * tile_area;
+            g += color.g * tile_area;
+            b += color.b * tile_area;
+        }
+    };
+    
+    /**
+     * @brief Prediction used for the root tile, which has no parent
+     */
+    static Color root_prediction() { return Color(128, 128, 128); }
+    
+    /**
+     * @brief Predict the last child as the parent's total minus its siblings'
+     * @param parent Parent color
+     * @param parent_area Parent pixel count
+     * @param siblings Totals of the other children
+     * @param area The last child's pixel count (non-zero)
+     */
+    static Color predict_last_child(const Color& parent, uint64_t parent_area,
+                                    const SiblingSums& siblings, uint64_t area);
+    
+    void encode_split(RangeEncoder& encoder, int depth, bool split);
+    bool decode_split(RangeDecoder& decoder, int depth);
+    
+    void encode_color(RangeEncoder& encoder, int depth, bool leaf, bool last_child,
+                      const Color& color, const Color& prediction);
+    Color decode_color(RangeDecoder& decoder, int depth, bool leaf, bool last_child,
+                       const Color& prediction);
+
+private:
+    static constexpr size_t CHANNELS = 3;
+    static constexpr size_t TREE_SIZE = 256;  // Bit models per 8-bit symbol tree
+    static constexpr size_t KINDS = 4;  // leaf/internal x last/other child
+    
+    // Fixed-size, so a coder lives wherever it is declared and never allocates
+    std::array<AdaptiveBit, DEPTH_CONTEXTS> split_models_;
+    std::array<AdaptiveBit, static_cast<size_t>(DEPTH_CONTEXTS) * KINDS * CHANNELS * TREE_SIZE> color_models_;
+    
+    AdaptiveBit* color_tree(int depth, size_t kind, size_t channel) {
+        size_t context = (static_cast<size_t>(depth_context(depth)) * KINDS + kind) * CHANNELS + channel;
+        return &color_models_[context * TREE_SIZE];
+    }
+    
+    static size_t color_kind(bool leaf, bool last_child) { return (leaf ? 1 : 0) + (last_child ? 2 : 0); }
+    
+    static int depth_context(int depth) { return depth < DEPTH_CONTEXTS ? depth : DEPTH_CONTEXTS - 1; }
+    
+    /**
+     * @brief Map a residual (mod 256) to a symbol where small magnitudes are small
+     */
+    static uint8_t to_symbol(int residual) {
+        int8_t value = static_cast<int8_t>(static_cast<uint8_t>(residual));
+        return static_cast<uint8_t>(value >= 0 ? value * 2 : -value * 2 - 1);
+    }
+    
+    static int from_symbol(uint8_t symbol) {
+        return (symbol & 1) ? -(symbol >> 1) - 1 : symbol >> 1;
+    }
+};
+
+} // namespace spectre
+
+#endif // TILE_COLOR_CODER_H
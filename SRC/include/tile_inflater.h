@@ -24,10 +24,15 @@ public:
     
     /**
      * @brief Inflate (subdivide) a Spectre tile into its children
+     * 
+     * Children receive consecutive IDs starting at first_child_id; the caller
+     * (normally the owning SpectreTree) is responsible for handing out IDs.
+     * 
      * @param tile The tile to inflate
+     * @param first_child_id ID of the first child
      * @return Vector of child tile IDs
      */
-    static std::vector<SpectreTile::ID> inflate_tile(SpectreTile& tile);
+    static std::vector<SpectreTile::ID> inflate_tile(SpectreTile& tile, SpectreTile::ID first_child_id);
     
     /**
      * @brief Get the bounding region of a child tile within parent
@@ -59,10 +64,6 @@ public:
      * @param depth Current depth
      */
     static double calculate_tile_size(double initial_size, int depth);
-
-private:
-    // Counter for generating unique IDs
-    static SpectreTile::ID next_tile_id_;
 };
 
 } // namespace spectre
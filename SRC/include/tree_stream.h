@@ -0,0 +1,107 @@
+#ifndef TREE_STREAM_H
+#define TREE_STREAM_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace spectre {
+
+/**
+ * @brief Layout of the serialized tree stream (before entropy coding)
+ *
+ * Implicit-topology stream (version 2):
+ *   magic "SPT" | version(1) | width(4) | height(4) | tile_count(varint) | max_depth(1)
+ *   split flags: one bit per tile in pre-order, MSB first, padded to a byte
+ *   leaf colors: r, g, b per leaf, in pre-order
+ *
+ * Predicted stream (version 3): the same header, then one range-coded payload
+ * holding for each tile in pre-order its split flag and its color as a
+ * residual against the parent's color (see TileColorCoder). Internal tiles
+ * carry colors too, since they are the predictions for their children.
+ * Tiles covering no pixels code no color and take their parent's.
+ *
+ * Progressive stream (version 4): the same header, then the tiles of one
+ * depth at a time (breadth-first), coded as in version 3. Each depth is a
+ * separately flushed range-coded block preceded by its size (varint), while
+ * the coder's models carry over between depths. Decoding can stop after
+ * any depth, and every complete depth in a truncated stream still yields
+ * an image: tiles not yet split further are painted with their average.
+ *
+ * Lossless stream (version 6): the same header, then the size (varint) and
+ * payload of a version 4 stream of the tree, the base layer, followed by
+ * per-pixel residuals that make the image exact (see ResidualCoder).
+ * Stopping after the base layer gives the tree's lossy image.
+ *
+ * Sequence frames (version 5, see sequence_codec.h) reuse the header and
+ * the implicit layout for their re-coded subtrees; only SequenceDecoder
+ * reads them.
+ *
+ * Every subdivision creates TileInflater::CHILDREN_PER_TILE children, so the
+ * topology needs no tile indices and the leaf count follows from the tile
+ * count. Streams without the magic are the legacy indexed format (version 1),
+ * which starts directly with the width.
+ */
+class TreeStream {
+public:
+    static constexpr uint8_t MAGIC[3] = {'S', 'P', 'T'};
+    static constexpr uint8_t VERSION_INDEXED = 0x01;
+    static constexpr uint8_t VERSION_IMPLICIT = 0x02;
+    static constexpr uint8_t VERSION_PREDICTED = 0x03;
+    static constexpr uint8_t VERSION_PROGRESSIVE = 0x04;
+    static constexpr uint8_t VERSION_SEQUENCE = 0x05;  // Frames of a sequence (SequenceDecoder only)
+    static constexpr uint8_t VERSION_LOSSLESS = 0x06;
+    
+    /**
+     * @brief Fields common to the stream header
+     */
+    struct Header {
+        uint8_t version = VERSION_IMPLICIT;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint64_t tile_count = 0;
+        uint8_t max_depth = 0;
+    };
+    
+    /**
+     * @brief Check whether data starts with the stream magic
+     */
+    static bool has_magic(const uint8_t* data, size_t size);
+    
+    /**
+     * @brief Append a header to a byte stream
+     */
+    static void write_header(const Header& header, std::vector<uint8_t>& output);
+    
+    /**
+     * @brief Parse a header
+     * @param offset Set to the first byte after the header
+     * @return false if the header is truncated or has no magic
+     */
+    static bool read_header(const uint8_t* data, size_t size, Header& header, size_t& offset);
+    
+    /**
+     * @brief Number of leaves in a complete tree with tile_count tiles
+     */
+    static uint64_t leaf_count(uint64_t tile_count);
+    
+    /**
+     * @brief Bytes used by the split flags of tile_count tiles
+     */
+    static uint64_t split_flag_bytes(uint64_t tile_count) { return (tile_count + 7) / 8; }
+    
+    /**
+     * @brief Append an unsigned LEB128 value
+     */
+    static void write_varint(uint64_t value, std::vector<uint8_t>& output);
+    
+    /**
+     * @brief Read an unsigned LEB128 value
+     * @return false if the value is truncated or longer than 64 bits
+     */
+    static bool read_varint(const uint8_t* data, size_t size, size_t& offset, uint64_t& value);
+};
+
+} // namespace spectre
+
+#endif // TREE_STREAM_H
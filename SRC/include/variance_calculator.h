@@ -2,6 +2,7 @@
 #define VARIANCE_CALCULATOR_H
 
 #include "color_data.h"
+#include "integral_image.h"
 #include <cstdint>
 
 namespace spectre {
@@ -41,8 +42,71 @@ public:
      * @param threshold Variance threshold for subdivision
      */
     static bool should_subdivide(const ColorData& data, double threshold);
+    
+    /**
+     * @brief Calculate the variance of colors in a view (no pixel copies)
+     * @param view The image region
+     */
+    static double calculate_variance(const ImageView& view);
+    
+    /**
+     * @brief Calculate variance per channel (R, G, B) of a view
+     */
+    static void calculate_channel_variance(
+        const ImageView& view,
+        double& var_r,
+        double& var_g,
+        double& var_b
+    );
+    
+    /**
+     * @brief Determine if a region given as a view should be subdivided
+     */
+    static bool should_subdivide(const ImageView& view, double threshold);
+    
+    /**
+     * @brief Calculate per-channel variance of a region in constant time
+     * @param integral Summed-area tables of the image
+     * @param x,y Region origin
+     * @param width,height Region size
+     * @param var_r Output for red variance
+     * @param var_g Output for green variance
+     * @param var_b Output for blue variance
+     */
+    static void calculate_channel_variance(
+        const IntegralImage& integral,
+        uint32_t x, uint32_t y,
+        uint32_t width, uint32_t height,
+        double& var_r,
+        double& var_g,
+        double& var_b
+    );
+    
+    /**
+     * @brief Calculate the combined variance of a region in constant time
+     */
+    static double calculate_variance(
+        const IntegralImage& integral,
+        uint32_t x, uint32_t y,
+        uint32_t width, uint32_t height
+    );
+    
+    /**
+     * @brief Determine if a region should be subdivided, using summed-area tables
+     */
+    static bool should_subdivide(
+        const IntegralImage& integral,
+        uint32_t x, uint32_t y,
+        uint32_t width, uint32_t height,
+        double threshold
+    );
 
 private:
+    /**
+     * @brief Regions smaller than this (in pixels) are scanned on one thread
+     */
+    static constexpr uint64_t PARALLEL_MIN_PIXELS = 1 << 16;
+    
     /**
      * @brief Calculate mean value of a set of numbers
      */
@@ -0,0 +1,301 @@
+#include "batch_compressor.h"
+#include "image_io.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace etca {
+
+namespace {
+
+/**
+ * @brief Result of one image handed from a worker to the writer
+ */
+struct EncodedImage {
+    size_t job = 0;
+    std::vector<uint8_t> bytes;
+    std::string error;   // Non-empty if loading or compressing failed
+};
+
+/**
+ * @brief Bounded multi-producer, single-consumer queue of encoded images
+ *
+ * Workers block in push() while the queue is full, which caps how many
+ * encoded files are in memory when the disk falls behind.
+ */
+class EncodedQueue {
+public:
+    explicit EncodedQueue(size_t capacity) : capacity_(capacity) {}
+    
+    void push(EncodedImage item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [&] { return items_.size() < capacity_; });
+        items_.push_back(std::move(item));
+        not_empty_.notify_one();
+    }
+    
+    EncodedImage pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [&] { return !items_.empty(); });
+        EncodedImage item = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return item;
+    }
+
+private:
+    size_t capacity_;
+    std::deque<EncodedImage> items_;
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+};
+
+} // namespace
+
+static bool is_image_path(const fs::path& path) {
+    try {
+        detect_image_format(path.string());
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+// Output path for an input: its extension replaced by .etca, placed under output_dir if given
+static std::string output_for(const fs::path& input, const fs::path& relative, const std::string& output_dir) {
+    fs::path output = output_dir.empty() ? input : fs::path(output_dir) / relative;
+    output.replace_extension(".etca");
+    return output.string();
+}
+
+// Deepest directory holding every path (absolute and normalized; empty if they share no root)
+static fs::path common_root(const std::vector<fs::path>& paths) {
+    fs::path root;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        fs::path parent = paths[i].parent_path();
+        if (i == 0) {
+            root = parent;
+            continue;
+        }
+        fs::path shared;
+        for (auto a = root.begin(), b = parent.begin(); a != root.end() && b != parent.end() && *a == *b; ++a, ++b) {
+            shared /= *a;
+        }
+        root = shared;
+    }
+    return root;
+}
+
+// Two jobs writing one file would silently keep only the later image
+static void check_distinct_outputs(const std::vector<BatchJob>& jobs) {
+    std::map<std::string, const BatchJob*> owners;
+    for (const BatchJob& job : jobs) {
+        std::string key = fs::absolute(job.output_path).lexically_normal().string();
+        auto [owner, inserted] = owners.emplace(key, &job);
+        if (!inserted) {
+            throw std::runtime_error("'" + owner->second->input_path + "' and '" + job.input_path +
+                                     "' would both be written to '" + job.output_path + "'");
+        }
+    }
+}
+
+std::vector<BatchJob> BatchCompressor::collect_jobs(const std::string& input, const std::string& output_dir) {
+    std::vector<BatchJob> jobs;
+    
+    if (fs::is_directory(input)) {
+        for (const auto& entry : fs::recursive_directory_iterator(input)) {
+            if (!entry.is_regular_file() || !is_image_path(entry.path())) {
+                continue;
+            }
+            BatchJob job;
+            job.input_path = entry.path().string();
+            job.output_path = output_for(entry.path(), fs::relative(entry.path(), input), output_dir);
+            jobs.push_back(std::move(job));
+        }
+        
+        // Directory iteration order is unspecified; keep runs reproducible
+        std::sort(jobs.begin(), jobs.end(),
+                  [](const BatchJob& a, const BatchJob& b) { return a.input_path < b.input_path; });
+        check_distinct_outputs(jobs);
+        return jobs;
+    }
+    
+    std::ifstream list(input);
+    if (!list.is_open()) {
+        throw std::runtime_error("Cannot open batch list: " + input);
+    }
+    
+    std::vector<fs::path> paths;
+    std::string line;
+    while (std::getline(list, line)) {
+        // Tolerate CRLF lists and surrounding whitespace
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') {
+            continue;
+        }
+        size_t last = line.find_last_not_of(" \t\r");
+        paths.emplace_back(line.substr(first, last - first + 1));
+    }
+    
+    // Outputs keep each input's place below the directory the inputs share,
+    // so same-named images from different directories stay apart
+    std::vector<fs::path> absolute_paths;
+    absolute_paths.reserve(paths.size());
+    for (const fs::path& path : paths) {
+        absolute_paths.push_back(fs::absolute(path).lexically_normal());
+    }
+    fs::path root = common_root(absolute_paths);
+    
+    for (size_t i = 0; i < paths.size(); ++i) {
+        fs::path relative = root.empty() ? fs::path() : absolute_paths[i].lexically_relative(root);
+        BatchJob job;
+        job.input_path = paths[i].string();
+        job.output_path = output_for(paths[i], relative.empty() ? paths[i].filename() : relative, output_dir);
+        jobs.push_back(std::move(job));
+    }
+    
+    check_distinct_outputs(jobs);
+    return jobs;
+}
+
+// Run body(index, worker) for every index in [0, count) on `workers` threads
+template <typename Body>
+static void parallel_for_each(size_t count, unsigned workers, Body body) {
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> threads;
+    threads.reserve(workers);
+    for (unsigned w = 0; w < workers; ++w) {
+        threads.emplace_back([&, w] {
+            for (size_t i = next++; i < count; i = next++) {
+                body(i, w);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+static void write_file(const std::vector<uint8_t>& bytes, const std::string& path) {
+    fs::path parent = fs::path(path).parent_path();
+    if (!parent.empty()) {
+        fs::create_directories(parent);
+    }
+    
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot open file for writing: " + path);
+    }
+    file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (!file.good()) {
+        throw std::runtime_error("Failed to write .etca file: " + path);
+    }
+}
+
+BatchStatistics BatchCompressor::run(
+    std::vector<BatchJob> jobs,
+    const BatchOptions& options,
+    const ProgressCallback& progress) {
+    
+    auto start_time = std::chrono::steady_clock::now();
+    
+    BatchStatistics stats;
+    stats.workers = options.workers > 0 ? options.workers : std::max(1u, std::thread::hardware_concurrency());
+    if (jobs.empty()) {
+        return stats;
+    }
+    
+    // Size every image from its header so work can be handed out largest first
+    parallel_for_each(jobs.size(), stats.workers, [&](size_t i, unsigned) {
+        BatchJob& job = jobs[i];
+        std::error_code ec;
+        uintmax_t file_size = fs::file_size(job.input_path, ec);
+        job.input_bytes = ec ? 0 : static_cast<uint64_t>(file_size);
+        
+        try {
+            uint32_t width = 0, height = 0;
+            read_image_size(job.input_path, width, height);
+            job.pixels = static_cast<uint64_t>(width) * height;
+        } catch (const std::exception&) {
+            // Unreadable headers fail properly when the image is loaded
+            job.pixels = job.input_bytes;
+        }
+    });
+    
+    std::stable_sort(jobs.begin(), jobs.end(),
+                     [](const BatchJob& a, const BatchJob& b) { return a.pixels > b.pixels; });
+    
+    size_t queue_depth = options.write_queue_depth > 0 ? options.write_queue_depth : 2 * size_t(stats.workers);
+    EncodedQueue queue(queue_depth);
+    
+    // Writer stage: drains the queue in completion order while workers keep compressing
+    std::thread writer([&] {
+        for (size_t finished = 1; finished <= jobs.size(); ++finished) {
+            EncodedImage encoded = queue.pop();
+            const BatchJob& job = jobs[encoded.job];
+            
+            if (encoded.error.empty()) {
+                try {
+                    write_file(encoded.bytes, job.output_path);
+                } catch (const std::exception& e) {
+                    encoded.error = e.what();
+                }
+            }
+            
+            if (encoded.error.empty()) {
+                ++stats.images_done;
+                stats.input_bytes += job.input_bytes;
+                stats.output_bytes += encoded.bytes.size();
+                stats.pixels += job.pixels;
+            } else {
+                ++stats.images_failed;
+                stats.failures.push_back({job.input_path, encoded.error});
+            }
+            
+            if (progress) {
+                progress(job, encoded.error, finished, jobs.size());
+            }
+        }
+    });
+    
+    // Parallelism comes from the pool, so each worker compresses serially;
+    // its context keeps scratch buffers warm from one image to the next
+    std::vector<spectre::ExecutionContext> contexts;
+    contexts.reserve(stats.workers);
+    for (unsigned w = 0; w < stats.workers; ++w) {
+        contexts.emplace_back(1);
+    }
+    
+    // Load and compress stages: one image per worker at a time
+    parallel_for_each(jobs.size(), stats.workers, [&](size_t i, unsigned worker) {
+        EncodedImage encoded;
+        encoded.job = i;
+        try {
+            spectre::ColorData image = load_image(jobs[i].input_path);
+            encoded.bytes = EtcaWriter::encode(image, options.lossless, options.variance_threshold,
+                                               options.metadata, options.region_depth, &contexts[worker]);
+        } catch (const std::exception& e) {
+            encoded.error = e.what();
+            encoded.bytes.clear();
+        }
+        queue.push(std::move(encoded));
+    });
+    
+    writer.join();
+    
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    return stats;
+}
+
+} // namespace etca
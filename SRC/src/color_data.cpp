@@ -1,21 +1,93 @@
 #include "color_data.h"
 #include "image_io.h"
+#include "pixel_kernels.h"
 #include <algorithm>
 #include <numeric>
 #include <stdexcept>
 
 namespace spectre {
 
+ImageView ImageView::subview(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const {
+    if (x >= width_ || y >= height_) {
+        return ImageView(origin_, 0, 0, stride_);
+    }
+    
+    uint32_t clamped_width = std::min(width, width_ - x);
+    uint32_t clamped_height = std::min(height, height_ - y);
+    return ImageView(row(y) + x, clamped_width, clamped_height, stride_);
+}
+
+Color ImageView::calculate_average_color() const {
+    if (empty()) {
+        return Color(0, 0, 0);
+    }
+    
+    uint64_t sums[3] = {0, 0, 0};
+    const PixelKernels& kernels = pixel_kernels();
+    
+    // A view that spans whole rows of its parent is one contiguous run
+    if (stride_ == width_) {
+        kernels.sum(row(0), static_cast<size_t>(width_) * height_, sums);
+    } else {
+        for (uint32_t y = 0; y < height_; ++y) {
+            kernels.sum(row(y), width_, sums);
+        }
+    }
+    
+    uint64_t count = static_cast<uint64_t>(width_) * height_;
+    return Color(
+        static_cast<uint8_t>(sums[0] / count),
+        static_cast<uint8_t>(sums[1] / count),
+        static_cast<uint8_t>(sums[2] / count)
+    );
+}
+
+MutableImageView MutableImageView::subview(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const {
+    if (x >= width_ || y >= height_) {
+        return MutableImageView(origin_, 0, 0, stride_);
+    }
+    
+    uint32_t clamped_width = std::min(width, width_ - x);
+    uint32_t clamped_height = std::min(height, height_ - y);
+    return MutableImageView(row(y) + x, clamped_width, clamped_height, stride_);
+}
+
+void MutableImageView::fill_region(uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+                                   const Color& color) const {
+    if (x >= width_ || y >= height_) {
+        return;
+    }
+    
+    uint32_t end_x = x + std::min(width, width_ - x);
+    uint32_t end_y = y + std::min(height, height_ - y);
+    
+    const PixelKernels& kernels = pixel_kernels();
+    for (uint32_t row_index = y; row_index < end_y; ++row_index) {
+        kernels.fill(row(row_index) + x, end_x - x, color);
+    }
+}
+
+void MutableImageView::copy_region(const ImageView& source, uint32_t x, uint32_t y) const {
+    if (x >= width_ || y >= height_) {
+        return;
+    }
+    
+    uint32_t copy_width = std::min(source.get_width(), width_ - x);
+    uint32_t copy_height = std::min(source.get_height(), height_ - y);
+    
+    for (uint32_t row_index = 0; row_index < copy_height; ++row_index) {
+        const Color* src = source.row(row_index);
+        std::copy(src, src + copy_width, row(y + row_index) + x);
+    }
+}
+
 ColorData::ColorData(uint32_t width, uint32_t height)
     : width_(width), height_(height) {
-    pixels_.resize(width_ * height_, Color(0, 0, 0));
+    pixels_.resize(static_cast<size_t>(width_) * height_, Color(0, 0, 0));
 }
 
-ColorData::ColorData(const std::string& file_path) {
-    auto image = etca::load_image(file_path);
-    width_ = image.get_width();
-    height_ = image.get_height();
-    pixels_ = image.get_pixels();
+ColorData::ColorData(const std::string& file_path)
+    : ColorData(etca::load_image(file_path)) {
 }
 
 void ColorData::set_pixel(uint32_t x, uint32_t y, const Color& color) {
@@ -34,43 +106,30 @@ Color ColorData::get_pixel(uint32_t x, uint32_t y) const {
 ColorData ColorData::extract_region(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const {
     ColorData region(width, height);
     
-    for (uint32_t row = 0; row < height; ++row) {
-        for (uint32_t col = 0; col < width; ++col) {
-            uint32_t src_x = x + col;
-            uint32_t src_y = y + row;
-            
-            if (src_x < width_ && src_y < height_) {
-                region.set_pixel(col, row, get_pixel(src_x, src_y));
-            }
-        }
+    // Pixels outside the image stay black; copy the overlapping part row by row
+    ImageView source = view(x, y, width, height);
+    for (uint32_t row = 0; row < source.get_height(); ++row) {
+        const Color* src = source.row(row);
+        std::copy(src, src + source.get_width(), region.pixels_.begin() + region.xy_to_index(0, row));
     }
     
     return region;
 }
 
 Color ColorData::calculate_average_color() const {
-    if (pixels_.empty()) {
-        return Color(0, 0, 0);
-    }
-    
-    uint64_t sum_r = 0, sum_g = 0, sum_b = 0;
-    
-    for (const auto& pixel : pixels_) {
-        sum_r += pixel.r;
-        sum_g += pixel.g;
-        sum_b += pixel.b;
-    }
-    
-    size_t count = pixels_.size();
-    return Color(
-        static_cast<uint8_t>(sum_r / count),
-        static_cast<uint8_t>(sum_g / count),
-        static_cast<uint8_t>(sum_b / count)
-    );
+    return view().calculate_average_color();
 }
 
 void ColorData::fill(const Color& color) {
-    std::fill(pixels_.begin(), pixels_.end(), color);
+    pixel_kernels().fill(pixels_.data(), pixels_.size(), color);
+}
+
+void ColorData::fill_region(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const Color& color) {
+    mutable_view().fill_region(x, y, width, height, color);
+}
+
+void ColorData::copy_region(const ImageView& source, uint32_t x, uint32_t y) {
+    mutable_view().copy_region(source, x, y);
 }
 
 void ColorData::save_to_file(const std::string& file_path) const {
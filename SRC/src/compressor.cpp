@@ -1,145 +1,437 @@
 #include "compressor.h"
+#include "tile_inflater.h"
+#include "tree_stream.h"
+#include "tile_color_coder.h"
+#include "residual_coder.h"
+#include "profiler.h"
 #include <algorithm>
 
 namespace spectre {
 
+// Base layer of CompressionConfig::lossless()
+static constexpr double LOSSLESS_VARIANCE_THRESHOLD = 0.05;
+static constexpr int LOSSLESS_MAX_DEPTH = 6;
+
+CompressionConfig CompressionConfig::lossless() {
+    // Residuals carry the detail, so the tree only has to follow the broad
+    // structure; deeper trees cost more in tiles than they save in residuals
+    CompressionConfig config;
+    config.variance_threshold = LOSSLESS_VARIANCE_THRESHOLD;
+    config.max_tree_depth = LOSSLESS_MAX_DEPTH;
+    config.tree_stream_version = TreeStream::VERSION_LOSSLESS;
+    return config;
+}
+
+// Fill every leaf of a tree with its color, as a progressive decoder paints it
+static void paint_leaves(const SpectreTree& tree, SpectreTile::ID id,
+                         uint32_t x, uint32_t y, uint32_t width, uint32_t height, ColorData& image) {
+    if (!tree.is_subdivided(id)) {
+        Color color;
+        tree.get_color(id, color.r, color.g, color.b);
+        image.fill_region(x, y, width, height, color);
+        return;
+    }
+    
+    SpectreTile::ID first_child = tree.get_first_child(id);
+    for (int k = 0; k < TileInflater::CHILDREN_PER_TILE; ++k) {
+        uint32_t child_x, child_y, child_width, child_height;
+        TileInflater::get_child_bounds(width, height, k, child_x, child_y, child_width, child_height);
+        paint_leaves(tree, first_child + static_cast<SpectreTile::ID>(k),
+                     x + child_x, y + child_y, child_width, child_height, image);
+    }
+}
+
+// Stream header describing a tree
+static TreeStream::Header stream_header(const SpectreTree& tree, uint8_t version) {
+    TreeStream::Header header;
+    header.version = version;
+    tree.get_dimensions(header.width, header.height);
+    header.tile_count = tree.get_tile_count();
+    header.max_depth = static_cast<uint8_t>(std::min(tree.get_max_depth(), 255));
+    return header;
+}
+
 Compressor::Compressor(const CompressionConfig& config)
-    : config_(config), last_stats_{0, 0, 0, 0.0} {
+    : config_(config), last_stats_{0, 0, 0, 0, 0.0}, tree_(0, 0), context_(1) {
 }
 
 CompressedImage Compressor::compress(const ColorData& image) {
+    return compress(image.view());
+}
+
+CompressedImage Compressor::compress(const ImageView& image) {
+    ExecutionContext context;
+    return compress(image, context);
+}
+
+CompressedImage Compressor::compress(const ImageView& image, ExecutionContext& context) {
+    // Build the Spectre-Tree
+    SpectreTree tree(image.get_width(), image.get_height());
+    {
+        ProfileScope scope(context.get_profiler(), "tree_build");
+        tree.build(image, config_.variance_threshold, config_.max_tree_depth,
+                   config_.parallel_cutoff_pixels, context);
+    }
+    
     CompressedImage result;
     result.width = image.get_width();
     result.height = image.get_height();
     result.config = config_;
+    encode_into(tree, &image, result.data, context);
+    return result;
+}
+
+void Compressor::compress_into(const ColorData& image, std::vector<uint8_t>& output) {
+    compress_into(image.view(), output, context_);
+}
+
+void Compressor::compress_into(const ImageView& image, std::vector<uint8_t>& output, ExecutionContext& context) {
+    {
+        ProfileScope scope(context.get_profiler(), "tree_build");
+        tree_.build(image, config_.variance_threshold, config_.max_tree_depth,
+                    config_.parallel_cutoff_pixels, context);
+    }
     
-    // Build the Spectre-Tree
-    SpectreTree tree(image.get_width(), image.get_height());
-    tree.build(image, config_.variance_threshold, config_.max_tree_depth);
+    encode_into(tree_, &image, output, context);
+}
+
+CompressedImage Compressor::encode_tree(const SpectreTree& tree, ExecutionContext& context) {
+    CompressedImage result;
+    tree.get_dimensions(result.width, result.height);
+    result.config = config_;
+    encode_tree_into(tree, result.data, context);
+    return result;
+}
+
+void Compressor::encode_tree_into(const SpectreTree& tree, std::vector<uint8_t>& output, ExecutionContext& context) {
+    encode_into(tree, nullptr, output, context);
+}
+
+void Compressor::encode_into(const SpectreTree& tree, const ImageView* image, std::vector<uint8_t>& output,
+                             ExecutionContext& context) {
+    Profiler* profiler = context.get_profiler();
     
     // Record statistics
     last_stats_.tile_count = tree.get_tile_count();
     last_stats_.max_depth = tree.get_max_depth();
-    last_stats_.leaf_count = static_cast<uint32_t>(tree.get_leaf_nodes().size());
+    last_stats_.leaf_count = static_cast<uint32_t>(TreeStream::leaf_count(tree.get_tile_count()));
+    if (profiler != nullptr) {
+        record_tree_counters(tree, *profiler);
+    }
     
-    // Estimate compression ratio
-    // Original: width * height * 3 bytes (RGB)
-    // Compressed: tree structure + tile colors + metadata
-    size_t original_size = image.get_width() * image.get_height() * 3;
-    size_t estimated_compressed_size = tree.get_tile_count() * 10;  // ~10 bytes per tile
-    last_stats_.compression_ratio = static_cast<double>(original_size) / 
-                                    static_cast<double>(std::max(size_t(1), estimated_compressed_size));
+    if (stream_version() == TreeStream::VERSION_IMPLICIT) {
+        // Serialize into the context, then let the winning codec's buffer become the output
+        std::vector<uint8_t>& stream = context.stream_scratch();
+        {
+            ProfileScope scope(profiler, "serialize");
+            serialize_tree(tree, stream);
+        }
+        {
+            ProfileScope scope(profiler, "entropy");
+            AdaptiveEncoder::encode_into(stream, adaptive_options(context), entropy_stats_,
+                                         output, context.entropy_scratch());
+        }
+    } else {
+        // Range-coded streams only get the NONE marker, so write it first and serialize after it
+        {
+            ProfileScope scope(profiler, "serialize");
+            output.clear();
+            output.push_back(static_cast<uint8_t>(EntropyCodec::NONE));
+            if (image != nullptr && config_.tree_stream_version == TreeStream::VERSION_LOSSLESS) {
+                append_lossless(tree, *image, output, context.get_threads());
+            } else {
+                append_tree(tree, output);
+            }
+        }
+        entropy_stats_ = {output.size() - 1, output.size(), 1.0f, EntropyCodec::NONE};
+    }
     
-    // Serialize the tree
-    serialize_tree(tree, image, result.data);
+    // Original: width * height * 3 bytes (RGB), against the finished stream
+    uint32_t width, height;
+    tree.get_dimensions(width, height);
+    size_t original_size = static_cast<size_t>(width) * height * 3;
+    last_stats_.compressed_size = output.size();
+    last_stats_.compression_ratio = static_cast<double>(original_size) /
+                                    static_cast<double>(std::max(size_t(1), output.size()));
+}
+
+void Compressor::record_tree_counters(const SpectreTree& tree, Profiler& profiler) const {
+    // Derived from the finished tree so the build itself stays uninstrumented:
+    // every tile above the depth limit had its variance evaluated
+    std::vector<uint64_t> tiles_per_depth(static_cast<size_t>(tree.get_max_depth()) + 1, 0);
+    uint64_t variance_evaluations = 0;
+    for (SpectreTile::ID id = tree.get_root_id(); id < tree.get_root_id() + tree.get_tile_count(); ++id) {
+        int depth = tree.get_depth(id);
+        ++tiles_per_depth[static_cast<size_t>(depth)];
+        if (depth < config_.max_tree_depth) {
+            ++variance_evaluations;
+        }
+    }
     
-    // Apply entropy coding
-    apply_entropy_coding(result.data);
+    for (size_t depth = 0; depth < tiles_per_depth.size(); ++depth) {
+        profiler.add_tiles_at_depth(static_cast<int>(depth), tiles_per_depth[depth]);
+    }
+    profiler.add("tiles", tree.get_tile_count());
+    profiler.add("leaves", last_stats_.leaf_count);
+    profiler.add("variance_evaluations", variance_evaluations);
+}
+
+uint8_t Compressor::stream_version() const {
+    if (config_.tree_stream_version == TreeStream::VERSION_LOSSLESS) {
+        return TreeStream::VERSION_PROGRESSIVE;
+    }
+    return (config_.tree_stream_version == TreeStream::VERSION_PREDICTED ||
+            config_.tree_stream_version == TreeStream::VERSION_PROGRESSIVE)
+         ? config_.tree_stream_version : TreeStream::VERSION_IMPLICIT;
+}
+
+AdaptiveOptions Compressor::adaptive_options(const ExecutionContext& context) const {
+    AdaptiveOptions options;
+    options.prefer_speed = config_.prefer_speed;
+    options.level = config_.compression_level;
+    options.zlib_strategy = config_.zlib_strategy;
+    options.selection = config_.codec_selection;
+    options.threads = context.get_threads();
+    options.block_size = config_.entropy_block_size;
+    options.profiler = context.get_profiler();
+    return options;
+}
+
+void Compressor::serialize_tree(const SpectreTree& tree, std::vector<uint8_t>& output) const {
+    output.clear();
+    append_tree(tree, output);
+}
+
+void Compressor::append_tree(const SpectreTree& tree, std::vector<uint8_t>& output) const {
     
-    return result;
+    // Tree stream formats (see tree_stream.h):
+    // [Header: magic | version | width | height | tile_count | max_depth]
+    // Implicit:  [Split flags: 1 bit per tile, pre-order] [Leaf colors: r g b per leaf, pre-order]
+    // Predicted: [Range-coded split flags and parent-predicted colors, pre-order]
+    // Progressive: [Per depth: size | range-coded split flags and colors, breadth-first]
+    
+    TreeStream::Header header = stream_header(tree, stream_version());
+    TreeStream::write_header(header, output);
+    
+    if (header.version == TreeStream::VERSION_PREDICTED) {
+        encode_predicted_tiles(tree, output);
+        return;
+    }
+    if (header.version == TreeStream::VERSION_PROGRESSIVE) {
+        encode_progressive_tiles(tree, output, serialize_scratch_);
+        return;
+    }
+    
+    // Both sections have known sizes, so fill them in place
+    size_t flags_offset = output.size();
+    size_t colors_offset = flags_offset + static_cast<size_t>(TreeStream::split_flag_bytes(header.tile_count));
+    output.resize(colors_offset + static_cast<size_t>(TreeStream::leaf_count(header.tile_count)) * 3, 0);
+    
+    // Pre-order walk; children are pushed in reverse so child 0 is visited first
+    std::vector<SpectreTile::ID>& pending = serialize_scratch_.pending;
+    pending.assign(1, tree.get_root_id());
+    size_t tile_index = 0;
+    size_t color_offset = colors_offset;
+    
+    while (!pending.empty()) {
+        SpectreTile::ID tile_id = pending.back();
+        pending.pop_back();
+        
+        if (tree.is_subdivided(tile_id)) {
+            output[flags_offset + tile_index / 8] |= static_cast<uint8_t>(0x80 >> (tile_index % 8));
+            
+            SpectreTile::ID first_child = tree.get_first_child(tile_id);
+            for (int k = TileInflater::CHILDREN_PER_TILE - 1; k >= 0; --k) {
+                pending.push_back(first_child + static_cast<SpectreTile::ID>(k));
+            }
+        } else {
+            tree.get_color(tile_id, output[color_offset], output[color_offset + 1], output[color_offset + 2]);
+            color_offset += 3;
+        }
+        ++tile_index;
+    }
 }
 
-void Compressor::serialize_tree(
+void Compressor::append_lossless(const SpectreTree& tree, const ImageView& image, std::vector<uint8_t>& output,
+                                 int threads) const {
+    // Lossless: [Header] [Base layer: size | progressive payload] [Residuals, see residual_coder.h]
+    TreeStream::write_header(stream_header(tree, TreeStream::VERSION_LOSSLESS), output);
+    
+    std::vector<uint8_t>& base_layer = serialize_scratch_.base_layer;
+    base_layer.clear();
+    encode_progressive_tiles(tree, base_layer, serialize_scratch_);
+    TreeStream::write_varint(base_layer.size(), output);
+    output.insert(output.end(), base_layer.begin(), base_layer.end());
+    
+    ColorData& base = serialize_scratch_.base_image;
+    if (base.get_width() != image.get_width() || base.get_height() != image.get_height()) {
+        base = ColorData(image.get_width(), image.get_height());
+    }
+    paint_leaves(tree, tree.get_root_id(), 0, 0, image.get_width(), image.get_height(), base);
+    ResidualCoder::encode(image, base, output, threads);
+}
+
+void Compressor::encode_predicted_tiles(const SpectreTree& tree, std::vector<uint8_t>& output) {
+    RangeEncoder encoder(output);
+    TileColorCoder coder;
+    
+    uint32_t width, height;
+    tree.get_dimensions(width, height);
+    encode_predicted_tile(tree, tree.get_root_id(), width, height,
+                          TileColorCoder::root_prediction(), false, encoder, coder);
+    
+    encoder.flush();
+}
+
+Color Compressor::encode_predicted_tile(
     const SpectreTree& tree,
-    const ColorData& image,
-    std::vector<uint8_t>& output) {
+    SpectreTile::ID id,
+    uint32_t width, uint32_t height,
+    const Color& prediction,
+    bool last_child,
+    RangeEncoder& encoder,
+    TileColorCoder& coder) {
     
-    // Simple serialization format:
-    // [Header: width(4) | height(4) | tile_count(4) | depth(2)]
-    // [Tile Data: id(4) | depth(2) | parent_id(4) | r(1) | g(1) | b(1) | child_count(1) | child_ids...]
+    int depth = tree.get_depth(id);
+    bool split = tree.is_subdivided(id);
+    coder.encode_split(encoder, depth, split);
     
-    output.clear();
+    // Tiles without pixels have no color to code; they take the prediction
+    uint64_t area = static_cast<uint64_t>(width) * height;
+    Color color = prediction;
+    if (area > 0) {
+        tree.get_color(id, color.r, color.g, color.b);
+        coder.encode_color(encoder, depth, !split, last_child, color, prediction);
+    }
     
-    // Write header
-    uint32_t width = image.get_width();
-    uint32_t height = image.get_height();
-    uint32_t tile_count = static_cast<uint32_t>(tree.get_tile_count());
-    uint16_t max_depth = static_cast<uint16_t>(tree.get_max_depth());
-    
-    output.push_back((width >> 24) & 0xFF);
-    output.push_back((width >> 16) & 0xFF);
-    output.push_back((width >> 8) & 0xFF);
-    output.push_back(width & 0xFF);
-    
-    output.push_back((height >> 24) & 0xFF);
-    output.push_back((height >> 16) & 0xFF);
-    output.push_back((height >> 8) & 0xFF);
-    output.push_back(height & 0xFF);
-    
-    output.push_back((tile_count >> 24) & 0xFF);
-    output.push_back((tile_count >> 16) & 0xFF);
-    output.push_back((tile_count >> 8) & 0xFF);
-    output.push_back(tile_count & 0xFF);
-    
-    output.push_back((max_depth >> 8) & 0xFF);
-    output.push_back(max_depth & 0xFF);
-    
-    // Serialize individual tiles using indexed format for efficiency
-    // Format for each tile: index(2) | depth(1) | parent_index(2) | r(1) | g(1) | b(1) | child_count(1) | [child_index(2)]...
-    // This reduces overhead from 22+ bytes to ~14 bytes per tile
-    auto all_tiles = tree.get_all_tiles();
-    std::map<SpectreTile::ID, uint16_t> id_to_index;
-    
-    // First pass: create index mapping
-    uint16_t index = 0;
-    for (SpectreTile::ID tile_id : all_tiles) {
-        id_to_index[tile_id] = index++;
-    }
-    
-    // Second pass: serialize tiles using indices
-    for (SpectreTile::ID tile_id : all_tiles) {
-        const SpectreTile* tile_ptr = tree.get_tile(tile_id);
-        if (!tile_ptr) continue;
-        
-        // Write tile index (uint16_t) - 2 bytes instead of 8
-        uint16_t tile_index = id_to_index[tile_id];
-        output.push_back((tile_index >> 8) & 0xFF);
-        output.push_back(tile_index & 0xFF);
+    if (split) {
+        // Pre-order, as in the implicit format
+        SpectreTile::ID first_child = tree.get_first_child(id);
+        TileColorCoder::SiblingSums siblings;
         
-        // Write depth (uint8_t) - 1 byte instead of 2 (max 255 levels)
-        int depth = tile_ptr->get_depth();
-        output.push_back(static_cast<uint8_t>(depth & 0xFF));
-        
-        // Write parent index (uint16_t) - 2 bytes instead of 8
-        SpectreTile::ID parent_id = tile_ptr->get_parent_id();
-        uint16_t parent_index = (parent_id > 0 && id_to_index.count(parent_id)) 
-                               ? id_to_index[parent_id] 
-                               : 0xFFFF;  // 0xFFFF means no parent (root)
-        output.push_back((parent_index >> 8) & 0xFF);
-        output.push_back(parent_index & 0xFF);
-        
-        // Write color (3 bytes: r, g, b)
-        uint8_t r, g, b;
-        tile_ptr->get_color(r, g, b);
-        output.push_back(r);
-        output.push_back(g);
-        output.push_back(b);
-        
-        // Write child count and child IDs
-        const auto& children = tile_ptr->get_children();
-        uint8_t child_count = static_cast<uint8_t>(children.size());
-        output.push_back(child_count);
+        for (int k = 0; k < TileInflater::CHILDREN_PER_TILE; ++k) {
+            uint32_t child_x, child_y, child_width, child_height;
+            TileInflater::get_child_bounds(width, height, k, child_x, child_y, child_width, child_height);
+            uint64_t child_area = static_cast<uint64_t>(child_width) * child_height;
+            
+            bool last = k == TileInflater::CHILDREN_PER_TILE - 1;
+            Color child_prediction = color;
+            if (last && child_area > 0) {
+                child_prediction = TileColorCoder::predict_last_child(color, area, siblings, child_area);
+            }
+            
+            Color child_color = encode_predicted_tile(tree, first_child + static_cast<SpectreTile::ID>(k),
+                                                      child_width, child_height, child_prediction, last,
+                                                      encoder, coder);
+            siblings.add(child_color, child_area);
+        }
+    }
+    
+    return color;
+}
+
+void Compressor::encode_progressive_tiles(const SpectreTree& tree, std::vector<uint8_t>& output,
+                                          SerializeScratch& scratch) {
+    // The coder's models carry over from one depth to the next; only the
+    // range coder restarts, so every depth ends on a byte boundary
+    TileColorCoder coder;
+    std::vector<uint8_t>& level_bytes = scratch.level_bytes;
+    level_bytes.clear();
+    
+    uint32_t width, height;
+    tree.get_dimensions(width, height);
+    
+    // Depth 0 holds just the root
+    SpectreTile::ID root = tree.get_root_id();
+    Color root_color = TileColorCoder::root_prediction();
+    {
+        RangeEncoder encoder(level_bytes);
+        bool split = tree.is_subdivided(root);
+        coder.encode_split(encoder, 0, split);
+        if (static_cast<uint64_t>(width) * height > 0) {
+            tree.get_color(root, root_color.r, root_color.g, root_color.b);
+            coder.encode_color(encoder, 0, !split, false, root_color, TileColorCoder::root_prediction());
+        }
+        encoder.flush();
+    }
+    TreeStream::write_varint(level_bytes.size(), output);
+    output.insert(output.end(), level_bytes.begin(), level_bytes.end());
+    
+    // Split tiles of the depth just coded; their children form the next depth
+    std::vector<ProgressiveTile>& frontier = scratch.frontier;
+    frontier.clear();
+    if (tree.is_subdivided(root)) {
+        frontier.push_back({root, width, height, root_color});
+    }
+    std::vector<ProgressiveTile>& next_frontier = scratch.next_frontier;
+    
+    for (int depth = 1; !frontier.empty(); ++depth) {
+        level_bytes.clear();
+        next_frontier.clear();
+        RangeEncoder encoder(level_bytes);
         
-        for (SpectreTile::ID child_id : children) {
-            // Write child index (uint16_t) - 2 bytes instead of 8
-            uint16_t child_index = id_to_index.count(child_id) ? id_to_index[child_id] : 0xFFFF;
-            output.push_back((child_index >> 8) & 0xFF);
-            output.push_back(child_index & 0xFF);
+        for (const ProgressiveTile& parent : frontier) {
+            SpectreTile::ID first_child = tree.get_first_child(parent.id);
+            uint64_t area = static_cast<uint64_t>(parent.width) * parent.height;
+            TileColorCoder::SiblingSums siblings;
+            
+            for (int k = 0; k < TileInflater::CHILDREN_PER_TILE; ++k) {
+                SpectreTile::ID child = first_child + static_cast<SpectreTile::ID>(k);
+                uint32_t child_x, child_y, child_width, child_height;
+                TileInflater::get_child_bounds(parent.width, parent.height, k,
+                                               child_x, child_y, child_width, child_height);
+                uint64_t child_area = static_cast<uint64_t>(child_width) * child_height;
+                
+                bool last = k == TileInflater::CHILDREN_PER_TILE - 1;
+                Color prediction = parent.color;
+                if (last && child_area > 0) {
+                    prediction = TileColorCoder::predict_last_child(parent.color, area, siblings, child_area);
+                }
+                
+                bool split = tree.is_subdivided(child);
+                coder.encode_split(encoder, depth, split);
+                
+                Color color = prediction;
+                if (child_area > 0) {
+                    tree.get_color(child, color.r, color.g, color.b);
+                    coder.encode_color(encoder, depth, !split, last, color, prediction);
+                }
+                siblings.add(color, child_area);
+                
+                if (split) {
+                    next_frontier.push_back({child, child_width, child_height, color});
+                }
+            }
         }
+        
+        encoder.flush();
+        TreeStream::write_varint(level_bytes.size(), output);
+        output.insert(output.end(), level_bytes.begin(), level_bytes.end());
+        frontier.swap(next_frontier);
     }
 }
 
-void Compressor::apply_entropy_coding(std::vector<uint8_t>& data) {
+void Compressor::apply_entropy_coding(std::vector<uint8_t>& data, ExecutionContext& context) {
     // Use the new adaptive entropy encoder to select the best compression strategy
     if (data.empty()) {
         return;
     }
     
-    // Apply adaptive encoding that tries multiple codecs and picks the best one
-    data = AdaptiveEncoder::encode(data, config_.prefer_speed);
+    // Range-coded streams leave nothing for a byte codec to find
+    // (and progressive streams must stay readable when truncated)
+    if (TreeStream::has_magic(data.data(), data.size()) &&
+        (data[3] == TreeStream::VERSION_PREDICTED || data[3] == TreeStream::VERSION_PROGRESSIVE ||
+         data[3] == TreeStream::VERSION_LOSSLESS)) {
+        data.insert(data.begin(), static_cast<uint8_t>(EntropyCodec::NONE));
+        entropy_stats_ = {data.size() - 1, data.size(), 1.0f, EntropyCodec::NONE};
+        return;
+    }
     
-    // Store entropy statistics
-    entropy_stats_ = AdaptiveEncoder::get_stats();
+    // Apply adaptive encoding that tries multiple codecs and picks the best one;
+    // statistics come back per call, so concurrent compressors don't race
+    std::vector<uint8_t>& stream = context.stream_scratch();
+    stream.swap(data);
+    AdaptiveEncoder::encode_into(stream, adaptive_options(context), entropy_stats_, data, context.entropy_scratch());
 }
 
 } // namespace spectre
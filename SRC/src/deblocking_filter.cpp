@@ -0,0 +1,173 @@
+#include "deblocking_filter.h"
+#include "execution_context.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+namespace spectre {
+
+static constexpr uint32_t CHUNK_PIXELS = 16;     // Pixels compared per memcmp
+static constexpr uint32_t STRIPE_COLUMNS = 256;  // Columns per task in the column pass
+static constexpr uint32_t NO_EDGE = std::numeric_limits<uint32_t>::max();
+
+static inline bool same_color(const Color& a, const Color& b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+static inline bool is_soft_step(const Color& a, const Color& b, uint8_t threshold) {
+    return std::abs(a.r - b.r) <= threshold &&
+           std::abs(a.g - b.g) <= threshold &&
+           std::abs(a.b - b.b) <= threshold;
+}
+
+static inline uint8_t mix(uint8_t a, uint8_t b, uint32_t weight, uint32_t span) {
+    return static_cast<uint8_t>((a * (span - weight) + b * weight + span / 2) / span);
+}
+
+// Replace the r pixels before and r pixels from `at` (spaced `step` apart)
+// with a linear ramp from a to b, sampled at pixel centres
+static void blend_ramp(Color* at, ptrdiff_t step, uint32_t r, Color a, Color b) {
+    uint32_t span = 4 * r;
+    Color* p = at - static_cast<ptrdiff_t>(r) * step;
+    for (uint32_t i = 0; i < 2 * r; ++i, p += step) {
+        uint32_t weight = 2 * i + 1;
+        *p = Color(mix(a.r, b.r, weight, span), mix(a.g, b.g, weight, span), mix(a.b, b.b, weight, span));
+    }
+}
+
+// Ramp half-width for an edge between runs of the given lengths
+static inline uint32_t ramp_radius(uint32_t radius, uint32_t before, uint32_t after) {
+    return std::min(radius, std::min(before, after) / 2);
+}
+
+// Smooth across horizontal tile edges. Rows are swept top to bottom; an edge
+// is filtered once the next edge in its column (or the bottom) is found, by
+// which point only rows above the sweep are written, so the rows still to
+// be compared are original.
+static void filter_columns(ColorData& image, const DeblockingConfig& config, int threads) {
+    uint32_t width = image.get_width();
+    uint32_t height = image.get_height();
+    ptrdiff_t stride = static_cast<ptrdiff_t>(width);
+    
+    std::vector<uint32_t> run_start(width, 0);    // First row of the run above the pending edge
+    std::vector<uint32_t> pending(width, NO_EDGE);  // Row of the last edge found
+    
+    auto settle = [&](uint32_t x, uint32_t next_edge) {
+        uint32_t edge = pending[x];
+        if (edge == NO_EDGE) {
+            return;
+        }
+        uint32_t r = ramp_radius(config.radius, edge - run_start[x], next_edge - edge);
+        run_start[x] = edge;
+        
+        Color* at = image.row(edge) + x;
+        Color above = at[-stride];
+        Color below = at[0];
+        if (r > 0 && is_soft_step(above, below, config.edge_threshold)) {
+            blend_ramp(at, stride, r, above, below);
+        }
+    };
+    
+    size_t stripe_count = (width + STRIPE_COLUMNS - 1) / STRIPE_COLUMNS;
+    
+#if ETCA_OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(threads)
+#else
+    (void)threads;
+#endif
+    for (size_t stripe = 0; stripe < stripe_count; ++stripe) {
+        uint32_t x_begin = static_cast<uint32_t>(stripe) * STRIPE_COLUMNS;
+        uint32_t x_end = std::min(width, x_begin + STRIPE_COLUMNS);
+        
+        for (uint32_t y = 1; y < height; ++y) {
+            const Color* above = image.row(y - 1);
+            const Color* current = image.row(y);
+            
+            for (uint32_t x0 = x_begin; x0 < x_end; x0 += CHUNK_PIXELS) {
+                uint32_t n = std::min(CHUNK_PIXELS, x_end - x0);
+                if (std::memcmp(above + x0, current + x0, n * sizeof(Color)) == 0) {
+                    continue;  // Inside tiles along this whole chunk
+                }
+                for (uint32_t x = x0; x < x0 + n; ++x) {
+                    if (!same_color(above[x], current[x])) {
+                        settle(x, y);
+                        pending[x] = y;
+                    }
+                }
+            }
+        }
+        
+        for (uint32_t x = x_begin; x < x_end; ++x) {
+            settle(x, height);
+        }
+    }
+}
+
+// Smooth across vertical tile edges, one row at a time
+static void filter_rows(ColorData& image, const DeblockingConfig& config, int threads) {
+    uint32_t width = image.get_width();
+    uint32_t height = image.get_height();
+    
+#if ETCA_OPENMP
+    #pragma omp parallel num_threads(threads)
+#else
+    (void)threads;
+#endif
+    {
+        std::vector<uint32_t> edges;
+        
+#if ETCA_OPENMP
+        #pragma omp for schedule(dynamic, 16)
+#endif
+        for (uint32_t y = 0; y < height; ++y) {
+            Color* row = image.row(y);
+            
+            // Edge at x: row[x - 1] and row[x] differ
+            edges.clear();
+            for (uint32_t x0 = 1; x0 < width; x0 += CHUNK_PIXELS) {
+                uint32_t n = std::min(CHUNK_PIXELS, width - x0);
+                if (std::memcmp(row + x0 - 1, row + x0, n * sizeof(Color)) == 0) {
+                    continue;
+                }
+                for (uint32_t x = x0; x < x0 + n; ++x) {
+                    if (!same_color(row[x - 1], row[x])) {
+                        edges.push_back(x);
+                    }
+                }
+            }
+            
+            // Ramps stay within half of each run, so earlier ones never reach
+            // the pixels a later edge reads
+            for (size_t i = 0; i < edges.size(); ++i) {
+                uint32_t edge = edges[i];
+                uint32_t before = edge - (i > 0 ? edges[i - 1] : 0);
+                uint32_t after = (i + 1 < edges.size() ? edges[i + 1] : width) - edge;
+                uint32_t r = ramp_radius(config.radius, before, after);
+                
+                Color left = row[edge - 1];
+                Color right = row[edge];
+                if (r > 0 && is_soft_step(left, right, config.edge_threshold)) {
+                    blend_ramp(row + edge, 1, r, left, right);
+                }
+            }
+        }
+    }
+}
+
+void DeblockingFilter::apply(ColorData& image, const DeblockingConfig& config, int threads) {
+    if (config.radius == 0 || image.get_width() == 0 || image.get_height() == 0) {
+        return;
+    }
+    
+    // The column pass leaves rows piecewise flat (pixels sharing the tiles
+    // above and below an edge get the same ramp), so the row pass still
+    // finds runs by comparing neighbours
+    threads = ExecutionContext::resolve_threads(threads);
+    filter_columns(image, config, threads);
+    filter_rows(image, config, threads);
+}
+
+} // namespace spectre
@@ -1,5 +1,10 @@
 #include "decompressor.h"
 #include "tile_inflater.h"
+#include "tree_stream.h"
+#include "tile_color_coder.h"
+#include "deblocking_filter.h"
+#include "residual_coder.h"
+#include "profiler.h"
 #include <functional>
 #include <algorithm>
 #if ETCA_OPENMP
@@ -21,7 +26,6 @@ static void calculate_tile_bounds(
     
     // Get the hierarchical address for this tile
     HierarchicalAddress address = tree.get_address(tile_id);
-    const auto& address_segments = address.get_address();
     
     // Start with the root tile covering the entire image
     uint32_t current_x = 0;
@@ -30,13 +34,13 @@ static void calculate_tile_bounds(
     uint32_t current_height = image_height;
     
     // Traverse the address to get the final bounds
-    for (uint32_t segment : address_segments) {
+    for (size_t level = 0; level < address.get_depth(); ++level) {
         uint32_t child_x, child_y, child_width, child_height;
         
         // Use TileInflater to get child bounds
         TileInflater::get_child_bounds(
             current_width, current_height,
-            static_cast<int>(segment),
+            static_cast<int>(address.get_segment(level)),
             child_x, child_y, child_width, child_height
         );
         
@@ -60,44 +64,119 @@ ColorData Decompressor::decompress(const CompressedImage& compressed) {
 ColorData Decompressor::decompress(
     const CompressedImage& compressed,
     bool should_interpolate,
-    int /*max_depth*/) {
+    int max_depth) {
     
-    // Deserialize the tree from compressed data
-    auto tree = deserialize_tree(compressed.data, compressed.width, compressed.height);
-    
-    if (!tree) {
-        // Return blank image on failure
-        return ColorData(compressed.width, compressed.height);
-    }
+    return decompress(ByteSpan(compressed.data), compressed.width, compressed.height,
+                      should_interpolate, max_depth);
+}
+
+ColorData Decompressor::decompress(
+    ByteSpan data,
+    uint32_t width,
+    uint32_t height,
+    bool should_interpolate,
+    int max_depth) {
     
-    // Reconstruct the image from the tree
-    ColorData image = reconstruct_image(*tree, should_interpolate);
+    ExecutionContext context;
+    return decompress(data, width, height, should_interpolate, max_depth, context);
+}
+
+ColorData Decompressor::decompress(
+    ByteSpan data,
+    uint32_t width,
+    uint32_t height,
+    bool should_interpolate,
+    int max_depth,
+    ExecutionContext& context) {
     
+    ColorData image(width, height);
+    decompress_into(data, width, height, image, context, should_interpolate, max_depth);
     return image;
 }
 
-std::unique_ptr<SpectreTree> Decompressor::deserialize_tree(
-    const std::vector<uint8_t>& data,
+bool Decompressor::decompress_into(
+    ByteSpan data,
     uint32_t width,
-    uint32_t height) {
+    uint32_t height,
+    ColorData& image,
+    ExecutionContext& context,
+    bool should_interpolate,
+    int max_depth) {
     
-    // Create empty tree
-    auto tree = std::make_unique<SpectreTree>(width, height);
+    if (image.get_width() != width || image.get_height() != height) {
+        image = ColorData(width, height);
+    }
+    
+    bool ok = decompress_into(data, image.mutable_view(), context, max_depth);
     
+    if (should_interpolate) {
+        ProfileScope scope(context.get_profiler(), "deblock");
+        apply_interpolation(image, context.get_threads());
+    }
+    
+    return ok;
+}
+
+bool Decompressor::decompress_into(
+    ByteSpan data,
+    const MutableImageView& image,
+    ExecutionContext& context,
+    int max_depth) {
+    
+    Profiler* profiler = context.get_profiler();
+    
+    ByteSpan stream;
+    {
+        ProfileScope scope(profiler, "entropy_decode");
+        stream = decode_entropy_layer(data, context.stream_scratch(), context.entropy_scratch(), context.get_threads());
+    }
+    if (profiler != nullptr) {
+        profiler->add("entropy_decode.bytes_in", data.size());
+        profiler->add("entropy_decode.bytes_out", stream.size());
+    }
+    
+    ProfileScope scope(profiler, "rasterize");
+    if (TreeStream::has_magic(stream.data(), stream.size())) {
+        // Paint leaves straight from the stream; a malformed stream leaves
+        // the undecoded area untouched (progressive streams stay coarse instead)
+        return rasterize_stream(stream, max_depth, image, context.get_threads());
+    }
+    
+    // Legacy indexed streams still go through a tree and an image of their own
+    auto tree = deserialize_tree(stream, image.get_width(), image.get_height());
+    image.copy_region(reconstruct_image(*tree, false, context.get_threads()).view(), 0, 0);
+    return true;
+}
+
+ByteSpan Decompressor::decode_entropy_layer(ByteSpan data, std::vector<uint8_t>& storage) {
+    EntropyScratch scratch;
+    return decode_entropy_layer(data, storage, scratch);
+}
+
+ByteSpan Decompressor::decode_entropy_layer(ByteSpan data, std::vector<uint8_t>& storage, EntropyScratch& scratch,
+                                            int threads) {
+    storage.clear();
     if (data.empty()) {
-        return tree;
+        return {};
+    }
+    
+    // Unencoded streams are viewed in place, past the marker
+    if (data[0] == static_cast<uint8_t>(EntropyCodec::NONE)) {
+        return data.subspan(1);
     }
     
     // Try to decode with the new entropy decoding system
     // Check if the first byte is an entropy codec marker
-    std::vector<uint8_t> decoded_data;
+    std::vector<uint8_t>& decoded_data = storage;
     
-    if (data[0] == static_cast<uint8_t>(EntropyCodec::NONE) ||
-        data[0] == static_cast<uint8_t>(EntropyCodec::RLE) ||
+    if (data[0] == static_cast<uint8_t>(EntropyCodec::RLE) ||
         data[0] == static_cast<uint8_t>(EntropyCodec::DEFLATE) ||
-        data[0] == static_cast<uint8_t>(EntropyCodec::ADVANCED)) {
+        data[0] == static_cast<uint8_t>(EntropyCodec::ADVANCED) ||
+        data[0] == static_cast<uint8_t>(EntropyCodec::HUFFMAN) ||
+        data[0] == static_cast<uint8_t>(EntropyCodec::ZLIB) ||
+        data[0] == static_cast<uint8_t>(EntropyCodec::CHUNKED)) {
         // New entropy encoding detected - decode it
-        decoded_data = AdaptiveEncoder::decode(data);
+        AdaptiveEncoder::decode_into(data, decoded_data, scratch, threads);
     } else if (data[0] == 0x01 || data[0] == 0x00) {
         // Old format encoding (legacy RLE support)
         if (data[0] == 0x01) {
@@ -136,9 +215,21 @@ std::unique_ptr<SpectreTree> Decompressor::deserialize_tree(
         }
     } else {
         // Unknown format - assume unencoded
-        decoded_data = data;
+        return data;
     }
     
+    return ByteSpan(decoded_data);
+}
+
+std::unique_ptr<SpectreTree> Decompressor::deserialize_tree(
+    ByteSpan decoded_data,
+    uint32_t width,
+    uint32_t height) {
+    
+    // Create empty tree
+    auto tree = std::make_unique<SpectreTree>(width, height);
+    
+    // Legacy indexed format (version 1)
     if (decoded_data.size() < 14) {
         // Not enough data for header
         return tree;
@@ -176,8 +267,13 @@ std::unique_ptr<SpectreTree> Decompressor::deserialize_tree(
     
     // Parse tile records using new compact index-based format
     // Format: index(2) | depth(1) | parent_index(2) | r(1) | g(1) | b(1) | child_count(1) | [child_index(2)]...
-    std::vector<uint64_t> index_to_id(tile_count);  // Map tile index to actual tile ID
-    std::map<uint64_t, std::pair<uint64_t, uint32_t>> tile_to_parent_and_position;  // Map: tile_id -> (parent_id, child_position)
+    struct TileRecord {
+        uint8_t r = 0, g = 0, b = 0;
+        bool present = false;
+        bool has_parent = false;
+        std::vector<uint16_t> children;
+    };
+    std::vector<TileRecord> records(tile_count);
     
     for (uint32_t i = 0; i < tile_count && data_offset < decoded_data.size(); ++i) {
         // Each tile needs at least: index(2) + depth(1) + parent_index(2) + r(1) + g(1) + b(1) + child_count(1) = 9 bytes
@@ -190,21 +286,14 @@ std::unique_ptr<SpectreTree> Decompressor::deserialize_tree(
                              static_cast<uint16_t>(decoded_data[data_offset+1] & 0xFF));
         data_offset += 2;
         
-        // Convert index to tile ID (use index + 1 to match compressor's ID scheme where root=1)
-        uint64_t tile_id = static_cast<uint64_t>(tile_index) + 1;
-        index_to_id[tile_index] = tile_id;
-        
-        // Parse depth (uint8_t)
-        int tile_depth = static_cast<int>(decoded_data[data_offset++]);
+        // Skip depth (uint8_t); it is implied by the tile's position in the tree
+        data_offset += 1;
         
         // Parse parent index (uint16_t)
         uint16_t parent_index = static_cast<uint16_t>((static_cast<uint16_t>(decoded_data[data_offset] & 0xFF) << 8) |
                                static_cast<uint16_t>(decoded_data[data_offset+1] & 0xFF));
         data_offset += 2;
         
-        // Convert parent index to parent ID
-        uint64_t parent_id = (parent_index == 0xFFFF) ? 0 : (static_cast<uint64_t>(parent_index) + 1);
-        
         // Parse color (r, g, b)
         uint8_t r = decoded_data[data_offset++];
         uint8_t g = decoded_data[data_offset++];
@@ -213,56 +302,354 @@ std::unique_ptr<SpectreTree> Decompressor::deserialize_tree(
         // Parse child count
         uint8_t child_count = decoded_data[data_offset++];
         
-        // Parse child indices and convert to IDs, track their positions
-        std::vector<uint64_t> children;
         if (data_offset + (child_count * 2) > decoded_data.size()) {
             // Not enough data for all children
             break;
         }
         
+        std::vector<uint16_t> children;
         for (uint8_t j = 0; j < child_count; ++j) {
             uint16_t child_index = static_cast<uint16_t>((static_cast<uint16_t>(decoded_data[data_offset] & 0xFF) << 8) |
                                   static_cast<uint16_t>(decoded_data[data_offset+1] & 0xFF));
             data_offset += 2;
-            uint64_t child_id = (child_index == 0xFFFF) ? 0 : (static_cast<uint64_t>(child_index) + 1);
-            children.push_back(child_id);
-            
-            // Track: child appears at position j in parent tile_id
-            tile_to_parent_and_position[child_id] = {tile_id, j};
+            children.push_back(child_index);
         }
         
-        // Add tile to tree
-        tree->add_deserialized_tile(tile_id, tile_depth, parent_id, r, g, b, children);
+        if (tile_index >= records.size()) {
+            continue;  // Corrupt index
+        }
+        
+        TileRecord& record = records[tile_index];
+        record.r = r;
+        record.g = g;
+        record.b = b;
+        record.present = true;
+        record.has_parent = parent_index != 0xFFFF;
+        record.children = std::move(children);
     }
     
-    // Reconstruct hierarchical addresses for ALL tiles from parent-child relationships
-    // Build address for each tile by traversing up to root
-    for (const auto& [tile_id, parent_and_pos] : tile_to_parent_and_position) {
-        std::vector<uint32_t> address_path;
-        uint64_t current_id = tile_id;
-        
-        // Traverse up to root, collecting positions
-        while (tile_to_parent_and_position.count(current_id)) {
-            const auto& [parent_id, position] = tile_to_parent_and_position[current_id];
-            address_path.push_back(position);
-            current_id = parent_id;
+    // Find the root record (the only tile without a parent)
+    size_t root_index = records.size();
+    for (size_t i = 0; i < records.size(); ++i) {
+        if (records[i].present && !records[i].has_parent) {
+            root_index = i;
+            break;
         }
+    }
+    if (root_index == records.size()) {
+        return tree;
+    }
+    
+    // Rebuild the tree top-down; a child's position in its parent's list is
+    // its position in the new child block, which also defines its address
+    std::vector<std::pair<size_t, SpectreTile::ID>> pending = {{root_index, tree->get_root_id()}};
+    std::vector<bool> visited(records.size(), false);
+    visited[root_index] = true;
+    
+    while (!pending.empty()) {
+        auto [record_index, tile_id] = pending.back();
+        pending.pop_back();
+        
+        const TileRecord& record = records[record_index];
+        tree->set_color(tile_id, record.r, record.g, record.b);
         
-        // Reverse to get path from root to tile
-        std::reverse(address_path.begin(), address_path.end());
+        if (record.children.empty()) {
+            continue;
+        }
         
-        // Set the reconstructed address
-        HierarchicalAddress reconstructed_address(address_path);
-        tree->set_tile_address(tile_id, reconstructed_address);
+        SpectreTile::ID first_child = tree->subdivide(tile_id);
+        size_t child_slots = std::min(record.children.size(),
+                                      static_cast<size_t>(TileInflater::CHILDREN_PER_TILE));
+        for (size_t k = 0; k < child_slots; ++k) {
+            uint16_t child_index = record.children[k];
+            if (child_index < records.size() && records[child_index].present && !visited[child_index]) {
+                visited[child_index] = true;
+                pending.push_back({child_index, first_child + k});
+            }
+        }
     }
     
-    // Root tile should have empty address (already set correctly)
     return tree;
 }
 
+bool Decompressor::rasterize_stream(ByteSpan stream, int max_depth, const MutableImageView& image,
+                                    int threads) {
+    TreeStream::Header header;
+    size_t offset = 0;
+    if (!TreeStream::read_header(stream.data(), stream.size(), header, offset) ||
+        header.width != image.get_width() || header.height != image.get_height() ||
+        header.tile_count == 0) {
+        return false;
+    }
+    
+    if (header.version == TreeStream::VERSION_PROGRESSIVE) {
+        return rasterize_progressive(stream.subspan(offset), header, max_depth, image);
+    }
+    if (header.version == TreeStream::VERSION_LOSSLESS) {
+        return rasterize_lossless(stream.subspan(offset), header, max_depth, image, threads);
+    }
+    if (header.version == TreeStream::VERSION_PREDICTED) {
+        int lod_depth = max_depth < 0 ? header.max_depth : std::min(max_depth, static_cast<int>(header.max_depth));
+        PredictedCursor cursor{RangeDecoder(stream.data() + offset, stream.size() - offset),
+                               TileColorCoder(), header.tile_count, 0, header.max_depth, lod_depth};
+        Color root_color;
+        return rasterize_predicted_tile(cursor, 0, 0, image.get_width(), image.get_height(), 0,
+                                        TileColorCoder::root_prediction(), false, root_color, image) &&
+               cursor.next_tile == header.tile_count;
+    }
+    if (header.version != TreeStream::VERSION_IMPLICIT) {
+        return false;
+    }
+    
+    // Reject counts the payload cannot hold before sizing anything from them
+    uint64_t tile_count = header.tile_count;
+    if (tile_count > static_cast<uint64_t>(stream.size() - offset) * 8) {
+        return false;
+    }
+    size_t color_offset = offset + static_cast<size_t>(TreeStream::split_flag_bytes(tile_count));
+    if (color_offset + TreeStream::leaf_count(tile_count) * 3 > stream.size()) {
+        return false;
+    }
+    
+    StreamCursor cursor{stream.data() + offset, stream.data() + color_offset, tile_count, 0, header.max_depth};
+    return rasterize_tile(cursor, 0, 0, image.get_width(), image.get_height(), 0, image) &&
+           cursor.next_tile == tile_count;
+}
+
+bool Decompressor::rasterize_tile(
+    StreamCursor& cursor,
+    uint32_t x, uint32_t y,
+    uint32_t width, uint32_t height,
+    int depth,
+    const MutableImageView& image) {
+    
+    // The depth bound keeps a corrupt stream from recursing without limit
+    if (cursor.next_tile >= cursor.tile_count || depth > cursor.max_depth) {
+        return false;
+    }
+    
+    uint64_t tile_index = cursor.next_tile++;
+    bool split = (cursor.split_flags[tile_index / 8] >> (7 - tile_index % 8)) & 1;
+    
+    if (!split) {
+        image.fill_region(x, y, width, height, Color(cursor.colors[0], cursor.colors[1], cursor.colors[2]));
+        cursor.colors += 3;
+        return true;
+    }
+    
+    for (int i = 0; i < TileInflater::CHILDREN_PER_TILE; ++i) {
+        uint32_t child_x, child_y, child_width, child_height;
+        TileInflater::get_child_bounds(width, height, i, child_x, child_y, child_width, child_height);
+        
+        if (!rasterize_tile(cursor, x + child_x, y + child_y, child_width, child_height, depth + 1, image)) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+bool Decompressor::rasterize_predicted_tile(
+    PredictedCursor& cursor,
+    uint32_t x, uint32_t y,
+    uint32_t width, uint32_t height,
+    int depth,
+    const Color& prediction,
+    bool last_child,
+    Color& decoded_color,
+    const MutableImageView& image) {
+    
+    if (cursor.next_tile >= cursor.tile_count || depth > cursor.max_depth) {
+        return false;
+    }
+    cursor.next_tile++;
+    
+    bool split = cursor.coder.decode_split(cursor.decoder, depth);
+    Color color = prediction;
+    if (width > 0 && height > 0) {
+        color = cursor.coder.decode_color(cursor.decoder, depth, !split, last_child, prediction);
+    }
+    
+    // Running out of data means the tile count in the header is a lie
+    if (cursor.decoder.exhausted()) {
+        return false;
+    }
+    
+    decoded_color = color;
+    if (depth <= cursor.lod_depth && (!split || depth == cursor.lod_depth)) {
+        image.fill_region(x, y, width, height, color);
+    }
+    if (!split) {
+        return true;
+    }
+    
+    uint64_t area = static_cast<uint64_t>(width) * height;
+    TileColorCoder::SiblingSums siblings;
+    
+    for (int i = 0; i < TileInflater::CHILDREN_PER_TILE; ++i) {
+        uint32_t child_x, child_y, child_width, child_height;
+        TileInflater::get_child_bounds(width, height, i, child_x, child_y, child_width, child_height);
+        uint64_t child_area = static_cast<uint64_t>(child_width) * child_height;
+        
+        bool last = i == TileInflater::CHILDREN_PER_TILE - 1;
+        Color child_prediction = color;
+        if (last && child_area > 0) {
+            child_prediction = TileColorCoder::predict_last_child(color, area, siblings, child_area);
+        }
+        
+        Color child_color;
+        if (!rasterize_predicted_tile(cursor, x + child_x, y + child_y, child_width, child_height,
+                                      depth + 1, child_prediction, last, child_color, image)) {
+            return false;
+        }
+        siblings.add(child_color, child_area);
+    }
+    
+    return true;
+}
+
+bool Decompressor::rasterize_lossless(
+    ByteSpan payload,
+    const TreeStream::Header& header,
+    int max_depth,
+    const MutableImageView& image,
+    int threads) {
+    
+    size_t offset = 0;
+    uint64_t base_size = 0;
+    if (!TreeStream::read_varint(payload.data(), payload.size(), offset, base_size) ||
+        base_size > payload.size() - offset) {
+        return false;
+    }
+    
+    // Residuals are differences from the complete base layer, so a preview stops before them
+    if (!rasterize_progressive(payload.subspan(offset, static_cast<size_t>(base_size)), header, max_depth, image)) {
+        return false;
+    }
+    if (max_depth >= 0 && max_depth < header.max_depth) {
+        return true;
+    }
+    
+    return ResidualCoder::decode(payload.subspan(offset + static_cast<size_t>(base_size)), image, threads);
+}
+
+bool Decompressor::rasterize_progressive(
+    ByteSpan payload,
+    const TreeStream::Header& header,
+    int max_depth,
+    const MutableImageView& image) {
+    
+    int last_depth = max_depth < 0 ? header.max_depth : std::min(max_depth, static_cast<int>(header.max_depth));
+    TileColorCoder coder;
+    size_t offset = 0;
+    uint64_t decoded_tiles = 0;
+    
+    // Split tiles of the depth just decoded, painted only if decoding stops there
+    std::vector<ProgressiveTile> frontier;
+    std::vector<ProgressiveTile> next_frontier;
+    auto paint_frontier = [&image](const std::vector<ProgressiveTile>& tiles) {
+        for (const ProgressiveTile& tile : tiles) {
+            image.fill_region(tile.x, tile.y, tile.width, tile.height, tile.color);
+        }
+    };
+    
+    // Depth 0: the root alone
+    uint64_t block_size = 0;
+    if (!TreeStream::read_varint(payload.data(), payload.size(), offset, block_size) ||
+        block_size > payload.size() - offset) {
+        return false;
+    }
+    {
+        RangeDecoder decoder(payload.data() + offset, static_cast<size_t>(block_size));
+        bool split = coder.decode_split(decoder, 0);
+        Color color = TileColorCoder::root_prediction();
+        if (image.get_width() > 0 && image.get_height() > 0) {
+            color = coder.decode_color(decoder, 0, !split, false, color);
+        }
+        if (decoder.exhausted()) {
+            return false;
+        }
+        offset += static_cast<size_t>(block_size);
+        ++decoded_tiles;
+        
+        if (split && last_depth > 0) {
+            frontier.push_back({0, 0, image.get_width(), image.get_height(), color});
+        } else {
+            image.fill_region(0, 0, image.get_width(), image.get_height(), color);
+        }
+    }
+    
+    for (int depth = 1; !frontier.empty(); ++depth) {
+        // A missing block ends the preview at the previous depth
+        if (!TreeStream::read_varint(payload.data(), payload.size(), offset, block_size) ||
+            block_size > payload.size() - offset) {
+            paint_frontier(frontier);
+            return false;
+        }
+        
+        RangeDecoder decoder(payload.data() + offset, static_cast<size_t>(block_size));
+        offset += static_cast<size_t>(block_size);
+        next_frontier.clear();
+        
+        // Leaves are painted as they come, split tiles wait for their children
+        bool stop_here = depth == last_depth;
+        for (const ProgressiveTile& parent : frontier) {
+            uint64_t area = static_cast<uint64_t>(parent.width) * parent.height;
+            TileColorCoder::SiblingSums siblings;
+            
+            decoded_tiles += TileInflater::CHILDREN_PER_TILE;
+            if (decoded_tiles > header.tile_count) {
+                paint_frontier(frontier);
+                return false;
+            }
+            
+            for (int k = 0; k < TileInflater::CHILDREN_PER_TILE; ++k) {
+                uint32_t child_x, child_y, child_width, child_height;
+                TileInflater::get_child_bounds(parent.width, parent.height, k,
+                                               child_x, child_y, child_width, child_height);
+                uint64_t child_area = static_cast<uint64_t>(child_width) * child_height;
+                
+                bool last = k == TileInflater::CHILDREN_PER_TILE - 1;
+                Color prediction = parent.color;
+                if (last && child_area > 0) {
+                    prediction = TileColorCoder::predict_last_child(parent.color, area, siblings, child_area);
+                }
+                
+                bool split = coder.decode_split(decoder, depth);
+                Color color = prediction;
+                if (child_area > 0) {
+                    color = coder.decode_color(decoder, depth, !split, last, prediction);
+                }
+                siblings.add(color, child_area);
+                
+                ProgressiveTile child{parent.x + child_x, parent.y + child_y, child_width, child_height, color};
+                if (split && !stop_here) {
+                    next_frontier.push_back(child);
+                } else {
+                    image.fill_region(child.x, child.y, child.width, child.height, color);
+                }
+            }
+        }
+        
+        // A damaged block is discarded whole: repaint its parents
+        if (decoder.exhausted()) {
+            paint_frontier(frontier);
+            return false;
+        }
+        
+        if (stop_here) {
+            return depth < header.max_depth || decoded_tiles == header.tile_count;
+        }
+        frontier.swap(next_frontier);
+    }
+    
+    return decoded_tiles == header.tile_count;
+}
+
 ColorData Decompressor::reconstruct_image(
     const SpectreTree& tree,
-    bool should_interpolate) {
+    bool should_interpolate,
+    int threads) {
     
     uint32_t width, height;
     tree.get_dimensions(width, height);
@@ -275,15 +662,15 @@ ColorData Decompressor::reconstruct_image(
     // For each leaf, paint its region with its color using proper spatial mapping
     // Parallelize leaf processing since each tile is independent
 #if ETCA_OPENMP
-    #pragma omp parallel for
+    #pragma omp parallel for num_threads(threads)
+#else
+    (void)threads;
 #endif
     for (size_t leaf_idx = 0; leaf_idx < leaves.size(); ++leaf_idx) {
         auto leaf_id = leaves[leaf_idx];
-        const SpectreTile* tile = tree.get_tile(leaf_id);
-        if (!tile) continue;
         
         uint8_t r, g, b;
-        tile->get_color(r, g, b);
+        tree.get_color(leaf_id, r, g, b);
         Color tile_color(r, g, b);
         
         // Calculate tile bounds based on hierarchical address
@@ -291,93 +678,21 @@ ColorData Decompressor::reconstruct_image(
         calculate_tile_bounds(tree, leaf_id, width, height,
                              tile_x, tile_y, tile_width, tile_height);
         
-        // Fill the tile region with its color
-        uint32_t end_x = tile_x + tile_width;
-        uint32_t end_y = tile_y + tile_height;
-        
-        // Clamp to image bounds
-        if (end_x > width) end_x = width;
-        if (end_y > height) end_y = height;
-        
-        // Parallelize pixel assignment within each tile
-#if ETCA_OPENMP
-        #pragma omp parallel for collapse(2)
-#endif
-        for (uint32_t x = tile_x; x < end_x; ++x) {
-            for (uint32_t y = tile_y; y < end_y; ++y) {
-                image.set_pixel(x, y, tile_color);
-            }
-        }
+        // Leaves are disjoint, so threads never write the same rows
+        image.fill_region(tile_x, tile_y, tile_width, tile_height, tile_color);
     }
     
     // Apply interpolation if requested
     if (should_interpolate) {
-        apply_interpolation(image);
+        apply_interpolation(image, threads);
     }
     
     return image;
 }
 
-void Decompressor::apply_interpolation(ColorData& image) {
-    // Apply bilinear interpolation at tile boundaries to reduce blocking artifacts
-    // This smooths transitions between tiles with different colors
-    
-    uint32_t width = image.get_width();
-    uint32_t height = image.get_height();
-    
-    // Create a duplicate for reading while we write
-    ColorData interpolated = image;
-    
-    // Apply interpolation kernel: average nearby pixels with weighted blending
-    // For simplicity, use a 3x3 kernel that blurs boundaries slightly
-    const float BLEND_STRENGTH = 0.5f;
-    
-    for (uint32_t y = 0; y < height; ++y) {
-        for (uint32_t x = 0; x < width; ++x) {
-            // Get center pixel
-            Color center = image.get_pixel(x, y);
-            
-            // Accumulate weighted colors from neighbors
-            float blend_r = center.r * (1.0f - BLEND_STRENGTH);
-            float blend_g = center.g * (1.0f - BLEND_STRENGTH);
-            float blend_b = center.b * (1.0f - BLEND_STRENGTH);
-            
-            float weight_sum = 1.0f - BLEND_STRENGTH;
-            
-            // Sample neighbors with reduced weight
-            const float neighbor_weight = BLEND_STRENGTH / 8.0f;
-            
-            // 8-connected neighbors
-            int neighbors_x[] = {-1,  0,  1, -1,  1, -1,  0,  1};
-            int neighbors_y[] = {-1, -1, -1,  0,  0,  1,  1,  1};
-            
-            for (int i = 0; i < 8; ++i) {
-                int nx = static_cast<int>(x) + neighbors_x[i];
-                int ny = static_cast<int>(y) + neighbors_y[i];
-                
-                if (nx >= 0 && nx < static_cast<int>(width) &&
-                    ny >= 0 && ny < static_cast<int>(height)) {
-                    Color neighbor = image.get_pixel(static_cast<uint32_t>(nx), static_cast<uint32_t>(ny));
-                    blend_r += neighbor.r * neighbor_weight;
-                    blend_g += neighbor.g * neighbor_weight;
-                    blend_b += neighbor.b * neighbor_weight;
-                    weight_sum += neighbor_weight;
-                }
-            }
-            
-            // Normalize and clamp to [0, 255]
-            if (weight_sum > 0) {
-                uint8_t final_r = static_cast<uint8_t>(blend_r / weight_sum);
-                uint8_t final_g = static_cast<uint8_t>(blend_g / weight_sum);
-                uint8_t final_b = static_cast<uint8_t>(blend_b / weight_sum);
-                
-                interpolated.set_pixel(x, y, Color(final_r, final_g, final_b));
-            }
-        }
-    }
-    
-    // Replace original with interpolated
-    image = interpolated;
+void Decompressor::apply_interpolation(ColorData& image, int threads) {
+    // Smooth the seams between tiles; interiors are flat and left alone
+    DeblockingFilter::apply(image, DeblockingConfig(), threads);
 }
 
 } // namespace spectre
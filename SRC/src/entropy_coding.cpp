@@ -1,9 +1,16 @@
 #include "entropy_coding.h"
+#include "execution_context.h"
+#include "profiler.h"
 #include <algorithm>
 #include <queue>
+#include <functional>
 #include <bitset>
 #include <cstring>
 #include <iostream>
+#include <zlib.h>
+#if ETCA_OPENMP
+#include <omp.h>
+#endif
 
 namespace spectre {
 
@@ -11,17 +18,16 @@ namespace spectre {
 // RLECodec Implementation
 // ============================================================================
 
-std::vector<uint8_t> RLECodec::encode(const std::vector<uint8_t>& input) {
+void RLECodec::encode_into(const std::vector<uint8_t>& input, std::vector<uint8_t>& encoded) {
     stats_.original_size = input.size();
     
+    encoded.clear();
+    encoded.push_back(static_cast<uint8_t>(EntropyCodec::RLE));
     if (input.empty()) {
         stats_.compressed_size = 1;
-        return {static_cast<uint8_t>(EntropyCodec::RLE)};
+        return;
     }
     
-    std::vector<uint8_t> encoded;
-    encoded.push_back(static_cast<uint8_t>(EntropyCodec::RLE));
-    
     const uint8_t RLE_MARKER = 0xFF;
     size_t i = 0;
     
@@ -36,7 +42,9 @@ std::vector<uint8_t> RLECodec::encode(const std::vector<uint8_t>& input) {
             run_length++;
         }
         
-        if (run_length >= 4) {
+        // Runs of the marker byte stay escaped literals: MARKER | MARKER
+        // would read back as an escape rather than a run
+        if (run_length >= 4 && current != RLE_MARKER) {
             // Encode as RLE: MARKER | byte_value | count
             encoded.push_back(RLE_MARKER);
             encoded.push_back(current);
@@ -58,15 +66,13 @@ std::vector<uint8_t> RLECodec::encode(const std::vector<uint8_t>& input) {
     stats_.codec_used = EntropyCodec::RLE;
     stats_.compression_ratio = static_cast<float>(stats_.original_size) / 
                                std::max(1.0f, static_cast<float>(stats_.compressed_size));
-    
-    return encoded;
 }
 
-std::vector<uint8_t> RLECodec::decode(const std::vector<uint8_t>& input) {
-    std::vector<uint8_t> decoded;
+void RLECodec::decode_into(ByteSpan input, std::vector<uint8_t>& decoded) {
+    decoded.clear();
     
     if (input.empty() || input[0] != static_cast<uint8_t>(EntropyCodec::RLE)) {
-        return decoded;
+        return;
     }
     
     const uint8_t RLE_MARKER = 0xFF;
@@ -97,188 +103,395 @@ std::vector<uint8_t> RLECodec::decode(const std::vector<uint8_t>& input) {
             i++;
         }
     }
-    
-    return decoded;
 }
 
 // ============================================================================
 // HuffmanCodec Implementation
 // ============================================================================
 
-std::shared_ptr<HuffmanNode> HuffmanCodec::build_tree(const std::vector<uint32_t>& frequencies) {
-    // Priority queue: {frequency, node}
-    auto cmp = [](const std::pair<uint32_t, std::shared_ptr<HuffmanNode>>& a,
-                  const std::pair<uint32_t, std::shared_ptr<HuffmanNode>>& b) {
-        return a.first > b.first;  // Min-heap
-    };
-    std::priority_queue<std::pair<uint32_t, std::shared_ptr<HuffmanNode>>,
-                        std::vector<std::pair<uint32_t, std::shared_ptr<HuffmanNode>>>,
-                        decltype(cmp)> pq(cmp);
-    
-    // Create leaf nodes for all bytes that appear in the data
-    for (size_t i = 0; i < frequencies.size(); ++i) {
+std::vector<uint8_t> HuffmanCodec::build_code_lengths(const std::vector<uint64_t>& frequencies) {
+    std::vector<uint8_t> lengths(SYMBOL_COUNT, 0);
+    
+    // Nodes 0-255 are symbols, the rest are merged internal nodes
+    std::vector<int> parent(SYMBOL_COUNT * 2, -1);
+    using HeapItem = std::pair<uint64_t, int>;
+    std::priority_queue<HeapItem, std::vector<HeapItem>, std::greater<HeapItem>> heap;
+    
+    for (size_t i = 0; i < SYMBOL_COUNT; ++i) {
         if (frequencies[i] > 0) {
-            auto node = std::make_shared<HuffmanNode>(static_cast<uint8_t>(i), frequencies[i]);
-            pq.push({frequencies[i], node});
+            heap.push({frequencies[i], static_cast<int>(i)});
         }
     }
     
-    // Special case: only one unique byte
-    if (pq.size() == 1) {
-        auto node = pq.top().second;
-        auto root = std::make_shared<HuffmanNode>(0, node->frequency);
-        root->left = node;
-        return root;
+    if (heap.empty()) {
+        return lengths;
+    }
+    if (heap.size() == 1) {
+        // A lone symbol still needs a 1-bit code
+        lengths[static_cast<size_t>(heap.top().second)] = 1;
+        return lengths;
     }
     
-    // Build tree bottom-up
-    while (pq.size() > 1) {
-        auto left = pq.top().second;
-        pq.pop();
-        auto right = pq.top().second;
-        pq.pop();
+    int next_node = static_cast<int>(SYMBOL_COUNT);
+    while (heap.size() > 1) {
+        HeapItem left = heap.top();
+        heap.pop();
+        HeapItem right = heap.top();
+        heap.pop();
         
-        auto parent = std::make_shared<HuffmanNode>(0, left->frequency + right->frequency);
-        parent->left = left;
-        parent->right = right;
+        parent[static_cast<size_t>(left.second)] = next_node;
+        parent[static_cast<size_t>(right.second)] = next_node;
+        heap.push({left.first + right.first, next_node++});
+    }
+    
+    // Ordered by falling frequency, used to adjust lengths below
+    std::vector<size_t> symbols;
+    for (size_t i = 0; i < SYMBOL_COUNT; ++i) {
+        if (frequencies[i] == 0) {
+            continue;
+        }
         
-        pq.push({parent->frequency, parent});
+        int depth = 0;
+        for (int node = parent[i]; node != -1; node = parent[static_cast<size_t>(node)]) {
+            ++depth;
+        }
+        lengths[i] = static_cast<uint8_t>(std::min(depth, MAX_CODE_LENGTH));
+        symbols.push_back(i);
+    }
+    std::stable_sort(symbols.begin(), symbols.end(), [&frequencies](size_t a, size_t b) {
+        return frequencies[a] > frequencies[b];
+    });
+    
+    // Clamping can over-subscribe the code space (Kraft sum above 1, measured
+    // here in units of 2^-MAX_CODE_LENGTH). Lengthen the rarest short codes
+    // until it fits, then give any space left back to the most frequent ones.
+    const uint64_t capacity = uint64_t(1) << MAX_CODE_LENGTH;
+    uint64_t kraft = 0;
+    for (size_t symbol : symbols) {
+        kraft += capacity >> lengths[symbol];
     }
     
-    return pq.empty() ? nullptr : pq.top().second;
+    while (kraft > capacity) {
+        for (auto it = symbols.rbegin(); it != symbols.rend(); ++it) {
+            if (lengths[*it] < MAX_CODE_LENGTH) {
+                lengths[*it]++;
+                kraft -= capacity >> lengths[*it];
+                break;
+            }
+        }
+    }
+    
+    for (size_t symbol : symbols) {
+        while (lengths[symbol] > 1 && kraft + (capacity >> lengths[symbol]) <= capacity) {
+            kraft += capacity >> lengths[symbol];
+            lengths[symbol]--;
+        }
+    }
+    
+    return lengths;
 }
 
-void HuffmanCodec::generate_codes(const std::shared_ptr<HuffmanNode>& node,
-                                   const std::string& code,
-                                   std::map<uint8_t, std::string>& codes) {
-    if (!node) return;
-    
-    if (!node->left && !node->right) {
-        // Leaf node
-        codes[node->value] = code.empty() ? "0" : code;
-        return;
+bool HuffmanCodec::build_canonical_codes(const std::vector<uint8_t>& lengths, std::vector<uint32_t>& codes) {
+    uint32_t length_count[MAX_CODE_LENGTH + 1] = {0};
+    for (uint8_t length : lengths) {
+        if (length > MAX_CODE_LENGTH) {
+            return false;
+        }
+        length_count[length]++;
     }
+    length_count[0] = 0;
     
-    if (node->left) {
-        generate_codes(node->left, code + "0", codes);
+    // First code of each length, as in DEFLATE
+    uint32_t next_code[MAX_CODE_LENGTH + 1] = {0};
+    uint32_t code = 0;
+    for (int length = 1; length <= MAX_CODE_LENGTH; ++length) {
+        code = (code + length_count[length - 1]) << 1;
+        next_code[length] = code;
+        if (code + length_count[length] > (uint32_t(1) << length)) {
+            return false;
+        }
     }
-    if (node->right) {
-        generate_codes(node->right, code + "1", codes);
+    
+    codes.assign(lengths.size(), 0);
+    for (size_t symbol = 0; symbol < lengths.size(); ++symbol) {
+        if (lengths[symbol] > 0) {
+            codes[symbol] = next_code[lengths[symbol]]++;
+        }
     }
+    
+    return true;
 }
 
-std::vector<uint8_t> HuffmanCodec::encode(const std::vector<uint8_t>& input) {
+void HuffmanCodec::encode_into(const std::vector<uint8_t>& input, std::vector<uint8_t>& encoded) {
     stats_.original_size = input.size();
     
-    if (input.empty()) {
-        stats_.compressed_size = 1;
-        return {static_cast<uint8_t>(EntropyCodec::NONE)};
+    encoded.clear();
+    encoded.reserve(HEADER_SIZE + input.size());
+    encoded.push_back(static_cast<uint8_t>(EntropyCodec::HUFFMAN));
+    
+    uint64_t size = input.size();
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        encoded.push_back(static_cast<uint8_t>(size >> shift));
     }
     
     // Analyze byte frequencies
-    std::vector<uint32_t> frequencies(256, 0);
+    std::vector<uint64_t> frequencies(SYMBOL_COUNT, 0);
     for (uint8_t byte : input) {
         frequencies[byte]++;
     }
     
-    // Build Huffman tree
-    auto root = build_tree(frequencies);
-    if (!root) {
-        stats_.compressed_size = input.size() + 1;
-        return input;  // Fallback
-    }
+    std::vector<uint8_t> lengths = build_code_lengths(frequencies);
+    std::vector<uint32_t> codes;
+    build_canonical_codes(lengths, codes);
     
-    // Generate codes
-    huffman_codes_.clear();
-    generate_codes(root, "", huffman_codes_);
+    // Code lengths, two per byte
+    for (size_t i = 0; i < SYMBOL_COUNT; i += 2) {
+        encoded.push_back(static_cast<uint8_t>((lengths[i] << 4) | lengths[i + 1]));
+    }
     
-    // Encode data (simple approach: just use RLE instead for now, Huffman is complex)
-    // A full Huffman implementation would encode bit sequences
-    // For now, return RLE-encoded as fallback
-    RLECodec rle;
-    auto result = rle.encode(input);
+    BitWriter writer(encoded);
+    for (uint8_t byte : input) {
+        writer.write(codes[byte], lengths[byte]);
+    }
+    writer.flush();
     
-    stats_.compressed_size = result.size();
-    stats_.codec_used = EntropyCodec::RLE;  // Using RLE as approximation
+    stats_.compressed_size = encoded.size();
+    stats_.codec_used = EntropyCodec::HUFFMAN;
     stats_.compression_ratio = static_cast<float>(stats_.original_size) / 
                                std::max(1.0f, static_cast<float>(stats_.compressed_size));
-    
-    return result;
 }
 
-std::vector<uint8_t> HuffmanCodec::decode(const std::vector<uint8_t>& input) {
-    // For now, delegate to RLE since "encode" returns RLE data
-    RLECodec rle;
-    return rle.decode(input);
+void HuffmanCodec::decode_into(ByteSpan input, std::vector<uint8_t>& decoded) {
+    decoded.clear();
+    if (input.size() < HEADER_SIZE || input[0] != static_cast<uint8_t>(EntropyCodec::HUFFMAN)) {
+        return;
+    }
+    
+    uint64_t size = 0;
+    for (size_t i = 1; i <= 8; ++i) {
+        size = (size << 8) | input[i];
+    }
+    
+    // Every code is at least one bit long
+    const uint8_t* payload = input.data() + HEADER_SIZE;
+    size_t payload_size = input.size() - HEADER_SIZE;
+    if (size > static_cast<uint64_t>(payload_size) * 8) {
+        return;
+    }
+    
+    std::vector<uint8_t> lengths(SYMBOL_COUNT);
+    for (size_t i = 0; i < SYMBOL_COUNT; i += 2) {
+        uint8_t packed = input[9 + i / 2];
+        lengths[i] = static_cast<uint8_t>(packed >> 4);
+        lengths[i + 1] = static_cast<uint8_t>(packed & 0x0F);
+    }
+    
+    std::vector<uint32_t> codes;
+    if (!build_canonical_codes(lengths, codes)) {
+        return;
+    }
+    
+    // Single-code table first: every slot whose prefix is a code maps to it
+    const size_t table_size = size_t(1) << MAX_CODE_LENGTH;
+    std::vector<DecodeEntry> table(table_size, DecodeEntry{{0, 0}, 0, 0, 0});
+    for (size_t symbol = 0; symbol < SYMBOL_COUNT; ++symbol) {
+        int length = lengths[symbol];
+        if (length == 0) {
+            continue;
+        }
+        size_t first = static_cast<size_t>(codes[symbol]) << (MAX_CODE_LENGTH - length);
+        size_t last = first + (size_t(1) << (MAX_CODE_LENGTH - length));
+        for (size_t slot = first; slot < last; ++slot) {
+            table[slot] = DecodeEntry{{static_cast<uint8_t>(symbol), 0},
+                                      static_cast<uint8_t>(length), static_cast<uint8_t>(length), 1};
+        }
+    }
+    
+    // Then pair each slot with the next code if its remaining bits hold all of it
+    for (size_t slot = 0; slot < table_size; ++slot) {
+        DecodeEntry& entry = table[slot];
+        if (entry.symbol_count == 0) {
+            continue;
+        }
+        const DecodeEntry& next = table[(slot << entry.first_length) & (table_size - 1)];
+        if (next.first_length > 0 && entry.first_length + next.first_length <= MAX_CODE_LENGTH) {
+            entry.symbols[1] = next.symbols[0];
+            entry.total_length = static_cast<uint8_t>(entry.first_length + next.first_length);
+            entry.symbol_count = 2;
+        }
+    }
+    
+    decoded.resize(static_cast<size_t>(size));
+    BitReader reader(payload, payload_size);
+    size_t out = 0;
+    
+    while (out < decoded.size()) {
+        const DecodeEntry& entry = table[reader.peek(MAX_CODE_LENGTH)];
+        if (entry.symbol_count == 0) {
+            decoded.clear();  // Bits match no code
+            return;
+        }
+        
+        decoded[out++] = entry.symbols[0];
+        if (entry.symbol_count == 2 && out < decoded.size()) {
+            decoded[out++] = entry.symbols[1];
+            reader.consume(entry.total_length);
+        } else {
+            reader.consume(entry.first_length);
+        }
+        
+        if (reader.exhausted()) {
+            decoded.clear();
+            return;
+        }
+    }
 }
 
 // ============================================================================
 // DeflateCodec Implementation
 // ============================================================================
 
-DeflateCodec::DeflateCodec(uint16_t window_size, uint16_t max_match_len)
-    : window_size_(window_size), max_match_len_(max_match_len) {
+/**
+ * @brief Match finder settings for one compression level
+ */
+struct DeflateLevelParams {
+    uint32_t max_chain;
+    uint16_t nice_length;
+    bool lazy_matching;
+};
+
+static const DeflateLevelParams DEFLATE_LEVELS[DeflateCodec::MAX_LEVEL] = {
+    {4, 16, false},     // 1
+    {8, 32, false},     // 2
+    {16, 32, false},    // 3
+    {16, 64, true},     // 4
+    {32, 128, true},    // 5
+    {64, 128, true},    // 6
+    {128, 258, true},   // 7
+    {512, 258, true},   // 8
+    {4096, 258, true},  // 9
+};
+
+DeflateCodec::DeflateCodec(uint16_t window_size, uint16_t max_match_len, int level)
+    : window_size_(std::max<uint16_t>(window_size, 1)), max_match_len_(max_match_len) {
+    
+    const DeflateLevelParams& params =
+        DEFLATE_LEVELS[std::clamp(level, MIN_LEVEL, MAX_LEVEL) - MIN_LEVEL];
+    max_chain_ = params.max_chain;
+    nice_length_ = std::min(params.nice_length, max_match_len_);
+    lazy_matching_ = params.lazy_matching;
+}
+
+uint32_t DeflateCodec::hash_at(const std::vector<uint8_t>& data, size_t pos) {
+    uint32_t value = (static_cast<uint32_t>(data[pos]) << 16) |
+                     (static_cast<uint32_t>(data[pos + 1]) << 8) |
+                     static_cast<uint32_t>(data[pos + 2]);
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+void DeflateCodec::insert_position(const std::vector<uint8_t>& data, size_t pos) {
+    if (pos + 2 >= data.size()) {
+        return;
+    }
+    
+    uint32_t hash = hash_at(data, pos);
+    hash_prev_[pos % window_size_] = hash_head_[hash];
+    hash_head_[hash] = static_cast<int64_t>(pos);
 }
 
 std::pair<uint16_t, uint16_t> DeflateCodec::find_match(
     const std::vector<uint8_t>& data,
-    size_t pos,
-    uint16_t window_size) {
+    size_t pos) {
     
-    if (pos == 0) return {0, 0};
+    if (pos == 0 || pos + 2 >= data.size()) return {0, 0};
     
-    size_t window_start = (pos > window_size) ? (pos - window_size) : 0;
+    size_t max_len = std::min<size_t>(max_match_len_, data.size() - pos);
     size_t match_len = 0;
     size_t best_distance = 0;
     
-    // Try to find matches in the sliding window
-    for (size_t i = window_start; i < pos; ++i) {
-        size_t len = 0;
-        while (pos + len < data.size() && 
-               i + len < pos &&
-               data[i + len] == data[pos + len] &&
-               len < max_match_len_) {
-            len++;
+    // Walk candidates from nearest to farthest; chain entries older than
+    // the window may have been overwritten, so stop at the window edge.
+    // Matches may overlap pos (the decoder copies byte by byte).
+    int64_t candidate = hash_head_[hash_at(data, pos)];
+    for (uint32_t chain = max_chain_; candidate >= 0 && chain > 0; --chain) {
+        size_t i = static_cast<size_t>(candidate);
+        if (i >= pos || pos - i > window_size_ || match_len >= max_len) {
+            break;
         }
         
-        if (len > match_len) {
-            match_len = len;
-            best_distance = pos - i;
+        // Only candidates that could beat the current best are compared in full
+        if (data[i + match_len] == data[pos + match_len]) {
+            size_t len = 0;
+            while (len < max_len && data[i + len] == data[pos + len]) {
+                len++;
+            }
+            
+            if (len > match_len) {
+                match_len = len;
+                best_distance = pos - i;
+                if (len >= nice_length_) {
+                    break;
+                }
+            }
         }
+        
+        candidate = hash_prev_[i % window_size_];
     }
     
-    // Only return match if it's at least 3 bytes
-    if (match_len >= 3) {
+    if (match_len >= MIN_MATCH_LENGTH) {
         return {static_cast<uint16_t>(match_len), static_cast<uint16_t>(best_distance)};
     } else {
         return {0, 0};
     }
 }
 
-std::vector<uint8_t> DeflateCodec::encode(const std::vector<uint8_t>& input) {
+void DeflateCodec::encode_into(const std::vector<uint8_t>& input, std::vector<uint8_t>& encoded) {
     stats_.original_size = input.size();
     
-    std::vector<uint8_t> encoded;
+    encoded.clear();
     encoded.push_back(static_cast<uint8_t>(EntropyCodec::DEFLATE));
     
     if (input.empty()) {
         stats_.compressed_size = 1;
-        return encoded;
+        return;
     }
     
+    encoded.reserve(input.size() / 2 + 16);
+    hash_head_.assign(size_t(1) << HASH_BITS, -1);
+    hash_prev_.assign(window_size_, -1);
+    
     size_t i = 0;
     const uint8_t MATCH_MARKER = 0xFF;
     
+    // Match found for position i by the previous lazy-matching lookahead
+    bool have_next = false;
+    std::pair<uint16_t, uint16_t> next_match{0, 0};
+    
     while (i < input.size()) {
-        auto [match_len, distance] = find_match(input, i, window_size_);
+        auto [match_len, distance] = have_next ? next_match : find_match(input, i);
+        have_next = false;
+        insert_position(input, i);
+        
+        // Lazy matching: emit a literal instead if the next byte starts a longer match
+        if (match_len > 0 && lazy_matching_ && match_len < nice_length_) {
+            next_match = find_match(input, i + 1);
+            if (next_match.first > match_len) {
+                have_next = true;
+                match_len = 0;
+            }
+        }
         
         if (match_len > 0) {
             // Encode match: MARKER | length_hi | length_lo | dist_hi | dist_lo
             encoded.push_back(MATCH_MARKER);
-            encoded.push_back((match_len >> 8) & 0xFF);
-            encoded.push_back(match_len & 0xFF);
-            encoded.push_back((distance >> 8) & 0xFF);
-            encoded.push_back(distance & 0xFF);
+            encoded.push_back(static_cast<uint8_t>(match_len >> 8));
+            encoded.push_back(static_cast<uint8_t>(match_len));
+            encoded.push_back(static_cast<uint8_t>(distance >> 8));
+            encoded.push_back(static_cast<uint8_t>(distance));
+            
+            for (size_t k = 1; k < match_len; ++k) {
+                insert_position(input, i + k);
+            }
             i += match_len;
         } else if (input[i] == MATCH_MARKER) {
             // Escape marker
@@ -296,15 +509,13 @@ std::vector<uint8_t> DeflateCodec::encode(const std::vector<uint8_t>& input) {
     stats_.codec_used = EntropyCodec::DEFLATE;
     stats_.compression_ratio = static_cast<float>(stats_.original_size) / 
                                std::max(1.0f, static_cast<float>(stats_.compressed_size));
-    
-    return encoded;
 }
 
-std::vector<uint8_t> DeflateCodec::decode(const std::vector<uint8_t>& input) {
-    std::vector<uint8_t> decoded;
+void DeflateCodec::decode_into(ByteSpan input, std::vector<uint8_t>& decoded) {
+    decoded.clear();
     
     if (input.empty() || input[0] != static_cast<uint8_t>(EntropyCodec::DEFLATE)) {
-        return decoded;
+        return;
     }
     
     const uint8_t MATCH_MARKER = 0xFF;
@@ -341,162 +552,582 @@ std::vector<uint8_t> DeflateCodec::decode(const std::vector<uint8_t>& input) {
             i++;
         }
     }
+}
+
+// ============================================================================
+// ZlibCodec Implementation
+// ============================================================================
+
+ZlibCodec::ZlibCodec(int level, ZlibStrategy strategy)
+    : level_(std::clamp(level, Z_BEST_SPEED, Z_BEST_COMPRESSION)), strategy_(strategy) {
+}
+
+static int to_zlib_strategy(ZlibStrategy strategy) {
+    switch (strategy) {
+        case ZlibStrategy::FILTERED: return Z_FILTERED;
+        case ZlibStrategy::HUFFMAN_ONLY: return Z_HUFFMAN_ONLY;
+        case ZlibStrategy::RLE: return Z_RLE;
+        default: return Z_DEFAULT_STRATEGY;
+    }
+}
+
+// zlib counts bytes in uInt, so large buffers are fed in pieces
+static const size_t ZLIB_CHUNK = size_t(1) << 30;
+
+void ZlibCodec::encode_into(const std::vector<uint8_t>& input, std::vector<uint8_t>& encoded) {
+    stats_.original_size = input.size();
+    
+    encoded.clear();
+    encoded.push_back(static_cast<uint8_t>(EntropyCodec::ZLIB));
     
-    return decoded;
+    uint64_t size = input.size();
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        encoded.push_back(static_cast<uint8_t>(size >> shift));
+    }
+    
+    z_stream stream{};
+    if (deflateInit2(&stream, level_, Z_DEFLATED, 15, 8, to_zlib_strategy(strategy_)) != Z_OK) {
+        encoded.clear();
+        return;
+    }
+    
+    size_t bound = deflateBound(&stream, static_cast<uLong>(std::min(input.size(), ZLIB_CHUNK)));
+    encoded.resize(HEADER_SIZE + bound);
+    
+    size_t in_offset = 0;
+    size_t out_offset = HEADER_SIZE;
+    int result = Z_OK;
+    
+    while (result != Z_STREAM_END) {
+        if (stream.avail_in == 0 && in_offset < input.size()) {
+            size_t piece = std::min(input.size() - in_offset, ZLIB_CHUNK);
+            stream.next_in = const_cast<Bytef*>(input.data() + in_offset);
+            stream.avail_in = static_cast<uInt>(piece);
+            in_offset += piece;
+        }
+        if (out_offset == encoded.size()) {
+            encoded.resize(encoded.size() + std::max<size_t>(bound / 4, 4096));
+        }
+        
+        size_t room = std::min(encoded.size() - out_offset, ZLIB_CHUNK);
+        stream.next_out = encoded.data() + out_offset;
+        stream.avail_out = static_cast<uInt>(room);
+        
+        result = deflate(&stream, in_offset == input.size() ? Z_FINISH : Z_NO_FLUSH);
+        out_offset += room - stream.avail_out;
+        
+        if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR) {
+            deflateEnd(&stream);
+            encoded.clear();
+            return;
+        }
+    }
+    
+    deflateEnd(&stream);
+    encoded.resize(out_offset);
+    
+    stats_.compressed_size = encoded.size();
+    stats_.codec_used = EntropyCodec::ZLIB;
+    stats_.compression_ratio = static_cast<float>(stats_.original_size) / 
+                               std::max(1.0f, static_cast<float>(stats_.compressed_size));
+}
+
+void ZlibCodec::decode_into(ByteSpan input, std::vector<uint8_t>& decoded) {
+    decoded.clear();
+    if (input.size() < HEADER_SIZE || input[0] != static_cast<uint8_t>(EntropyCodec::ZLIB)) {
+        return;
+    }
+    
+    uint64_t size = 0;
+    for (size_t i = 1; i <= 8; ++i) {
+        size = (size << 8) | input[i];
+    }
+    
+    // DEFLATE cannot expand data by more than about 1032:1
+    size_t payload_size = input.size() - HEADER_SIZE;
+    if (size > static_cast<uint64_t>(payload_size) * 1032 + 64) {
+        return;
+    }
+    
+    z_stream stream{};
+    if (inflateInit(&stream) != Z_OK) {
+        return;
+    }
+    
+    decoded.resize(static_cast<size_t>(size));
+    size_t in_offset = HEADER_SIZE;
+    size_t out_offset = 0;
+    int result = Z_OK;
+    
+    while (result != Z_STREAM_END) {
+        if (stream.avail_in == 0 && in_offset < input.size()) {
+            size_t piece = std::min(input.size() - in_offset, ZLIB_CHUNK);
+            stream.next_in = const_cast<Bytef*>(input.data() + in_offset);
+            stream.avail_in = static_cast<uInt>(piece);
+            in_offset += piece;
+        }
+        
+        size_t room = std::min(decoded.size() - out_offset, ZLIB_CHUNK);
+        stream.next_out = decoded.data() + out_offset;
+        stream.avail_out = static_cast<uInt>(room);
+        
+        result = inflate(&stream, Z_NO_FLUSH);
+        out_offset += room - stream.avail_out;
+        
+        // Corrupt or truncated data, or more output than the stored size
+        if (result != Z_OK && result != Z_STREAM_END) {
+            inflateEnd(&stream);
+            decoded.clear();
+            return;
+        }
+    }
+    
+    inflateEnd(&stream);
+    if (out_offset != decoded.size()) {
+        decoded.clear();
+    }
 }
 
 // ============================================================================
 // AdvancedCodec Implementation
 // ============================================================================
 
-std::vector<uint8_t> AdvancedCodec::delta_encode(const std::vector<uint8_t>& input) {
-    if (input.empty()) return input;
+void AdvancedCodec::delta_encode(const std::vector<uint8_t>& input, std::vector<uint8_t>& output) {
+    output.resize(input.size());
+    if (input.empty()) return;
     
-    std::vector<uint8_t> encoded;
-    encoded.push_back(input[0]);  // Store first byte as-is
+    output[0] = input[0];  // Store first byte as-is
     
     for (size_t i = 1; i < input.size(); ++i) {
         // Store difference (with wrap-around for uint8)
-        uint8_t delta = input[i] - input[i - 1];
-        encoded.push_back(delta);
+        output[i] = static_cast<uint8_t>(input[i] - input[i - 1]);
     }
-    
-    return encoded;
 }
 
-std::vector<uint8_t> AdvancedCodec::delta_decode(const std::vector<uint8_t>& input) {
-    if (input.empty()) return input;
+void AdvancedCodec::delta_decode(const std::vector<uint8_t>& input, std::vector<uint8_t>& output) {
+    output.resize(input.size());
+    if (input.empty()) return;
     
-    std::vector<uint8_t> decoded;
-    decoded.push_back(input[0]);
+    output[0] = input[0];
     
     for (size_t i = 1; i < input.size(); ++i) {
         // Reconstruct original value from delta
-        uint8_t value = decoded[i - 1] + input[i];
-        decoded.push_back(value);
+        output[i] = static_cast<uint8_t>(output[i - 1] + input[i]);
     }
-    
-    return decoded;
 }
 
-std::vector<uint8_t> AdvancedCodec::encode(const std::vector<uint8_t>& input) {
+void AdvancedCodec::encode_into(const std::vector<uint8_t>& input, std::vector<uint8_t>& encoded) {
     stats_.original_size = input.size();
     
     if (input.empty()) {
         stats_.compressed_size = 1;
-        return {static_cast<uint8_t>(EntropyCodec::ADVANCED)};
+        encoded.assign(1, static_cast<uint8_t>(EntropyCodec::ADVANCED));
+        return;
     }
     
-    // Apply delta encoding first
-    auto delta_encoded = delta_encode(input);
-    
-    // Then apply deflate compression
-    DeflateCodec deflate(32768, 258);
-    auto deflate_result = deflate.encode(delta_encoded);
+    // Apply delta encoding first, then deflate compression
+    delta_encode(input, staging_);
+    deflate_.encode_into(staging_, encoded);
     
-    // Prepend Advanced codec marker
-    std::vector<uint8_t> result;
-    result.push_back(static_cast<uint8_t>(EntropyCodec::ADVANCED));
-    result.insert(result.end(), deflate_result.begin() + 1, deflate_result.end());  // Skip DEFLATE marker
+    // Same layout as a Deflate stream under the Advanced codec marker
+    encoded[0] = static_cast<uint8_t>(EntropyCodec::ADVANCED);
     
-    stats_.compressed_size = result.size();
+    stats_.compressed_size = encoded.size();
     stats_.codec_used = EntropyCodec::ADVANCED;
     stats_.compression_ratio = static_cast<float>(stats_.original_size) / 
                                std::max(1.0f, static_cast<float>(stats_.compressed_size));
-    
-    return result;
 }
 
-std::vector<uint8_t> AdvancedCodec::decode(const std::vector<uint8_t>& input) {
+void AdvancedCodec::decode_into(ByteSpan input, std::vector<uint8_t>& decoded) {
+    decoded.clear();
     if (input.empty() || input[0] != static_cast<uint8_t>(EntropyCodec::ADVANCED)) {
-        return {};
+        return;
     }
     
     // Reconstruct Deflate-encoded data
-    std::vector<uint8_t> deflate_input;
-    deflate_input.push_back(static_cast<uint8_t>(EntropyCodec::DEFLATE));
-    deflate_input.insert(deflate_input.end(), input.begin() + 1, input.end());
-    
-    // Decode with deflate
-    DeflateCodec deflate;
-    auto delta_decoded = deflate.decode(deflate_input);
+    decoded.push_back(static_cast<uint8_t>(EntropyCodec::DEFLATE));
+    decoded.insert(decoded.end(), input.begin() + 1, input.end());
     
-    // Decode delta
-    return delta_decode(delta_decoded);
+    // Decode with deflate, then undo the delta
+    deflate_.decode_into(decoded, staging_);
+    delta_decode(staging_, decoded);
 }
 
 // ============================================================================
 // AdaptiveEncoder Implementation
 // ============================================================================
 
-CompressionStats AdaptiveEncoder::last_stats_;
+const char* entropy_codec_name(EntropyCodec codec) {
+    switch (codec) {
+        case EntropyCodec::NONE: return "none";
+        case EntropyCodec::RLE: return "rle";
+        case EntropyCodec::DEFLATE: return "deflate";
+        case EntropyCodec::ADVANCED: return "advanced";
+        case EntropyCodec::HUFFMAN: return "huffman";
+        case EntropyCodec::ZLIB: return "zlib";
+        case EntropyCodec::CHUNKED: return "chunked";
+        default: return "none";
+    }
+}
 
-std::vector<uint8_t> AdaptiveEncoder::encode(const std::vector<uint8_t>& input, bool prefer_speed) {
+std::unique_ptr<EntropyCodec_Base> AdaptiveEncoder::create_codec(
+    EntropyCodec codec,
+    int level,
+    ZlibStrategy zlib_strategy) {
+    
+    switch (codec) {
+        case EntropyCodec::RLE:
+            return std::make_unique<RLECodec>();
+        case EntropyCodec::DEFLATE:
+            return std::make_unique<DeflateCodec>(32768, 258, level);
+        case EntropyCodec::ADVANCED:
+            return std::make_unique<AdvancedCodec>(level);
+        case EntropyCodec::HUFFMAN:
+            return std::make_unique<HuffmanCodec>();
+        case EntropyCodec::ZLIB:
+            return std::make_unique<ZlibCodec>(level, zlib_strategy);
+        default:
+            return nullptr;
+    }
+}
+
+void AdaptiveEncoder::shortlist_by_sampling(
+    const std::vector<uint8_t>& input,
+    EntropyCodec* candidates,
+    size_t& count,
+    const AdaptiveOptions& options,
+    EntropyScratch& scratch) {
+    
+    // Evenly spaced blocks, concatenated into one sample
+    std::vector<uint8_t>& sample = scratch.sample_buffer();
+    sample.clear();
+    sample.reserve(SAMPLE_BLOCK_COUNT * SAMPLE_BLOCK_SIZE);
+    size_t stride = input.size() / SAMPLE_BLOCK_COUNT;
+    for (size_t i = 0; i < SAMPLE_BLOCK_COUNT; ++i) {
+        auto begin = input.begin() + static_cast<std::ptrdiff_t>(i * stride);
+        sample.insert(sample.end(), begin, begin + static_cast<std::ptrdiff_t>(std::min(SAMPLE_BLOCK_SIZE, stride)));
+    }
+    
+    float ratios[MAX_CANDIDATES] = {};
+    
+    // Each candidate has its own codec and buffer in the scratch
+#if ETCA_OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(ExecutionContext::resolve_threads(options.threads))
+#endif
+    for (int i = 0; i < static_cast<int>(count); ++i) {
+        EntropyCodec candidate = candidates[static_cast<size_t>(i)];
+        EntropyCodec_Base* codec = scratch.encoder(candidate, options.level, options.zlib_strategy);
+        codec->encode_into(sample, scratch.trial_buffer(candidate));
+        ratios[static_cast<size_t>(i)] = codec->get_stats().compression_ratio;
+    }
+    
+    float best_ratio = *std::max_element(ratios, ratios + count);
+    
+    size_t kept = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (ratios[i] >= best_ratio * (1.0f - SAMPLE_MARGIN)) {
+            candidates[kept++] = candidates[i];
+        }
+    }
+    count = kept;
+}
+
+std::vector<uint8_t> AdaptiveEncoder::encode(
+    const std::vector<uint8_t>& input,
+    const AdaptiveOptions& options,
+    CompressionStats& stats) {
+    
+    EntropyScratch scratch;
+    std::vector<uint8_t> output;
+    encode_into(input, options, stats, output, scratch);
+    return output;
+}
+
+void AdaptiveEncoder::encode_into(
+    const std::vector<uint8_t>& input,
+    const AdaptiveOptions& options,
+    CompressionStats& stats,
+    std::vector<uint8_t>& output,
+    EntropyScratch& scratch) {
+    
     if (input.empty()) {
-        last_stats_ = {0, 1, 0.0f, EntropyCodec::NONE};
-        return {static_cast<uint8_t>(EntropyCodec::NONE)};
+        stats = {0, 1, 0.0f, EntropyCodec::NONE};
+        output.assign(1, static_cast<uint8_t>(EntropyCodec::NONE));
+        return;
+    }
+    if (options.block_size > 0 && input.size() > options.block_size) {
+        encode_chunked(input, options, stats, output, scratch);
+        return;
     }
     
-    std::vector<std::pair<std::vector<uint8_t>, const CompressionStats*>> results;
+    EntropyCodec candidates[MAX_CANDIDATES] = {EntropyCodec::RLE, EntropyCodec::HUFFMAN, EntropyCodec::ZLIB,
+                                               EntropyCodec::DEFLATE, EntropyCodec::ADVANCED};
+    size_t count = options.prefer_speed ? 3 : MAX_CANDIDATES;
     
-    // Try multiple codecs
-    RLECodec rle;
-    auto rle_result = rle.encode(input);
-    results.push_back({rle_result, &rle.get_stats()});
+    if (options.selection == CodecSelection::SAMPLED && input.size() >= SAMPLING_MIN_SIZE) {
+        ProfileScope scope(options.profiler, "codec_sampling");
+        shortlist_by_sampling(input, candidates, count, options, scratch);
+    }
     
-    if (!prefer_speed) {
-        DeflateCodec deflate;
-        auto deflate_result = deflate.encode(input);
-        results.push_back({deflate_result, &deflate.get_stats()});
+    // Full trials are independent, so run them side by side
+    CompressionStats result_stats[MAX_CANDIDATES];
+    
+#if ETCA_OPENMP
+    #pragma omp parallel for schedule(dynamic) if(count > 1) \
+        num_threads(ExecutionContext::resolve_threads(options.threads))
+#endif
+    for (int i = 0; i < static_cast<int>(count); ++i) {
+        EntropyCodec candidate = candidates[static_cast<size_t>(i)];
+        Profiler::Clock::time_point start;
+        if (options.profiler != nullptr) {
+            start = Profiler::Clock::now();
+        }
         
-        AdvancedCodec advanced;
-        auto advanced_result = advanced.encode(input);
-        results.push_back({advanced_result, &advanced.get_stats()});
+        EntropyCodec_Base* codec = scratch.encoder(candidate, options.level, options.zlib_strategy);
+        std::vector<uint8_t>& result = scratch.trial_buffer(candidate);
+        codec->encode_into(input, result);
+        result_stats[static_cast<size_t>(i)] = codec->get_stats();
+        
+        if (options.profiler != nullptr) {
+            std::string name = entropy_codec_name(candidate);
+            options.profiler->record("trial:" + name, "codec", start, Profiler::Clock::now());
+            options.profiler->add("codec." + name + ".bytes_in", input.size());
+            options.profiler->add("codec." + name + ".bytes_out", result.size());
+        }
     }
     
-    // Pick the codec with best compression ratio
+    // Pick the codec with best compression ratio (earlier candidates win ties)
     size_t best_idx = 0;
-    float best_ratio = results[0].second->compression_ratio;
-    
-    for (size_t i = 1; i < results.size(); ++i) {
-        if (results[i].second->compression_ratio > best_ratio) {
-            best_ratio = results[i].second->compression_ratio;
+    for (size_t i = 1; i < count; ++i) {
+        if (result_stats[i].compression_ratio > result_stats[best_idx].compression_ratio) {
             best_idx = i;
         }
     }
     
-    last_stats_ = *results[best_idx].second;
-    return results[best_idx].first;
+    // Trade buffers with the winner's slot, so both keep their capacity
+    stats = result_stats[best_idx];
+    output.swap(scratch.trial_buffer(candidates[best_idx]));
 }
 
-std::vector<uint8_t> AdaptiveEncoder::decode(const std::vector<uint8_t>& input) {
-    if (input.empty()) {
-        return {};
+void AdaptiveEncoder::encode_chunked(
+    const std::vector<uint8_t>& input,
+    const AdaptiveOptions& options,
+    CompressionStats& stats,
+    std::vector<uint8_t>& output,
+    EntropyScratch& scratch) {
+    
+    const size_t block_size = std::min(options.block_size, MAX_BLOCK_SIZE);
+    const size_t block_count = (input.size() + block_size - 1) / block_size;
+    const int threads = ExecutionContext::resolve_threads(options.threads);
+    
+    std::vector<EntropyScratch>& workers = scratch.workers(static_cast<size_t>(threads));
+    std::vector<std::vector<uint8_t>>& blocks = scratch.block_buffers();
+    blocks.resize(block_count);
+    
+    // The threads go to the blocks, so each block runs its trials serially
+    AdaptiveOptions block_options = options;
+    block_options.block_size = 0;
+    block_options.threads = 1;
+    
+#if ETCA_OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(threads)
+#endif
+    for (int64_t i = 0; i < static_cast<int64_t>(block_count); ++i) {
+#if ETCA_OPENMP
+        EntropyScratch& worker = workers[static_cast<size_t>(omp_get_thread_num())];
+#else
+        EntropyScratch& worker = workers[0];
+#endif
+        size_t begin = static_cast<size_t>(i) * block_size;
+        size_t end = std::min(begin + block_size, input.size());
+        std::vector<uint8_t>& block = worker.block_buffer();
+        block.assign(input.begin() + static_cast<std::ptrdiff_t>(begin), input.begin() + static_cast<std::ptrdiff_t>(end));
+        
+        CompressionStats block_stats;
+        encode_into(block, block_options, block_stats, blocks[static_cast<size_t>(i)], worker);
     }
     
-    EntropyCodec codec_type = static_cast<EntropyCodec>(input[0]);
+    size_t total = CHUNKED_HEADER_SIZE + 4 * block_count;
+    for (const std::vector<uint8_t>& block : blocks) {
+        total += block.size();
+    }
     
-    switch (codec_type) {
-        case EntropyCodec::RLE: {
-            RLECodec rle;
-            return rle.decode(input);
+    output.clear();
+    output.reserve(total);
+    output.push_back(static_cast<uint8_t>(EntropyCodec::CHUNKED));
+    uint64_t size = input.size();
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        output.push_back(static_cast<uint8_t>(size >> shift));
+    }
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        output.push_back(static_cast<uint8_t>(block_size >> shift));
+    }
+    for (const std::vector<uint8_t>& block : blocks) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            output.push_back(static_cast<uint8_t>(block.size() >> shift));
         }
-        case EntropyCodec::DEFLATE: {
-            DeflateCodec deflate;
-            return deflate.decode(input);
+    }
+    for (const std::vector<uint8_t>& block : blocks) {
+        output.insert(output.end(), block.begin(), block.end());
+    }
+    
+    stats.original_size = input.size();
+    stats.compressed_size = output.size();
+    stats.codec_used = EntropyCodec::CHUNKED;
+    stats.compression_ratio = static_cast<float>(stats.original_size) /
+                              std::max(1.0f, static_cast<float>(stats.compressed_size));
+}
+
+std::vector<uint8_t> AdaptiveEncoder::encode(const std::vector<uint8_t>& input, bool prefer_speed, int level) {
+    AdaptiveOptions options;
+    options.prefer_speed = prefer_speed;
+    options.level = level;
+    CompressionStats stats;
+    return encode(input, options, stats);
+}
+
+std::vector<uint8_t> AdaptiveEncoder::decode(ByteSpan input) {
+    EntropyScratch scratch;
+    std::vector<uint8_t> output;
+    decode_into(input, output, scratch);
+    return output;
+}
+
+void AdaptiveEncoder::decode_into(ByteSpan input, std::vector<uint8_t>& output, EntropyScratch& scratch, int threads) {
+    output.clear();
+    if (input.empty()) {
+        return;
+    }
+    if (input[0] == static_cast<uint8_t>(EntropyCodec::CHUNKED)) {
+        decode_chunked(input, output, scratch, threads);
+        return;
+    }
+    
+    EntropyCodec_Base* codec = scratch.decoder(static_cast<EntropyCodec>(input[0]));
+    if (codec) {
+        codec->decode_into(input, output);
+        return;
+    }
+    
+    if (input.size() > 1) {
+        output.assign(input.begin() + 1, input.end());
+    }
+}
+
+static uint64_t read_be(const uint8_t* data, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+void AdaptiveEncoder::decode_chunked(ByteSpan input, std::vector<uint8_t>& output, EntropyScratch& scratch,
+                                     int threads) {
+    if (input.size() < CHUNKED_HEADER_SIZE) {
+        return;
+    }
+    uint64_t original_size = read_be(input.data() + 1, 8);
+    uint64_t block_size = read_be(input.data() + 9, 4);
+    if (block_size == 0 || block_size > MAX_BLOCK_SIZE) {
+        return;
+    }
+    
+    // Every block takes at least a table entry and a codec marker
+    uint64_t block_count = (original_size + block_size - 1) / block_size;
+    if (block_count > (input.size() - CHUNKED_HEADER_SIZE) / 5) {
+        return;
+    }
+    
+    const uint8_t* table = input.data() + CHUNKED_HEADER_SIZE;
+    std::vector<uint64_t>& offsets = scratch.block_offsets();
+    offsets.resize(static_cast<size_t>(block_count) + 1);
+    
+    offsets[0] = CHUNKED_HEADER_SIZE + 4 * block_count;
+    for (uint64_t i = 0; i < block_count; ++i) {
+        offsets[i + 1] = offsets[i] + read_be(table + 4 * i, 4);
+    }
+    if (offsets[block_count] > input.size()) {
+        return;
+    }
+    
+    const int thread_count = ExecutionContext::resolve_threads(threads);
+    std::vector<EntropyScratch>& workers = scratch.workers(static_cast<size_t>(thread_count));
+    output.resize(static_cast<size_t>(original_size));
+    int failures = 0;
+    
+#if ETCA_OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(thread_count) reduction(+:failures)
+#endif
+    for (int64_t i = 0; i < static_cast<int64_t>(block_count); ++i) {
+#if ETCA_OPENMP
+        EntropyScratch& worker = workers[static_cast<size_t>(omp_get_thread_num())];
+#else
+        EntropyScratch& worker = workers[0];
+#endif
+        size_t index = static_cast<size_t>(i);
+        ByteSpan block = input.subspan(static_cast<size_t>(offsets[index]),
+                                       static_cast<size_t>(offsets[index + 1] - offsets[index]));
+        uint64_t begin = index * block_size;
+        uint64_t expected = std::min(block_size, original_size - begin);
+        
+        // Blocks never nest
+        std::vector<uint8_t>& decoded = worker.block_buffer();
+        if (block.empty() || block[0] == static_cast<uint8_t>(EntropyCodec::CHUNKED)) {
+            ++failures;
+            continue;
         }
-        case EntropyCodec::ADVANCED: {
-            AdvancedCodec advanced;
-            return advanced.decode(input);
+        decode_into(block, decoded, worker, 1);
+        if (decoded.size() != expected) {
+            ++failures;
+            continue;
         }
-        default:
-            return input.size() > 1 ? std::vector<uint8_t>(input.begin() + 1, input.end())
-                                    : std::vector<uint8_t>();
+        std::memcpy(output.data() + begin, decoded.data(), decoded.size());
     }
+    
+    if (failures > 0) {
+        output.clear();
+    }
+}
+
+// ============================================================================
+// EntropyScratch Implementation
+// ============================================================================
+
+EntropyCodec_Base* EntropyScratch::encoder(EntropyCodec codec, int level, ZlibStrategy zlib_strategy) {
+    Slot& slot = slots_[slot_of(codec)];
+    if (!slot.codec || slot.level != level || slot.zlib_strategy != zlib_strategy) {
+        slot.codec = AdaptiveEncoder::create_codec(codec, level, zlib_strategy);
+        slot.level = level;
+        slot.zlib_strategy = zlib_strategy;
+    }
+    return slot.codec.get();
 }
 
-const CompressionStats& AdaptiveEncoder::get_stats() {
-    return last_stats_;
+EntropyCodec_Base* EntropyScratch::decoder(EntropyCodec codec) {
+    Slot& slot = slots_[slot_of(codec)];
+    if (!slot.codec) {
+        return encoder(codec, DeflateCodec::DEFAULT_LEVEL, ZlibStrategy::DEFAULT);
+    }
+    return slot.codec.get();
+}
+
+std::vector<EntropyScratch>& EntropyScratch::workers(size_t count) {
+    if (workers_.size() < count) {
+        workers_.resize(count);
+    }
+    return workers_;
+}
+
+void EntropyScratch::release() {
+    for (Slot& slot : slots_) {
+        slot = Slot();
+    }
+    std::vector<uint8_t>().swap(sample_);
+    std::vector<EntropyScratch>().swap(workers_);
+    std::vector<std::vector<uint8_t>>().swap(blocks_);
+    std::vector<uint8_t>().swap(block_);
+    std::vector<uint64_t>().swap(offsets_);
 }
 
 } // namespace spectre
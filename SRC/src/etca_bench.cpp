@@ -0,0 +1,688 @@
+#include "compressor.h"
+#include "decompressor.h"
+#include "deblocking_filter.h"
+#include "entropy_coding.h"
+#include "etca_format.h"
+#include "execution_context.h"
+#include "image_io.h"
+#include "pixel_kernels.h"
+#include "profiler.h"
+#include "sequence_codec.h"
+#include "tree_stream.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using spectre::ColorData;
+using spectre::ExecutionContext;
+
+namespace {
+
+/**
+ * @brief Command-line settings of one benchmark run
+ */
+struct BenchOptions {
+    std::vector<uint32_t> sizes = {256, 1024, 4096};
+    std::vector<std::string> kinds = {"gradient", "noise", "photo"};
+    std::vector<std::string> image_paths;   // Real images (files or directories)
+    std::vector<int> threads;               // Empty = 1 and the OpenMP default
+    std::vector<std::string> stages;        // Stage name prefixes to run (empty = all)
+    int repeat = 3;
+    float quality = 10.0f;
+    std::string output;                     // Empty = stdout
+    std::string temp_dir;                   // Empty = system temp directory
+};
+
+/**
+ * @brief An image of the corpus
+ */
+struct BenchImage {
+    std::string name;
+    std::string kind;   // Synthetic kind, or "file" for real images
+    ColorData pixels;
+};
+
+/**
+ * @brief One measured (stage, image, thread count) combination
+ */
+struct BenchRow {
+    std::string stage;
+    std::string image;
+    std::string kind;
+    uint32_t width = 0, height = 0;
+    int threads = 1;
+    int repeats = 0;
+    double seconds = 0.0;       // Fastest run
+    double mean_seconds = 0.0;
+    double bytes = 0.0;         // Bytes processed per run (raw RGB, or stream bytes for codecs)
+    uint64_t tiles = 0;         // Tiles processed per run (0 = not a tile stage)
+    uint64_t peak_rss = 0;      // Peak resident bytes during the row (0 = unknown)
+    double ratio = 0.0;         // Compression ratio, for encoder rows
+};
+
+// ============================================================================
+// Synthetic corpus
+// ============================================================================
+
+// Deterministic per-pixel noise, independent of the order pixels are generated in
+static uint32_t pixel_hash(uint32_t x, uint32_t y, uint32_t seed) {
+    uint32_t h = x * 0x9E3779B1u ^ y * 0x85EBCA77u ^ seed * 0xC2B2AE3Du;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+    return h;
+}
+
+static uint8_t clamp_channel(double value) {
+    return static_cast<uint8_t>(std::clamp(value, 0.0, 255.0));
+}
+
+/**
+ * @brief Generate a synthetic image
+ *
+ * gradient: smooth ramps (few tiles, best case); noise: uniform random
+ * pixels (full-depth tree, worst case); photo: smooth low-frequency shading
+ * with hard-edged shapes and mild sensor noise, close to a natural photo.
+ */
+static ColorData make_synthetic(const std::string& kind, uint32_t size) {
+    ColorData image(size, size);
+    const double scale = 1.0 / static_cast<double>(size);
+    
+#if ETCA_OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int64_t row = 0; row < static_cast<int64_t>(size); ++row) {
+        uint32_t y = static_cast<uint32_t>(row);
+        spectre::Color* out = image.row(y);
+        double fy = y * scale;
+        
+        for (uint32_t x = 0; x < size; ++x) {
+            double fx = x * scale;
+            if (kind == "gradient") {
+                out[x] = spectre::Color(clamp_channel(fx * 255.0), clamp_channel(fy * 255.0),
+                                        clamp_channel((1.0 - fx) * 128.0 + fy * 127.0));
+            } else if (kind == "noise") {
+                uint32_t h = pixel_hash(x, y, 1);
+                out[x] = spectre::Color(static_cast<uint8_t>(h), static_cast<uint8_t>(h >> 8),
+                                        static_cast<uint8_t>(h >> 16));
+            } else {
+                double shade = 128.0 + 60.0 * std::sin(fx * 7.0 + fy * 3.0) + 40.0 * std::cos(fy * 11.0 - fx * 2.0);
+                if (std::hypot(fx - 0.6, fy - 0.4) < 0.2) {
+                    shade = shade * 0.5 + 90.0;
+                }
+                if (fx > 0.1 && fx < 0.3 && fy > 0.55 && fy < 0.9) {
+                    shade = 230.0 - fy * 40.0;
+                }
+                uint32_t h = pixel_hash(x, y, 2);
+                double grain = static_cast<double>(h & 15) - 7.5;
+                out[x] = spectre::Color(clamp_channel(shade + grain),
+                                        clamp_channel(shade * 0.8 + 30.0 + grain),
+                                        clamp_channel(255.0 - shade * 0.7 + grain));
+            }
+        }
+    }
+    
+    return image;
+}
+
+// ============================================================================
+// Benchmark driver
+// ============================================================================
+
+static std::string json_string(const std::string& text) {
+    std::ostringstream out;
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+/**
+ * @brief Runs every stage over each corpus image and collects the rows
+ *
+ * Each stage is timed on its own: inputs it needs (a built tree, a
+ * serialized stream, a decoded image) are prepared once, untimed, and every
+ * repetition starts from the same input. Stages with parallel regions are
+ * swept over the requested thread counts through an ExecutionContext; the
+ * others run once on one thread.
+ */
+class Bench {
+public:
+    explicit Bench(const BenchOptions& options) : options_(options) {
+        if (options_.threads.empty()) {
+            options_.threads.push_back(1);
+            int all = ExecutionContext::resolve_threads(0);
+            if (all > 1) {
+                options_.threads.push_back(all);
+            }
+        }
+        per_row_rss_ = spectre::Profiler::reset_peak_rss();
+    }
+    
+    void run(const BenchImage& image);
+    
+    void write_json(std::ostream& out) const;
+
+private:
+    BenchOptions options_;
+    std::vector<BenchRow> rows_;
+    bool per_row_rss_ = false;
+    
+    bool wants(const std::string& stage) const {
+        if (options_.stages.empty()) {
+            return true;
+        }
+        return std::any_of(options_.stages.begin(), options_.stages.end(),
+                           [&](const std::string& prefix) { return stage.compare(0, prefix.size(), prefix) == 0; });
+    }
+    
+    spectre::CompressionConfig config(uint8_t stream_version) const {
+        spectre::CompressionConfig config;
+        config.variance_threshold = options_.quality / 255.0f;
+        config.tree_stream_version = stream_version;
+        return config;
+    }
+    
+    /**
+     * @brief Time one row; setup() runs untimed before each run of body()
+     * @param body Returns the tiles it processed (0 for non-tile stages)
+     */
+    template <typename Setup, typename Body>
+    BenchRow* measure(const std::string& stage, const BenchImage& image, int threads, double bytes,
+                      Setup setup, Body body);
+};
+
+template <typename Setup, typename Body>
+BenchRow* Bench::measure(const std::string& stage, const BenchImage& image, int threads, double bytes,
+                         Setup setup, Body body) {
+    if (!wants(stage)) {
+        return nullptr;
+    }
+    
+    BenchRow row;
+    row.stage = stage;
+    row.image = image.name;
+    row.kind = image.kind;
+    row.width = image.pixels.get_width();
+    row.height = image.pixels.get_height();
+    row.threads = threads;
+    row.repeats = std::max(1, options_.repeat);
+    row.bytes = bytes;
+    
+    spectre::Profiler::reset_peak_rss();
+    double total = 0.0;
+    for (int run = 0; run < row.repeats; ++run) {
+        setup();
+        auto start = std::chrono::steady_clock::now();
+        row.tiles = body();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        row.seconds = run == 0 ? seconds : std::min(row.seconds, seconds);
+        total += seconds;
+    }
+    row.mean_seconds = total / row.repeats;
+    row.peak_rss = spectre::Profiler::peak_rss_bytes();
+    
+    std::cerr << std::left << std::setw(18) << stage << std::setw(16) << image.name
+              << " threads " << std::setw(3) << threads << std::right << std::fixed << std::setprecision(1)
+              << std::setw(10) << (row.seconds > 0.0 ? bytes / (1024.0 * 1024.0) / row.seconds : 0.0) << " MB/s\n"
+              << std::defaultfloat;
+    
+    rows_.push_back(row);
+    return &rows_.back();
+}
+
+void Bench::run(const BenchImage& image) {
+    const ColorData& pixels = image.pixels;
+    const uint32_t width = pixels.get_width();
+    const uint32_t height = pixels.get_height();
+    const double raw_bytes = static_cast<double>(width) * height * 3.0;
+    auto no_setup = [] {};
+    
+    // Tree build (variance-driven subdivision over the summed-area tables)
+    spectre::CompressionConfig build_config = config(spectre::TreeStream::VERSION_PROGRESSIVE);
+    for (int threads : options_.threads) {
+        ExecutionContext context(threads);
+        measure("build", image, threads, raw_bytes, no_setup, [&] {
+            spectre::SpectreTree tree(width, height);
+            tree.build(pixels.view(), build_config.variance_threshold, build_config.max_tree_depth,
+                       build_config.parallel_cutoff_pixels, context);
+            return static_cast<uint64_t>(tree.get_tile_count());
+        });
+    }
+    
+    spectre::SpectreTree tree(width, height);
+    ExecutionContext build_context;
+    tree.build(pixels.view(), build_config.variance_threshold, build_config.max_tree_depth,
+               build_config.parallel_cutoff_pixels, build_context);
+    const uint64_t tile_count = tree.get_tile_count();
+    
+    // Tree stream serialization and decoding, per stream version
+    static const uint8_t VERSIONS[] = {spectre::TreeStream::VERSION_IMPLICIT, spectre::TreeStream::VERSION_PREDICTED,
+                                       spectre::TreeStream::VERSION_PROGRESSIVE};
+    std::vector<uint8_t> implicit_stream;
+    ColorData decoded(width, height);
+    
+    for (uint8_t version : VERSIONS) {
+        std::string suffix = "_v" + std::to_string(version);
+        spectre::Compressor compressor(config(version));
+        
+        std::vector<uint8_t> stream;
+        measure("serialize" + suffix, image, 1, raw_bytes, no_setup, [&] {
+            compressor.serialize_tree(tree, stream);
+            return tile_count;
+        });
+        if (stream.empty()) {
+            compressor.serialize_tree(tree, stream);
+        }
+        
+        // Stored without an entropy layer, so only the rasterizer is timed
+        std::vector<uint8_t> payload;
+        payload.reserve(stream.size() + 1);
+        payload.push_back(static_cast<uint8_t>(spectre::EntropyCodec::NONE));
+        payload.insert(payload.end(), stream.begin(), stream.end());
+        
+        ExecutionContext serial(1);
+        measure("rasterize" + suffix, image, 1, raw_bytes, no_setup, [&] {
+            decoded = spectre::Decompressor::decompress(spectre::ByteSpan(payload), width, height, false, -1, serial);
+            return tile_count;
+        });
+        
+        if (version == spectre::TreeStream::VERSION_IMPLICIT) {
+            implicit_stream = std::move(stream);
+        }
+    }
+    
+    // Entropy codecs over the byte-oriented implicit stream (range-coded
+    // streams leave nothing for them to find)
+    static const spectre::EntropyCodec CODECS[] = {spectre::EntropyCodec::RLE, spectre::EntropyCodec::HUFFMAN,
+                                                   spectre::EntropyCodec::ZLIB, spectre::EntropyCodec::DEFLATE,
+                                                   spectre::EntropyCodec::ADVANCED};
+    const double stream_bytes = static_cast<double>(implicit_stream.size());
+    
+    for (spectre::EntropyCodec codec_id : CODECS) {
+        std::string name = spectre::entropy_codec_name(codec_id);
+        auto codec = spectre::AdaptiveEncoder::create_codec(codec_id, spectre::DeflateCodec::DEFAULT_LEVEL);
+        
+        std::vector<uint8_t> encoded;
+        BenchRow* row = measure("encode_" + name, image, 1, stream_bytes, no_setup, [&] {
+            encoded = codec->encode(implicit_stream);
+            return uint64_t(0);
+        });
+        if (encoded.empty()) {
+            encoded = codec->encode(implicit_stream);
+        }
+        if (row != nullptr) {
+            row->ratio = stream_bytes / std::max<double>(1.0, static_cast<double>(encoded.size()));
+        }
+        
+        measure("decode_" + name, image, 1, stream_bytes, no_setup, [&] {
+            std::vector<uint8_t> restored = codec->decode(encoded);
+            return uint64_t(0);
+        });
+    }
+    
+    for (int threads : options_.threads) {
+        spectre::AdaptiveOptions adaptive;
+        adaptive.threads = threads;
+        spectre::CompressionStats stats;
+        BenchRow* row = measure("encode_adaptive", image, threads, stream_bytes, no_setup, [&] {
+            spectre::AdaptiveEncoder::encode(implicit_stream, adaptive, stats);
+            return uint64_t(0);
+        });
+        if (row != nullptr) {
+            row->ratio = stats.compression_ratio;
+        }
+    }
+    
+    // Deblocking of the decoded (piecewise-flat) image, restored before each run
+    ColorData deblocked(width, height);
+    for (int threads : options_.threads) {
+        measure("deblock", image, threads, raw_bytes, [&] { deblocked = decoded; }, [&] {
+            spectre::DeblockingFilter::apply(deblocked, spectre::DeblockingConfig(), threads);
+            return uint64_t(0);
+        });
+    }
+    
+    // Whole .etca files, as written and read by the CLI
+    std::vector<uint8_t> file_bytes;
+    for (int threads : options_.threads) {
+        ExecutionContext context(threads);
+        BenchRow* row = measure("etca_encode", image, threads, raw_bytes, no_setup, [&] {
+            file_bytes = etca::EtcaWriter::encode(pixels, false, options_.quality, etca::EtcaMetadata(),
+                                                  etca::EtcaDirectory::AUTO_DEPTH, &context);
+            return uint64_t(0);
+        });
+        if (row != nullptr) {
+            row->ratio = raw_bytes / std::max<double>(1.0, static_cast<double>(file_bytes.size()));
+        }
+    }
+    if (file_bytes.empty() && wants("etca_decode")) {
+        file_bytes = etca::EtcaWriter::encode(pixels, false, options_.quality);
+    }
+    for (int threads : options_.threads) {
+        ExecutionContext context(threads);
+        measure("etca_decode", image, threads, raw_bytes, no_setup, [&] {
+            decoded = etca::EtcaReader::read(spectre::ByteSpan(file_bytes), -1, &context);
+            return uint64_t(0);
+        });
+    }
+    
+    // The same for bit-exact files (tree base layer plus residuals)
+    file_bytes.clear();
+    for (int threads : options_.threads) {
+        ExecutionContext context(threads);
+        BenchRow* row = measure("lossless_encode", image, threads, raw_bytes, no_setup, [&] {
+            file_bytes = etca::EtcaWriter::encode(pixels, true, options_.quality, etca::EtcaMetadata(),
+                                                  etca::EtcaDirectory::AUTO_DEPTH, &context);
+            return uint64_t(0);
+        });
+        if (row != nullptr) {
+            row->ratio = raw_bytes / std::max<double>(1.0, static_cast<double>(file_bytes.size()));
+        }
+    }
+    if (file_bytes.empty() && wants("lossless_decode")) {
+        file_bytes = etca::EtcaWriter::encode(pixels, true, options_.quality);
+    }
+    for (int threads : options_.threads) {
+        ExecutionContext context(threads);
+        measure("lossless_decode", image, threads, raw_bytes, no_setup, [&] {
+            decoded = etca::EtcaReader::read(spectre::ByteSpan(file_bytes), -1, &context);
+            return uint64_t(0);
+        });
+    }
+    
+    // Frame sequences: the image with a square moving across it, so each
+    // inter frame re-codes about two squares' worth of tiles. One frame is
+    // patched from the next, so the clip never holds more than one copy
+    const int frame_count = 16;
+    const uint32_t square = std::max(1u, std::min(width, height) / 8);
+    ColorData frame = pixels;
+    auto square_at = [&](int f, uint32_t& x, uint32_t& y) {
+        x = static_cast<uint32_t>((static_cast<uint64_t>(width - square) * f) / (frame_count - 1));
+        y = static_cast<uint32_t>((static_cast<uint64_t>(height - square) * f) / (frame_count - 1));
+    };
+    auto encode_clip = [&](spectre::SequenceEncoder& encoder, ExecutionContext& context,
+                           std::vector<std::vector<uint8_t>>& streams) {
+        uint64_t coded_tiles = 0;
+        streams.clear();
+        for (int f = 0; f < frame_count; ++f) {
+            uint32_t x, y;
+            if (f > 0) {
+                square_at(f - 1, x, y);
+                frame.copy_region(pixels.view(x, y, square, square), x, y);
+            }
+            square_at(f, x, y);
+            frame.fill_region(x, y, square, square, spectre::Color(255, 0, 255));
+            streams.push_back(encoder.encode(frame.view(), context));
+            coded_tiles += encoder.get_last_statistics().coded_tile_count;
+        }
+        uint32_t x, y;
+        square_at(frame_count - 1, x, y);
+        frame.copy_region(pixels.view(x, y, square, square), x, y);
+        return coded_tiles;
+    };
+    spectre::SequenceConfig sequence_config;
+    sequence_config.compression = config(spectre::TreeStream::VERSION_IMPLICIT);
+    const double sequence_bytes = raw_bytes * frame_count;
+    
+    std::vector<std::vector<uint8_t>> sequence;
+    for (int threads : options_.threads) {
+        ExecutionContext context(threads);
+        BenchRow* row = measure("sequence_encode", image, threads, sequence_bytes, no_setup, [&] {
+            spectre::SequenceEncoder encoder(sequence_config);
+            return encode_clip(encoder, context, sequence);
+        });
+        if (row != nullptr) {
+            size_t encoded = 0;
+            for (const auto& stream : sequence) {
+                encoded += stream.size();
+            }
+            row->ratio = sequence_bytes / std::max<double>(1.0, static_cast<double>(encoded));
+        }
+    }
+    if (sequence.empty() && wants("sequence_decode")) {
+        spectre::SequenceEncoder encoder(sequence_config);
+        ExecutionContext context;
+        encode_clip(encoder, context, sequence);
+    }
+    measure("sequence_decode", image, 1, sequence_bytes, no_setup, [&] {
+        spectre::SequenceDecoder decoder;
+        for (const auto& stream : sequence) {
+            if (!decoder.decode(spectre::ByteSpan(stream))) {
+                throw std::runtime_error("Sequence frame failed to decode");
+            }
+        }
+        return uint64_t(0);
+    });
+    
+    // Image file I/O (reads come from the page cache the writes just filled)
+    fs::path temp_dir = options_.temp_dir.empty() ? fs::temp_directory_path() : fs::path(options_.temp_dir);
+    for (const char* format : {"ppm", "png"}) {
+        std::string path = (temp_dir / ("etca_bench_" + image.name + "." + format)).string();
+        measure(std::string(format) + "_write", image, 1, raw_bytes, no_setup, [&] {
+            pixels.save_to_file(path);
+            return uint64_t(0);
+        });
+        if (!wants(std::string(format) + "_read")) {
+            fs::remove(path);
+            continue;
+        }
+        if (!fs::exists(path)) {
+            pixels.save_to_file(path);
+        }
+        measure(std::string(format) + "_read", image, 1, raw_bytes, no_setup, [&] {
+            decoded = ColorData(path);
+            return uint64_t(0);
+        });
+        fs::remove(path);
+    }
+}
+
+void Bench::write_json(std::ostream& out) const {
+    std::time_t now = std::time(nullptr);
+    char timestamp[32];
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    
+    auto number = [](double value) {
+        std::ostringstream text;
+        text << std::setprecision(6) << value;
+        return text.str();
+    };
+    auto per_second = [&](double amount, double seconds) {
+        return seconds > 0.0 ? number(amount / seconds) : std::string("null");
+    };
+    
+    out << "{\n"
+        << "  \"benchmark\": \"etca_bench\",\n"
+        << "  \"format_version\": 1,\n"
+        << "  \"timestamp\": \"" << timestamp << "\",\n"
+        << "  \"simd\": " << json_string(spectre::simd_level_name(spectre::pixel_kernels().level)) << ",\n"
+        << "  \"openmp\": " << (ETCA_OPENMP ? "true" : "false") << ",\n"
+        << "  \"default_threads\": " << ExecutionContext::resolve_threads(0) << ",\n"
+        << "  \"quality\": " << number(options_.quality) << ",\n"
+        << "  \"peak_rss_scope\": \"" << (per_row_rss_ ? "row" : "process") << "\",\n"
+        << "  \"rows\": [";
+    
+    for (size_t i = 0; i < rows_.size(); ++i) {
+        const BenchRow& row = rows_[i];
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"stage\": " << json_string(row.stage)
+            << ", \"image\": " << json_string(row.image)
+            << ", \"kind\": " << json_string(row.kind)
+            << ", \"width\": " << row.width
+            << ", \"height\": " << row.height
+            << ", \"threads\": " << row.threads
+            << ", \"repeats\": " << row.repeats
+            << ", \"seconds\": " << number(row.seconds)
+            << ", \"mean_seconds\": " << number(row.mean_seconds)
+            << ", \"bytes\": " << number(row.bytes)
+            << ", \"mb_per_s\": " << per_second(row.bytes / (1024.0 * 1024.0), row.seconds)
+            << ", \"tiles\": " << row.tiles
+            << ", \"tiles_per_s\": " << (row.tiles > 0 ? per_second(static_cast<double>(row.tiles), row.seconds) : "null")
+            << ", \"peak_rss_bytes\": " << (row.peak_rss > 0 ? std::to_string(row.peak_rss) : "null");
+        if (row.ratio > 0.0) {
+            out << ", \"ratio\": " << number(row.ratio);
+        }
+        out << "}";
+    }
+    
+    out << "\n  ]\n}\n";
+}
+
+} // namespace
+
+template <typename T, typename Parse>
+static std::vector<T> parse_list(const std::string& text, Parse parse) {
+    std::vector<T> values;
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (!item.empty()) {
+            values.push_back(parse(item));
+        }
+    }
+    return values;
+}
+
+static void print_usage(const char* program_name) {
+    std::cout << "Usage: " << program_name << " [options]\n\n"
+              << "Times each stage of the codec separately and writes the results as JSON.\n"
+              << "\nOptions:\n"
+              << "  --sizes <list>      Square sizes of the synthetic corpus (default: 256,1024,4096; up to 16384)\n"
+              << "  --kinds <list>      Synthetic kinds: gradient,noise,photo (default: all; 'none' for real images only)\n"
+              << "  --images <path>     Also benchmark a real image, or every image in a directory (repeatable)\n"
+              << "  --threads <list>    Thread counts for parallel stages (default: 1 and all)\n"
+              << "  --stages <list>     Only run stages starting with these names, e.g. build,encode_\n"
+              << "  --repeat <n>        Runs per row; the fastest is reported (default: 3)\n"
+              << "  --quality <0-100>   Lossy quality, as in etca compress (default: 10.0)\n"
+              << "  --output <file>     Write the JSON here (default: stdout)\n"
+              << "  --temp-dir <dir>    Directory for the file I/O stages (default: system temp)\n"
+              << "\nStages: build, serialize_v{2,3,4}, rasterize_v{2,3,4}, encode_/decode_<codec>,\n"
+              << "encode_adaptive, deblock, etca_encode, etca_decode, lossless_encode, lossless_decode,\n"
+              << "sequence_encode, sequence_decode, {ppm,png}_{write,read}.\n"
+              << "MB/s counts 2^20 bytes of raw RGB (stream bytes for the codec stages).\n";
+}
+
+// Image files named by a --images argument, in a stable order
+static std::vector<fs::path> collect_image_files(const std::string& path) {
+    std::vector<fs::path> candidates;
+    if (fs::is_directory(path)) {
+        for (const auto& entry : fs::recursive_directory_iterator(path)) {
+            if (entry.is_regular_file()) {
+                candidates.push_back(entry.path());
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+    } else {
+        candidates.push_back(path);
+    }
+    
+    std::vector<fs::path> files;
+    for (const fs::path& file : candidates) {
+        try {
+            etca::detect_image_format(file.string());
+            files.push_back(file);
+        } catch (const std::exception&) {
+            // Not an image
+        }
+    }
+    return files;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    auto to_int = [](const std::string& item) { return std::stoi(item); };
+    auto to_size = [](const std::string& item) { return static_cast<uint32_t>(std::stoul(item)); };
+    auto to_string = [](const std::string& item) { return item; };
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--sizes" && i + 1 < argc) {
+            options.sizes = parse_list<uint32_t>(argv[++i], to_size);
+        } else if (arg == "--kinds" && i + 1 < argc) {
+            options.kinds = parse_list<std::string>(argv[++i], to_string);
+        } else if (arg == "--images" && i + 1 < argc) {
+            options.image_paths.push_back(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.threads = parse_list<int>(argv[++i], to_int);
+        } else if (arg == "--stages" && i + 1 < argc) {
+            options.stages = parse_list<std::string>(argv[++i], to_string);
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            options.repeat = std::stoi(argv[++i]);
+        } else if (arg == "--quality" && i + 1 < argc) {
+            options.quality = std::stof(argv[++i]);
+        } else if (arg == "--output" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (arg == "--temp-dir" && i + 1 < argc) {
+            options.temp_dir = argv[++i];
+        } else if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return 0;
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    try {
+        Bench bench(options);
+        
+        // Synthetic images are generated one at a time, so a 16k run holds one image
+        for (const std::string& kind : options.kinds) {
+            if (kind == "none") {
+                continue;
+            }
+            if (kind != "gradient" && kind != "noise" && kind != "photo") {
+                throw std::runtime_error("Unknown image kind: " + kind);
+            }
+            for (uint32_t size : options.sizes) {
+                if (size == 0 || size > 16384) {
+                    throw std::runtime_error("Sizes must be between 1 and 16384");
+                }
+                BenchImage image{kind + "-" + std::to_string(size), kind, make_synthetic(kind, size)};
+                bench.run(image);
+            }
+        }
+        
+        for (const std::string& path : options.image_paths) {
+            for (const fs::path& file : collect_image_files(path)) {
+                BenchImage image{file.stem().string(), "file", etca::load_image(file.string())};
+                bench.run(image);
+            }
+        }
+        
+        if (options.output.empty()) {
+            bench.write_json(std::cout);
+        } else {
+            std::ofstream out(options.output);
+            if (!out.is_open()) {
+                throw std::runtime_error("Cannot open file for writing: " + options.output);
+            }
+            bench.write_json(out);
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
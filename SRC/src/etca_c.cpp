@@ -0,0 +1,202 @@
+#include "etca_c.h"
+#include "etca_format.h"
+#include "execution_context.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Message for etca_last_error(); per thread, like the calls themselves
+static thread_local std::string last_error;
+
+static etca_status fail(etca_status status, const char* message) {
+    last_error = message;
+    return status;
+}
+
+// Run body, turning anything it throws into a status; library errors
+// (std::runtime_error) map to `error_status`
+template <typename Body>
+static etca_status guarded(etca_status error_status, Body body) {
+    try {
+        body();
+        return ETCA_OK;
+    } catch (const std::bad_alloc&) {
+        return fail(ETCA_ERROR_OUT_OF_MEMORY, "Out of memory");
+    } catch (const std::runtime_error& e) {
+        return fail(error_status, e.what());
+    } catch (const std::exception& e) {
+        return fail(ETCA_ERROR_INTERNAL, e.what());
+    } catch (...) {
+        return fail(ETCA_ERROR_INTERNAL, "Unknown error");
+    }
+}
+
+// Whether rows of `stride` bytes can hold `width` RGB24 pixels
+static bool holds_row(size_t stride, uint32_t width) {
+    return static_cast<uint64_t>(stride) >= static_cast<uint64_t>(width) * sizeof(spectre::Color);
+}
+
+static etca_status read_header(const uint8_t* data, size_t size, etca::EtcaHeader& header) {
+    if (data == nullptr) {
+        return fail(ETCA_ERROR_INVALID_ARGUMENT, "data is NULL");
+    }
+    return guarded(ETCA_ERROR_CORRUPT_DATA, [&] {
+        header = etca::EtcaHeader::deserialize(spectre::ByteSpan(data, size));
+    });
+}
+
+// Compress the caller's rows in place when they are a whole number of pixels
+// apart; otherwise they cannot be viewed as pixels and are copied once
+static std::vector<uint8_t> encode_rows(const uint8_t* rgb, uint32_t width, uint32_t height, size_t stride,
+                                        const etca_encode_options& options, spectre::ExecutionContext& context) {
+    uint8_t region_depth = options.region_depth == ETCA_REGION_DEPTH_AUTO
+        ? etca::EtcaDirectory::AUTO_DEPTH
+        : static_cast<uint8_t>(std::min<uint32_t>(options.region_depth, etca::EtcaDirectory::MAX_DEPTH));
+    bool lossless = options.lossless != 0;
+    
+    if (stride % sizeof(spectre::Color) == 0) {
+        spectre::ImageView view(reinterpret_cast<const spectre::Color*>(rgb), width, height,
+                                stride / sizeof(spectre::Color));
+        return etca::EtcaWriter::encode(view, lossless, options.quality, etca::EtcaMetadata(), region_depth,
+                                        &context);
+    }
+    
+    spectre::ColorData image(width, height);
+    for (uint32_t y = 0; y < height; ++y) {
+        std::memcpy(image.row(y), rgb + static_cast<size_t>(y) * stride, static_cast<size_t>(width) * 3);
+    }
+    return etca::EtcaWriter::encode(image, lossless, options.quality, etca::EtcaMetadata(), region_depth,
+                                    &context);
+}
+
+extern "C" {
+
+void etca_encode_options_init(etca_encode_options* options) {
+    if (options == nullptr) {
+        return;
+    }
+    options->struct_size = sizeof(etca_encode_options);
+    options->lossless = 0;
+    options->quality = 10.0f;
+    options->region_depth = ETCA_REGION_DEPTH_AUTO;
+    options->threads = 0;
+}
+
+etca_status etca_encode(const uint8_t* rgb, uint32_t width, uint32_t height, size_t stride,
+                        const etca_encode_options* options, etca_buffer* out) {
+    if (out == nullptr) {
+        return fail(ETCA_ERROR_INVALID_ARGUMENT, "out is NULL");
+    }
+    *out = etca_buffer{nullptr, 0, nullptr};
+    if (rgb == nullptr) {
+        return fail(ETCA_ERROR_INVALID_ARGUMENT, "rgb is NULL");
+    }
+    if (width == 0 || height == 0) {
+        return fail(ETCA_ERROR_INVALID_ARGUMENT, "Image has no pixels");
+    }
+    if (!holds_row(stride, width)) {
+        return fail(ETCA_ERROR_INVALID_ARGUMENT, "stride is smaller than a row of pixels");
+    }
+    
+    // Callers built against an older header pass a shorter struct; its missing fields keep their defaults
+    etca_encode_options settings;
+    etca_encode_options_init(&settings);
+    if (options != nullptr) {
+        if (options->struct_size == 0) {
+            return fail(ETCA_ERROR_INVALID_ARGUMENT, "options were not set up by etca_encode_options_init");
+        }
+        std::memcpy(&settings, options, std::min<size_t>(options->struct_size, sizeof(settings)));
+        settings.struct_size = sizeof(settings);
+    }
+    if (!(settings.quality >= 0.0f)) {
+        return fail(ETCA_ERROR_INVALID_ARGUMENT, "quality must be 0 or more");
+    }
+    
+    return guarded(ETCA_ERROR_INTERNAL, [&] {
+        spectre::ExecutionContext context(std::max(0, settings.threads));
+        
+        // The buffer hands out the vector's own storage, so the file is never copied
+        auto bytes = std::make_unique<std::vector<uint8_t>>(
+            encode_rows(rgb, width, height, stride, settings, context));
+        out->data = bytes->data();
+        out->size = bytes->size();
+        out->internal = bytes.release();
+    });
+}
+
+void etca_buffer_free(etca_buffer* buffer) {
+    if (buffer == nullptr) {
+        return;
+    }
+    delete static_cast<std::vector<uint8_t>*>(buffer->internal);
+    *buffer = etca_buffer{nullptr, 0, nullptr};
+}
+
+etca_status etca_get_info(const uint8_t* data, size_t size, uint32_t* width, uint32_t* height) {
+    if (width == nullptr || height == nullptr) {
+        return fail(ETCA_ERROR_INVALID_ARGUMENT, "width or height is NULL");
+    }
+    
+    etca::EtcaHeader header;
+    etca_status status = read_header(data, size, header);
+    if (status != ETCA_OK) {
+        return status;
+    }
+    *width = header.width;
+    *height = header.height;
+    return ETCA_OK;
+}
+
+etca_status etca_decode(const uint8_t* data, size_t size, uint8_t* rgb, size_t stride) {
+    if (rgb == nullptr) {
+        return fail(ETCA_ERROR_INVALID_ARGUMENT, "rgb is NULL");
+    }
+    
+    etca::EtcaHeader header;
+    etca_status status = read_header(data, size, header);
+    if (status != ETCA_OK) {
+        return status;
+    }
+    if (!holds_row(stride, header.width)) {
+        return fail(ETCA_ERROR_INVALID_ARGUMENT, "stride is smaller than a row of the image");
+    }
+    
+    return guarded(ETCA_ERROR_CORRUPT_DATA, [&] {
+        spectre::ByteSpan file_bytes(data, size);
+        spectre::ExecutionContext context;
+        
+        // Regions are painted straight into the caller's rows when they are whole pixels apart
+        if (stride % sizeof(spectre::Color) == 0) {
+            spectre::MutableImageView view(reinterpret_cast<spectre::Color*>(rgb), header.width, header.height,
+                                           stride / sizeof(spectre::Color));
+            etca::EtcaReader::read_into(file_bytes, view, -1, &context);
+            return;
+        }
+        
+        spectre::ColorData image = etca::EtcaReader::read(file_bytes, -1, &context);
+        for (uint32_t y = 0; y < header.height; ++y) {
+            std::memcpy(rgb + static_cast<size_t>(y) * stride, image.row(y), static_cast<size_t>(header.width) * 3);
+        }
+    });
+}
+
+const char* etca_status_string(etca_status status) {
+    switch (status) {
+        case ETCA_OK: return "OK";
+        case ETCA_ERROR_INVALID_ARGUMENT: return "Invalid argument";
+        case ETCA_ERROR_CORRUPT_DATA: return "Corrupt or unsupported .etca data";
+        case ETCA_ERROR_OUT_OF_MEMORY: return "Out of memory";
+        case ETCA_ERROR_INTERNAL: return "Internal error";
+    }
+    return "Unknown status";
+}
+
+const char* etca_last_error(void) {
+    return last_error.c_str();
+}
+
+} // extern "C"
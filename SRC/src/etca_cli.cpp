@@ -1,16 +1,19 @@
 #include "etca_format.h"
 #include "image_io.h"
+#include "batch_compressor.h"
+#include "profiler.h"
 #include <iostream>
 #include <string>
 #include <cstring>
+#include <cstdlib>
 #include <vector>
 #include <iomanip>
 #include <chrono>
 #include <ctime>
 #include <sstream>
-#if ETCA_OPENMP
-#include <omp.h>
-#endif
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
 
 void print_usage(const char* program_name) {
     std::cout << "Usage: " << program_name << " <command> [options]\n\n"
@@ -18,23 +21,51 @@ void print_usage(const char* program_name) {
               << "  compress    Compress an image to .etca format\n"
               << "  decompress  Decompress a .etca file to image format\n"
               << "  info        Display information about a .etca file\n"
+              << "  batch       Compress every image of a directory or list file\n"
               << "\nCompress options:\n"
               << "  -i, --input <file>          Input image file (PPM or PNG)\n"
               << "  -o, --output <file>         Output .etca file (auto-generated if omitted)\n"
-              << "  --lossless                  Use lossless compression (default: lossy)\n"
+              << "  --lossless                  Bit-exact compression: a tree plus per-pixel residuals (default: lossy)\n"
               << "  --quality <0.0-100.0>       Compression quality (default: 10.0)\n"
               << "  --author <name>             Author metadata\n"
               << "  --threads <number>          Number of threads to use (default: all available)\n"
+              << "  --stream                    Read and compress in bands (bounded memory for huge images)\n"
+              << "  --band-mpixels <number>     Pixels per band in millions with --stream (default: 16)\n"
+              << "  --region-depth <0-8|auto>   Split into 4^depth independently coded regions (default: auto,\n"
+              << "                              one region below 1 MP, then regions of at least 256x256)\n"
+              << "  --target-size <bytes>       Largest file that fits (K/M suffixes allowed)\n"
+              << "  --target-psnr <dB>          Smallest file with at least this RGB PSNR\n"
+              << "  --variants <list>           Several files from one tree build, e.g. size:40K,psnr:32,quality:10\n"
+              << "                              (written as <output>-1.etca, <output>-2.etca, ...)\n"
+              << "  --profile                   Print per-phase timings, counters and peak memory\n"
+              << "  --trace <file>              Also write a Chrome trace_event JSON (implies --profile)\n"
               << "\nDecompress options:\n"
               << "  -i, --input <file>          Input .etca file\n"
               << "  -o, --output <file>         Output image file (PPM or PNG)\n"
+              << "  --interpolate               Smooth the seams between tiles (deblocking)\n"
+              << "  --fast                      Favor export speed over PNG size (zlib level 1, sub filter)\n"
+              << "  --png-level <0-9>           PNG zlib level (default: 6)\n"
+              << "  --png-filter <name>         PNG row filter: adaptive, none, sub, up, average, paeth\n"
               << "  --threads <number>          Number of threads to use (default: all available)\n"
+              << "  --profile                   Print per-phase timings, counters and peak memory\n"
+              << "  --trace <file>              Also write a Chrome trace_event JSON (implies --profile)\n"
               << "\nInfo options:\n"
               << "  -i, --input <file>          Input .etca file\n"
+              << "\nBatch options:\n"
+              << "  -i, --input <dir|file>      Directory to scan, or list file with one image path per line\n"
+              << "  -o, --output <dir>          Output directory (default: next to each input)\n"
+              << "  --lossless                  Bit-exact compression: a tree plus per-pixel residuals (default: lossy)\n"
+              << "  --quality <0.0-100.0>       Compression quality (default: 10.0)\n"
+              << "  --author <name>             Author metadata\n"
+              << "  --region-depth <0-8|auto>   Split into 4^depth independently coded regions (default: auto)\n"
+              << "  --threads <number>          Worker threads, one image each (default: all available)\n"
+              << "  --quiet                     Only print failures and the summary\n"
               << "\nExamples:\n"
               << "  " << program_name << " compress -i photo.ppm -o photo.etca --quality 20\n"
+              << "  " << program_name << " compress -i photo.ppm -o photo.etca --quality 2 --variants size:20K,psnr:30,psnr:36\n"
               << "  " << program_name << " decompress -i photo.etca -o output.ppm\n"
-              << "  " << program_name << " info -i photo.etca\n";
+              << "  " << program_name << " info -i photo.etca\n"
+              << "  " << program_name << " batch -i photos/ -o compressed/ --threads 16\n";
 }
 
 // when bro says c++ is easy
@@ -66,11 +97,145 @@ std::string estimate_eta(double elapsed, double progress) {
     return format_time(remaining);
 }
 
+// Print the profile of a finished command and write its trace if one was asked for
+void report_profile(spectre::Profiler& profiler, const std::string& trace_file) {
+    profiler.sample_peak_rss();
+    profiler.print_summary(std::cout);
+    
+    if (trace_file.empty()) {
+        return;
+    }
+    std::ofstream trace(trace_file);
+    profiler.write_chrome_trace(trace);
+    if (!trace.good()) {
+        throw std::runtime_error("Failed to write trace file: " + trace_file);
+    }
+    std::cout << "Trace written to '" << trace_file << "' (open in chrome://tracing or ui.perfetto.dev)\n";
+}
+
+// Leading number of text, with the rest left in `suffix`; false if there is none
+bool parse_number(const std::string& text, double& value, std::string& suffix) {
+    char* end = nullptr;
+    value = std::strtod(text.c_str(), &end);
+    if (end == text.c_str()) {
+        return false;
+    }
+    suffix = end;
+    return true;
+}
+
+// The whole of text as a number
+bool parse_number(const std::string& text, double& value) {
+    std::string suffix;
+    return parse_number(text, value, suffix) && suffix.empty();
+}
+
+// Byte count with an optional K or M suffix (binary units)
+bool parse_byte_count(const std::string& text, uint64_t& bytes) {
+    double value = 0.0;
+    std::string suffix;
+    if (!parse_number(text, value, suffix)) {
+        return false;
+    }
+    double scale = 1.0;
+    if (suffix == "K" || suffix == "k") {
+        scale = 1024.0;
+    } else if (suffix == "M" || suffix == "m") {
+        scale = 1024.0 * 1024.0;
+    } else if (!suffix.empty()) {
+        return false;
+    }
+    if (!(value >= 0.0 && value * scale < 18446744073709551616.0)) {  // Also rejects NaN and counts past 2^64
+        return false;
+    }
+    bytes = static_cast<uint64_t>(value * scale);
+    return true;
+}
+
+// One --variants entry: size:<bytes>, psnr:<dB> or quality:<0.0-100.0>
+bool parse_rate_target(const std::string& spec, spectre::RateTarget& target) {
+    size_t colon = spec.find(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    std::string kind = spec.substr(0, colon);
+    std::string value = spec.substr(colon + 1);
+    
+    if (kind == "size") {
+        uint64_t bytes = 0;
+        if (!parse_byte_count(value, bytes)) {
+            return false;
+        }
+        target = spectre::RateTarget::size(bytes);
+    } else if (kind == "psnr") {
+        double decibels = 0.0;
+        if (!parse_number(value, decibels)) {
+            return false;
+        }
+        target = spectre::RateTarget::psnr(decibels);
+    } else if (kind == "quality") {
+        double quality = 0.0;
+        if (!parse_number(value, quality)) {
+            return false;
+        }
+        target = spectre::RateTarget::threshold(static_cast<float>(quality) / 255.0f);  // Same scale (and rounding) as --quality
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// One --region-depth value: 0 to EtcaDirectory::MAX_DEPTH, or "auto"
+bool parse_region_depth(const std::string& text, uint8_t& depth) {
+    if (text == "auto") {
+        depth = etca::EtcaDirectory::AUTO_DEPTH;
+        return true;
+    }
+    char* end = nullptr;
+    long value = std::strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || value < 0 || value > etca::EtcaDirectory::MAX_DEPTH) {
+        return false;
+    }
+    depth = static_cast<uint8_t>(value);
+    return true;
+}
+
+// One --png-filter name
+bool parse_png_filter(const std::string& name, etca::PNGFilter& filter) {
+    static const std::pair<const char*, etca::PNGFilter> FILTERS[] = {
+        {"adaptive", etca::PNGFilter::ADAPTIVE}, {"none", etca::PNGFilter::NONE}, {"sub", etca::PNGFilter::SUB},
+        {"up", etca::PNGFilter::UP}, {"average", etca::PNGFilter::AVERAGE}, {"paeth", etca::PNGFilter::PAETH}};
+    for (const auto& [filter_name, value] : FILTERS) {
+        if (name == filter_name) {
+            filter = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+// <stem>-<n><extension> for the n-th variant
+std::string variant_path(const std::string& output_file, size_t n) {
+    size_t dot_pos = output_file.find_last_of('.');
+    size_t slash_pos = output_file.find_last_of("/\\");
+    if (dot_pos == std::string::npos || (slash_pos != std::string::npos && dot_pos < slash_pos)) {
+        return output_file + "-" + std::to_string(n);
+    }
+    return output_file.substr(0, dot_pos) + "-" + std::to_string(n) + output_file.substr(dot_pos);
+}
+
 int cmd_compress(int argc, char** argv) {
     std::string input_file, output_file, author;
     bool lossless = false;
     float quality = 10.0f;
     int num_threads = -1;  // -1 = use all available
+    bool streaming = false;
+    uint64_t band_pixels = etca::EtcaWriter::DEFAULT_BAND_PIXELS;
+    uint8_t region_depth = etca::EtcaDirectory::AUTO_DEPTH;
+    bool profile = false;
+    std::string trace_file;
+    std::vector<spectre::RateTarget> targets;
+    bool multiple_variants = false;
     
     for (int i = 2; i < argc; ++i) {
         std::string arg = argv[i];
@@ -78,6 +243,32 @@ int cmd_compress(int argc, char** argv) {
             input_file = argv[++i];
         } else if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
             output_file = argv[++i];
+        } else if (arg == "--target-size" && i + 1 < argc) {
+            uint64_t bytes = 0;
+            if (!parse_byte_count(argv[++i], bytes)) {
+                std::cerr << "Error: invalid --target-size '" << argv[i] << "'\n";
+                return 1;
+            }
+            targets.push_back(spectre::RateTarget::size(bytes));
+        } else if (arg == "--target-psnr" && i + 1 < argc) {
+            double decibels = 0.0;
+            if (!parse_number(argv[++i], decibels)) {
+                std::cerr << "Error: invalid --target-psnr '" << argv[i] << "'\n";
+                return 1;
+            }
+            targets.push_back(spectre::RateTarget::psnr(decibels));
+        } else if (arg == "--variants" && i + 1 < argc) {
+            std::stringstream list(argv[++i]);
+            std::string spec;
+            while (std::getline(list, spec, ',')) {
+                spectre::RateTarget target;
+                if (!parse_rate_target(spec, target)) {
+                    std::cerr << "Error: invalid variant '" << spec << "' (expected size:, psnr: or quality:)\n";
+                    return 1;
+                }
+                targets.push_back(target);
+            }
+            multiple_variants = true;
         } else if (arg == "--lossless") {
             lossless = true;
         } else if (arg == "--quality" && i + 1 < argc) {
@@ -86,13 +277,29 @@ int cmd_compress(int argc, char** argv) {
             author = argv[++i];
         } else if (arg == "--threads" && i + 1 < argc) {
             num_threads = std::stoi(argv[++i]);
+        } else if (arg == "--stream") {
+            streaming = true;
+        } else if (arg == "--band-mpixels" && i + 1 < argc) {
+            band_pixels = static_cast<uint64_t>(std::stod(argv[++i]) * (1 << 20));
+        } else if (arg == "--region-depth" && i + 1 < argc) {
+            if (!parse_region_depth(argv[++i], region_depth)) {
+                std::cerr << "Error: --region-depth must be between 0 and "
+                          << static_cast<int>(etca::EtcaDirectory::MAX_DEPTH) << ", or auto\n";
+                return 1;
+            }
+        } else if (arg == "--profile") {
+            profile = true;
+        } else if (arg == "--trace" && i + 1 < argc) {
+            trace_file = argv[++i];
+            profile = true;
         }
     }
     
-    if (num_threads > 0) {
-#if ETCA_OPENMP
-        omp_set_num_threads(num_threads);
-#endif
+    // The thread budget travels with the calls instead of being set process-wide
+    spectre::ExecutionContext context(std::max(0, num_threads));
+    spectre::Profiler profiler;
+    if (profile) {
+        context.set_profiler(&profiler);
     }
     
     if (input_file.empty()) {
@@ -100,6 +307,16 @@ int cmd_compress(int argc, char** argv) {
         return 1;
     }
     
+    if (streaming && !targets.empty()) {
+        std::cerr << "Error: --stream cannot be combined with size, PSNR or variant targets\n";
+        return 1;
+    }
+    if (streaming && region_depth != etca::EtcaDirectory::AUTO_DEPTH) {
+        std::cerr << "Error: --stream picks its own region depth from --band-mpixels\n";
+        return 1;
+    }
+    multiple_variants = multiple_variants || targets.size() > 1;
+    
     if (output_file.empty()) {
         size_t dot_pos = input_file.find_last_of('.');
         if (dot_pos != std::string::npos) {
@@ -120,7 +337,51 @@ int cmd_compress(int argc, char** argv) {
         }
         metadata.set("compression_mode", lossless ? "lossless" : "lossy");
         
-        etca::EtcaWriter::write_from_file(input_file, output_file, lossless, quality, metadata);
+        if (!targets.empty()) {
+            spectre::ColorData image = [&] {
+                spectre::ProfileScope scope(context.get_profiler(), "load");
+                return spectre::ColorData(input_file);
+            }();
+            
+            // One tree build per region, pruned for every target
+            std::vector<double> psnr;
+            std::vector<std::vector<uint8_t>> files = etca::EtcaWriter::encode_variants(
+                image, lossless, quality, targets, metadata, region_depth, &context, &psnr);
+            
+            spectre::ProfileScope scope(context.get_profiler(), "write");
+            for (size_t n = 0; n < files.size(); ++n) {
+                std::string path = multiple_variants ? variant_path(output_file, n + 1) : output_file;
+                std::ofstream file(path, std::ios::binary);
+                file.write(reinterpret_cast<const char*>(files[n].data()), static_cast<std::streamsize>(files[n].size()));
+                if (!file.good()) {
+                    throw std::runtime_error("Failed to write .etca file: " + path);
+                }
+                std::cout << "  " << path << ": " << format_bytes(files[n].size()) << "\n";
+                
+                // The nearest level was written; say so instead of passing it off as the target
+                const spectre::RateTarget& target = targets[n];
+                if (target.kind == spectre::RateTarget::Kind::SIZE &&
+                    static_cast<double>(files[n].size()) > target.value) {
+                    std::cerr << "Warning: " << path << " is " << format_bytes(files[n].size())
+                              << ", above the size target of " << format_bytes(static_cast<uint64_t>(target.value))
+                              << " (the coarsest tree does not fit)\n";
+                } else if (target.kind == spectre::RateTarget::Kind::PSNR && psnr[n] < target.value) {
+                    std::cerr << "Warning: " << path << " reaches " << std::fixed << std::setprecision(2) << psnr[n]
+                              << " dB, below the PSNR target of " << target.value
+                              << " dB (a lower --quality builds a finer tree)\n";
+                }
+            }
+        } else if (streaming) {
+            uint64_t held = etca::EtcaWriter::write_streaming(input_file, output_file, lossless, quality, metadata,
+                                                              band_pixels, &context);
+            if (held > band_pixels) {
+                std::cerr << "Warning: bands held " << held << " pixels, above the --band-mpixels budget of "
+                          << band_pixels << " (regions are at their smallest height)\n";
+            }
+        } else {
+            etca::EtcaWriter::write_from_file(input_file, output_file, lossless, quality, metadata, region_depth,
+                                              &context);
+        }
         
         auto end_time = std::chrono::high_resolution_clock::now();
         double elapsed = std::chrono::duration<double>(end_time - start_time).count();
@@ -128,6 +389,10 @@ int cmd_compress(int argc, char** argv) {
         std::cout << "Successfully compressed image to .etca format\n";
         std::cout << "Compression time: " << format_time(elapsed) << "\n";
         
+        if (profile) {
+            report_profile(profiler, trace_file);
+        }
+        
         return 0;
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
@@ -138,6 +403,12 @@ int cmd_compress(int argc, char** argv) {
 int cmd_decompress(int argc, char** argv) {
     std::string input_file, output_file;
     int num_threads = -1;  // -1 = use all available
+    bool interpolate = false;
+    bool profile = false;
+    std::string trace_file;
+    etca::ExportOptions export_options;
+    int png_level = -2;  // -2 = not given
+    std::string png_filter;
     
     for (int i = 2; i < argc; ++i) {
         std::string arg = argv[i];
@@ -147,13 +418,27 @@ int cmd_decompress(int argc, char** argv) {
             output_file = argv[++i];
         } else if (arg == "--threads" && i + 1 < argc) {
             num_threads = std::stoi(argv[++i]);
+        } else if (arg == "--interpolate") {
+            interpolate = true;
+        } else if (arg == "--fast") {
+            export_options = etca::ExportOptions::fast();
+        } else if (arg == "--png-level" && i + 1 < argc) {
+            png_level = std::stoi(argv[++i]);
+        } else if (arg == "--png-filter" && i + 1 < argc) {
+            png_filter = argv[++i];
+        } else if (arg == "--profile") {
+            profile = true;
+        } else if (arg == "--trace" && i + 1 < argc) {
+            trace_file = argv[++i];
+            profile = true;
         }
     }
     
-    if (num_threads > 0) {
-#if ETCA_OPENMP
-        omp_set_num_threads(num_threads);
-#endif
+    // The thread budget travels with the calls instead of being set process-wide
+    spectre::ExecutionContext context(std::max(0, num_threads));
+    spectre::Profiler profiler;
+    if (profile) {
+        context.set_profiler(&profiler);
     }
     
     if (input_file.empty() || output_file.empty()) {
@@ -161,12 +446,25 @@ int cmd_decompress(int argc, char** argv) {
         return 1;
     }
     
+    // Explicit settings refine --fast wherever it appears
+    if (png_level != -2) {
+        if (png_level < 0 || png_level > 9) {
+            std::cerr << "Error: --png-level must be between 0 and 9\n";
+            return 1;
+        }
+        export_options.zlib_level = png_level;
+    }
+    if (!png_filter.empty() && !parse_png_filter(png_filter, export_options.filter)) {
+        std::cerr << "Error: unknown --png-filter '" << png_filter << "'\n";
+        return 1;
+    }
+    
     try {
         std::cout << "Decompressing '" << input_file << "' to '" << output_file << "'...\n";
         
         auto start_time = std::chrono::high_resolution_clock::now();
         
-        etca::EtcaReader::read_to_file(input_file, output_file);
+        etca::EtcaReader::read_to_file(input_file, output_file, interpolate, &context, export_options);
         
         auto end_time = std::chrono::high_resolution_clock::now();
         double elapsed = std::chrono::duration<double>(end_time - start_time).count();
@@ -174,6 +472,10 @@ int cmd_decompress(int argc, char** argv) {
         std::cout << "Successfully decompressed .etca file\n";
         std::cout << "Decompression time: " << format_time(elapsed) << "\n";
         
+        if (profile) {
+            report_profile(profiler, trace_file);
+        }
+        
         return 0;
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
@@ -222,6 +524,85 @@ int cmd_info(int argc, char** argv) {
     }
 }
 
+int cmd_batch(int argc, char** argv) {
+    std::string input, output_dir, author;
+    etca::BatchOptions options;
+    bool quiet = false;
+    
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "-i" || arg == "--input") && i + 1 < argc) {
+            input = argv[++i];
+        } else if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+            output_dir = argv[++i];
+        } else if (arg == "--lossless") {
+            options.lossless = true;
+        } else if (arg == "--quality" && i + 1 < argc) {
+            options.variance_threshold = std::stof(argv[++i]);
+        } else if (arg == "--author" && i + 1 < argc) {
+            author = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.workers = static_cast<unsigned>(std::max(0, std::stoi(argv[++i])));
+        } else if (arg == "--region-depth" && i + 1 < argc) {
+            if (!parse_region_depth(argv[++i], options.region_depth)) {
+                std::cerr << "Error: --region-depth must be between 0 and "
+                          << static_cast<int>(etca::EtcaDirectory::MAX_DEPTH) << ", or auto\n";
+                return 1;
+            }
+        } else if (arg == "--quiet") {
+            quiet = true;
+        }
+    }
+    
+    if (input.empty()) {
+        std::cerr << "Error: --input is required\n";
+        return 1;
+    }
+    
+    try {
+        if (!author.empty()) {
+            options.metadata.set("author", author);
+        }
+        options.metadata.set("compression_mode", options.lossless ? "lossless" : "lossy");
+        
+        std::vector<etca::BatchJob> jobs = etca::BatchCompressor::collect_jobs(input, output_dir);
+        if (jobs.empty()) {
+            std::cerr << "Error: no images found in '" << input << "'\n";
+            return 1;
+        }
+        std::cout << "Compressing " << jobs.size() << " images...\n";
+        
+        auto start_time = std::chrono::steady_clock::now();
+        auto progress = [&](const etca::BatchJob& job, const std::string& error, size_t finished, size_t total) {
+            if (!error.empty()) {
+                std::cerr << "Failed '" << job.input_path << "': " << error << "\n";
+            } else if (!quiet) {
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+                std::cout << "[" << finished << "/" << total << "] " << job.output_path
+                          << " (ETA " << estimate_eta(elapsed, static_cast<double>(finished) / static_cast<double>(total)) << ")\n";
+            }
+        };
+        
+        etca::BatchStatistics stats = etca::BatchCompressor::run(std::move(jobs), options, progress);
+        
+        std::cout << "\nBatch summary\n";
+        std::cout << "=============\n";
+        std::cout << "Images: " << stats.images_done << " compressed, " << stats.images_failed << " failed\n";
+        std::cout << "Workers: " << stats.workers << "\n";
+        std::cout << "Input: " << format_bytes(stats.input_bytes) << ", output: " << format_bytes(stats.output_bytes) << "\n";
+        std::cout << "Wall time: " << format_time(stats.seconds) << "\n";
+        std::cout << std::fixed << std::setprecision(2)
+                  << "Throughput: " << stats.images_per_second() << " images/s, "
+                  << stats.megabytes_per_second() << " MB/s, "
+                  << stats.megapixels_per_second() << " Mpx/s\n";
+        
+        return stats.images_failed == 0 ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
+
 int main(int argc, char** argv) {
     if (argc < 2) {
         print_usage(argv[0]);
@@ -236,6 +617,8 @@ int main(int argc, char** argv) {
         return cmd_decompress(argc, argv);
     } else if (command == "info") {
         return cmd_info(argc, argv);
+    } else if (command == "batch") {
+        return cmd_batch(argc, argv);
     } else if (command == "--help" || command == "-h") {
         print_usage(argv[0]);
         return 0;
@@ -1,12 +1,20 @@
 #include "etca_format.h"
 #include "decompressor.h"
+#include "deblocking_filter.h"
 #include "image_io.h"
+#include "mapped_file.h"
+#include "profiler.h"
+#include "rate_control.h"
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
 #include <cstring>
 #include <algorithm>
+#include <limits>
 #include <iomanip>
+#if ETCA_OPENMP
+#include <omp.h>
+#endif
 
 namespace etca {
 
@@ -56,7 +64,7 @@ std::vector<uint8_t> EtcaHeader::serialize() const {
     return data;
 }
 
-EtcaHeader EtcaHeader::deserialize(const std::vector<uint8_t>& data) {
+EtcaHeader EtcaHeader::deserialize(spectre::ByteSpan data) {
     if (data.size() < HEADER_SIZE) {
         throw std::runtime_error("Invalid .etca file: header too small");
     }
@@ -75,7 +83,8 @@ EtcaHeader EtcaHeader::deserialize(const std::vector<uint8_t>& data) {
     
     // Format version
     header.format_version = data[4];
-    if (header.format_version != VERSION) {
+    if (header.format_version != VERSION_SINGLE_STREAM && header.format_version != VERSION_REGIONS &&
+        header.format_version != VERSION_REGION_SIZES) {
         throw std::runtime_error("Unsupported .etca format version: " + 
                                  std::to_string(header.format_version));
     }
@@ -113,6 +122,155 @@ EtcaHeader EtcaHeader::deserialize(const std::vector<uint8_t>& data) {
     return header;
 }
 
+// ============================================================================
+// EtcaDirectory Implementation
+// ============================================================================
+
+std::vector<uint8_t> EtcaDirectory::serialize() const {
+    std::vector<uint8_t> data;
+    data.reserve(serialized_size());
+    
+    data.push_back(depth);
+    
+    uint32_t count = static_cast<uint32_t>(region_count());
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        data.push_back(static_cast<uint8_t>(count >> shift));
+    }
+    
+    if (wide_offsets) {
+        for (uint64_t offset : offsets) {
+            for (int shift = 56; shift >= 0; shift -= 8) {
+                data.push_back(static_cast<uint8_t>(offset >> shift));
+            }
+        }
+        return data;
+    }
+    
+    for (size_t k = 0; k < count; ++k) {
+        uint64_t size = offsets[k + 1] - offsets[k];
+        if (size > UINT32_MAX) {
+            throw std::runtime_error("Region " + std::to_string(k) + " is too large for the directory (" +
+                                     std::to_string(size) + " bytes); use a deeper region directory");
+        }
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            data.push_back(static_cast<uint8_t>(size >> shift));
+        }
+    }
+    
+    return data;
+}
+
+EtcaDirectory EtcaDirectory::deserialize(spectre::ByteSpan data, uint8_t format_version) {
+    if (data.size() < FIXED_SIZE) {
+        throw std::runtime_error("Invalid .etca file: region directory truncated");
+    }
+    
+    EtcaDirectory directory;
+    directory.wide_offsets = format_version == EtcaHeader::VERSION_REGIONS;
+    directory.depth = data[0];
+    if (directory.depth > MAX_DEPTH) {
+        throw std::runtime_error("Invalid .etca file: region depth " + std::to_string(directory.depth));
+    }
+    
+    uint32_t count = (static_cast<uint32_t>(data[1]) << 24) |
+                     (static_cast<uint32_t>(data[2]) << 16) |
+                     (static_cast<uint32_t>(data[3]) << 8) |
+                     static_cast<uint32_t>(data[4]);
+    if (count != (uint32_t(1) << (2 * directory.depth))) {
+        throw std::runtime_error("Invalid .etca file: region count does not match depth");
+    }
+    
+    directory.offsets.assign(static_cast<size_t>(count) + 1, 0);
+    if (data.size() < directory.serialized_size()) {
+        throw std::runtime_error("Invalid .etca file: region directory truncated");
+    }
+    
+    size_t position = FIXED_SIZE;
+    if (!directory.wide_offsets) {
+        // v3: sizes, summed into offsets
+        for (size_t k = 0; k < count; ++k) {
+            uint64_t size = 0;
+            for (int i = 0; i < 4; ++i) {
+                size = (size << 8) | data[position++];
+            }
+            directory.offsets[k + 1] = directory.offsets[k] + size;
+        }
+        return directory;
+    }
+    
+    for (uint64_t& offset : directory.offsets) {
+        offset = 0;
+        for (int i = 0; i < 8; ++i) {
+            offset = (offset << 8) | data[position++];
+        }
+    }
+    
+    // Offsets must be ordered; ones past the end of a truncated file are
+    // clamped when the regions are read
+    for (size_t k = 0; k < count; ++k) {
+        if (directory.offsets[k] > directory.offsets[k + 1]) {
+            throw std::runtime_error("Invalid .etca file: region offsets out of order");
+        }
+    }
+    if (directory.offsets.front() != 0) {
+        throw std::runtime_error("Invalid .etca file: region offsets do not start at zero");
+    }
+    
+    return directory;
+}
+
+uint8_t EtcaDirectory::depth_for(uint32_t width, uint32_t height) {
+    if (static_cast<uint64_t>(width) * height < SINGLE_REGION_PIXELS) {
+        return 0;
+    }
+    
+    // Deepen while the smallest region of the next depth still has enough pixels
+    uint8_t depth = 0;
+    while (depth < MAX_DEPTH &&
+           static_cast<uint64_t>(width >> (depth + 1)) * (height >> (depth + 1)) >= MIN_REGION_PIXELS) {
+        ++depth;
+    }
+    return depth;
+}
+
+uint8_t EtcaDirectory::resolve_depth(uint8_t requested, uint32_t width, uint32_t height) {
+    return requested == AUTO_DEPTH ? depth_for(width, height) : std::min(requested, MAX_DEPTH);
+}
+
+std::vector<uint32_t> EtcaDirectory::axis_bounds(uint32_t length, uint8_t depth) {
+    std::vector<uint32_t> bounds = {0, length};
+    
+    // Each subdivision gives the first half of every span the extra pixel,
+    // as TileInflater::get_child_bounds does
+    for (uint8_t level = 0; level < depth; ++level) {
+        std::vector<uint32_t> split;
+        split.reserve(bounds.size() * 2 - 1);
+        for (size_t i = 0; i + 1 < bounds.size(); ++i) {
+            split.push_back(bounds[i]);
+            split.push_back(bounds[i] + (bounds[i + 1] - bounds[i] + 1) / 2);
+        }
+        split.push_back(length);
+        bounds.swap(split);
+    }
+    
+    return bounds;
+}
+
+std::vector<EtcaRegion> EtcaDirectory::region_bounds(uint32_t width, uint32_t height, uint8_t depth) {
+    std::vector<uint32_t> columns = axis_bounds(width, depth);
+    std::vector<uint32_t> rows = axis_bounds(height, depth);
+    
+    std::vector<EtcaRegion> regions;
+    regions.reserve((columns.size() - 1) * (rows.size() - 1));
+    for (size_t row = 0; row + 1 < rows.size(); ++row) {
+        for (size_t column = 0; column + 1 < columns.size(); ++column) {
+            regions.push_back({columns[column], rows[row],
+                               columns[column + 1] - columns[column], rows[row + 1] - rows[row]});
+        }
+    }
+    return regions;
+}
+
 // ============================================================================
 // EtcaMetadata Implementation
 // ============================================================================
@@ -143,7 +301,7 @@ std::vector<uint8_t> EtcaMetadata::serialize() const {
     return std::vector<uint8_t>(str.begin(), str.end());
 }
 
-EtcaMetadata EtcaMetadata::deserialize(const std::vector<uint8_t>& data) {
+EtcaMetadata EtcaMetadata::deserialize(spectre::ByteSpan data) {
     EtcaMetadata metadata;
     
     std::string str(data.begin(), data.end());
@@ -168,186 +326,742 @@ EtcaMetadata EtcaMetadata::deserialize(const std::vector<uint8_t>& data) {
 // EtcaWriter Implementation
 // ============================================================================
 
-void EtcaWriter::write(
-    const spectre::ColorData& image,
-    const std::string& output_path,
-    bool lossless,
-    float variance_threshold,
-    uint16_t max_depth) {
+// The caller's context, or `fallback` (default thread count, scratch kept for this call only)
+static spectre::ExecutionContext& context_or(spectre::ExecutionContext* context,
+                                             spectre::ExecutionContext& fallback) {
+    return context != nullptr ? *context : fallback;
+}
+
+// Run body(k, worker_context) for every region k in [0, count), one region per
+// thread with a serial context each; a lone region gets the whole budget instead
+template <typename Body>
+static void for_each_region(size_t count, spectre::ExecutionContext& context, Body body) {
+    if (count == 1) {
+        body(size_t(0), context);
+        return;
+    }
     
-    // Create compression configuration
-    spectre::CompressionConfig config;
-    config.variance_threshold = variance_threshold / 255.0f;  // Normalize to 0.0-1.0
+    std::vector<spectre::ExecutionContext>& workers = context.worker_contexts();
     
-    if (max_depth > 0) {
-        config.max_tree_depth = max_depth;
-    } else if (lossless) {
-        // For lossless, use a very high depth to capture all details
-        config.max_tree_depth = 32;
+#if ETCA_OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(context.get_threads())
+#endif
+    for (size_t k = 0; k < count; ++k) {
+#if ETCA_OPENMP
+        body(k, workers[static_cast<size_t>(omp_get_thread_num())]);
+#else
+        body(k, workers[0]);
+#endif
+    }
+}
+
+// Region config for a directory of the given depth: the directory stands in
+// for the top levels of the tree
+static spectre::CompressionConfig region_config_for(const spectre::CompressionConfig& config, uint8_t region_depth) {
+    spectre::CompressionConfig region_config = config;
+    region_config.max_tree_depth = std::max(0, config.max_tree_depth - region_depth);
+    return region_config;
+}
+
+// Append the region payload (directory, then the region streams in order) to out
+static void append_region_payload(
+    const std::vector<std::vector<uint8_t>>& streams,
+    uint8_t region_depth,
+    std::vector<uint8_t>& out) {
+    
+    EtcaDirectory directory;
+    directory.depth = region_depth;
+    directory.offsets.reserve(streams.size() + 1);
+    uint64_t offset = 0;
+    directory.offsets.push_back(offset);
+    for (const auto& stream : streams) {
+        offset += stream.size();
+        directory.offsets.push_back(offset);
+    }
+    
+    std::vector<uint8_t> directory_bytes = directory.serialize();
+    out.reserve(out.size() + directory_bytes.size() + static_cast<size_t>(offset));
+    out.insert(out.end(), directory_bytes.begin(), directory_bytes.end());
+    for (const auto& stream : streams) {
+        out.insert(out.end(), stream.begin(), stream.end());
     }
+}
+
+// Compress every directory region as its own stream; appends the region payload to out
+static void compress_regions(
+    const spectre::ImageView& image,
+    const spectre::CompressionConfig& config,
+    uint8_t region_depth,
+    spectre::ExecutionContext& context,
+    std::vector<uint8_t>& out) {
+    
+    std::vector<EtcaRegion> regions = EtcaDirectory::region_bounds(
+        image.get_width(), image.get_height(), region_depth);
+    spectre::CompressionConfig region_config = region_config_for(config, region_depth);
     
-    // Create and use compressor
-    spectre::Compressor compressor(config);
-    spectre::CompressedImage compressed = compressor.compress(image);
+    std::vector<std::vector<uint8_t>> streams(regions.size());
+    
+    for_each_region(regions.size(), context, [&](size_t k, spectre::ExecutionContext& worker) {
+        const EtcaRegion& region = regions[k];
+        if (region.width == 0 || region.height == 0) {
+            return;
+        }
+        spectre::Compressor compressor(region_config);
+        streams[k] = compressor.compress(image.subview(region.x, region.y, region.width, region.height), worker).data;
+    });
     
-    // Create header
+    append_region_payload(streams, region_depth, out);
+}
+
+// Header for an image written by EtcaWriter
+static EtcaHeader make_header(uint32_t width, uint32_t height, bool lossless, size_t metadata_size) {
     EtcaHeader header;
     header.format_version = EtcaHeader::VERSION;
     header.compression_mode = lossless ? CompressionMode::LOSSLESS : CompressionMode::LOSSY;
-    header.width = image.get_width();
-    header.height = image.get_height();
+    header.width = width;
+    header.height = height;
     header.color_depth = EtcaHeader::COLOR_DEPTH_RGB24;
-    header.metadata_size = 0;  // No metadata for now
+    header.metadata_size = static_cast<uint32_t>(metadata_size);
+    return header;
+}
+
+// Compression settings used when compressing from an image file
+static spectre::CompressionConfig file_config(bool lossless, float variance_threshold) {
+    spectre::CompressionConfig config;
+    
+    if (lossless) {
+        // A modest tree as the base layer; residuals make it exact
+        config = spectre::CompressionConfig::lossless();
+    } else {
+        // For lossy, use the quality parameter to determine variance threshold
+        config.variance_threshold = variance_threshold / 255.0f;  // Normalize to 0.0-1.0
+        config.max_tree_depth = 12;
+    }
     
-    // Serialize and write to file
+    return config;
+}
+
+// Compress an image into a complete .etca file image: header, metadata and region payload
+static std::vector<uint8_t> encode_etca_file(
+    const spectre::ImageView& image,
+    bool lossless,
+    const spectre::CompressionConfig& config,
+    const std::vector<uint8_t>& metadata_bytes,
+    uint8_t region_depth,
+    spectre::ExecutionContext& context) {
+    
+    EtcaHeader header = make_header(image.get_width(), image.get_height(), lossless, metadata_bytes.size());
+    
+    std::vector<uint8_t> file_bytes = header.serialize();
+    file_bytes.insert(file_bytes.end(), metadata_bytes.begin(), metadata_bytes.end());
+    
+    // Region directory and compressed regions
+    spectre::ProfileScope scope(context.get_profiler(), "encode");
+    compress_regions(image, config,
+                     EtcaDirectory::resolve_depth(region_depth, image.get_width(), image.get_height()),
+                     context, file_bytes);
+    
+    return file_bytes;
+}
+
+static void write_bytes(const std::vector<uint8_t>& bytes, const std::string& output_path) {
     std::ofstream file(output_path, std::ios::binary);
     if (!file.is_open()) {
         throw std::runtime_error("Cannot open file for writing: " + output_path);
     }
     
-    // Write header
-    auto header_bytes = header.serialize();
-    file.write(reinterpret_cast<const char*>(header_bytes.data()), static_cast<std::streamsize>(header_bytes.size()));
-    
-    // Write compressed data
-    file.write(reinterpret_cast<const char*>(compressed.data.data()), static_cast<std::streamsize>(compressed.data.size()));
+    file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
     
     if (!file.good()) {
         throw std::runtime_error("Failed to write .etca file: " + output_path);
     }
 }
 
-void EtcaWriter::write_from_file(
-    const std::string& input_file,
+void EtcaWriter::write(
+    const spectre::ColorData& image,
     const std::string& output_path,
     bool lossless,
     float variance_threshold,
-    const EtcaMetadata& metadata) {
-    
-    // Load image from file
-    spectre::ColorData image(input_file);
+    uint16_t max_depth,
+    uint8_t region_depth,
+    spectre::ExecutionContext* context) {
     
     // Create compression configuration
     spectre::CompressionConfig config;
-    
     if (lossless) {
-        // For lossless, use extremely low variance threshold to capture all details
-        config.variance_threshold = 0.001;  // Very aggressive subdivision for perfect reconstruction
-        config.max_tree_depth = 24;  // Allow very deep trees for detail
+        config = spectre::CompressionConfig::lossless();
     } else {
-        // For lossy, use the quality parameter to determine variance threshold
         config.variance_threshold = variance_threshold / 255.0f;  // Normalize to 0.0-1.0
-        config.max_tree_depth = 12;
     }
     
-    // Create and use compressor
-    spectre::Compressor compressor(config);
-    spectre::CompressedImage compressed = compressor.compress(image);
+    if (max_depth > 0) {
+        config.max_tree_depth = max_depth;
+    }
     
-    // Create header
-    EtcaHeader header;
-    header.format_version = EtcaHeader::VERSION;
-    header.compression_mode = lossless ? CompressionMode::LOSSLESS : CompressionMode::LOSSY;
-    header.width = image.get_width();
-    header.height = image.get_height();
-    header.color_depth = EtcaHeader::COLOR_DEPTH_RGB24;
+    spectre::ExecutionContext fallback;
+    spectre::ExecutionContext& call_context = context_or(context, fallback);
+    std::vector<uint8_t> file_bytes = encode_etca_file(image.view(), lossless, config, {}, region_depth,
+                                                     call_context);
+    
+    spectre::ProfileScope scope(call_context.get_profiler(), "write");
+    write_bytes(file_bytes, output_path);
+}
+
+void EtcaWriter::write_from_file(
+    const std::string& input_file,
+    const std::string& output_path,
+    bool lossless,
+    float variance_threshold,
+    const EtcaMetadata& metadata,
+    uint8_t region_depth,
+    spectre::ExecutionContext* context) {
+    
+    spectre::ExecutionContext fallback;
+    spectre::ExecutionContext& call_context = context_or(context, fallback);
+    spectre::Profiler* profiler = call_context.get_profiler();
+    
+    // Load image from file
+    spectre::ColorData image = [&] {
+        spectre::ProfileScope scope(profiler, "load");
+        return spectre::ColorData(input_file);
+    }();
+    
+    std::vector<uint8_t> file_bytes = encode(image, lossless, variance_threshold, metadata, region_depth,
+                                             &call_context);
+    
+    spectre::ProfileScope scope(profiler, "write");
+    write_bytes(file_bytes, output_path);
+}
+
+std::vector<uint8_t> EtcaWriter::encode(
+    const spectre::ColorData& image,
+    bool lossless,
+    float variance_threshold,
+    const EtcaMetadata& metadata,
+    uint8_t region_depth,
+    spectre::ExecutionContext* context) {
+    
+    return encode(image.view(), lossless, variance_threshold, metadata, region_depth, context);
+}
+
+std::vector<uint8_t> EtcaWriter::encode(
+    const spectre::ImageView& image,
+    bool lossless,
+    float variance_threshold,
+    const EtcaMetadata& metadata,
+    uint8_t region_depth,
+    spectre::ExecutionContext* context) {
+    
+    spectre::ExecutionContext fallback;
+    return encode_etca_file(image, lossless, file_config(lossless, variance_threshold),
+                            metadata.serialize(), region_depth, context_or(context, fallback));
+}
+
+std::vector<std::vector<uint8_t>> EtcaWriter::encode_variants(
+    const spectre::ColorData& image,
+    bool lossless,
+    float variance_threshold,
+    const std::vector<spectre::RateTarget>& targets,
+    const EtcaMetadata& metadata,
+    uint8_t region_depth,
+    spectre::ExecutionContext* context,
+    std::vector<double>* psnr) {
+    
+    spectre::ExecutionContext fallback;
+    spectre::ExecutionContext& call_context = context_or(context, fallback);
+    
+    region_depth = EtcaDirectory::resolve_depth(region_depth, image.get_width(), image.get_height());
+    std::vector<EtcaRegion> regions = EtcaDirectory::region_bounds(
+        image.get_width(), image.get_height(), region_depth);
+    spectre::CompressionConfig region_config = region_config_for(file_config(lossless, variance_threshold),
+                                                                 region_depth);
+    
+    // Each region's tree is built once and pruned for every variant
+    std::vector<spectre::RateController> controllers(regions.size(), spectre::RateController(region_config));
+    {
+        spectre::ProfileScope scope(call_context.get_profiler(), "encode");
+        for_each_region(regions.size(), call_context, [&](size_t k, spectre::ExecutionContext& worker) {
+            const EtcaRegion& region = regions[k];
+            if (region.width == 0 || region.height == 0) {
+                return;
+            }
+            controllers[k].build(image.view(region.x, region.y, region.width, region.height), worker);
+        });
+    }
+    
+    // All regions are pruned at one threshold, so the image's levels are the union of theirs
+    std::vector<double> levels = {region_config.variance_threshold};
+    for (const auto& controller : controllers) {
+        levels.insert(levels.end(), controller.get_levels().begin(), controller.get_levels().end());
+    }
+    std::sort(levels.begin(), levels.end());
+    levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+    
+    std::vector<uint8_t> metadata_bytes = metadata.serialize();
+    uint64_t pixel_count = static_cast<uint64_t>(image.get_width()) * image.get_height();
+    
+    // Only the unpruned variant keeps the lossless settings; pruned trees
+    // are coded without residuals, which need the pixels
+    auto is_lossless = [&](double threshold) {
+        return lossless && threshold <= region_config.variance_threshold;
+    };
+    
+    auto error_at = [&](double threshold) {
+        uint64_t error = 0;
+        for (const auto& controller : controllers) {
+            error += controller.squared_error(threshold);
+        }
+        return error;
+    };
+    
+    auto encode_at = [&](double threshold) {
+        bool variant_lossless = is_lossless(threshold);
+        
+        std::vector<std::vector<uint8_t>> streams(regions.size());
+        for_each_region(regions.size(), call_context, [&](size_t k, spectre::ExecutionContext& worker) {
+            const EtcaRegion& region = regions[k];
+            if (region.width == 0 || region.height == 0) {
+                return;
+            }
+            if (variant_lossless) {
+                spectre::Compressor compressor(region_config);
+                streams[k] = compressor.compress(image.view(region.x, region.y, region.width, region.height),
+                                                 worker).data;
+                return;
+            }
+            streams[k] = controllers[k].compress_at(threshold, worker).data;
+        });
+        
+        EtcaHeader header = make_header(image.get_width(), image.get_height(), variant_lossless,
+                                        metadata_bytes.size());
+        std::vector<uint8_t> file_bytes = header.serialize();
+        file_bytes.insert(file_bytes.end(), metadata_bytes.begin(), metadata_bytes.end());
+        append_region_payload(streams, region_depth, file_bytes);
+        return file_bytes;
+    };
+    
+    std::vector<std::vector<uint8_t>> files;
+    files.reserve(targets.size());
+    if (psnr != nullptr) {
+        psnr->clear();
+    }
+    for (const spectre::RateTarget& target : targets) {
+        double threshold = target.value;
+        switch (target.kind) {
+            case spectre::RateTarget::Kind::SIZE: {
+                // The finest level that fits; bisection ends on the last fitting candidate
+                std::vector<uint8_t> best;
+                size_t level = spectre::RateController::first_level(levels.size(), [&](size_t candidate) {
+                    std::vector<uint8_t> file_bytes = encode_at(levels[candidate]);
+                    if (static_cast<double>(file_bytes.size()) > target.value) {
+                        return false;
+                    }
+                    best = std::move(file_bytes);
+                    return true;
+                });
+                threshold = levels[std::min(level, levels.size() - 1)];
+                files.push_back(level == levels.size() ? encode_at(threshold) : std::move(best));
+                break;
+            }
+            case spectre::RateTarget::Kind::PSNR: {
+                size_t level = spectre::RateController::level_for_psnr(
+                    levels.size(), target.value, pixel_count, [&](size_t candidate) {
+                        return error_at(levels[candidate]);
+                    });
+                threshold = levels[level];
+                files.push_back(encode_at(threshold));
+                break;
+            }
+            case spectre::RateTarget::Kind::THRESHOLD:
+            default:
+                files.push_back(encode_at(threshold));
+                break;
+        }
+        
+        if (psnr != nullptr) {
+            psnr->push_back(is_lossless(threshold) ? std::numeric_limits<double>::infinity()
+                                                   : spectre::RateController::psnr(error_at(threshold), pixel_count));
+        }
+    }
+    
+    return files;
+}
+
+uint64_t EtcaWriter::write_streaming(
+    const std::string& input_file,
+    const std::string& output_path,
+    bool lossless,
+    float variance_threshold,
+    const EtcaMetadata& metadata,
+    uint64_t band_pixels,
+    spectre::ExecutionContext* context) {
+    
+    spectre::ExecutionContext fallback;
+    spectre::ExecutionContext& call_context = context_or(context, fallback);
+    
+    std::unique_ptr<ImageRowReader> reader = open_image_rows(input_file);
+    uint32_t width = reader->get_width();
+    uint32_t height = reader->get_height();
+    
+    // Deepen the directory until one band of regions fits the budget, or
+    // the regions cannot get any shorter
+    uint8_t region_depth = EtcaDirectory::depth_for(width, height);
+    std::vector<uint32_t> rows = EtcaDirectory::axis_bounds(height, region_depth);
+    while (region_depth < EtcaDirectory::MAX_DEPTH &&
+           static_cast<uint64_t>(rows[1]) * width > band_pixels) {
+        rows = EtcaDirectory::axis_bounds(height, ++region_depth);
+    }
+    std::vector<uint32_t> columns = EtcaDirectory::axis_bounds(width, region_depth);
+    
+    spectre::CompressionConfig config = region_config_for(file_config(lossless, variance_threshold), region_depth);
     
-    // Serialize metadata
-    auto metadata_bytes = const_cast<EtcaMetadata&>(metadata).serialize();
-    header.metadata_size = static_cast<uint32_t>(metadata_bytes.size());
+    std::vector<uint8_t> metadata_bytes = metadata.serialize();
+    EtcaHeader header = make_header(width, height, lossless, metadata_bytes.size());
     
-    // Serialize and write to file
     std::ofstream file(output_path, std::ios::binary);
     if (!file.is_open()) {
         throw std::runtime_error("Cannot open file for writing: " + output_path);
     }
     
-    // Write header
     auto header_bytes = header.serialize();
     file.write(reinterpret_cast<const char*>(header_bytes.data()), static_cast<std::streamsize>(header_bytes.size()));
-    
-    // Write metadata
     if (header.metadata_size > 0) {
         file.write(reinterpret_cast<const char*>(metadata_bytes.data()), static_cast<std::streamsize>(metadata_bytes.size()));
     }
     
-    // Write compressed data
-    file.write(reinterpret_cast<const char*>(compressed.data.data()), static_cast<std::streamsize>(compressed.data.size()));
+    // Reserve the directory; it is filled in once every region's size is known
+    size_t region_count = (rows.size() - 1) * (columns.size() - 1);
+    EtcaDirectory directory;
+    directory.depth = region_depth;
+    directory.offsets.assign(region_count + 1, 0);
+    std::streamoff directory_position = file.tellp();
+    auto placeholder = directory.serialize();
+    file.write(reinterpret_cast<const char*>(placeholder.data()), static_cast<std::streamsize>(placeholder.size()));
+    
+    // The first band is the tallest
+    spectre::ColorData band(width, rows[1]);
+    std::vector<std::vector<uint8_t>> streams(columns.size() - 1);
+    size_t region_index = 0;
+    uint64_t offset = 0;
+    
+    spectre::Profiler* profiler = call_context.get_profiler();
+    
+    for (size_t row = 0; row + 1 < rows.size(); ++row) {
+        uint32_t band_height = rows[row + 1] - rows[row];
+        {
+            spectre::ProfileScope scope(profiler, "load");
+            reader->read_rows(band.row(0), band_height);
+        }
+        
+        {
+            spectre::ProfileScope scope(profiler, "encode");
+            for_each_region(streams.size(), call_context, [&](size_t column, spectre::ExecutionContext& worker) {
+                uint32_t region_width = columns[column + 1] - columns[column];
+                streams[column].clear();
+                if (region_width == 0 || band_height == 0) {
+                    return;
+                }
+                spectre::Compressor compressor(config);
+                streams[column] = compressor.compress(band.view(columns[column], 0, region_width, band_height),
+                                                      worker).data;
+            });
+        }
+        
+        // Regions leave in directory order as soon as their band is done
+        spectre::ProfileScope scope(profiler, "write");
+        for (const auto& stream : streams) {
+            file.write(reinterpret_cast<const char*>(stream.data()), static_cast<std::streamsize>(stream.size()));
+            offset += stream.size();
+            directory.offsets[++region_index] = offset;
+        }
+        
+        if (!file.good()) {
+            throw std::runtime_error("Failed to write .etca file: " + output_path);
+        }
+    }
+    
+    auto directory_bytes = directory.serialize();
+    file.seekp(directory_position);
+    file.write(reinterpret_cast<const char*>(directory_bytes.data()), static_cast<std::streamsize>(directory_bytes.size()));
     
     if (!file.good()) {
         throw std::runtime_error("Failed to write .etca file: " + output_path);
     }
+    
+    return static_cast<uint64_t>(rows[1]) * width;
 }
 
 // ============================================================================
 // EtcaReader Implementation
 // ============================================================================
 
-spectre::ColorData EtcaReader::read(const std::string& input_path) {
-    std::ifstream file(input_path, std::ios::binary);
-    if (!file.is_open()) {
-        throw std::runtime_error("Cannot open file: " + input_path);
+// Parse the header and locate the payload that follows the metadata
+static spectre::ByteSpan payload_section(spectre::ByteSpan file_bytes, EtcaHeader& header) {
+    if (file_bytes.size() < EtcaHeader::HEADER_SIZE) {
+        throw std::runtime_error("Failed to read .etca header");
     }
     
-    // Read header
-    std::vector<uint8_t> header_bytes(EtcaHeader::HEADER_SIZE);
-    file.read(reinterpret_cast<char*>(header_bytes.data()), EtcaHeader::HEADER_SIZE);
-    if (file.gcount() != EtcaHeader::HEADER_SIZE) {
-        throw std::runtime_error("Failed to read .etca header");
+    header = EtcaHeader::deserialize(file_bytes);
+    if (file_bytes.size() - EtcaHeader::HEADER_SIZE < header.metadata_size) {
+        throw std::runtime_error("Failed to read .etca metadata");
     }
     
-    EtcaHeader header = EtcaHeader::deserialize(header_bytes);
+    return file_bytes.subspan(EtcaHeader::HEADER_SIZE + header.metadata_size);
+}
+
+// Decode the regions overlapping a rectangle and paint them into image,
+// which covers the rectangle whose top-left pixel is (x, y)
+static void decode_regions(
+    spectre::ByteSpan payload,
+    const EtcaHeader& header,
+    uint32_t x, uint32_t y,
+    const spectre::MutableImageView& image,
+    int max_depth,
+    spectre::ExecutionContext& context) {
+    
+    EtcaDirectory directory = EtcaDirectory::deserialize(payload, header.format_version);
+    std::vector<EtcaRegion> regions = EtcaDirectory::region_bounds(header.width, header.height, directory.depth);
+    uint32_t width = image.get_width();
+    uint32_t height = image.get_height();
     
-    // Skip metadata if present
-    if (header.metadata_size > 0) {
-        file.ignore(header.metadata_size);
+    // The directory stands in for the top levels of each region's tree
+    int region_max_depth = max_depth < 0 ? -1 : std::max(0, max_depth - directory.depth);
+    spectre::ByteSpan region_bytes = payload.subspan(directory.serialized_size());
+    
+    // Only regions that intersect the rectangle are touched
+    std::vector<size_t> overlapping;
+    for (size_t k = 0; k < regions.size(); ++k) {
+        const EtcaRegion& region = regions[k];
+        if (region.x < x + width && x < region.x + region.width &&
+            region.y < y + height && y < region.y + region.height) {
+            overlapping.push_back(k);
+        }
     }
     
-    // Read remaining compressed data
-    std::vector<uint8_t> compressed_data;
-    char byte;
-    while (file.read(&byte, 1)) {
-        compressed_data.push_back(static_cast<uint8_t>(byte));
+    // Regions cover disjoint pixels, so they can be painted concurrently
+    for_each_region(overlapping.size(), context, [&](size_t i, spectre::ExecutionContext& worker) {
+        size_t k = overlapping[i];
+        const EtcaRegion& region = regions[k];
+        uint64_t begin = std::min<uint64_t>(directory.offsets[k], region_bytes.size());
+        uint64_t end = std::min<uint64_t>(directory.offsets[k + 1], region_bytes.size());
+        spectre::ByteSpan stream = region_bytes.subspan(static_cast<size_t>(begin), static_cast<size_t>(end - begin));
+        
+        uint32_t left = std::max(x, region.x);
+        uint32_t top = std::max(y, region.y);
+        uint32_t right = std::min(x + width, region.x + region.width);
+        uint32_t bottom = std::min(y + height, region.y + region.height);
+        spectre::MutableImageView target = image.subview(left - x, top - y, right - left, bottom - top);
+        
+        // A region inside the rectangle is painted in place; one the edge cuts is decoded and cropped
+        if (right - left == region.width && bottom - top == region.height) {
+            spectre::Decompressor::decompress_into(stream, target, worker, region_max_depth);
+            return;
+        }
+        spectre::ColorData decoded = spectre::Decompressor::decompress(
+            stream, region.width, region.height, false, region_max_depth, worker);
+        target.copy_region(decoded.view(left - region.x, top - region.y, right - left, bottom - top), 0, 0);
+    });
+}
+
+// Decode a whole file's payload into image, which has the size in the header
+static void decode_payload(
+    spectre::ByteSpan payload,
+    const EtcaHeader& header,
+    const spectre::MutableImageView& image,
+    int max_depth,
+    spectre::ExecutionContext& context) {
+    
+    if (header.format_version == EtcaHeader::VERSION_SINGLE_STREAM) {
+        spectre::Decompressor::decompress_into(payload, image, context, max_depth);
+        return;
     }
+    decode_regions(payload, header, 0, 0, image, max_depth, context);
+}
+
+spectre::ColorData EtcaReader::read(const std::string& input_path, int max_depth,
+                                    spectre::ExecutionContext* context) {
+    MappedFile file = [&] {
+        spectre::ProfileScope scope(context != nullptr ? context->get_profiler() : nullptr, "map");
+        return MappedFile(input_path);
+    }();
+    return read(file.bytes(), max_depth, context);
+}
+
+spectre::ColorData EtcaReader::read(spectre::ByteSpan file_bytes, int max_depth,
+                                    spectre::ExecutionContext* context) {
+    spectre::ExecutionContext fallback;
+    spectre::ExecutionContext& call_context = context_or(context, fallback);
     
-    // Decompress image
-    spectre::CompressedImage compressed;
-    compressed.width = header.width;
-    compressed.height = header.height;
-    compressed.data = compressed_data;
+    EtcaHeader header;
+    spectre::ByteSpan payload = payload_section(file_bytes, header);
     
-    return spectre::Decompressor::decompress(compressed);
+    spectre::ProfileScope scope(call_context.get_profiler(), "decode");
+    spectre::ColorData image(header.width, header.height);
+    decode_payload(payload, header, image.mutable_view(), max_depth, call_context);
+    return image;
 }
 
-void EtcaReader::read_to_file(const std::string& input_path, const std::string& output_file) {
-    spectre::ColorData image = read(input_path);
-    image.save_to_file(output_file);
+void EtcaReader::read_into(spectre::ByteSpan file_bytes, const spectre::MutableImageView& image, int max_depth,
+                           spectre::ExecutionContext* context) {
+    spectre::ExecutionContext fallback;
+    spectre::ExecutionContext& call_context = context_or(context, fallback);
+    
+    EtcaHeader header;
+    spectre::ByteSpan payload = payload_section(file_bytes, header);
+    if (image.get_width() != header.width || image.get_height() != header.height) {
+        throw std::runtime_error("Cannot decode a " + std::to_string(header.width) + "x" +
+                                 std::to_string(header.height) + " image into " +
+                                 std::to_string(image.get_width()) + "x" + std::to_string(image.get_height()) +
+                                 " pixels");
+    }
+    
+    spectre::ProfileScope scope(call_context.get_profiler(), "decode");
+    decode_payload(payload, header, image, max_depth, call_context);
 }
 
-EtcaFile EtcaReader::read_header_and_metadata(const std::string& input_path) {
-    std::ifstream file(input_path, std::ios::binary);
-    if (!file.is_open()) {
-        throw std::runtime_error("Cannot open file: " + input_path);
+spectre::ColorData EtcaReader::read_region(
+    const std::string& input_path,
+    uint32_t x, uint32_t y,
+    uint32_t width, uint32_t height,
+    int max_depth,
+    spectre::ExecutionContext* context) {
+    
+    MappedFile file(input_path);
+    return read_region(file.bytes(), x, y, width, height, max_depth, context);
+}
+
+spectre::ColorData EtcaReader::read_region(
+    spectre::ByteSpan file_bytes,
+    uint32_t x, uint32_t y,
+    uint32_t width, uint32_t height,
+    int max_depth,
+    spectre::ExecutionContext* context) {
+    
+    spectre::ExecutionContext fallback;
+    spectre::ExecutionContext& call_context = context_or(context, fallback);
+    
+    EtcaHeader header;
+    spectre::ByteSpan payload = payload_section(file_bytes, header);
+    
+    if (x >= header.width || y >= header.height || width == 0 || height == 0) {
+        throw std::runtime_error("Region lies outside the " + std::to_string(header.width) + "x" +
+                                 std::to_string(header.height) + " image");
     }
+    width = std::min(width, header.width - x);
+    height = std::min(height, header.height - y);
     
-    // Read header
-    std::vector<uint8_t> header_bytes(EtcaHeader::HEADER_SIZE);
-    file.read(reinterpret_cast<char*>(header_bytes.data()), EtcaHeader::HEADER_SIZE);
-    if (file.gcount() != EtcaHeader::HEADER_SIZE) {
-        throw std::runtime_error("Failed to read .etca header");
+    spectre::ProfileScope scope(call_context.get_profiler(), "decode");
+    if (header.format_version == EtcaHeader::VERSION_SINGLE_STREAM) {
+        // No directory: decode everything and crop
+        spectre::ColorData image = spectre::Decompressor::decompress(
+            payload, header.width, header.height, false, max_depth, call_context);
+        return image.extract_region(x, y, width, height);
     }
+    spectre::ColorData image(width, height);
+    decode_regions(payload, header, x, y, image.mutable_view(), max_depth, call_context);
+    return image;
+}
+
+// Decode a region payload band by band (one row of regions each), handing every
+// band's rows to the writer before decoding the next
+static void stream_regions(
+    spectre::ByteSpan payload,
+    const EtcaHeader& header,
+    ImageRowWriter& writer,
+    spectre::ExecutionContext& context) {
     
+    EtcaDirectory directory = EtcaDirectory::deserialize(payload, header.format_version);
+    std::vector<uint32_t> rows = EtcaDirectory::axis_bounds(header.height, directory.depth);
+    std::vector<uint32_t> columns = EtcaDirectory::axis_bounds(header.width, directory.depth);
+    spectre::ByteSpan region_bytes = payload.subspan(directory.serialized_size());
+    size_t band_regions = columns.size() - 1;
+    
+    spectre::Profiler* profiler = context.get_profiler();
+    
+    // The first band is the tallest
+    spectre::ColorData band(header.width, rows[1]);
+    spectre::MutableImageView band_view = band.mutable_view();
+    
+    for (size_t row = 0; row + 1 < rows.size(); ++row) {
+        uint32_t band_height = rows[row + 1] - rows[row];
+        if (band_height == 0) {
+            continue;
+        }
+        
+        {
+            spectre::ProfileScope scope(profiler, "decode");
+            for_each_region(band_regions, context, [&](size_t column, spectre::ExecutionContext& worker) {
+                size_t k = row * band_regions + column;
+                uint32_t region_width = columns[column + 1] - columns[column];
+                if (region_width == 0) {
+                    return;
+                }
+                uint64_t begin = std::min<uint64_t>(directory.offsets[k], region_bytes.size());
+                uint64_t end = std::min<uint64_t>(directory.offsets[k + 1], region_bytes.size());
+                spectre::ByteSpan stream = region_bytes.subspan(static_cast<size_t>(begin),
+                                                                static_cast<size_t>(end - begin));
+                
+                // Painted in place; a cut-short stream may not reach every pixel, so the
+                // previous band's are cleared first
+                spectre::MutableImageView target = band_view.subview(columns[column], 0, region_width, band_height);
+                if (directory.offsets[k + 1] > region_bytes.size()) {
+                    target.fill_region(0, 0, region_width, band_height, spectre::Color());
+                }
+                spectre::Decompressor::decompress_into(stream, target, worker);
+            });
+        }
+        
+        spectre::ProfileScope scope(profiler, "save");
+        writer.write_rows(band.row(0), band_height);
+    }
+}
+
+void EtcaReader::read_to_file(const std::string& input_path, const std::string& output_file, bool interpolate,
+                              spectre::ExecutionContext* context, const ExportOptions& options) {
+    spectre::ExecutionContext fallback;
+    spectre::ExecutionContext& call_context = context_or(context, fallback);
+    
+    spectre::Profiler* profiler = call_context.get_profiler();
+    
+    // Deblocking needs every row's neighbours, so it takes the whole image
+    if (!interpolate) {
+        MappedFile file(input_path);
+        EtcaHeader header;
+        spectre::ByteSpan payload = payload_section(file.bytes(), header);
+        if (header.format_version != EtcaHeader::VERSION_SINGLE_STREAM) {
+            std::unique_ptr<ImageRowWriter> writer = open_image_row_writer(output_file, header.width, header.height,
+                                                                           options);
+            stream_regions(payload, header, *writer, call_context);
+            writer->finish();
+            return;
+        }
+    }
+    
+    spectre::ColorData image = read(input_path, -1, &call_context);
+    if (interpolate) {
+        // After stitching, so region seams are smoothed like any other tile edge
+        spectre::ProfileScope scope(profiler, "deblock");
+        spectre::DeblockingFilter::apply(image, spectre::DeblockingConfig(), call_context.get_threads());
+    }
+    
+    spectre::ProfileScope scope(profiler, "save");
+    save_image(image, output_file, options);
+}
+
+EtcaFile EtcaReader::read_header_and_metadata(const std::string& input_path) {
+    // Mapping is lazy, so the payload pages are never touched here
+    MappedFile file(input_path);
+    return read_header_and_metadata(file.bytes());
+}
+
+EtcaFile EtcaReader::read_header_and_metadata(spectre::ByteSpan file_bytes) {
     EtcaFile etca_file;
-    etca_file.header = EtcaHeader::deserialize(header_bytes);
+    payload_section(file_bytes, etca_file.header);
     
     // Read metadata if present
     if (etca_file.header.metadata_size > 0) {
-        std::vector<uint8_t> metadata_bytes(etca_file.header.metadata_size);
-        file.read(reinterpret_cast<char*>(metadata_bytes.data()), etca_file.header.metadata_size);
-        if (file.gcount() != static_cast<std::streamsize>(etca_file.header.metadata_size)) {
-            throw std::runtime_error("Failed to read .etca metadata");
-        }
-        etca_file.metadata = EtcaMetadata::deserialize(metadata_bytes);
+        etca_file.metadata = EtcaMetadata::deserialize(
+            file_bytes.subspan(EtcaHeader::HEADER_SIZE, etca_file.header.metadata_size));
     }
     
     return etca_file;
@@ -0,0 +1,48 @@
+#include "execution_context.h"
+#if ETCA_OPENMP
+#include <omp.h>
+#endif
+
+namespace spectre {
+
+ExecutionContext::ExecutionContext(int threads)
+    : threads_(resolve_threads(threads)) {
+}
+
+int ExecutionContext::resolve_threads(int threads) {
+    if (threads > 0) {
+        return threads;
+    }
+#if ETCA_OPENMP
+    // Only read here; the default stays whatever OMP_NUM_THREADS asked for
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+std::vector<ExecutionContext>& ExecutionContext::worker_contexts() {
+    while (workers_.size() < static_cast<size_t>(threads_)) {
+        workers_.emplace_back(1);
+        workers_.back().profiler_ = profiler_;
+    }
+    return workers_;
+}
+
+void ExecutionContext::release_scratch() {
+    std::vector<uint32_t>().swap(integral_scratch_);
+    std::vector<uint8_t>().swap(stream_scratch_);
+    entropy_scratch_.release();
+    for (auto& worker : workers_) {
+        worker.release_scratch();
+    }
+}
+
+void ExecutionContext::set_profiler(Profiler* profiler) {
+    profiler_ = profiler;
+    for (auto& worker : workers_) {
+        worker.set_profiler(profiler);
+    }
+}
+
+} // namespace spectre
@@ -0,0 +1,165 @@
+#include "fft.h"
+#include "execution_context.h"
+#include <cmath>
+#include <utility>
+
+namespace spectre {
+
+// Below this many values a 2D transform runs on one thread
+static constexpr uint64_t PARALLEL_MIN_VALUES = 1u << 16;
+
+static bool is_power_of_two(size_t n) {
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+FFTPlan::FFTPlan(size_t size) : size_(size), radix2_size_(size) {
+    if (size_ <= 1) {
+        return;
+    }
+    
+    if (!is_power_of_two(size_)) {
+        radix2_size_ = 1;
+        while (radix2_size_ < 2 * size_ - 1) {
+            radix2_size_ <<= 1;
+        }
+    }
+    
+    // Radix-2 tables
+    int bits = 0;
+    while ((size_t(1) << bits) < radix2_size_) {
+        ++bits;
+    }
+    bit_reverse_.resize(radix2_size_);
+    for (size_t i = 0; i < radix2_size_; ++i) {
+        bit_reverse_[i] = static_cast<uint32_t>((bit_reverse_[i >> 1] >> 1) | ((i & 1) << (bits - 1)));
+    }
+    
+    twiddles_.resize(radix2_size_ / 2);
+    for (size_t k = 0; k < twiddles_.size(); ++k) {
+        double angle = -2.0 * M_PI * static_cast<double>(k) / static_cast<double>(radix2_size_);
+        twiddles_[k] = Complex(std::cos(angle), std::sin(angle));
+    }
+    
+    if (radix2_size_ == size_) {
+        return;
+    }
+    
+    // Bluestein: k n = (k^2 + n^2 - (k - n)^2) / 2, so the transform is the
+    // chirp times the convolution of (x times the chirp) with the conjugate
+    // chirp. k^2 is reduced mod 2N so the angles stay exact for large N.
+    chirp_.resize(size_);
+    for (size_t k = 0; k < size_; ++k) {
+        uint64_t k_squared = (static_cast<uint64_t>(k) * k) % (2 * static_cast<uint64_t>(size_));
+        double angle = -M_PI * static_cast<double>(k_squared) / static_cast<double>(size_);
+        chirp_[k] = Complex(std::cos(angle), std::sin(angle));
+    }
+    
+    chirp_spectrum_.assign(radix2_size_, Complex(0.0, 0.0));
+    chirp_spectrum_[0] = std::conj(chirp_[0]);
+    for (size_t k = 1; k < size_; ++k) {
+        chirp_spectrum_[k] = std::conj(chirp_[k]);
+        chirp_spectrum_[radix2_size_ - k] = std::conj(chirp_[k]);
+    }
+    radix2(chirp_spectrum_.data());
+}
+
+void FFTPlan::radix2(Complex* data) const {
+    for (size_t i = 0; i < radix2_size_; ++i) {
+        size_t j = bit_reverse_[i];
+        if (i < j) {
+            std::swap(data[i], data[j]);
+        }
+    }
+    
+    for (size_t length = 2; length <= radix2_size_; length <<= 1) {
+        size_t half = length / 2;
+        size_t stride = radix2_size_ / length;
+        for (size_t start = 0; start < radix2_size_; start += length) {
+            for (size_t k = 0; k < half; ++k) {
+                Complex odd = data[start + k + half] * twiddles_[k * stride];
+                data[start + k + half] = data[start + k] - odd;
+                data[start + k] += odd;
+            }
+        }
+    }
+}
+
+void FFTPlan::forward(Complex* data, std::vector<Complex>& scratch) const {
+    if (size_ <= 1) {
+        return;
+    }
+    if (radix2_size_ == size_) {
+        radix2(data);
+        return;
+    }
+    
+    scratch.assign(radix2_size_, Complex(0.0, 0.0));
+    for (size_t k = 0; k < size_; ++k) {
+        scratch[k] = data[k] * chirp_[k];
+    }
+    radix2(scratch.data());
+    
+    // Multiply the spectra, then invert with the conjugate trick
+    for (size_t k = 0; k < radix2_size_; ++k) {
+        scratch[k] = std::conj(scratch[k] * chirp_spectrum_[k]);
+    }
+    radix2(scratch.data());
+    
+    double scale = 1.0 / static_cast<double>(radix2_size_);
+    for (size_t k = 0; k < size_; ++k) {
+        data[k] = std::conj(scratch[k]) * scale * chirp_[k];
+    }
+}
+
+void FFTPlan::forward_2d(std::vector<Complex>& data, uint32_t width, uint32_t height, int threads) {
+    if (width == 0 || height == 0) {
+        return;
+    }
+    
+    const FFTPlan row_plan(width);
+    const FFTPlan column_plan(height);
+    const bool parallel = static_cast<uint64_t>(width) * height >= PARALLEL_MIN_VALUES;
+#if ETCA_OPENMP
+    const int thread_count = ExecutionContext::resolve_threads(threads);
+#else
+    (void)threads;
+    (void)parallel;
+#endif
+    
+    // Rows are contiguous and independent
+#if ETCA_OPENMP
+    #pragma omp parallel if(parallel) num_threads(thread_count)
+#endif
+    {
+        std::vector<Complex> scratch;
+#if ETCA_OPENMP
+        #pragma omp for schedule(static)
+#endif
+        for (uint32_t y = 0; y < height; ++y) {
+            row_plan.forward(&data[static_cast<size_t>(y) * width], scratch);
+        }
+    }
+    
+    // Columns are gathered into a contiguous buffer per thread
+#if ETCA_OPENMP
+    #pragma omp parallel if(parallel) num_threads(thread_count)
+#endif
+    {
+        std::vector<Complex> column(height);
+        std::vector<Complex> scratch;
+#if ETCA_OPENMP
+        #pragma omp for schedule(static)
+#endif
+        for (uint32_t x = 0; x < width; ++x) {
+            for (uint32_t y = 0; y < height; ++y) {
+                column[y] = data[static_cast<size_t>(y) * width + x];
+            }
+            column_plan.forward(column.data(), scratch);
+            for (uint32_t y = 0; y < height; ++y) {
+                data[static_cast<size_t>(y) * width + x] = column[y];
+            }
+        }
+    }
+}
+
+} // namespace spectre
@@ -4,8 +4,18 @@
 
 namespace spectre {
 
-HierarchicalAddress::HierarchicalAddress(const std::vector<AddressSegment>& address)
-    : address_(address) {
+HierarchicalAddress::HierarchicalAddress(const std::vector<AddressSegment>& address) {
+    bool packs = address.size() <= PackedAddress::MAX_DEPTH &&
+                 std::all_of(address.begin(), address.end(),
+                             [](AddressSegment segment) { return segment <= PackedAddress::MAX_SEGMENT; });
+    if (!packs) {
+        overflow_ = address;
+        return;
+    }
+    
+    for (AddressSegment segment : address) {
+        packed_ = packed_.child(segment);
+    }
 }
 
 HierarchicalAddress HierarchicalAddress::from_string(const std::string& str) {
@@ -28,48 +38,82 @@ HierarchicalAddress HierarchicalAddress::from_string(const std::string& str) {
 }
 
 std::string HierarchicalAddress::to_string() const {
-    if (address_.empty()) {
+    if (is_root()) {
         return ".";  // root
     }
     
     std::ostringstream oss;
-    for (size_t i = 0; i < address_.size(); ++i) {
+    for (size_t i = 0; i < get_depth(); ++i) {
         if (i > 0) oss << ".";
-        oss << address_[i];
+        oss << get_segment(i);
     }
     return oss.str();
 }
 
+std::vector<HierarchicalAddress::AddressSegment> HierarchicalAddress::get_address() const {
+    if (!is_packed()) {
+        return overflow_;
+    }
+    
+    std::vector<AddressSegment> segments(packed_.depth);
+    for (uint32_t level = 0; level < packed_.depth; ++level) {
+        segments[level] = packed_.segment(level);
+    }
+    return segments;
+}
+
 HierarchicalAddress HierarchicalAddress::get_child_address(AddressSegment segment) const {
-    auto child_addr = address_;
+    if (is_packed() && packed_.has_room() && segment <= PackedAddress::MAX_SEGMENT) {
+        return HierarchicalAddress(packed_.child(segment));
+    }
+    
+    auto child_addr = get_address();
     child_addr.push_back(segment);
     return HierarchicalAddress(child_addr);
 }
 
 HierarchicalAddress HierarchicalAddress::get_parent_address() const {
-    if (address_.empty()) {
-        return HierarchicalAddress();  // Can't go above root
+    if (is_packed()) {
+        return HierarchicalAddress(packed_.parent());  // The root stays the root
     }
     
-    auto parent_addr = address_;
+    auto parent_addr = overflow_;
     parent_addr.pop_back();
     return HierarchicalAddress(parent_addr);
 }
 
 bool HierarchicalAddress::is_descendant_of(const HierarchicalAddress& parent) const {
-    if (parent.address_.size() >= address_.size()) {
+    if (is_packed() && parent.is_packed()) {
+        return packed_.is_descendant_of(parent.packed_);
+    }
+    if (parent.get_depth() >= get_depth()) {
         return false;
     }
     
-    return std::equal(parent.address_.begin(), parent.address_.end(), address_.begin());
+    for (size_t level = 0; level < parent.get_depth(); ++level) {
+        if (parent.get_segment(level) != get_segment(level)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 bool HierarchicalAddress::operator==(const HierarchicalAddress& other) const {
-    return address_ == other.address_;
+    // Each address has one form, so different forms mean different addresses
+    if (is_packed() != other.is_packed()) {
+        return false;
+    }
+    return is_packed() ? packed_ == other.packed_ : overflow_ == other.overflow_;
 }
 
 bool HierarchicalAddress::operator<(const HierarchicalAddress& other) const {
-    return address_ < other.address_;
+    if (is_packed() && other.is_packed()) {
+        return packed_ < other.packed_;
+    }
+    
+    std::vector<AddressSegment> lhs = get_address();
+    std::vector<AddressSegment> rhs = other.get_address();
+    return lhs < rhs;
 }
 
 } // namespace spectre
@@ -5,211 +5,468 @@
 #include <cctype>
 #include <cstring>
 #include <png.h>
+#include <zlib.h>
 
 namespace etca {
 
 // ============================================================================
-// PPM Loader Implementation
+// Row Reader Implementations
 // ============================================================================
 
-spectre::ColorData PPMLoader::load(const std::string& file_path) const {
-    std::ifstream file(file_path, std::ios::binary);
-    if (!file.is_open()) {
-        throw std::runtime_error("Cannot open file: " + file_path);
+namespace {
+
+// Fill a whole image from a row reader
+spectre::ColorData read_all_rows(ImageRowReader& reader) {
+    spectre::ColorData image(reader.get_width(), reader.get_height());
+    for (uint32_t y = 0; y < reader.get_height(); ++y) {
+        reader.read_rows(image.row(y), 1);
     }
-    
-    // Read magic number (P6 for binary PPM)
-    std::string magic;
-    file >> magic;
-    if (magic != "P6") {
-        throw std::runtime_error("Not a valid binary PPM file (P6 format expected): " + file_path);
+    return image;
+}
+
+/**
+ * @brief Reads P6 scanlines straight from the file
+ */
+class PPMRowReader : public ImageRowReader {
+public:
+    explicit PPMRowReader(const std::string& file_path) : file_(file_path, std::ios::binary) {
+        if (!file_.is_open()) {
+            throw std::runtime_error("Cannot open file: " + file_path);
+        }
+        
+        // Read magic number (P6 for binary PPM)
+        std::string magic;
+        file_ >> magic;
+        if (magic != "P6") {
+            throw std::runtime_error("Not a valid binary PPM file (P6 format expected): " + file_path);
+        }
+        
+        // Skip comments
+        file_ >> std::ws;
+        while (file_.peek() == '#') {
+            std::string line;
+            std::getline(file_, line);  // Skip comment line
+            file_ >> std::ws;
+        }
+        
+        // Read width and height
+        file_ >> width_ >> height_;
+        
+        if (!file_ || width_ == 0 || height_ == 0) {
+            throw std::runtime_error("Invalid PPM dimensions: " + std::to_string(width_) + "x" + std::to_string(height_));
+        }
+        
+        // Read max color value
+        int max_color = 0;
+        file_ >> max_color;
+        if (max_color != 255) {
+            throw std::runtime_error("PPM max color value must be 255, got: " + std::to_string(max_color));
+        }
+        
+        // Skip whitespace after max color value
+        file_.ignore(1);
     }
     
-    // Skip comments
-    int c;
-    while ((c = file.peek()) == '#') {
-        std::string line;
-        std::getline(file, line);  // Skip comment line
+    void read_rows(spectre::Color* out, uint32_t count) override {
+        if (count > height_ - rows_read_) {
+            throw std::runtime_error("Read past the last row of PPM file");
+        }
+        
+        // P6 samples are packed RGB, the same layout as Color rows
+        std::streamsize row_bytes = static_cast<std::streamsize>(width_) * 3;
+        for (uint32_t y = 0; y < count; ++y) {
+            file_.read(reinterpret_cast<char*>(out), row_bytes);
+            if (file_.gcount() != row_bytes) {
+                throw std::runtime_error("Failed to read complete pixel data from PPM file");
+            }
+            out += width_;
+            ++rows_read_;
+        }
     }
-    
-    // Read width and height
-    uint32_t width, height;
-    file >> width >> height;
-    
-    if (width == 0 || height == 0) {
-        throw std::runtime_error("Invalid PPM dimensions: " + std::to_string(width) + "x" + std::to_string(height));
+
+private:
+    std::ifstream file_;
+};
+
+/**
+ * @brief Decodes PNG rows on demand with libpng, converted to 8-bit RGB
+ */
+class PNGRowReader : public ImageRowReader {
+public:
+    explicit PNGRowReader(const std::string& file_path) : file_path_(file_path) {
+        fp_ = fopen(file_path.c_str(), "rb");
+        if (!fp_) {
+            throw std::runtime_error("Cannot open PNG file: " + file_path);
+        }
+        
+        // Initialize PNG structures
+        png_ptr_ = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+        if (!png_ptr_) {
+            fclose(fp_);
+            throw std::runtime_error("Failed to create PNG read structure");
+        }
+        
+        info_ptr_ = png_create_info_struct(png_ptr_);
+        if (!info_ptr_) {
+            png_destroy_read_struct(&png_ptr_, nullptr, nullptr);
+            fclose(fp_);
+            throw std::runtime_error("Failed to create PNG info structure");
+        }
+        
+        // Set error handling using setjmp
+        if (setjmp(png_jmpbuf(png_ptr_))) {
+            png_destroy_read_struct(&png_ptr_, &info_ptr_, nullptr);
+            fclose(fp_);
+            throw std::runtime_error("Error reading PNG file: " + file_path);
+        }
+        
+        // Set up file I/O
+        png_init_io(png_ptr_, fp_);
+        
+        // Read PNG info
+        png_read_info(png_ptr_, info_ptr_);
+        
+        width_ = png_get_image_width(png_ptr_, info_ptr_);
+        height_ = png_get_image_height(png_ptr_, info_ptr_);
+        png_byte color_type = png_get_color_type(png_ptr_, info_ptr_);
+        png_byte bit_depth = png_get_bit_depth(png_ptr_, info_ptr_);
+        
+        if (width_ == 0 || height_ == 0) {
+            png_destroy_read_struct(&png_ptr_, &info_ptr_, nullptr);
+            fclose(fp_);
+            throw std::runtime_error("Invalid PNG dimensions: " + std::to_string(width_) + "x" + std::to_string(height_));
+        }
+        
+        // Convert to RGB if necessary
+        if (bit_depth == 16) {
+            png_set_strip_16(png_ptr_);
+        }
+        
+        if (color_type == PNG_COLOR_TYPE_PALETTE) {
+            png_set_palette_to_rgb(png_ptr_);
+        }
+        
+        if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) {
+            png_set_expand_gray_1_2_4_to_8(png_ptr_);
+        }
+        
+        // Convert grayscale to RGB
+        if (color_type == PNG_COLOR_TYPE_GRAY ||
+            color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
+            png_set_gray_to_rgb(png_ptr_);
+        }
+        
+        // Alpha (including palette transparency, which the expansion above
+        // turns into alpha) is ignored; dropping it leaves rows in Color's
+        // packed RGB layout
+        if ((color_type & PNG_COLOR_MASK_ALPHA) || png_get_valid(png_ptr_, info_ptr_, PNG_INFO_tRNS)) {
+            png_set_strip_alpha(png_ptr_);
+        }
+        
+        bool interlaced = png_get_interlace_type(png_ptr_, info_ptr_) != PNG_INTERLACE_NONE;
+        if (interlaced) {
+            png_set_interlace_handling(png_ptr_);
+        }
+        
+        png_read_update_info(png_ptr_, info_ptr_);
+        
+        size_t row_bytes = static_cast<size_t>(width_) * 3;  // RGB
+        if (png_get_rowbytes(png_ptr_, info_ptr_) != row_bytes) {
+            png_destroy_read_struct(&png_ptr_, &info_ptr_, nullptr);
+            fclose(fp_);
+            throw std::runtime_error("Unsupported PNG pixel layout: " + file_path);
+        }
+        if (interlaced) {
+            // Adam7 passes revisit every row, so the whole image is decoded up front
+            rows_.resize(row_bytes * height_);
+            std::vector<png_bytep> row_pointers(height_);
+            for (uint32_t y = 0; y < height_; ++y) {
+                row_pointers[y] = &rows_[y * row_bytes];
+            }
+            png_read_image(png_ptr_, row_pointers.data());
+        }
+        interlaced_ = interlaced;
     }
     
-    // Read max color value
-    int max_color;
-    file >> max_color;
-    if (max_color != 255) {
-        throw std::runtime_error("PPM max color value must be 255, got: " + std::to_string(max_color));
+    ~PNGRowReader() override {
+        png_destroy_read_struct(&png_ptr_, &info_ptr_, nullptr);
+        fclose(fp_);
     }
     
-    // Skip whitespace after max color value
-    file.ignore(1);
+    PNGRowReader(const PNGRowReader&) = delete;
+    PNGRowReader& operator=(const PNGRowReader&) = delete;
     
-    // Read pixel data
-    spectre::ColorData image(width, height);
-    std::vector<uint8_t> buffer(width * height * 3);
-    file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
-    
-    if (file.gcount() != static_cast<std::streamsize>(buffer.size())) {
-        throw std::runtime_error("Failed to read complete pixel data from PPM file");
+    void read_rows(spectre::Color* out, uint32_t count) override {
+        if (count > height_ - rows_read_) {
+            throw std::runtime_error("Read past the last row of PNG file: " + file_path_);
+        }
+        
+        size_t row_bytes = static_cast<size_t>(width_) * 3;
+        for (uint32_t y = 0; y < count; ++y) {
+            uint8_t* row = reinterpret_cast<uint8_t*>(out);
+            if (interlaced_) {
+                std::memcpy(row, &rows_[static_cast<size_t>(rows_read_) * row_bytes], row_bytes);
+            } else {
+                decode_row(row);  // Straight into the caller's pixels
+            }
+            out += width_;
+            ++rows_read_;
+        }
     }
-    
-    // Fill image data (row-major order)
-    for (uint32_t y = 0; y < height; ++y) {
-        for (uint32_t x = 0; x < width; ++x) {
-            size_t idx = (y * width + x) * 3;
-            spectre::Color color(buffer[idx], buffer[idx + 1], buffer[idx + 2]);
-            image.set_pixel(x, y, color);
+
+private:
+    /**
+     * @brief Decode the next row into `row`; libpng errors longjmp back here
+     */
+    void decode_row(uint8_t* row) {
+        if (setjmp(png_jmpbuf(png_ptr_))) {
+            throw std::runtime_error("Error reading PNG file: " + file_path_);
         }
+        png_read_row(png_ptr_, row, nullptr);
     }
     
-    return image;
-}
+    std::string file_path_;
+    FILE* fp_ = nullptr;
+    png_structp png_ptr_ = nullptr;
+    png_infop info_ptr_ = nullptr;
+    std::vector<uint8_t> rows_;  // The whole image, if interlaced
+    bool interlaced_ = false;
+};
 
 // ============================================================================
-// PPM Exporter Implementation
+// Row Writer Implementations
 // ============================================================================
 
-void PPMExporter::save(const spectre::ColorData& color_data, const std::string& file_path) const {
-    std::ofstream file(file_path, std::ios::binary);
-    if (!file.is_open()) {
-        throw std::runtime_error("Cannot write to file: " + file_path);
+/**
+ * @brief Writes P6 scanlines straight to the file
+ */
+class PPMRowWriter : public ImageRowWriter {
+public:
+    PPMRowWriter(const std::string& file_path, uint32_t width, uint32_t height)
+        : file_path_(file_path), file_(file_path, std::ios::binary) {
+        if (!file_.is_open()) {
+            throw std::runtime_error("Cannot write to file: " + file_path);
+        }
+        width_ = width;
+        height_ = height;
+        
+        // Write PPM header
+        file_ << "P6\n" << width << " " << height << "\n" << "255\n";
     }
     
-    uint32_t width = color_data.get_width();
-    uint32_t height = color_data.get_height();
-    
-    // Write PPM header
-    file << "P6\n";
-    file << width << " " << height << "\n";
-    file << "255\n";
-    
-    // Write pixel data
-    const auto& pixels = color_data.get_pixels();
-    for (const auto& pixel : pixels) {
-        file.put(static_cast<char>(pixel.r));
-        file.put(static_cast<char>(pixel.g));
-        file.put(static_cast<char>(pixel.b));
+    void write_rows(const spectre::Color* rows, uint32_t count) override {
+        if (count > height_ - rows_written_) {
+            throw std::runtime_error("Write past the last row of PPM file: " + file_path_);
+        }
+        
+        // Color rows are already packed RGB, so a band is one write
+        file_.write(reinterpret_cast<const char*>(rows),
+                    static_cast<std::streamsize>(static_cast<size_t>(width_) * count * sizeof(spectre::Color)));
+        rows_written_ += count;
+        if (!file_.good()) {
+            throw std::runtime_error("Failed to write PPM file: " + file_path_);
+        }
     }
     
-    if (!file.good()) {
-        throw std::runtime_error("Failed to write PPM file: " + file_path);
+    void finish() override {
+        if (rows_written_ != height_) {
+            throw std::runtime_error("PPM file finished before its last row: " + file_path_);
+        }
+        file_.close();
+        if (!file_.good()) {
+            throw std::runtime_error("Failed to write PPM file: " + file_path_);
+        }
     }
-}
 
-// ============================================================================
-// PNG Loader Implementation (using libpng)
-// ============================================================================
+private:
+    std::string file_path_;
+    std::ofstream file_;
+};
 
-spectre::ColorData PNGLoader::load(const std::string& file_path) const {
-    FILE* fp = fopen(file_path.c_str(), "rb");
-    if (!fp) {
-        throw std::runtime_error("Cannot open PNG file: " + file_path);
-    }
-    
-    // Initialize PNG structures
-    png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-    if (!png_ptr) {
-        fclose(fp);
-        throw std::runtime_error("Failed to create PNG read structure");
-    }
-    
-    png_infop info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr) {
-        png_destroy_read_struct(&png_ptr, nullptr, nullptr);
-        fclose(fp);
-        throw std::runtime_error("Failed to create PNG info structure");
+int png_filter_flags(PNGFilter filter) {
+    switch (filter) {
+        case PNGFilter::NONE: return PNG_FILTER_NONE;
+        case PNGFilter::SUB: return PNG_FILTER_SUB;
+        case PNGFilter::UP: return PNG_FILTER_UP;
+        case PNGFilter::AVERAGE: return PNG_FILTER_AVG;
+        case PNGFilter::PAETH: return PNG_FILTER_PAETH;
+        default: return PNG_ALL_FILTERS;
     }
-    
-    // Set error handling using setjmp
-    if (setjmp(png_jmpbuf(png_ptr))) {
-        png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
-        fclose(fp);
-        throw std::runtime_error("Error reading PNG file: " + file_path);
-    }
-    
-    // Set up file I/O
-    png_init_io(png_ptr, fp);
-    
-    // Read PNG info
-    png_read_info(png_ptr, info_ptr);
-    
-    uint32_t width = png_get_image_width(png_ptr, info_ptr);
-    uint32_t height = png_get_image_height(png_ptr, info_ptr);
-    png_byte color_type = png_get_color_type(png_ptr, info_ptr);
-    png_byte bit_depth = png_get_bit_depth(png_ptr, info_ptr);
-    
-    if (width == 0 || height == 0) {
-        png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
-        fclose(fp);
-        throw std::runtime_error("Invalid PNG dimensions: " + std::to_string(width) + "x" + std::to_string(height));
-    }
-    
-    // Convert to RGB if necessary
-    if (bit_depth == 16) {
-        png_set_strip_16(png_ptr);
-    }
-    
-    if (color_type == PNG_COLOR_TYPE_PALETTE) {
-        png_set_palette_to_rgb(png_ptr);
+}
+
+int zlib_strategy_value(spectre::ZlibStrategy strategy) {
+    switch (strategy) {
+        case spectre::ZlibStrategy::FILTERED: return Z_FILTERED;
+        case spectre::ZlibStrategy::HUFFMAN_ONLY: return Z_HUFFMAN_ONLY;
+        case spectre::ZlibStrategy::RLE: return Z_RLE;
+        default: return Z_DEFAULT_STRATEGY;
     }
-    
-    if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) {
-        png_set_expand_gray_1_2_4_to_8(png_ptr);
+}
+
+/**
+ * @brief Encodes rows with libpng as they arrive
+ */
+class PNGRowWriter : public ImageRowWriter {
+public:
+    PNGRowWriter(const std::string& file_path, uint32_t width, uint32_t height, const ExportOptions& options)
+        : file_path_(file_path) {
+        width_ = width;
+        height_ = height;
+        
+        fp_ = fopen(file_path.c_str(), "wb");
+        if (!fp_) {
+            throw std::runtime_error("Cannot write to PNG file: " + file_path);
+        }
+        
+        // Initialize PNG structures
+        png_ptr_ = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+        if (!png_ptr_) {
+            fclose(fp_);
+            throw std::runtime_error("Failed to create PNG write structure");
+        }
+        
+        info_ptr_ = png_create_info_struct(png_ptr_);
+        if (!info_ptr_) {
+            png_destroy_write_struct(&png_ptr_, nullptr);
+            fclose(fp_);
+            throw std::runtime_error("Failed to create PNG info structure");
+        }
+        
+        // Set error handling using setjmp
+        if (setjmp(png_jmpbuf(png_ptr_))) {
+            png_destroy_write_struct(&png_ptr_, &info_ptr_);
+            fclose(fp_);
+            throw std::runtime_error("Error writing PNG file: " + file_path);
+        }
+        
+        // Set up file I/O
+        png_init_io(png_ptr_, fp_);
+        
+        // Unset options keep libpng's defaults
+        if (options.zlib_level >= 0) {
+            png_set_compression_level(png_ptr_, std::min(options.zlib_level, 9));
+        }
+        if (options.zlib_strategy != spectre::ZlibStrategy::DEFAULT) {
+            png_set_compression_strategy(png_ptr_, zlib_strategy_value(options.zlib_strategy));
+        }
+        if (options.filter != PNGFilter::ADAPTIVE) {
+            png_set_filter(png_ptr_, PNG_FILTER_TYPE_BASE, png_filter_flags(options.filter));
+        }
+        
+        // Set PNG image info
+        png_set_IHDR(
+            png_ptr_,
+            info_ptr_,
+            width, height,
+            8,  // bit depth
+            PNG_COLOR_TYPE_RGB,
+            PNG_INTERLACE_NONE,
+            PNG_COMPRESSION_TYPE_DEFAULT,
+            PNG_FILTER_TYPE_DEFAULT
+        );
+        
+        // Write PNG info
+        png_write_info(png_ptr_, info_ptr_);
     }
     
-    if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)) {
-        png_set_tRNS_to_alpha(png_ptr);
+    ~PNGRowWriter() override {
+        png_destroy_write_struct(&png_ptr_, &info_ptr_);
+        if (fp_) {
+            fclose(fp_);
+        }
     }
     
-    // Convert grayscale to RGB
-    if (color_type == PNG_COLOR_TYPE_GRAY ||
-        color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
-        png_set_gray_to_rgb(png_ptr);
-    }
+    PNGRowWriter(const PNGRowWriter&) = delete;
+    PNGRowWriter& operator=(const PNGRowWriter&) = delete;
     
-    // Add alpha channel if missing (but we'll ignore it)
-    if (color_type == PNG_COLOR_TYPE_RGB ||
-        color_type == PNG_COLOR_TYPE_GRAY ||
-        color_type == PNG_COLOR_TYPE_PALETTE) {
-        png_set_filler(png_ptr, 0xFF, PNG_FILLER_AFTER);
+    void write_rows(const spectre::Color* rows, uint32_t count) override {
+        if (count > height_ - rows_written_) {
+            throw std::runtime_error("Write past the last row of PNG file: " + file_path_);
+        }
+        
+        // Color rows are already packed RGB
+        for (uint32_t y = 0; y < count; ++y) {
+            encode_row(reinterpret_cast<png_const_bytep>(rows));
+            rows += width_;
+            ++rows_written_;
+        }
     }
     
-    png_read_update_info(png_ptr, info_ptr);
-    
-    // Create image data
-    spectre::ColorData image(width, height);
-    
-    // Allocate row pointers
-    std::vector<png_bytep> row_pointers(height);
-    std::vector<uint8_t> image_data(width * height * 4);  // RGBA
-    
-    for (uint32_t y = 0; y < height; ++y) {
-        row_pointers[y] = &image_data[y * width * 4];
+    void finish() override {
+        if (rows_written_ != height_) {
+            throw std::runtime_error("PNG file finished before its last row: " + file_path_);
+        }
+        if (setjmp(png_jmpbuf(png_ptr_))) {
+            throw std::runtime_error("Error writing PNG file: " + file_path_);
+        }
+        png_write_end(png_ptr_, info_ptr_);
+        
+        int result = fclose(fp_);
+        fp_ = nullptr;
+        if (result != 0) {
+            throw std::runtime_error("Failed to write PNG file: " + file_path_);
+        }
     }
-    
-    // Read PNG data
-    png_read_image(png_ptr, row_pointers.data());
-    
-    // Copy RGB data to ColorData (ignoring alpha channel)
-    for (uint32_t y = 0; y < height; ++y) {
-        for (uint32_t x = 0; x < width; ++x) {
-            size_t idx = (y * width + x) * 4;
-            spectre::Color color(image_data[idx], image_data[idx + 1], image_data[idx + 2]);
-            image.set_pixel(x, y, color);
+
+private:
+    /**
+     * @brief Encode one row; libpng errors longjmp back here
+     */
+    void encode_row(png_const_bytep row) {
+        if (setjmp(png_jmpbuf(png_ptr_))) {
+            throw std::runtime_error("Error writing PNG file: " + file_path_);
         }
+        png_write_row(png_ptr_, row);
     }
     
-    // Cleanup
-    png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
-    fclose(fp);
-    
-    return image;
+    std::string file_path_;
+    FILE* fp_ = nullptr;
+    png_structp png_ptr_ = nullptr;
+    png_infop info_ptr_ = nullptr;
+};
+
+// Write a whole image through a row writer
+void write_all_rows(const spectre::ColorData& image, ImageRowWriter& writer) {
+    if (image.get_height() > 0) {
+        writer.write_rows(image.get_pixels().data(), image.get_height());
+    }
+    writer.finish();
+}
+
+} // namespace
+
+ExportOptions ExportOptions::fast() {
+    ExportOptions options;
+    options.zlib_level = 1;
+    options.filter = PNGFilter::SUB;
+    return options;
+}
+
+// ============================================================================
+// PPM Loader Implementation
+// ============================================================================
+
+spectre::ColorData PPMLoader::load(const std::string& file_path) const {
+    PPMRowReader reader(file_path);
+    return read_all_rows(reader);
+}
+
+// ============================================================================
+// PPM Exporter Implementation
+// ============================================================================
+
+void PPMExporter::save(const spectre::ColorData& color_data, const std::string& file_path) const {
+    PPMRowWriter writer(file_path, color_data.get_width(), color_data.get_height());
+    write_all_rows(color_data, writer);
+}
+
+// ============================================================================
+// PNG Loader Implementation (using libpng)
+// ============================================================================
+
+spectre::ColorData PNGLoader::load(const std::string& file_path) const {
+    PNGRowReader reader(file_path);
+    return read_all_rows(reader);
 }
 
 // ============================================================================
@@ -217,78 +474,8 @@ spectre::ColorData PNGLoader::load(const std::string& file_path) const {
 // ============================================================================
 
 void PNGExporter::save(const spectre::ColorData& color_data, const std::string& file_path) const {
-    uint32_t width = color_data.get_width();
-    uint32_t height = color_data.get_height();
-    
-    FILE* fp = fopen(file_path.c_str(), "wb");
-    if (!fp) {
-        throw std::runtime_error("Cannot write to PNG file: " + file_path);
-    }
-    
-    // Initialize PNG structures
-    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-    if (!png_ptr) {
-        fclose(fp);
-        throw std::runtime_error("Failed to create PNG write structure");
-    }
-    
-    png_infop info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr) {
-        png_destroy_write_struct(&png_ptr, nullptr);
-        fclose(fp);
-        throw std::runtime_error("Failed to create PNG info structure");
-    }
-    
-    // Set error handling using setjmp
-    if (setjmp(png_jmpbuf(png_ptr))) {
-        png_destroy_write_struct(&png_ptr, &info_ptr);
-        fclose(fp);
-        throw std::runtime_error("Error writing PNG file: " + file_path);
-    }
-    
-    // Set up file I/O
-    png_init_io(png_ptr, fp);
-    
-    // Set PNG image info
-    png_set_IHDR(
-        png_ptr,
-        info_ptr,
-        width, height,
-        8,  // bit depth
-        PNG_COLOR_TYPE_RGB,
-        PNG_INTERLACE_NONE,
-        PNG_COMPRESSION_TYPE_DEFAULT,
-        PNG_FILTER_TYPE_DEFAULT
-    );
-    
-    // Write PNG info
-    png_write_info(png_ptr, info_ptr);
-    
-    // Prepare pixel data
-    const auto& pixels = color_data.get_pixels();
-    std::vector<png_bytep> row_pointers(height);
-    std::vector<uint8_t> image_data(width * height * 3);  // RGB
-    
-    // Copy ColorData pixels to RGB format
-    for (uint32_t y = 0; y < height; ++y) {
-        for (uint32_t x = 0; x < width; ++x) {
-            size_t src_idx = y * width + x;
-            size_t dst_idx = (y * width + x) * 3;
-            
-            image_data[dst_idx] = pixels[src_idx].r;
-            image_data[dst_idx + 1] = pixels[src_idx].g;
-            image_data[dst_idx + 2] = pixels[src_idx].b;
-        }
-        row_pointers[y] = &image_data[y * width * 3];
-    }
-    
-    // Write PNG data
-    png_write_image(png_ptr, row_pointers.data());
-    png_write_end(png_ptr, info_ptr);
-    
-    // Cleanup
-    png_destroy_write_struct(&png_ptr, &info_ptr);
-    fclose(fp);
+    PNGRowWriter writer(file_path, color_data.get_width(), color_data.get_height(), options_);
+    write_all_rows(color_data, writer);
 }
 
 // ============================================================================
@@ -329,14 +516,71 @@ spectre::ColorData load_image(const std::string& file_path) {
     throw std::runtime_error("Unsupported image format: " + format);
 }
 
-void save_image(const spectre::ColorData& color_data, const std::string& file_path) {
+std::unique_ptr<ImageRowReader> open_image_rows(const std::string& file_path) {
+    std::string format = detect_image_format(file_path);
+    
+    if (format == "ppm") {
+        return std::make_unique<PPMRowReader>(file_path);
+    } else if (format == "png") {
+        return std::make_unique<PNGRowReader>(file_path);
+    }
+    
+    throw std::runtime_error("Unsupported image format: " + format);
+}
+
+void read_image_size(const std::string& file_path, uint32_t& width, uint32_t& height) {
+    std::string format = detect_image_format(file_path);
+    
+    if (format == "ppm") {
+        // Opening the reader parses just the header
+        PPMRowReader reader(file_path);
+        width = reader.get_width();
+        height = reader.get_height();
+        return;
+    }
+    
+    // PNG: signature followed by the IHDR chunk, whose data starts with width and height
+    std::ifstream file(file_path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot open file: " + file_path);
+    }
+    
+    uint8_t head[24];
+    file.read(reinterpret_cast<char*>(head), sizeof(head));
+    if (file.gcount() != static_cast<std::streamsize>(sizeof(head)) ||
+        png_sig_cmp(head, 0, 8) != 0 || std::memcmp(head + 12, "IHDR", 4) != 0) {
+        throw std::runtime_error("Not a valid PNG file: " + file_path);
+    }
+    
+    auto read_be32 = [&](size_t offset) {
+        return (static_cast<uint32_t>(head[offset]) << 24) | (static_cast<uint32_t>(head[offset + 1]) << 16) |
+               (static_cast<uint32_t>(head[offset + 2]) << 8) | static_cast<uint32_t>(head[offset + 3]);
+    };
+    width = read_be32(16);
+    height = read_be32(20);
+}
+
+std::unique_ptr<ImageRowWriter> open_image_row_writer(const std::string& file_path, uint32_t width, uint32_t height,
+                                                      const ExportOptions& options) {
+    std::string format = detect_image_format(file_path);
+    
+    if (format == "ppm") {
+        return std::make_unique<PPMRowWriter>(file_path, width, height);
+    } else if (format == "png") {
+        return std::make_unique<PNGRowWriter>(file_path, width, height, options);
+    }
+    
+    throw std::runtime_error("Unsupported image format: " + format);
+}
+
+void save_image(const spectre::ColorData& color_data, const std::string& file_path, const ExportOptions& options) {
     std::string format = detect_image_format(file_path);
     
     if (format == "ppm") {
         PPMExporter exporter;
         exporter.save(color_data, file_path);
     } else if (format == "png") {
-        PNGExporter exporter;
+        PNGExporter exporter(options);
         exporter.save(color_data, file_path);
     } else {
         throw std::runtime_error("Unsupported image format: " + format);
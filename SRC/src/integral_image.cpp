@@ -0,0 +1,146 @@
+#include "integral_image.h"
+#include "pixel_kernels.h"
+#include "execution_context.h"
+#include <algorithm>
+#include <utility>
+
+namespace spectre {
+
+IntegralImage::IntegralImage(const ColorData& image)
+    : IntegralImage(image.view()) {
+}
+
+IntegralImage::IntegralImage(const ImageView& view)
+    : IntegralImage(view, 0, std::vector<uint32_t>()) {
+}
+
+IntegralImage::IntegralImage(const ImageView& view, int threads, std::vector<uint32_t>&& storage)
+    : width_(view.get_width()), height_(view.get_height()), table_(std::move(storage)) {
+
+    const size_t row_cells = static_cast<size_t>(width_ + 1) * CELL_SIZE;
+#if ETCA_OPENMP
+    const int thread_count = ExecutionContext::resolve_threads(threads);
+#else
+    (void)threads;
+#endif
+
+    // Only the zero first row and column are not overwritten below, so
+    // reused storage is not cleared as a whole
+    table_.resize(row_cells * (height_ + 1));
+    std::fill(table_.begin(), table_.begin() + static_cast<std::ptrdiff_t>(row_cells), 0u);
+
+    // Pass 1: running sums along each row (rows are independent)
+    const PixelKernels& kernels = pixel_kernels();
+#if ETCA_OPENMP
+    #pragma omp parallel for if(static_cast<uint64_t>(width_) * height_ >= PARALLEL_MIN_PIXELS) num_threads(thread_count)
+#endif
+    for (uint32_t y = 0; y < height_; ++y) {
+        uint32_t* out = &table_[static_cast<size_t>(y + 1) * row_cells + CELL_SIZE];
+        std::fill(out - CELL_SIZE, out, 0u);
+        kernels.prefix_sums(view.row(y), width_, out);
+    }
+
+    // Pass 2: accumulate down the columns, one strip of columns per thread.
+    // Unsigned wrap-around is intentional (see class comment).
+    const size_t strip = COLUMN_STRIP_CELLS * CELL_SIZE;
+    const size_t strip_count = (row_cells + strip - 1) / strip;
+
+#if ETCA_OPENMP
+    #pragma omp parallel for if(static_cast<uint64_t>(width_) * height_ >= PARALLEL_MIN_PIXELS) num_threads(thread_count)
+#endif
+    for (size_t s = 0; s < strip_count; ++s) {
+        size_t begin = s * strip;
+        size_t end = std::min(begin + strip, row_cells);
+
+        for (uint32_t y = 1; y < height_; ++y) {
+            const uint32_t* above = &table_[static_cast<size_t>(y) * row_cells];
+            uint32_t* out = &table_[static_cast<size_t>(y + 1) * row_cells];
+            for (size_t i = begin; i < end; ++i) {
+                out[i] += above[i];
+            }
+        }
+    }
+}
+
+std::vector<uint32_t> IntegralImage::release_storage() {
+    width_ = 0;
+    height_ = 0;
+    return std::move(table_);
+}
+
+void IntegralImage::add_block_sums(
+    uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, RegionSums& sums) const {
+
+    const uint32_t* a = cell(x0, y0);
+    const uint32_t* b = cell(x1, y0);
+    const uint32_t* c = cell(x0, y1);
+    const uint32_t* d = cell(x1, y1);
+
+    uint32_t block[CELL_SIZE];
+    for (size_t i = 0; i < CELL_SIZE; ++i) {
+        block[i] = d[i] - b[i] - c[i] + a[i];
+    }
+
+    sums.sum_r += block[0];
+    sums.sum_g += block[1];
+    sums.sum_b += block[2];
+    sums.sq_r += block[3];
+    sums.sq_g += block[4];
+    sums.sq_b += block[5];
+}
+
+IntegralImage::RegionSums IntegralImage::region_sums(
+    uint32_t x, uint32_t y, uint32_t width, uint32_t height) const {
+
+    RegionSums sums;
+
+    if (x >= width_ || y >= height_) {
+        return sums;
+    }
+
+    uint32_t end_x = x + std::min(width, width_ - x);
+    uint32_t end_y = y + std::min(height, height_ - y);
+
+    sums.count = static_cast<uint64_t>(end_x - x) * (end_y - y);
+    if (sums.count == 0) {
+        return sums;
+    }
+
+    if (sums.count <= MAX_EXACT_AREA) {
+        add_block_sums(x, y, end_x, end_y, sums);
+        return sums;
+    }
+
+    // Split large regions into blocks whose sums cannot wrap
+    uint32_t block_width = static_cast<uint32_t>(std::min<uint64_t>(end_x - x, MAX_EXACT_AREA));
+    uint32_t block_height = static_cast<uint32_t>(std::max<uint64_t>(1, MAX_EXACT_AREA / block_width));
+
+    for (uint32_t by = y; by < end_y; ) {
+        uint32_t by_end = by + std::min(block_height, end_y - by);
+        for (uint32_t bx = x; bx < end_x; ) {
+            uint32_t bx_end = bx + std::min(block_width, end_x - bx);
+            add_block_sums(bx, by, bx_end, by_end, sums);
+            bx = bx_end;
+        }
+        by = by_end;
+    }
+
+    return sums;
+}
+
+Color IntegralImage::region_average_color(
+    uint32_t x, uint32_t y, uint32_t width, uint32_t height) const {
+
+    RegionSums sums = region_sums(x, y, width, height);
+    if (sums.count == 0) {
+        return Color(0, 0, 0);
+    }
+
+    return Color(
+        static_cast<uint8_t>(sums.sum_r / sums.count),
+        static_cast<uint8_t>(sums.sum_g / sums.count),
+        static_cast<uint8_t>(sums.sum_b / sums.count)
+    );
+}
+
+} // namespace spectre
@@ -173,6 +173,20 @@ void demo_spectrum_analysis() {
     SpectrumAnalyzer::export_spectrum_to_csv(aperiodic_spectrum, "spectrum_aperiodic.csv");
     SpectrumAnalyzer::export_spectrum_to_csv(periodic_spectrum, "spectrum_periodic.csv");
     
+    // The same analysis on a decoded image: a smooth gradient reconstructed from tiles
+    ColorData gradient(512, 512);
+    for (uint32_t y = 0; y < gradient.get_height(); ++y) {
+        for (uint32_t x = 0; x < gradient.get_width(); ++x) {
+            gradient.set_pixel(x, y, Color(static_cast<uint8_t>(x / 2), static_cast<uint8_t>(y / 2), 128));
+        }
+    }
+    Compressor compressor;
+    ColorData decoded = Decompressor::decompress(compressor.compress(gradient));
+    auto decoded_spectrum = SpectrumAnalyzer::compute_spatial_spectrum(decoded, 128);
+    std::cout << "\nDecoded 512x512 gradient: " << decoded_spectrum.peak_count << " peaks, spectral entropy "
+              << std::fixed << std::setprecision(4) << SpectrumAnalyzer::calculate_spectral_entropy(decoded_spectrum)
+              << "\n";
+    
     std::cout << "\nConclusion: Aperiodic (Spectre) tilings have continuous frequency\n";
     std::cout << "distribution (like white noise), reducing Moiré artifacts.\n";
 }
@@ -202,7 +216,7 @@ void demo_compression() {
     
     const auto& stats = compressor.get_last_statistics();
     std::cout << "Original size: " << (image.get_width() * image.get_height() * 3) << " bytes\n";
-    std::cout << "Compressed size: ~" << (stats.tile_count * 10) << " bytes\n";
+    std::cout << "Compressed size: " << stats.compressed_size << " bytes\n";
     std::cout << "Compression ratio: " << std::fixed << std::setprecision(2) 
               << stats.compression_ratio << "x\n";
     std::cout << "Tiles: " << stats.tile_count << "\n";
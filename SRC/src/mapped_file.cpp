@@ -0,0 +1,164 @@
+#include "mapped_file.h"
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <limits>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#define ETCA_MMAP_WIN32 1
+#elif defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ETCA_MMAP_POSIX 1
+#endif
+
+namespace etca {
+
+MappedFile::MappedFile(const std::string& path) {
+    if (!map(path)) {
+        read(path);
+    }
+}
+
+MappedFile::~MappedFile() {
+    release();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : data_(other.data_), size_(other.size_), mapping_(other.mapping_),
+      buffer_(std::move(other.buffer_)) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.mapping_ = nullptr;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        release();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        mapping_ = std::exchange(other.mapping_, nullptr);
+        buffer_ = std::move(other.buffer_);
+    }
+    return *this;
+}
+
+bool MappedFile::map(const std::string& path) {
+#if defined(ETCA_MMAP_POSIX)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size <= 0) {
+        // Empty and special files cannot be mapped; let the read path handle them
+        ::close(fd);
+        return false;
+    }
+
+    size_t length = static_cast<size_t>(info.st_size);
+    void* view = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);  // The mapping keeps its own reference to the file
+    if (view == MAP_FAILED) {
+        return false;
+    }
+
+    // Decoding walks the payload front to back
+    ::madvise(view, length, MADV_SEQUENTIAL);
+
+    mapping_ = view;
+    data_ = static_cast<const uint8_t*>(view);
+    size_ = length;
+    return true;
+#elif defined(ETCA_MMAP_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart <= 0 ||
+        static_cast<uint64_t>(file_size.QuadPart) > std::numeric_limits<size_t>::max()) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr) {
+        return false;
+    }
+
+    // The view keeps the mapping object alive once its handle is closed
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (view == nullptr) {
+        return false;
+    }
+
+    mapping_ = view;
+    data_ = static_cast<const uint8_t*>(view);
+    size_ = static_cast<size_t>(file_size.QuadPart);
+    return true;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+void MappedFile::read(const std::string& path) {
+    // A directory opens as a stream on some platforms but has no sensible length
+    std::error_code error;
+    std::filesystem::file_status status = std::filesystem::status(path, error);
+    if (!error && std::filesystem::exists(status) && !std::filesystem::is_regular_file(status)) {
+        throw std::runtime_error("Not a regular file: " + path);
+    }
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot open file: " + path);
+    }
+
+    std::streamoff length = file.tellg();
+    if (length < 0) {
+        throw std::runtime_error("Cannot determine size of file: " + path);
+    }
+    file.seekg(0, std::ios::beg);
+
+    // One sized read instead of growing a buffer as bytes arrive
+    buffer_.resize(static_cast<size_t>(length));
+    if (!buffer_.empty()) {
+        file.read(reinterpret_cast<char*>(buffer_.data()), static_cast<std::streamsize>(buffer_.size()));
+        if (file.gcount() != static_cast<std::streamsize>(buffer_.size())) {
+            throw std::runtime_error("Failed to read file: " + path);
+        }
+    }
+
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+}
+
+void MappedFile::release() {
+    if (mapping_ != nullptr) {
+#if defined(ETCA_MMAP_POSIX)
+        ::munmap(mapping_, size_);
+#elif defined(ETCA_MMAP_WIN32)
+        UnmapViewOfFile(mapping_);
+#endif
+        mapping_ = nullptr;
+    }
+    buffer_.clear();
+    data_ = nullptr;
+    size_ = 0;
+}
+
+} // namespace etca
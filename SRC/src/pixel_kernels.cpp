@@ -0,0 +1,521 @@
+#include "pixel_kernels.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define ETCA_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define ETCA_TARGET(isa)
+#else
+// Per-function targets keep the rest of the build at the baseline ISA
+#define ETCA_TARGET(isa) __attribute__((target(isa)))
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define ETCA_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace spectre {
+
+// ============================================================================
+// Scalar kernels (reference and tails)
+// ============================================================================
+
+static void sum_scalar(const Color* pixels, size_t count, uint64_t sums[3]) {
+    uint64_t r = 0, g = 0, b = 0;
+    for (size_t i = 0; i < count; ++i) {
+        r += pixels[i].r;
+        g += pixels[i].g;
+        b += pixels[i].b;
+    }
+    sums[0] += r;
+    sums[1] += g;
+    sums[2] += b;
+}
+
+static void sum_squares_scalar(const Color* pixels, size_t count, uint64_t sums[6]) {
+    uint64_t r = 0, g = 0, b = 0, rr = 0, gg = 0, bb = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t pr = pixels[i].r, pg = pixels[i].g, pb = pixels[i].b;
+        r += pr;
+        g += pg;
+        b += pb;
+        rr += pr * pr;
+        gg += pg * pg;
+        bb += pb * pb;
+    }
+    sums[0] += r;
+    sums[1] += g;
+    sums[2] += b;
+    sums[3] += rr;
+    sums[4] += gg;
+    sums[5] += bb;
+}
+
+static void fill_scalar(Color* pixels, size_t count, Color color) {
+    std::fill_n(pixels, count, color);
+}
+
+// Continue running sums from `running` (six values) over a run of pixels
+static void prefix_sums_from(const Color* pixels, uint32_t count, uint32_t running[6], uint32_t* cells) {
+    for (uint32_t x = 0; x < count; ++x) {
+        const Color& pixel = pixels[x];
+        running[0] += pixel.r;
+        running[1] += pixel.g;
+        running[2] += pixel.b;
+        running[3] += static_cast<uint32_t>(pixel.r) * pixel.r;
+        running[4] += static_cast<uint32_t>(pixel.g) * pixel.g;
+        running[5] += static_cast<uint32_t>(pixel.b) * pixel.b;
+        std::copy(running, running + 6, cells);
+        cells += 6;
+    }
+}
+
+static void prefix_sums_scalar(const Color* pixels, uint32_t count, uint32_t* cells) {
+    uint32_t running[6] = {0, 0, 0, 0, 0, 0};
+    prefix_sums_from(pixels, count, running, cells);
+}
+
+// ============================================================================
+// x86 kernels
+// ============================================================================
+
+#if defined(ETCA_SIMD_X86)
+
+// CHANNEL_MASK[c][j] selects byte j of a packed RGB run if it belongs to
+// channel c. The pattern repeats every 3 bytes, so the first 48 bytes serve
+// one SSE period (16 pixels) and all 96 one AVX2 period (32 pixels).
+alignas(32) static const uint8_t CHANNEL_MASK[3][96] = {
+#define ETCA_M3(a, b, c) a, b, c, a, b, c, a, b, c, a, b, c
+#define ETCA_M96(a, b, c) ETCA_M3(a, b, c), ETCA_M3(a, b, c), ETCA_M3(a, b, c), ETCA_M3(a, b, c), \
+                          ETCA_M3(a, b, c), ETCA_M3(a, b, c), ETCA_M3(a, b, c), ETCA_M3(a, b, c)
+    { ETCA_M96(0xFF, 0, 0) },
+    { ETCA_M96(0, 0xFF, 0) },
+    { ETCA_M96(0, 0, 0xFF) },
+#undef ETCA_M96
+#undef ETCA_M3
+};
+
+// Squared-sum lanes are 32-bit; flush them to 64-bit totals this often
+static constexpr size_t SQUARE_FLUSH_BLOCKS = 4096;
+
+template <bool SQUARES>
+ETCA_TARGET("sse4.1")
+static void sum_squares_sse41_impl(const Color* pixels, size_t count, uint64_t sums[6]) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(pixels);
+    size_t blocks = count / 16;
+    const __m128i zero = _mm_setzero_si128();
+    
+    __m128i mask[3][3];
+    for (int k = 0; k < 3; ++k) {
+        for (int c = 0; c < 3; ++c) {
+            mask[k][c] = _mm_load_si128(reinterpret_cast<const __m128i*>(&CHANNEL_MASK[c][16 * k]));
+        }
+    }
+    
+    __m128i sum[3] = {zero, zero, zero};  // Two 64-bit lanes per channel
+    uint64_t square_total[3] = {0, 0, 0};
+    
+    for (size_t done = 0; done < blocks; ) {
+        size_t chunk = std::min(blocks - done, SQUARE_FLUSH_BLOCKS);
+        __m128i square[3] = {zero, zero, zero};
+        
+        for (size_t b = done; b < done + chunk; ++b) {
+            for (int k = 0; k < 3; ++k) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + 48 * b + 16 * k));
+                for (int c = 0; c < 3; ++c) {
+                    __m128i m = _mm_and_si128(v, mask[k][c]);
+                    sum[c] = _mm_add_epi64(sum[c], _mm_sad_epu8(m, zero));
+                    if (SQUARES) {
+                        // Neighbouring bytes are different channels, so each
+                        // 16-bit pair holds at most one nonzero value
+                        __m128i lo = _mm_unpacklo_epi8(m, zero);
+                        __m128i hi = _mm_unpackhi_epi8(m, zero);
+                        square[c] = _mm_add_epi32(square[c], _mm_madd_epi16(lo, lo));
+                        square[c] = _mm_add_epi32(square[c], _mm_madd_epi16(hi, hi));
+                    }
+                }
+            }
+        }
+        
+        if (SQUARES) {
+            for (int c = 0; c < 3; ++c) {
+                alignas(16) uint32_t lanes[4];
+                _mm_store_si128(reinterpret_cast<__m128i*>(lanes), square[c]);
+                square_total[c] += uint64_t(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+            }
+        }
+        done += chunk;
+    }
+    
+    for (int c = 0; c < 3; ++c) {
+        alignas(16) uint64_t lanes[2];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), sum[c]);
+        sums[c] += lanes[0] + lanes[1];
+        if (SQUARES) {
+            sums[3 + c] += square_total[c];
+        }
+    }
+    
+    const Color* tail = pixels + blocks * 16;
+    if (SQUARES) {
+        sum_squares_scalar(tail, count - blocks * 16, sums);
+    } else {
+        sum_scalar(tail, count - blocks * 16, sums);
+    }
+}
+
+static void sum_sse41(const Color* pixels, size_t count, uint64_t sums[3]) {
+    if (count < 16) {
+        sum_scalar(pixels, count, sums);
+        return;
+    }
+    sum_squares_sse41_impl<false>(pixels, count, sums);
+}
+
+static void sum_squares_sse41(const Color* pixels, size_t count, uint64_t sums[6]) {
+    if (count < 16) {
+        sum_squares_scalar(pixels, count, sums);
+        return;
+    }
+    sum_squares_sse41_impl<true>(pixels, count, sums);
+}
+
+ETCA_TARGET("sse4.1")
+static void fill_sse41(Color* pixels, size_t count, Color color) {
+    if (count < 16) {
+        fill_scalar(pixels, count, color);
+        return;
+    }
+    
+    Color pattern[16];
+    std::fill_n(pattern, 16, color);
+    const __m128i* source = reinterpret_cast<const __m128i*>(pattern);
+    __m128i p0 = _mm_loadu_si128(source);
+    __m128i p1 = _mm_loadu_si128(source + 1);
+    __m128i p2 = _mm_loadu_si128(source + 2);
+    
+    size_t blocks = count / 16;
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(pixels);
+    for (size_t b = 0; b < blocks; ++b) {
+        __m128i* out = reinterpret_cast<__m128i*>(bytes + 48 * b);
+        _mm_storeu_si128(out, p0);
+        _mm_storeu_si128(out + 1, p1);
+        _mm_storeu_si128(out + 2, p2);
+    }
+    fill_scalar(pixels + blocks * 16, count - blocks * 16, color);
+}
+
+ETCA_TARGET("sse4.1")
+static void prefix_sums_sse41(const Color* pixels, uint32_t count, uint32_t* cells) {
+    if (count == 0) {
+        return;
+    }
+    
+    // Lanes 0-2 carry r, g, b; lane 3 picks up the next pixel's red and is
+    // always overwritten by the following store
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(pixels);
+    __m128i sum = _mm_setzero_si128();
+    __m128i square = _mm_setzero_si128();
+    
+    // The 4-byte load reads one byte past the pixel, so the last one is scalar
+    for (uint32_t x = 0; x + 1 < count; ++x) {
+        int32_t word;
+        std::memcpy(&word, bytes + 3 * size_t(x), sizeof(word));
+        __m128i v = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(word));
+        sum = _mm_add_epi32(sum, v);
+        square = _mm_add_epi32(square, _mm_mullo_epi32(v, v));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(cells + 6 * size_t(x)), sum);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(cells + 6 * size_t(x) + 3), square);
+    }
+    
+    alignas(16) uint32_t sum_lanes[4], square_lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(sum_lanes), sum);
+    _mm_store_si128(reinterpret_cast<__m128i*>(square_lanes), square);
+    uint32_t running[6] = {sum_lanes[0], sum_lanes[1], sum_lanes[2],
+                           square_lanes[0], square_lanes[1], square_lanes[2]};
+    prefix_sums_from(pixels + (count - 1), 1, running, cells + 6 * size_t(count - 1));
+}
+
+template <bool SQUARES>
+ETCA_TARGET("avx2")
+static void sum_squares_avx2_impl(const Color* pixels, size_t count, uint64_t sums[6]) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(pixels);
+    size_t blocks = count / 32;
+    const __m256i zero = _mm256_setzero_si256();
+    
+    __m256i mask[3][3];
+    for (int k = 0; k < 3; ++k) {
+        for (int c = 0; c < 3; ++c) {
+            mask[k][c] = _mm256_load_si256(reinterpret_cast<const __m256i*>(&CHANNEL_MASK[c][32 * k]));
+        }
+    }
+    
+    __m256i sum[3] = {zero, zero, zero};  // Four 64-bit lanes per channel
+    uint64_t square_total[3] = {0, 0, 0};
+    
+    for (size_t done = 0; done < blocks; ) {
+        size_t chunk = std::min(blocks - done, SQUARE_FLUSH_BLOCKS);
+        __m256i square[3] = {zero, zero, zero};
+        
+        for (size_t b = done; b < done + chunk; ++b) {
+            for (int k = 0; k < 3; ++k) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes + 96 * b + 32 * k));
+                for (int c = 0; c < 3; ++c) {
+                    __m256i m = _mm256_and_si256(v, mask[k][c]);
+                    sum[c] = _mm256_add_epi64(sum[c], _mm256_sad_epu8(m, zero));
+                    if (SQUARES) {
+                        __m256i lo = _mm256_unpacklo_epi8(m, zero);
+                        __m256i hi = _mm256_unpackhi_epi8(m, zero);
+                        square[c] = _mm256_add_epi32(square[c], _mm256_madd_epi16(lo, lo));
+                        square[c] = _mm256_add_epi32(square[c], _mm256_madd_epi16(hi, hi));
+                    }
+                }
+            }
+        }
+        
+        if (SQUARES) {
+            for (int c = 0; c < 3; ++c) {
+                alignas(32) uint32_t lanes[8];
+                _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), square[c]);
+                for (uint32_t lane : lanes) {
+                    square_total[c] += lane;
+                }
+            }
+        }
+        done += chunk;
+    }
+    
+    for (int c = 0; c < 3; ++c) {
+        alignas(32) uint64_t lanes[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), sum[c]);
+        sums[c] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        if (SQUARES) {
+            sums[3 + c] += square_total[c];
+        }
+    }
+    
+    // Fewer than 32 pixels left: finish with the SSE period, then scalar
+    const Color* tail = pixels + blocks * 32;
+    size_t left = count - blocks * 32;
+    if (left >= 16) {
+        sum_squares_sse41_impl<SQUARES>(tail, left, sums);
+    } else if (SQUARES) {
+        sum_squares_scalar(tail, left, sums);
+    } else {
+        sum_scalar(tail, left, sums);
+    }
+}
+
+static void sum_avx2(const Color* pixels, size_t count, uint64_t sums[3]) {
+    if (count < 32) {
+        sum_sse41(pixels, count, sums);
+        return;
+    }
+    sum_squares_avx2_impl<false>(pixels, count, sums);
+}
+
+static void sum_squares_avx2(const Color* pixels, size_t count, uint64_t sums[6]) {
+    if (count < 32) {
+        sum_squares_sse41(pixels, count, sums);
+        return;
+    }
+    sum_squares_avx2_impl<true>(pixels, count, sums);
+}
+
+ETCA_TARGET("avx2")
+static void fill_avx2(Color* pixels, size_t count, Color color) {
+    if (count < 32) {
+        fill_sse41(pixels, count, color);
+        return;
+    }
+    
+    Color pattern[32];
+    std::fill_n(pattern, 32, color);
+    const __m256i* source = reinterpret_cast<const __m256i*>(pattern);
+    __m256i p0 = _mm256_loadu_si256(source);
+    __m256i p1 = _mm256_loadu_si256(source + 1);
+    __m256i p2 = _mm256_loadu_si256(source + 2);
+    
+    size_t blocks = count / 32;
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(pixels);
+    for (size_t b = 0; b < blocks; ++b) {
+        __m256i* out = reinterpret_cast<__m256i*>(bytes + 96 * b);
+        _mm256_storeu_si256(out, p0);
+        _mm256_storeu_si256(out + 1, p1);
+        _mm256_storeu_si256(out + 2, p2);
+    }
+    fill_sse41(pixels + blocks * 32, count - blocks * 32, color);
+}
+
+// Highest level the CPU and OS support
+static SimdLevel detect_level() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+    
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    
+    bool avx2 = false;
+    if (max_leaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    bool sse41 = __builtin_cpu_supports("sse4.1");
+    bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (avx2) {
+        return SimdLevel::AVX2;
+    }
+    return sse41 ? SimdLevel::SSE41 : SimdLevel::SCALAR;
+}
+
+#endif // ETCA_SIMD_X86
+
+// ============================================================================
+// NEON kernels
+// ============================================================================
+
+#if defined(ETCA_SIMD_NEON)
+
+template <bool SQUARES>
+static void sum_squares_neon_impl(const Color* pixels, size_t count, uint64_t sums[6]) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(pixels);
+    size_t blocks = count / 16;
+    
+    uint64x2_t sum_total[3] = {vdupq_n_u64(0), vdupq_n_u64(0), vdupq_n_u64(0)};
+    uint64x2_t square_total[3] = {vdupq_n_u64(0), vdupq_n_u64(0), vdupq_n_u64(0)};
+    
+    // 16-bit sum lanes gain at most 510 per block; 32-bit square lanes 260100
+    const size_t flush_blocks = 128;
+    for (size_t done = 0; done < blocks; ) {
+        size_t chunk = std::min(blocks - done, flush_blocks);
+        uint16x8_t sum[3] = {vdupq_n_u16(0), vdupq_n_u16(0), vdupq_n_u16(0)};
+        uint32x4_t square[3] = {vdupq_n_u32(0), vdupq_n_u32(0), vdupq_n_u32(0)};
+        
+        for (size_t b = done; b < done + chunk; ++b) {
+            uint8x16x3_t v = vld3q_u8(bytes + 48 * b);  // De-interleaves r, g, b
+            for (int c = 0; c < 3; ++c) {
+                sum[c] = vpadalq_u8(sum[c], v.val[c]);
+                if (SQUARES) {
+                    square[c] = vpadalq_u16(square[c], vmull_u8(vget_low_u8(v.val[c]), vget_low_u8(v.val[c])));
+                    square[c] = vpadalq_u16(square[c], vmull_u8(vget_high_u8(v.val[c]), vget_high_u8(v.val[c])));
+                }
+            }
+        }
+        
+        for (int c = 0; c < 3; ++c) {
+            sum_total[c] = vpadalq_u32(sum_total[c], vpaddlq_u16(sum[c]));
+            square_total[c] = vpadalq_u32(square_total[c], square[c]);
+        }
+        done += chunk;
+    }
+    
+    for (int c = 0; c < 3; ++c) {
+        sums[c] += vgetq_lane_u64(sum_total[c], 0) + vgetq_lane_u64(sum_total[c], 1);
+        if (SQUARES) {
+            sums[3 + c] += vgetq_lane_u64(square_total[c], 0) + vgetq_lane_u64(square_total[c], 1);
+        }
+    }
+    
+    const Color* tail = pixels + blocks * 16;
+    if (SQUARES) {
+        sum_squares_scalar(tail, count - blocks * 16, sums);
+    } else {
+        sum_scalar(tail, count - blocks * 16, sums);
+    }
+}
+
+static void sum_neon(const Color* pixels, size_t count, uint64_t sums[3]) {
+    sum_squares_neon_impl<false>(pixels, count, sums);
+}
+
+static void sum_squares_neon(const Color* pixels, size_t count, uint64_t sums[6]) {
+    sum_squares_neon_impl<true>(pixels, count, sums);
+}
+
+static void fill_neon(Color* pixels, size_t count, Color color) {
+    uint8x16x3_t pattern;
+    pattern.val[0] = vdupq_n_u8(color.r);
+    pattern.val[1] = vdupq_n_u8(color.g);
+    pattern.val[2] = vdupq_n_u8(color.b);
+    
+    size_t blocks = count / 16;
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(pixels);
+    for (size_t b = 0; b < blocks; ++b) {
+        vst3q_u8(bytes + 48 * b, pattern);  // Interleaves back to r, g, b
+    }
+    fill_scalar(pixels + blocks * 16, count - blocks * 16, color);
+}
+
+#endif // ETCA_SIMD_NEON
+
+// ============================================================================
+// Dispatch
+// ============================================================================
+
+static PixelKernels kernels_for(SimdLevel level) {
+    switch (level) {
+#if defined(ETCA_SIMD_X86)
+        case SimdLevel::AVX2:
+            return {SimdLevel::AVX2, sum_avx2, sum_squares_avx2, fill_avx2, prefix_sums_sse41};
+        case SimdLevel::SSE41:
+            return {SimdLevel::SSE41, sum_sse41, sum_squares_sse41, fill_sse41, prefix_sums_sse41};
+#endif
+#if defined(ETCA_SIMD_NEON)
+        case SimdLevel::NEON:
+            return {SimdLevel::NEON, sum_neon, sum_squares_neon, fill_neon, prefix_sums_scalar};
+#endif
+        default:
+            return {SimdLevel::SCALAR, sum_scalar, sum_squares_scalar, fill_scalar, prefix_sums_scalar};
+    }
+}
+
+static PixelKernels select_kernels() {
+    SimdLevel level = SimdLevel::SCALAR;
+#if defined(ETCA_SIMD_X86)
+    level = detect_level();
+#elif defined(ETCA_SIMD_NEON)
+    level = SimdLevel::NEON;
+#endif
+    
+    // An unknown or unsupported request leaves the detected level alone
+    if (const char* requested = std::getenv("ETCA_SIMD")) {
+        for (SimdLevel candidate : {SimdLevel::SCALAR, SimdLevel::SSE41, SimdLevel::AVX2, SimdLevel::NEON}) {
+            bool available = candidate == SimdLevel::SCALAR || candidate == level ||
+                             (level == SimdLevel::AVX2 && candidate == SimdLevel::SSE41);
+            if (available && requested == std::string(simd_level_name(candidate))) {
+                level = candidate;
+                break;
+            }
+        }
+    }
+    
+    return kernels_for(level);
+}
+
+const PixelKernels& pixel_kernels() {
+    static const PixelKernels kernels = select_kernels();
+    return kernels;
+}
+
+const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::SSE41: return "sse4.1";
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::NEON: return "neon";
+        default: return "scalar";
+    }
+}
+
+} // namespace spectre
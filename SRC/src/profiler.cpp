@@ -0,0 +1,217 @@
+#include "profiler.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef PSAPI_VERSION
+#define PSAPI_VERSION 2  // GetProcessMemoryInfo from kernel32, no psapi.lib needed
+#endif
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace spectre {
+
+Profiler::Profiler() : origin_(Clock::now()) {
+}
+
+void Profiler::record(const std::string& name, const char* category, Clock::time_point start, Clock::time_point end) {
+    double start_us = std::chrono::duration<double, std::micro>(start - origin_).count();
+    double duration_us = std::chrono::duration<double, std::micro>(end - start).count();
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto thread = threads_.emplace(std::this_thread::get_id(), static_cast<int>(threads_.size())).first;
+    events_.push_back({name, category, start_us, duration_us, thread->second});
+}
+
+void Profiler::add(const std::string& counter, uint64_t value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    counters_[counter] += value;
+}
+
+void Profiler::add_tiles_at_depth(int depth, uint64_t count) {
+    if (depth < 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (tiles_per_depth_.size() <= static_cast<size_t>(depth)) {
+        tiles_per_depth_.resize(static_cast<size_t>(depth) + 1, 0);
+    }
+    tiles_per_depth_[static_cast<size_t>(depth)] += count;
+}
+
+void Profiler::sample_peak_rss() {
+    uint64_t peak = peak_rss_bytes();
+    std::lock_guard<std::mutex> lock(mutex_);
+    peak_rss_ = std::max(peak_rss_, peak);
+}
+
+std::vector<Profiler::Event> Profiler::get_events() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return events_;
+}
+
+std::map<std::string, uint64_t> Profiler::get_counters() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return counters_;
+}
+
+void Profiler::print_summary(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    // Phases in order of first appearance, with totals over every thread
+    struct PhaseTotal {
+        std::string name;
+        size_t calls = 0;
+        double total_us = 0.0;
+        double max_us = 0.0;
+    };
+    std::vector<PhaseTotal> phases;
+    for (const Event& event : events_) {
+        auto phase = std::find_if(phases.begin(), phases.end(),
+                                  [&](const PhaseTotal& p) { return p.name == event.name; });
+        if (phase == phases.end()) {
+            phases.push_back({event.name});
+            phase = phases.end() - 1;
+        }
+        ++phase->calls;
+        phase->total_us += event.duration_us;
+        phase->max_us = std::max(phase->max_us, event.duration_us);
+    }
+    
+    std::ios_base::fmtflags flags = out.flags();
+    out << "\nProfile (times summed over threads)\n"
+        << std::left << std::setw(24) << "  phase" << std::right << std::setw(8) << "calls"
+        << std::setw(14) << "total ms" << std::setw(14) << "max ms" << "\n";
+    out << std::fixed << std::setprecision(3);
+    for (const PhaseTotal& phase : phases) {
+        out << "  " << std::left << std::setw(22) << phase.name << std::right << std::setw(8) << phase.calls
+            << std::setw(14) << phase.total_us / 1000.0 << std::setw(14) << phase.max_us / 1000.0 << "\n";
+    }
+    
+    if (!counters_.empty()) {
+        out << "\nCounters\n";
+        for (const auto& counter : counters_) {
+            out << "  " << std::left << std::setw(30) << counter.first << std::right << counter.second << "\n";
+        }
+    }
+    
+    if (!tiles_per_depth_.empty()) {
+        out << "\nTiles per depth\n";
+        for (size_t depth = 0; depth < tiles_per_depth_.size(); ++depth) {
+            out << "  " << std::setw(4) << depth << "  " << tiles_per_depth_[depth] << "\n";
+        }
+    }
+    
+    if (peak_rss_ > 0) {
+        out << "\nPeak resident memory: " << std::setprecision(1)
+            << static_cast<double>(peak_rss_) / (1024.0 * 1024.0) << " MB\n";
+    }
+    out.flags(flags);
+}
+
+// Minimal JSON string escaping for phase names
+static std::string json_quote(const std::string& text) {
+    std::ostringstream out;
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+void Profiler::write_chrome_trace(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    std::ios_base::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    
+    bool first = true;
+    auto separator = [&] {
+        out << (first ? "\n" : ",\n");
+        first = false;
+    };
+    
+    // Complete ("X") events, one per phase
+    for (const Event& event : events_) {
+        separator();
+        out << "  {\"name\": " << json_quote(event.name) << ", \"cat\": " << json_quote(event.category)
+            << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread
+            << ", \"ts\": " << event.start_us << ", \"dur\": " << event.duration_us << "}";
+    }
+    
+    // Counters and the depth histogram travel as metadata on the process
+    separator();
+    out << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"etca\"}}";
+    
+    out << "\n], \"otherData\": {\"peak_rss_bytes\": " << peak_rss_;
+    for (const auto& counter : counters_) {
+        out << ", " << json_quote(counter.first) << ": " << counter.second;
+    }
+    out << ", \"tiles_per_depth\": [";
+    for (size_t depth = 0; depth < tiles_per_depth_.size(); ++depth) {
+        out << (depth == 0 ? "" : ", ") << tiles_per_depth_[depth];
+    }
+    out << "]}}\n";
+    out.flags(flags);
+}
+
+uint64_t Profiler::peak_rss_bytes() {
+#if defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::stoull(line.substr(6)) * 1024;
+        }
+    }
+    return 0;
+#elif defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return static_cast<uint64_t>(counters.PeakWorkingSetSize);
+    }
+    return 0;
+#elif defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return static_cast<uint64_t>(usage.ru_maxrss);         // Bytes
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;  // Kilobytes
+#endif
+#else
+    return 0;
+#endif
+}
+
+bool Profiler::reset_peak_rss() {
+#if defined(__linux__)
+    // Writing 5 resets the VmHWM high-water mark (Linux 4.0+)
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+    clear_refs.flush();
+    return clear_refs.good();
+#else
+    return false;
+#endif
+}
+
+} // namespace spectre
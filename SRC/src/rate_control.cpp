@@ -0,0 +1,212 @@
+#include "rate_control.h"
+#include "variance_calculator.h"
+#include "tile_inflater.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace spectre {
+
+RateController::RateController(const CompressionConfig& config)
+    : config_(config), tree_(0, 0) {
+}
+
+void RateController::build(const ImageView& image, ExecutionContext& context) {
+    Profiler* profiler = context.get_profiler();
+    
+    // The tables outlive the build: tile errors are measured from them too
+    IntegralImage integral = [&] {
+        ProfileScope scope(profiler, "integral_image");
+        return IntegralImage(image, context.get_threads(), std::move(context.integral_scratch()));
+    }();
+    
+    tree_ = SpectreTree(image.get_width(), image.get_height());
+    {
+        ProfileScope scope(profiler, "tree_build");
+        tree_.build(integral, config_.variance_threshold, config_.max_tree_depth,
+                    config_.parallel_cutoff_pixels, context);
+    }
+    
+    {
+        ProfileScope scope(profiler, "tile_stats");
+        variance_.assign(tree_.get_tile_count(), 0.0);
+        error_.assign(tree_.get_tile_count(), 0);
+        measure_subtree(integral, tree_.get_root_id(), 0, 0, image.get_width(), image.get_height());
+    }
+    
+    context.integral_scratch() = integral.release_storage();
+    
+    // Every split tile's variance is a threshold past which it collapses
+    levels_.clear();
+    for (size_t index = 0; index < variance_.size(); ++index) {
+        if (tree_.is_subdivided(tree_.get_root_id() + index)) {
+            levels_.push_back(variance_[index]);
+        }
+    }
+    std::sort(levels_.begin(), levels_.end());
+    levels_.erase(std::unique(levels_.begin(), levels_.end()), levels_.end());
+    levels_.insert(levels_.begin(), config_.variance_threshold);
+}
+
+void RateController::measure_subtree(
+    const IntegralImage& integral,
+    SpectreTile::ID id,
+    uint32_t x, uint32_t y,
+    uint32_t width, uint32_t height) {
+    
+    size_t index = index_of(id);
+    
+    // Error of the tile's (truncated) average color: sum of (p - c)^2 per channel
+    IntegralImage::RegionSums sums = integral.region_sums(x, y, width, height);
+    uint8_t r, g, b;
+    tree_.get_color(id, r, g, b);
+    auto channel_error = [&](uint64_t sum, uint64_t sq, uint64_t c) {
+        return sq + c * c * sums.count - 2 * c * sum;
+    };
+    error_[index] = channel_error(sums.sum_r, sums.sq_r, r) +
+                    channel_error(sums.sum_g, sums.sq_g, g) +
+                    channel_error(sums.sum_b, sums.sq_b, b);
+    
+    if (!tree_.is_subdivided(id)) {
+        return;
+    }
+    
+    variance_[index] = VarianceCalculator::calculate_variance(integral, x, y, width, height);
+    
+    SpectreTile::ID first_child = tree_.get_first_child(id);
+    for (int i = 0; i < TileInflater::CHILDREN_PER_TILE; ++i) {
+        uint32_t child_x, child_y, child_width, child_height;
+        TileInflater::get_child_bounds(width, height, i, child_x, child_y, child_width, child_height);
+        measure_subtree(integral, first_child + static_cast<SpectreTile::ID>(i),
+                        x + child_x, y + child_y, child_width, child_height);
+    }
+}
+
+uint64_t RateController::squared_error(double threshold) const {
+    if (tree_.get_tile_count() == 0) {
+        return 0;
+    }
+    
+    uint64_t total = 0;
+    std::vector<SpectreTile::ID> pending = {tree_.get_root_id()};
+    while (!pending.empty()) {
+        SpectreTile::ID id = pending.back();
+        pending.pop_back();
+        
+        if (!split_at(id, threshold)) {
+            total += error_[index_of(id)];
+            continue;
+        }
+        SpectreTile::ID first_child = tree_.get_first_child(id);
+        for (int i = 0; i < TileInflater::CHILDREN_PER_TILE; ++i) {
+            pending.push_back(first_child + static_cast<SpectreTile::ID>(i));
+        }
+    }
+    
+    return total;
+}
+
+double RateController::psnr(uint64_t squared_error, uint64_t pixel_count) {
+    if (squared_error == 0 || pixel_count == 0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    double mse = static_cast<double>(squared_error) / (3.0 * static_cast<double>(pixel_count));
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+double RateController::psnr_at(double threshold) const {
+    uint32_t width, height;
+    tree_.get_dimensions(width, height);
+    return psnr(squared_error(threshold), static_cast<uint64_t>(width) * height);
+}
+
+SpectreTree RateController::prune(double threshold) const {
+    uint32_t width, height;
+    tree_.get_dimensions(width, height);
+    
+    SpectreTree pruned(width, height);
+    if (tree_.get_tile_count() > 0) {
+        copy_pruned(tree_.get_root_id(), threshold, pruned, pruned.get_root_id());
+    }
+    return pruned;
+}
+
+void RateController::copy_pruned(SpectreTile::ID id, double threshold,
+                                 SpectreTree& pruned, SpectreTile::ID pruned_id) const {
+    uint8_t r, g, b;
+    tree_.get_color(id, r, g, b);
+    pruned.set_color(pruned_id, r, g, b);
+    
+    if (!split_at(id, threshold)) {
+        return;
+    }
+    
+    // Same pre-order as SpectreTree::build, so the IDs match a direct build
+    SpectreTile::ID first_child = tree_.get_first_child(id);
+    SpectreTile::ID pruned_first_child = pruned.subdivide(pruned_id);
+    for (int i = 0; i < TileInflater::CHILDREN_PER_TILE; ++i) {
+        copy_pruned(first_child + static_cast<SpectreTile::ID>(i), threshold,
+                    pruned, pruned_first_child + static_cast<SpectreTile::ID>(i));
+    }
+}
+
+CompressedImage RateController::compress_at(double threshold, ExecutionContext& context) const {
+    SpectreTree pruned = [&] {
+        ProfileScope scope(context.get_profiler(), "prune");
+        return prune(std::max(threshold, config_.variance_threshold));
+    }();
+    
+    Compressor compressor(config_);
+    CompressedImage result = compressor.encode_tree(pruned, context);
+    result.config.variance_threshold = std::max(threshold, config_.variance_threshold);
+    return result;
+}
+
+CompressedImage RateController::compress(const RateTarget& target, ExecutionContext& context) const {
+    if (levels_.empty()) {
+        return compress_at(config_.variance_threshold, context);
+    }
+    
+    switch (target.kind) {
+        case RateTarget::Kind::SIZE: {
+            // Keep the last fitting candidate: bisection ends on it
+            CompressedImage best;
+            size_t level = first_level(levels_.size(), [&](size_t candidate) {
+                CompressedImage encoded = compress_at(levels_[candidate], context);
+                if (static_cast<double>(encoded.data.size()) > target.value) {
+                    return false;
+                }
+                best = std::move(encoded);
+                return true;
+            });
+            if (level == levels_.size()) {
+                return compress_at(levels_.back(), context);
+            }
+            return best;
+        }
+        case RateTarget::Kind::PSNR: {
+            uint32_t width, height;
+            tree_.get_dimensions(width, height);
+            size_t level = level_for_psnr(levels_.size(), target.value, static_cast<uint64_t>(width) * height,
+                                          [&](size_t candidate) { return squared_error(levels_[candidate]); });
+            return compress_at(levels_[level], context);
+        }
+        case RateTarget::Kind::THRESHOLD:
+        default:
+            return compress_at(target.value, context);
+    }
+}
+
+std::vector<CompressedImage> RateController::compress_variants(const std::vector<RateTarget>& targets,
+                                                               ExecutionContext& context) const {
+    std::vector<CompressedImage> variants;
+    variants.reserve(targets.size());
+    for (const RateTarget& target : targets) {
+        variants.push_back(compress(target, context));
+    }
+    return variants;
+}
+
+} // namespace spectre
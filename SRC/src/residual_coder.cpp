@@ -0,0 +1,190 @@
+#include "residual_coder.h"
+#include "tree_stream.h"
+#include "execution_context.h"
+#include <algorithm>
+
+namespace spectre {
+
+void ResidualCoder::encode(const ImageView& image, const ColorData& base, std::vector<uint8_t>& output,
+                           int threads) {
+    uint32_t height = image.get_height();
+    size_t strip_count = (static_cast<size_t>(height) + STRIP_ROWS - 1) / STRIP_ROWS;
+    std::vector<std::vector<uint8_t>> strips(strip_count);
+    
+#if ETCA_OPENMP
+    #pragma omp parallel for schedule(dynamic) if(strip_count > 1) \
+        num_threads(ExecutionContext::resolve_threads(threads))
+#else
+    (void)threads;
+#endif
+    for (int64_t i = 0; i < static_cast<int64_t>(strip_count); ++i) {
+        uint32_t y_begin = static_cast<uint32_t>(i) * STRIP_ROWS;
+        ResidualCoder coder;
+        coder.encode_strip(image, base, y_begin, std::min(height, y_begin + STRIP_ROWS),
+                           strips[static_cast<size_t>(i)]);
+    }
+    
+    TreeStream::write_varint(STRIP_ROWS, output);
+    for (const auto& strip : strips) {
+        TreeStream::write_varint(strip.size(), output);
+    }
+    for (const auto& strip : strips) {
+        output.insert(output.end(), strip.begin(), strip.end());
+    }
+}
+
+bool ResidualCoder::decode(ByteSpan section, const MutableImageView& image, int threads) {
+    size_t offset = 0;
+    uint64_t strip_rows = 0;
+    if (!TreeStream::read_varint(section.data(), section.size(), offset, strip_rows) ||
+        strip_rows == 0 || strip_rows > UINT32_MAX) {
+        return false;
+    }
+    
+    uint64_t height = image.get_height();
+    size_t strip_count = static_cast<size_t>((height + strip_rows - 1) / strip_rows);
+    std::vector<uint64_t> offsets(strip_count + 1, 0);
+    for (size_t i = 0; i < strip_count; ++i) {
+        uint64_t size = 0;
+        if (!TreeStream::read_varint(section.data(), section.size(), offset, size) ||
+            size > section.size()) {
+            return false;
+        }
+        offsets[i + 1] = offsets[i] + size;
+    }
+    ByteSpan strips = section.subspan(offset);
+    if (offsets[strip_count] > strips.size()) {
+        return false;
+    }
+    
+    int failures = 0;
+    
+#if ETCA_OPENMP
+    #pragma omp parallel for schedule(dynamic) if(strip_count > 1) \
+        num_threads(ExecutionContext::resolve_threads(threads)) reduction(+:failures)
+#else
+    (void)threads;
+#endif
+    for (int64_t i = 0; i < static_cast<int64_t>(strip_count); ++i) {
+        size_t index = static_cast<size_t>(i);
+        uint64_t y_begin = index * strip_rows;
+        uint64_t y_end = std::min(height, y_begin + strip_rows);
+        ByteSpan bytes = strips.subspan(static_cast<size_t>(offsets[index]),
+                                        static_cast<size_t>(offsets[index + 1] - offsets[index]));
+        ResidualCoder coder;
+        if (!coder.decode_strip(bytes, image, static_cast<uint32_t>(y_begin), static_cast<uint32_t>(y_end))) {
+            ++failures;
+        }
+    }
+    
+    return failures == 0;
+}
+
+void ResidualCoder::encode_symbol(RangeEncoder& encoder, SymbolModels& models, uint8_t symbol) {
+    size_t length = 0;
+    while ((symbol >> length) != 0) {
+        ++length;
+    }
+    
+    // A full-length symbol needs no terminating zero
+    for (size_t i = 0; i < SYMBOL_BITS; ++i) {
+        bool longer = length > i;
+        encoder.encode_bit(models.length[i], longer);
+        if (!longer) {
+            break;
+        }
+    }
+    for (size_t bit = length; bit-- > 1;) {
+        encoder.encode_bit(models.bits[length * SYMBOL_BITS + bit - 1], (symbol >> (bit - 1)) & 1);
+    }
+}
+
+uint8_t ResidualCoder::decode_symbol(RangeDecoder& decoder, SymbolModels& models) {
+    size_t length = 0;
+    while (length < SYMBOL_BITS && decoder.decode_bit(models.length[length])) {
+        ++length;
+    }
+    if (length == 0) {
+        return 0;
+    }
+    
+    unsigned symbol = 1;
+    for (size_t bit = length; bit-- > 1;) {
+        symbol = (symbol << 1) | static_cast<unsigned>(decoder.decode_bit(models.bits[length * SYMBOL_BITS + bit - 1]));
+    }
+    return static_cast<uint8_t>(symbol);
+}
+
+void ResidualCoder::encode_strip(const ImageView& image, const ColorData& base, uint32_t y_begin, uint32_t y_end,
+                                 std::vector<uint8_t>& output) {
+    RangeEncoder encoder(output);
+    uint32_t width = image.get_width();
+    ImageView base_view = base.view();
+    RowPair rows(width);
+    
+    for (uint32_t y = y_begin; y < y_end; ++y) {
+        const Color* pixels = image.row(y);
+        const Color* base_pixels = base_view.row(y);
+        bool first_row = y == y_begin;
+        
+        for (uint32_t x = 0; x < width; ++x) {
+            int* current = &rows.current[static_cast<size_t>(x) * CHANNELS];
+            const int* above = &rows.above[static_cast<size_t>(x) * CHANNELS];
+            const int values[CHANNELS] = {pixels[x].r, pixels[x].g, pixels[x].b};
+            const int bases[CHANNELS] = {base_pixels[x].r, base_pixels[x].g, base_pixels[x].b};
+            
+            int error_before = 0;
+            for (size_t channel = 0; channel < CHANNELS; ++channel) {
+                Neighbours n = neighbours(current, above, x, first_row, channel, bases[channel]);
+                int error = wrap(values[channel] - predict(n.a, n.b, n.c));
+                encode_symbol(encoder, models(activity(n.a, n.b, n.c), channel), to_symbol(error - error_before));
+                error_before = error;
+                current[channel] = values[channel];
+            }
+        }
+        rows.above.swap(rows.current);
+    }
+    
+    encoder.flush();
+}
+
+bool ResidualCoder::decode_strip(ByteSpan bytes, const MutableImageView& image, uint32_t y_begin,
+                                 uint32_t y_end) {
+    RangeDecoder decoder(bytes.data(), bytes.size());
+    uint32_t width = image.get_width();
+    RowPair rows(width);
+    
+    for (uint32_t y = y_begin; y < y_end; ++y) {
+        Color* pixels = image.row(y);
+        bool first_row = y == y_begin;
+        
+        for (uint32_t x = 0; x < width; ++x) {
+            int* current = &rows.current[static_cast<size_t>(x) * CHANNELS];
+            const int* above = &rows.above[static_cast<size_t>(x) * CHANNELS];
+            uint8_t* channels[CHANNELS] = {&pixels[x].r, &pixels[x].g, &pixels[x].b};
+            
+            int error_before = 0;
+            for (size_t channel = 0; channel < CHANNELS; ++channel) {
+                // The pixel holds its base color until it is replaced here
+                Neighbours n = neighbours(current, above, x, first_row, channel, *channels[channel]);
+                int error = wrap(from_symbol(decode_symbol(decoder, models(activity(n.a, n.b, n.c), channel))) +
+                                 error_before);
+                error_before = error;
+                
+                uint8_t value = static_cast<uint8_t>(predict(n.a, n.b, n.c) + error);
+                *channels[channel] = value;
+                current[channel] = value;
+            }
+        }
+        rows.above.swap(rows.current);
+        
+        // Running out of data means the strip is truncated
+        if (decoder.exhausted()) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+} // namespace spectre
@@ -0,0 +1,506 @@
+#include "sequence_codec.h"
+#include "decompressor.h"
+#include "tile_inflater.h"
+#include "tree_stream.h"
+#include "profiler.h"
+#include <algorithm>
+#include <utility>
+
+namespace spectre {
+
+/**
+ * @brief Copy a subtree (splits and colors) under a tile of another tree
+ */
+static void copy_subtree(const SpectreTree& from, SpectreTile::ID id, SpectreTree& to, SpectreTile::ID to_id) {
+    uint8_t r, g, b;
+    from.get_color(id, r, g, b);
+    to.set_color(to_id, r, g, b);
+    
+    if (!from.is_subdivided(id)) {
+        return;
+    }
+    
+    SpectreTile::ID first_child = from.get_first_child(id);
+    SpectreTile::ID to_first_child = to.subdivide(to_id);
+    for (int i = 0; i < TileInflater::CHILDREN_PER_TILE; ++i) {
+        copy_subtree(from, first_child + static_cast<SpectreTile::ID>(i),
+                     to, to_first_child + static_cast<SpectreTile::ID>(i));
+    }
+}
+
+/**
+ * @brief Number of tiles in a subtree, the tile itself included
+ */
+static uint64_t subtree_size(const SpectreTree& tree, SpectreTile::ID id) {
+    uint64_t count = 0;
+    std::vector<SpectreTile::ID> pending = {id};
+    while (!pending.empty()) {
+        SpectreTile::ID tile = pending.back();
+        pending.pop_back();
+        ++count;
+        if (tree.is_subdivided(tile)) {
+            SpectreTile::ID first_child = tree.get_first_child(tile);
+            for (int i = 0; i < TileInflater::CHILDREN_PER_TILE; ++i) {
+                pending.push_back(first_child + static_cast<SpectreTile::ID>(i));
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Make a tile a leaf before a new subtree replaces it, keeping the live count
+ */
+static void detach_subtree(SpectreTree& tree, SpectreTile::ID id, uint64_t& live_tiles) {
+    live_tiles -= subtree_size(tree, id) - 1;
+    tree.collapse(id);
+}
+
+/**
+ * @brief Drop the tiles replaced subtrees left behind, once they outnumber the live ones
+ *
+ * Copying costs O(live tiles) and happens only after at least as many
+ * tiles were replaced, so patching stays proportional to the changed area.
+ */
+static void compact_if_sparse(SpectreTree& tree, uint64_t live_tiles) {
+    if (tree.get_tile_count() <= 2 * live_tiles) {
+        return;
+    }
+    uint32_t width, height;
+    tree.get_dimensions(width, height);
+    SpectreTree compact(width, height);
+    copy_subtree(tree, tree.get_root_id(), compact, compact.get_root_id());
+    tree = std::move(compact);
+}
+
+// ============================================================================
+// SequenceEncoder
+// ============================================================================
+
+SequenceEncoder::SequenceEncoder(const SequenceConfig& config)
+    : config_(config), tree_(0, 0), reference_(0, 0) {
+}
+
+std::vector<uint8_t> SequenceEncoder::encode(const ImageView& frame) {
+    ExecutionContext context;
+    return encode(frame, context);
+}
+
+std::vector<uint8_t> SequenceEncoder::encode(const ImageView& frame, ExecutionContext& context) {
+    uint32_t width = frame.get_width();
+    uint32_t height = frame.get_height();
+    
+    uint32_t tree_width, tree_height;
+    tree_.get_dimensions(tree_width, tree_height);
+    bool keyframe = keyframe_requested_ || tree_width != width || tree_height != height ||
+                    (config_.keyframe_interval > 0 && frames_since_keyframe_ >= config_.keyframe_interval);
+    
+    last_stats_ = FrameStats();
+    last_stats_.keyframe = keyframe;
+    
+    FrameWriter writer;
+    
+    if (keyframe) {
+        tree_ = SpectreTree(width, height);
+        live_tiles_ = 1;
+        reference_ = ColorData(width, height);
+        writer.write_op(SequenceStream::REPLACE);
+        code_subtree(frame, 0, 0, width, height, 0, tree_.get_root_id(), writer, context);
+        last_stats_.changed_blocks = static_cast<uint64_t>((width + SequenceStream::CHANGE_BLOCK_SIZE - 1) /
+                                                           SequenceStream::CHANGE_BLOCK_SIZE) *
+                                     ((height + SequenceStream::CHANGE_BLOCK_SIZE - 1) /
+                                      SequenceStream::CHANGE_BLOCK_SIZE);
+        frames_since_keyframe_ = 0;
+        keyframe_requested_ = false;
+    } else {
+        ChangeMap changes = [&] {
+            ProfileScope scope(context.get_profiler(), "change_detection");
+            return detect_changes(frame, context.get_threads());
+        }();
+        last_stats_.changed_blocks = changes.table.back();
+        
+        ProfileScope scope(context.get_profiler(), "tree_update");
+        encode_tile(frame, changes, tree_.get_root_id(), 0, 0, width, height, writer, context);
+        compact_if_sparse(tree_, live_tiles_);
+    }
+    ++frames_since_keyframe_;
+    
+    std::vector<uint8_t> stream = finish_frame(writer, keyframe, context);
+    
+    last_stats_.tile_count = live_tiles_;
+    last_stats_.coded_tile_count = writer.coded_tile_count;
+    last_stats_.stream_size = stream.size();
+    return stream;
+}
+
+SequenceEncoder::ChangeMap SequenceEncoder::detect_changes(const ImageView& frame, int threads) const {
+    const uint32_t block = SequenceStream::CHANGE_BLOCK_SIZE;
+    uint32_t width = frame.get_width();
+    uint32_t height = frame.get_height();
+    
+    ChangeMap changes;
+    changes.blocks_x = (width + block - 1) / block;
+    changes.blocks_y = (height + block - 1) / block;
+    
+    // A block changed when its mean squared error over the three channels
+    // exceeds change_threshold^2
+    double limit = config_.change_threshold * config_.change_threshold * 3.0;
+    std::vector<uint8_t> changed(static_cast<size_t>(changes.blocks_x) * changes.blocks_y, 0);
+    ImageView reference = reference_.view();
+    
+#if ETCA_OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(threads)
+#else
+    (void)threads;
+#endif
+    for (int64_t block_y = 0; block_y < static_cast<int64_t>(changes.blocks_y); ++block_y) {
+        uint32_t y0 = static_cast<uint32_t>(block_y) * block;
+        uint32_t y1 = std::min(height, y0 + block);
+        std::vector<uint64_t> block_error(changes.blocks_x, 0);
+        
+        for (uint32_t y = y0; y < y1; ++y) {
+            const Color* current = frame.row(y);
+            const Color* previous = reference.row(y);
+            for (uint32_t block_x = 0; block_x < changes.blocks_x; ++block_x) {
+                uint32_t x1 = std::min(width, (block_x + 1) * block);
+                uint64_t error = 0;
+                for (uint32_t x = block_x * block; x < x1; ++x) {
+                    int dr = static_cast<int>(current[x].r) - previous[x].r;
+                    int dg = static_cast<int>(current[x].g) - previous[x].g;
+                    int db = static_cast<int>(current[x].b) - previous[x].b;
+                    error += static_cast<uint64_t>(dr * dr + dg * dg + db * db);
+                }
+                block_error[block_x] += error;
+            }
+        }
+        
+        for (uint32_t block_x = 0; block_x < changes.blocks_x; ++block_x) {
+            uint32_t x1 = std::min(width, (block_x + 1) * block);
+            double pixels = static_cast<double>(x1 - block_x * block) * (y1 - y0);
+            changed[static_cast<size_t>(block_y) * changes.blocks_x + block_x] =
+                static_cast<double>(block_error[block_x]) > limit * pixels;
+        }
+    }
+    
+    // Summed-area table so a tile's count is four lookups
+    size_t stride = static_cast<size_t>(changes.blocks_x) + 1;
+    changes.table.assign(stride * (changes.blocks_y + 1), 0);
+    for (uint32_t block_y = 0; block_y < changes.blocks_y; ++block_y) {
+        for (uint32_t block_x = 0; block_x < changes.blocks_x; ++block_x) {
+            size_t index = (block_y + 1) * stride + block_x + 1;
+            changes.table[index] = changed[static_cast<size_t>(block_y) * changes.blocks_x + block_x] +
+                                   changes.table[index - 1] + changes.table[index - stride] -
+                                   changes.table[index - stride - 1];
+        }
+    }
+    
+    return changes;
+}
+
+uint64_t SequenceEncoder::ChangeMap::changed_blocks(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const {
+    if (width == 0 || height == 0) {
+        return 0;
+    }
+    
+    // Every block the region overlaps, so partial overlaps count as changed
+    const uint32_t block = SequenceStream::CHANGE_BLOCK_SIZE;
+    size_t x0 = x / block, x1 = (static_cast<size_t>(x) + width - 1) / block + 1;
+    size_t y0 = y / block, y1 = (static_cast<size_t>(y) + height - 1) / block + 1;
+    size_t stride = static_cast<size_t>(blocks_x) + 1;
+    return static_cast<uint64_t>(table[y1 * stride + x1]) - table[y0 * stride + x1] -
+           table[y1 * stride + x0] + table[y0 * stride + x0];
+}
+
+uint64_t SequenceEncoder::ChangeMap::touched_blocks(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const {
+    if (width == 0 || height == 0) {
+        return 0;
+    }
+    
+    const uint32_t block = SequenceStream::CHANGE_BLOCK_SIZE;
+    uint64_t columns = (static_cast<uint64_t>(x) + width - 1) / block + 1 - x / block;
+    uint64_t rows = (static_cast<uint64_t>(y) + height - 1) / block + 1 - y / block;
+    return columns * rows;
+}
+
+void SequenceEncoder::FrameWriter::write_op(SequenceStream::Op op) {
+    if (op_count % 4 == 0) {
+        ops.push_back(0);
+    }
+    ops.back() |= static_cast<uint8_t>(op << (6 - 2 * (op_count % 4)));
+    ++op_count;
+}
+
+void SequenceEncoder::FrameWriter::write_split(bool split) {
+    if (coded_tile_count % 8 == 0) {
+        split_flags.push_back(0);
+    }
+    if (split) {
+        split_flags.back() |= static_cast<uint8_t>(1u << (7 - coded_tile_count % 8));
+    }
+    ++coded_tile_count;
+}
+
+void SequenceEncoder::encode_tile(
+    const ImageView& frame,
+    const ChangeMap& changes,
+    SpectreTile::ID id,
+    uint32_t x, uint32_t y,
+    uint32_t width, uint32_t height,
+    FrameWriter& writer,
+    ExecutionContext& context) {
+    
+    // The subtree stays in the tree as it is
+    uint64_t changed = changes.changed_blocks(x, y, width, height);
+    if (changed == 0) {
+        writer.write_op(SequenceStream::SKIP);
+        return;
+    }
+    
+    // Keep the split while most of the tile is unchanged, so the rebuild
+    // stays confined to the children that actually moved
+    uint64_t touched = changes.touched_blocks(x, y, width, height);
+    if (tree_.is_subdivided(id) && static_cast<double>(changed) < config_.rebuild_fraction * static_cast<double>(touched)) {
+        writer.write_op(SequenceStream::DESCEND);
+        
+        SpectreTile::ID first_child = tree_.get_first_child(id);
+        for (int i = 0; i < TileInflater::CHILDREN_PER_TILE; ++i) {
+            uint32_t child_x, child_y, child_width, child_height;
+            TileInflater::get_child_bounds(width, height, i, child_x, child_y, child_width, child_height);
+            encode_tile(frame, changes, first_child + static_cast<SpectreTile::ID>(i),
+                        x + child_x, y + child_y, child_width, child_height, writer, context);
+        }
+        return;
+    }
+    
+    writer.write_op(SequenceStream::REPLACE);
+    detach_subtree(tree_, id, live_tiles_);
+    code_subtree(frame, x, y, width, height, tree_.get_depth(id), id, writer, context);
+}
+
+void SequenceEncoder::code_subtree(
+    const ImageView& frame,
+    uint32_t x, uint32_t y,
+    uint32_t width, uint32_t height,
+    int depth,
+    SpectreTile::ID id,
+    FrameWriter& writer,
+    ExecutionContext& context) {
+    
+    const CompressionConfig& config = config_.compression;
+    ImageView region = frame.subview(x, y, width, height);
+    
+    // Built over the region alone, with the depth the tile has left
+    SpectreTree subtree(width, height);
+    if (width > 0 && height > 0) {
+        subtree.build(region, config.variance_threshold, std::max(0, config.max_tree_depth - depth),
+                      config.parallel_cutoff_pixels, context);
+    }
+    
+    // Implicit layout (see tree_stream.h): split flags and leaf colors in pre-order
+    std::vector<SpectreTile::ID> pending = {subtree.get_root_id()};
+    while (!pending.empty()) {
+        SpectreTile::ID tile = pending.back();
+        pending.pop_back();
+        
+        bool split = subtree.is_subdivided(tile);
+        writer.write_split(split);
+        if (split) {
+            SpectreTile::ID first_child = subtree.get_first_child(tile);
+            for (int i = TileInflater::CHILDREN_PER_TILE - 1; i >= 0; --i) {
+                pending.push_back(first_child + static_cast<SpectreTile::ID>(i));
+            }
+        } else {
+            uint8_t r, g, b;
+            subtree.get_color(tile, r, g, b);
+            writer.colors.push_back(r);
+            writer.colors.push_back(g);
+            writer.colors.push_back(b);
+        }
+    }
+    
+    // Grafted onto the (leaf) tile it replaces
+    copy_subtree(subtree, subtree.get_root_id(), tree_, id);
+    live_tiles_ += subtree.get_tile_count() - 1;
+    reference_.copy_region(region, x, y);
+    last_stats_.coded_pixels += static_cast<uint64_t>(width) * height;
+}
+
+std::vector<uint8_t> SequenceEncoder::finish_frame(const FrameWriter& writer, bool keyframe,
+                                                   ExecutionContext& context) {
+    std::vector<uint8_t> stream;
+    {
+        ProfileScope scope(context.get_profiler(), "serialize");
+        
+        TreeStream::Header header;
+        header.version = TreeStream::VERSION_SEQUENCE;
+        tree_.get_dimensions(header.width, header.height);
+        header.tile_count = live_tiles_;
+        header.max_depth = static_cast<uint8_t>(std::min(tree_.get_max_depth(), 255));
+        TreeStream::write_header(header, stream);
+        
+        stream.push_back(keyframe ? SequenceStream::FRAME_KEY : 0);
+        TreeStream::write_varint(writer.op_count, stream);
+        TreeStream::write_varint(writer.coded_tile_count, stream);
+        stream.insert(stream.end(), writer.ops.begin(), writer.ops.end());
+        stream.insert(stream.end(), writer.split_flags.begin(), writer.split_flags.end());
+        stream.insert(stream.end(), writer.colors.begin(), writer.colors.end());
+    }
+    
+    ProfileScope scope(context.get_profiler(), "entropy");
+    Compressor compressor(config_.compression);
+    compressor.apply_entropy_coding(stream, context);
+    return stream;
+}
+
+// ============================================================================
+// SequenceDecoder
+// ============================================================================
+
+SequenceDecoder::SequenceDecoder()
+    : tree_(0, 0), frame_(0, 0) {
+}
+
+bool SequenceDecoder::decode(ByteSpan data) {
+    ByteSpan stream = Decompressor::decode_entropy_layer(data, storage_);
+    
+    TreeStream::Header header;
+    size_t offset = 0;
+    if (!TreeStream::read_header(stream.data(), stream.size(), header, offset) ||
+        header.version != TreeStream::VERSION_SEQUENCE || header.tile_count == 0 || offset >= stream.size()) {
+        return false;
+    }
+    
+    bool keyframe = (stream[offset++] & SequenceStream::FRAME_KEY) != 0;
+    uint64_t op_count, coded_tile_count;
+    if (!TreeStream::read_varint(stream.data(), stream.size(), offset, op_count) ||
+        !TreeStream::read_varint(stream.data(), stream.size(), offset, coded_tile_count)) {
+        return false;
+    }
+    
+    // Reject counts the payload cannot hold before sizing anything from them
+    uint64_t remaining = stream.size() - offset;
+    if (op_count == 0 || op_count > remaining * 4 || coded_tile_count > remaining * 8) {
+        return false;
+    }
+    uint64_t split_offset = offset + (op_count + 3) / 4;
+    uint64_t color_offset = split_offset + TreeStream::split_flag_bytes(coded_tile_count);
+    if (color_offset > stream.size()) {
+        return false;
+    }
+    
+    if (keyframe) {
+        if (frame_.get_width() != header.width || frame_.get_height() != header.height) {
+            frame_ = ColorData(header.width, header.height);
+        }
+    } else if (!has_reference_ || frame_.get_width() != header.width || frame_.get_height() != header.height) {
+        return false;
+    }
+    
+    FrameCursor cursor{stream.data() + offset, op_count, 0,
+                       stream.data() + split_offset, coded_tile_count, 0,
+                       stream.data() + color_offset, stream.data() + stream.size(), header.max_depth};
+    
+    // A keyframe replaces the root of an empty tree; its first op must say so
+    bool ok;
+    if (keyframe) {
+        tree_ = SpectreTree(header.width, header.height);
+        live_tiles_ = 1;
+        ok = (cursor.ops[0] >> 6) == SequenceStream::REPLACE;
+        cursor.next_op = 1;
+        ok = ok && decode_subtree(cursor, 0, 0, header.width, header.height, 0, tree_.get_root_id());
+    } else {
+        ok = decode_tile(cursor, tree_.get_root_id(), 0, 0, header.width, header.height);
+    }
+    ok = ok && cursor.next_op == op_count && cursor.next_coded_tile == coded_tile_count &&
+         cursor.colors == cursor.colors_end && live_tiles_ == header.tile_count;
+    
+    // A damaged frame leaves no trustworthy tree to patch: wait for a keyframe
+    if (ok) {
+        compact_if_sparse(tree_, live_tiles_);
+    }
+    has_reference_ = ok;
+    return ok;
+}
+
+bool SequenceDecoder::decode_tile(
+    FrameCursor& cursor,
+    SpectreTile::ID id,
+    uint32_t x, uint32_t y,
+    uint32_t width, uint32_t height) {
+    
+    if (cursor.next_op >= cursor.op_count) {
+        return false;
+    }
+    
+    uint64_t op_index = cursor.next_op++;
+    uint8_t op = (cursor.ops[op_index / 4] >> (6 - 2 * (op_index % 4))) & 0x03;
+    
+    switch (op) {
+        case SequenceStream::SKIP:
+            return true;
+        
+        case SequenceStream::DESCEND: {
+            if (!tree_.is_subdivided(id)) {
+                return false;
+            }
+            SpectreTile::ID first_child = tree_.get_first_child(id);
+            for (int i = 0; i < TileInflater::CHILDREN_PER_TILE; ++i) {
+                uint32_t child_x, child_y, child_width, child_height;
+                TileInflater::get_child_bounds(width, height, i, child_x, child_y, child_width, child_height);
+                if (!decode_tile(cursor, first_child + static_cast<SpectreTile::ID>(i),
+                                 x + child_x, y + child_y, child_width, child_height)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        
+        case SequenceStream::REPLACE:
+            detach_subtree(tree_, id, live_tiles_);
+            return decode_subtree(cursor, x, y, width, height, tree_.get_depth(id), id);
+        
+        default:
+            return false;
+    }
+}
+
+bool SequenceDecoder::decode_subtree(
+    FrameCursor& cursor,
+    uint32_t x, uint32_t y,
+    uint32_t width, uint32_t height,
+    int depth,
+    SpectreTile::ID id) {
+    
+    // The depth bound keeps a corrupt stream from recursing without limit
+    if (cursor.next_coded_tile >= cursor.coded_tile_count || depth > cursor.max_depth) {
+        return false;
+    }
+    
+    uint64_t tile_index = cursor.next_coded_tile++;
+    bool split = (cursor.split_flags[tile_index / 8] >> (7 - tile_index % 8)) & 1;
+    
+    if (!split) {
+        if (cursor.colors_end - cursor.colors < 3) {
+            return false;
+        }
+        tree_.set_color(id, cursor.colors[0], cursor.colors[1], cursor.colors[2]);
+        frame_.fill_region(x, y, width, height, Color(cursor.colors[0], cursor.colors[1], cursor.colors[2]));
+        cursor.colors += 3;
+        return true;
+    }
+    
+    SpectreTile::ID first_child = tree_.subdivide(id);
+    live_tiles_ += TileInflater::CHILDREN_PER_TILE;
+    for (int i = 0; i < TileInflater::CHILDREN_PER_TILE; ++i) {
+        uint32_t child_x, child_y, child_width, child_height;
+        TileInflater::get_child_bounds(width, height, i, child_x, child_y, child_width, child_height);
+        if (!decode_subtree(cursor, x + child_x, y + child_y, child_width, child_height, depth + 1,
+                            first_child + static_cast<SpectreTile::ID>(i))) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+} // namespace spectre
@@ -1,77 +1,159 @@
 #include "spectre_tree.h"
 #include "variance_calculator.h"
 #include "tile_inflater.h"
+#include "profiler.h"
+#include <utility>
 #if ETCA_OPENMP
 #include <omp.h>
 #endif
 
+// Tasks need OpenMP 3.0; older runtimes (e.g. MSVC's 2.0) build serially
+#if ETCA_OPENMP && defined(_OPENMP) && _OPENMP >= 200805
+#define ETCA_OPENMP_TASKS 1
+#else
+#define ETCA_OPENMP_TASKS 0
+#endif
+
 namespace spectre {
 
 SpectreTree::SpectreTree(uint32_t image_width, uint32_t image_height)
     : image_width_(image_width), image_height_(image_height), root_id_(1), max_depth_(0) {
     
     // Create root tile
-    auto root = std::make_unique<SpectreTile>(root_id_, 0, 0);
-    tiles_[root_id_] = std::move(root);
-    id_to_address_[root_id_] = HierarchicalAddress();  // Empty = root
+    create_tile(0, NO_TILE);
 }
 
-SpectreTile* SpectreTree::get_tile(SpectreTile::ID id) {
-    auto it = tiles_.find(id);
-    if (it != tiles_.end()) {
-        return it->second.get();
+SpectreTile::ID SpectreTree::get_tile_by_address(const HierarchicalAddress& address) const {
+    if (address.is_packed()) {
+        return get_tile_by_address(address.get_packed());
     }
-    return nullptr;
-}
-
-const SpectreTile* SpectreTree::get_tile(SpectreTile::ID id) const {
-    auto it = tiles_.find(id);
-    if (it != tiles_.end()) {
-        return it->second.get();
+    
+    SpectreTile::ID id = root_id_;
+    for (size_t level = 0; level < address.get_depth(); ++level) {
+        HierarchicalAddress::AddressSegment segment = address.get_segment(level);
+        if (segment >= static_cast<uint32_t>(TileInflater::CHILDREN_PER_TILE) || !is_subdivided(id)) {
+            return NO_TILE;
+        }
+        id = get_first_child(id) + segment;
     }
-    return nullptr;
+    return id;
 }
 
-SpectreTile* SpectreTree::get_tile_by_address(const HierarchicalAddress& address) {
-    // Linear search through address map (could optimize with reverse map)
-    for (auto& [id, addr] : id_to_address_) {
-        if (addr == address) {
-            return get_tile(id);
+SpectreTile::ID SpectreTree::get_tile_by_address(const PackedAddress& address) const {
+    // Descend from the root; each segment selects a child within the block
+    SpectreTile::ID id = root_id_;
+    for (uint32_t level = 0; level < address.depth; ++level) {
+        if (!is_subdivided(id)) {
+            return NO_TILE;
         }
+        id = get_first_child(id) + address.segment(level);
     }
-    return nullptr;
+    return id;
 }
 
-const SpectreTile* SpectreTree::get_tile_by_address(const HierarchicalAddress& address) const {
-    for (const auto& [id, addr] : id_to_address_) {
-        if (addr == address) {
-            return get_tile(id);
+HierarchicalAddress SpectreTree::get_address(SpectreTile::ID id) const {
+    if (!has_tile(id)) {
+        return HierarchicalAddress();
+    }
+    
+    // Walk up to the root; a child's position is its offset in the parent's block
+    uint32_t depth = static_cast<uint32_t>(get_depth(id));
+    if (depth <= PackedAddress::MAX_DEPTH) {
+        PackedAddress address{0, depth};
+        for (uint32_t level = depth; level > 0; --level) {
+            SpectreTile::ID parent_id = get_parent_id(id);
+            address.path |= static_cast<uint64_t>(id - get_first_child(parent_id)) << PackedAddress::shift(level - 1);
+            id = parent_id;
         }
+        return HierarchicalAddress(address);
+    }
+    
+    std::vector<HierarchicalAddress::AddressSegment> segments(depth);
+    for (size_t level = segments.size(); level > 0; --level) {
+        SpectreTile::ID parent_id = get_parent_id(id);
+        segments[level - 1] = static_cast<HierarchicalAddress::AddressSegment>(id - get_first_child(parent_id));
+        id = parent_id;
     }
-    return nullptr;
+    return HierarchicalAddress(segments);
 }
 
-HierarchicalAddress SpectreTree::get_address(SpectreTile::ID id) const {
-    auto it = id_to_address_.find(id);
-    if (it != id_to_address_.end()) {
-        return it->second;
-    }
-    return HierarchicalAddress();
+void SpectreTree::build(const ColorData& image, double variance_threshold, int max_depth,
+                        uint64_t parallel_cutoff) {
+    build(image.view(), variance_threshold, max_depth, parallel_cutoff);
+}
+
+void SpectreTree::build(const ImageView& view, double variance_threshold, int max_depth,
+                        uint64_t parallel_cutoff) {
+    ExecutionContext context;
+    build(view, variance_threshold, max_depth, parallel_cutoff, context);
 }
 
-void SpectreTree::build(const ColorData& image, double variance_threshold, int max_depth) {
-    SpectreTile* root = get_tile(root_id_);
-    if (!root) return;
+void SpectreTree::build(const ImageView& view, double variance_threshold, int max_depth,
+                        uint64_t parallel_cutoff, ExecutionContext& context) {
+    // Summed-area tables are built once; every tile then reads its stats in O(1)
+    IntegralImage integral = [&] {
+        ProfileScope scope(context.get_profiler(), "integral_image");
+        return IntegralImage(view, context.get_threads(), std::move(context.integral_scratch()));
+    }();
+    
+    build(integral, variance_threshold, max_depth, parallel_cutoff, context);
+    
+    // The tables are done with; keep their storage for the context's next build
+    context.integral_scratch() = integral.release_storage();
+}
+
+void SpectreTree::build(const IntegralImage& integral, double variance_threshold, int max_depth,
+                        uint64_t parallel_cutoff, ExecutionContext& context) {
+    Profiler* profiler = context.get_profiler();
+    
+    image_width_ = integral.get_width();
+    image_height_ = integral.get_height();
+    
+    // Phase 1: decide the tree shape, in parallel above the cutoff
+    std::vector<BuildNode>& nodes = build_nodes_;
+    nodes.clear();
+    {
+        ProfileScope scope(profiler, "subdivide");
+        
+        // A serial build records straight into the shared list, without per-task buffers
+        uint64_t task_cutoff = context.get_threads() > 1 ? parallel_cutoff : UINT64_MAX;
+#if ETCA_OPENMP_TASKS
+        uint64_t root_area = static_cast<uint64_t>(integral.get_width()) * integral.get_height();
+        #pragma omp parallel if(root_area >= task_cutoff) num_threads(context.get_threads())
+        #pragma omp single
+#endif
+        build_recursive(integral, 0, 0, integral.get_width(), integral.get_height(),
+                        variance_threshold, 0, max_depth, task_cutoff, nodes);
+    }
+    
+    // Phase 2: lay tiles out serially so IDs never depend on scheduling
+    ProfileScope scope(profiler, "layout");
+    parent_.resize(1);
+    first_child_.resize(1);
+    depth_.resize(1);
+    color_r_.resize(1);
+    color_g_.resize(1);
+    color_b_.resize(1);
+    first_child_[0] = NO_TILE;
+    max_depth_ = 0;
     
-    build_recursive(*root, image, HierarchicalAddress(), variance_threshold, 0, max_depth);
+    parent_.reserve(nodes.size());
+    first_child_.reserve(nodes.size());
+    depth_.reserve(nodes.size());
+    color_r_.reserve(nodes.size());
+    color_g_.reserve(nodes.size());
+    color_b_.reserve(nodes.size());
+    
+    attach_subtree(nodes, 0, root_id_);
+    nodes.clear();
 }
 
 std::vector<SpectreTile::ID> SpectreTree::get_leaf_nodes() const {
     std::vector<SpectreTile::ID> leaves;
     
-    for (const auto& [id, tile_ptr] : tiles_) {
-        if (!tile_ptr->is_subdivided()) {
-            leaves.push_back(id);
+    for (size_t index = 0; index < first_child_.size(); ++index) {
+        if (first_child_[index] == NO_TILE) {
+            leaves.push_back(root_id_ + index);
         }
     }
     
@@ -79,116 +161,123 @@ std::vector<SpectreTile::ID> SpectreTree::get_leaf_nodes() const {
 }
 
 std::vector<SpectreTile::ID> SpectreTree::get_all_tiles() const {
-    std::vector<SpectreTile::ID> all_tiles;
+    std::vector<SpectreTile::ID> all_tiles(depth_.size());
     
-    for (const auto& [id, tile_ptr] : tiles_) {
-        if (tile_ptr) {
-            all_tiles.push_back(id);
-        }
+    for (size_t index = 0; index < all_tiles.size(); ++index) {
+        all_tiles[index] = root_id_ + index;
     }
     
     return all_tiles;
 }
 
-void SpectreTree::add_deserialized_tile(
-    SpectreTile::ID id,
-    int depth,
-    SpectreTile::ID parent_id,
-    uint8_t r, uint8_t g, uint8_t b,
-    const std::vector<SpectreTile::ID>& children) {
-    
-    // Create a new tile with basic info
-    auto tile = std::make_unique<SpectreTile>(id, depth, parent_id);
-    
-    // Set the color
-    tile->set_color(r, g, b);
-    
-    // Add children
-    for (SpectreTile::ID child_id : children) {
-        tile->add_child(child_id);
+SpectreTile::ID SpectreTree::subdivide(SpectreTile::ID id) {
+    size_t index = index_of(id);
+    if (first_child_[index] != NO_TILE) {
+        return first_child_[index];
     }
     
-    // Register the tile
-    tiles_[id] = std::move(tile);
-    
-    // Estimate hierarchical address based on depth (placeholder)
-    // In full implementation, could reconstruct from parent-child relationships
-    std::vector<uint32_t> address_segments;
-    for (int i = 0; i < depth; ++i) {
-        address_segments.push_back(0);  // Placeholder segment
+    int child_depth = depth_[index] + 1;
+    SpectreTile::ID first_child = create_tile(child_depth, id);
+    for (int i = 1; i < TileInflater::CHILDREN_PER_TILE; ++i) {
+        create_tile(child_depth, id);
     }
-    id_to_address_[id] = HierarchicalAddress(address_segments);
+    first_child_[index] = first_child;
     
-    // Update max_depth if needed
-    if (depth > max_depth_) {
-        max_depth_ = depth;
+    if (child_depth > max_depth_) {
+        max_depth_ = child_depth;
     }
-}
-
-void SpectreTree::set_tile_address(SpectreTile::ID id, const HierarchicalAddress& address) {
-    id_to_address_[id] = address;
+    
+    return first_child;
 }
 
 void SpectreTree::build_recursive(
-    SpectreTile& tile,
-    const ColorData& image,
-    const HierarchicalAddress& address,
+    const IntegralImage& integral,
+    uint32_t x, uint32_t y,
+    uint32_t width, uint32_t height,
     double variance_threshold,
     int current_depth,
-    int max_depth) {
-    
-    // Update max depth
-    if (current_depth > max_depth_) {
-        max_depth_ = current_depth;
-    }
+    int max_depth,
+    uint64_t parallel_cutoff,
+    std::vector<BuildNode>& nodes) {
     
     // Calculate color for this tile (average of all pixels)
-    Color avg_color = image.calculate_average_color();
-    tile.set_color(avg_color.r, avg_color.g, avg_color.b);
+    Color avg_color = integral.region_average_color(x, y, width, height);
     
     // Check if we should subdivide
-    if (current_depth >= max_depth || !VarianceCalculator::should_subdivide(image, variance_threshold)) {
+    bool subdivide = current_depth < max_depth &&
+        VarianceCalculator::should_subdivide(integral, x, y, width, height, variance_threshold);
+    
+    nodes.push_back({avg_color, subdivide});
+    if (!subdivide) {
         return;  // This tile is a leaf
     }
     
-    // Inflate the tile
-    std::vector<SpectreTile::ID> children = TileInflater::inflate_tile(tile);
-    
-    // Process each child
-    uint32_t parent_width = image.get_width();
-    uint32_t parent_height = image.get_height();
+    uint32_t child_x[TileInflater::CHILDREN_PER_TILE], child_y[TileInflater::CHILDREN_PER_TILE];
+    uint32_t child_width[TileInflater::CHILDREN_PER_TILE], child_height[TileInflater::CHILDREN_PER_TILE];
+    for (int i = 0; i < TileInflater::CHILDREN_PER_TILE; ++i) {
+        TileInflater::get_child_bounds(width, height, i,
+                                       child_x[i], child_y[i], child_width[i], child_height[i]);
+    }
     
-    for (size_t i = 0; i < children.size(); ++i) {
-        uint32_t child_x, child_y, child_width, child_height;
-        TileInflater::get_child_bounds(parent_width, parent_height, static_cast<int>(i),
-                                       child_x, child_y, child_width, child_height);
-        
-        // Extract the region for this child
-        ColorData child_image = image.extract_region(child_x, child_y, child_width, child_height);
-        
-        // Create child tile
-        SpectreTile::ID child_id = children[i];
-        auto child_tile = std::make_unique<SpectreTile>(child_id, current_depth + 1, tile.get_id());
-        
-        // Store hierarchical address
-        HierarchicalAddress child_address = address.get_child_address(static_cast<uint32_t>(i));
+#if ETCA_OPENMP_TASKS
+    if (static_cast<uint64_t>(width) * height >= parallel_cutoff) {
+        // Each child subtree records into its own buffer; buffers are then
+        // appended in child order, which keeps the result deterministic
+        std::vector<BuildNode> child_nodes[TileInflater::CHILDREN_PER_TILE];
         
-        // Recursively build subtree
-        SpectreTile* child_ptr = child_tile.get();
-        tiles_[child_id] = std::move(child_tile);
-        id_to_address_[child_id] = child_address;
+        for (int i = 0; i < TileInflater::CHILDREN_PER_TILE; ++i) {
+            #pragma omp task default(none) shared(integral, child_nodes, child_x, child_y, child_width, child_height) \
+                firstprivate(i, x, y, variance_threshold, current_depth, max_depth, parallel_cutoff)
+            build_recursive(integral, x + child_x[i], y + child_y[i], child_width[i], child_height[i],
+                            variance_threshold, current_depth + 1, max_depth, parallel_cutoff,
+                            child_nodes[i]);
+        }
+        #pragma omp taskwait
         
-        build_recursive(*child_ptr, child_image, child_address, variance_threshold,
-                       current_depth + 1, max_depth);
+        for (const auto& subtree : child_nodes) {
+            nodes.insert(nodes.end(), subtree.begin(), subtree.end());
+        }
+        return;
+    }
+#endif
+    
+    for (int i = 0; i < TileInflater::CHILDREN_PER_TILE; ++i) {
+        build_recursive(integral, x + child_x[i], y + child_y[i], child_width[i], child_height[i],
+                        variance_threshold, current_depth + 1, max_depth, parallel_cutoff, nodes);
+    }
+}
+
+size_t SpectreTree::attach_subtree(
+    const std::vector<BuildNode>& nodes,
+    size_t index,
+    SpectreTile::ID id) {
+    
+    const BuildNode& node = nodes[index++];
+    set_color(id, node.color.r, node.color.g, node.color.b);
+    
+    if (!node.subdivided) {
+        return index;
     }
+    
+    // Inflate the tile; its children take the next block of IDs
+    SpectreTile::ID first_child = subdivide(id);
+    
+    for (int i = 0; i < TileInflater::CHILDREN_PER_TILE; ++i) {
+        index = attach_subtree(nodes, index, first_child + static_cast<SpectreTile::ID>(i));
+    }
+    
+    return index;
 }
 
 SpectreTile::ID SpectreTree::create_tile(int depth, SpectreTile::ID parent_id) {
-    static SpectreTile::ID id_counter = 2;  // Start after root
+    SpectreTile::ID new_id = root_id_ + depth_.size();
     
-    SpectreTile::ID new_id = id_counter++;
-    auto tile = std::make_unique<SpectreTile>(new_id, depth, parent_id);
-    tiles_[new_id] = std::move(tile);
+    parent_.push_back(parent_id);
+    first_child_.push_back(NO_TILE);
+    depth_.push_back(static_cast<uint8_t>(depth));
+    color_r_.push_back(0);
+    color_g_.push_back(0);
+    color_b_.push_back(0);
     
     return new_id;
 }
@@ -1,4 +1,5 @@
 #include "spectrum_analyzer.h"
+#include "fft.h"
 #include <cmath>
 #include <algorithm>
 #include <numeric>
@@ -78,20 +79,9 @@ std::vector<std::pair<double, double>> SpectrumAnalyzer::generate_periodic_tile_
 }
 
 std::vector<std::complex<double>> SpectrumAnalyzer::dft_1d(const std::vector<double>& data) {
-    uint32_t N = static_cast<uint32_t>(data.size());
-    std::vector<std::complex<double>> result(N);
-    
-    const double TWO_PI = 2.0 * M_PI;
-    
-    for (uint32_t k = 0; k < N; ++k) {
-        std::complex<double> sum(0.0, 0.0);
-        for (uint32_t n = 0; n < N; ++n) {
-            double angle = -TWO_PI * k * n / N;
-            sum += data[n] * std::complex<double>(std::cos(angle), std::sin(angle));
-        }
-        result[k] = sum;
-    }
-    
+    std::vector<std::complex<double>> result(data.begin(), data.end());
+    std::vector<std::complex<double>> scratch;
+    FFTPlan(result.size()).forward(result.data(), scratch);
     return result;
 }
 
@@ -150,6 +140,85 @@ SpectrumAnalyzer::Spectrum SpectrumAnalyzer::compute_spatial_spectrum(
         spectrum.magnitude[k] = std::abs(dft_result[k]) / num_frequencies;
     }
     
+    summarize(spectrum);
+    return spectrum;
+}
+
+SpectrumAnalyzer::Spectrum SpectrumAnalyzer::compute_spatial_spectrum(
+    const ColorData& image,
+    uint32_t num_frequencies,
+    int threads) {
+    
+    Spectrum spectrum;
+    spectrum.frequencies.resize(num_frequencies);
+    spectrum.magnitude.resize(num_frequencies, 0.0);
+    
+    const uint32_t width = image.get_width();
+    const uint32_t height = image.get_height();
+    if (num_frequencies == 0 || width == 0 || height == 0) {
+        return spectrum;
+    }
+    
+    // Luma with the mean removed, so the DC term does not dwarf the rest
+    std::vector<std::complex<double>> values(static_cast<size_t>(width) * height);
+    double mean = 0.0;
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            Color c = image.get_pixel(x, y);
+            double luma = 0.299 * c.r + 0.587 * c.g + 0.114 * c.b;
+            values[static_cast<size_t>(y) * width + x] = luma;
+            mean += luma;
+        }
+    }
+    mean /= static_cast<double>(values.size());
+    
+    // Separable Hann window
+    auto hann = [](uint32_t n, uint32_t size) {
+        return size > 1 ? 0.5 - 0.5 * std::cos(2.0 * M_PI * n / (size - 1)) : 1.0;
+    };
+    std::vector<double> window_x(width), window_y(height);
+    for (uint32_t x = 0; x < width; ++x) window_x[x] = hann(x, width);
+    for (uint32_t y = 0; y < height; ++y) window_y[y] = hann(y, height);
+    
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            auto& value = values[static_cast<size_t>(y) * width + x];
+            value = (value.real() - mean) * window_x[x] * window_y[y];
+        }
+    }
+    
+    FFTPlan::forward_2d(values, width, height, threads);
+    
+    // Average magnitudes over rings of radial frequency up to Nyquist
+    std::vector<uint64_t> counts(num_frequencies, 0);
+    const double bins_per_cycle = 2.0 * num_frequencies;
+    for (uint32_t v = 0; v < height; ++v) {
+        double fy = static_cast<double>(v <= height / 2 ? v : static_cast<double>(v) - height) / height;
+        for (uint32_t u = 0; u < width; ++u) {
+            double fx = static_cast<double>(u <= width / 2 ? u : static_cast<double>(u) - width) / width;
+            double radius = std::sqrt(fx * fx + fy * fy);
+            if (radius > 0.5) {
+                continue;  // Corners beyond Nyquist along both axes
+            }
+            size_t bin = std::min(static_cast<size_t>(radius * bins_per_cycle), static_cast<size_t>(num_frequencies - 1));
+            spectrum.magnitude[bin] += std::abs(values[static_cast<size_t>(v) * width + u]);
+            ++counts[bin];
+        }
+    }
+    
+    const double scale = 1.0 / static_cast<double>(values.size());
+    for (uint32_t k = 0; k < num_frequencies; ++k) {
+        spectrum.frequencies[k] = static_cast<double>(k) / bins_per_cycle;
+        if (counts[k] > 0) {
+            spectrum.magnitude[k] *= scale / static_cast<double>(counts[k]);
+        }
+    }
+    
+    summarize(spectrum);
+    return spectrum;
+}
+
+void SpectrumAnalyzer::summarize(Spectrum& spectrum) {
     // Find peak
     auto max_it = std::max_element(spectrum.magnitude.begin(), spectrum.magnitude.end());
     if (max_it != spectrum.magnitude.end()) {
@@ -161,8 +230,6 @@ SpectrumAnalyzer::Spectrum SpectrumAnalyzer::compute_spatial_spectrum(
     auto peaks = detect_peaks(spectrum);
     spectrum.peak_count = static_cast<uint32_t>(peaks.size());
     spectrum.has_discrete_peaks = spectrum.peak_count > 3;  // Periodic has many peaks, aperiodic few
-    
-    return spectrum;
 }
 
 std::vector<std::pair<double, double>> SpectrumAnalyzer::detect_peaks(
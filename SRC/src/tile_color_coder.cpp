@@ -0,0 +1,61 @@
+#include "tile_color_coder.h"
+#include <algorithm>
+
+namespace spectre {
+
+static uint8_t remainder_channel(uint8_t parent, uint64_t parent_area, uint64_t siblings, uint64_t area) {
+    // The parent color is a truncated average; assume its sum sat mid-way
+    int64_t parent_sum = static_cast<int64_t>(parent * parent_area + (parent_area - 1) / 2);
+    int64_t remainder = parent_sum - static_cast<int64_t>(siblings);
+    int64_t value = (remainder + static_cast<int64_t>(area / 2)) / static_cast<int64_t>(area);
+    return static_cast<uint8_t>(std::clamp<int64_t>(value, 0, 255));
+}
+
+Color TileColorCoder::predict_last_child(const Color& parent, uint64_t parent_area,
+                                         const SiblingSums& siblings, uint64_t area) {
+    return Color(
+        remainder_channel(parent.r, parent_area, siblings.r, area),
+        remainder_channel(parent.g, parent_area, siblings.g, area),
+        remainder_channel(parent.b, parent_area, siblings.b, area)
+    );
+}
+
+void TileColorCoder::encode_split(RangeEncoder& encoder, int depth, bool split) {
+    encoder.encode_bit(split_models_[static_cast<size_t>(depth_context(depth))], split);
+}
+
+bool TileColorCoder::decode_split(RangeDecoder& decoder, int depth) {
+    return decoder.decode_bit(split_models_[static_cast<size_t>(depth_context(depth))]);
+}
+
+void TileColorCoder::encode_color(
+    RangeEncoder& encoder, int depth, bool leaf, bool last_child,
+    const Color& color, const Color& prediction) {
+    
+    size_t kind = color_kind(leaf, last_child);
+    int residual_r = color.r - prediction.r;
+    int residual_g = color.g - prediction.g;
+    int residual_b = color.b - prediction.b;
+    
+    encoder.encode_byte(color_tree(depth, kind, 0), to_symbol(residual_r));
+    encoder.encode_byte(color_tree(depth, kind, 1), to_symbol(residual_g - residual_r));
+    encoder.encode_byte(color_tree(depth, kind, 2), to_symbol(residual_b - residual_g));
+}
+
+Color TileColorCoder::decode_color(
+    RangeDecoder& decoder, int depth, bool leaf, bool last_child, const Color& prediction) {
+    
+    size_t kind = color_kind(leaf, last_child);
+    int residual_r = from_symbol(decoder.decode_byte(color_tree(depth, kind, 0)));
+    int residual_g = residual_r + from_symbol(decoder.decode_byte(color_tree(depth, kind, 1)));
+    int residual_b = residual_g + from_symbol(decoder.decode_byte(color_tree(depth, kind, 2)));
+    
+    // Residuals were taken mod 256, so wrap back the same way
+    return Color(
+        static_cast<uint8_t>(prediction.r + residual_r),
+        static_cast<uint8_t>(prediction.g + residual_g),
+        static_cast<uint8_t>(prediction.b + residual_b)
+    );
+}
+
+} // namespace spectre
@@ -3,16 +3,13 @@
 
 namespace spectre {
 
-// Initialize static member
-SpectreTile::ID TileInflater::next_tile_id_ = 1;
-
-std::vector<SpectreTile::ID> TileInflater::inflate_tile(SpectreTile& tile) {
+std::vector<SpectreTile::ID> TileInflater::inflate_tile(SpectreTile& tile, SpectreTile::ID first_child_id) {
     std::vector<SpectreTile::ID> children;
     
     // Generate child tiles based on Spectre inflation rules
     // The Spectre tile inflates into 4 children with specific arrangement
     for (int i = 0; i < CHILDREN_PER_TILE; ++i) {
-        SpectreTile::ID child_id = next_tile_id_++;
+        SpectreTile::ID child_id = first_child_id + static_cast<SpectreTile::ID>(i);
         tile.add_child(child_id);
         children.push_back(child_id);
     }
@@ -0,0 +1,88 @@
+#include "tree_stream.h"
+#include "tile_inflater.h"
+
+namespace spectre {
+
+bool TreeStream::has_magic(const uint8_t* data, size_t size) {
+    return size >= 4 && data[0] == MAGIC[0] && data[1] == MAGIC[1] && data[2] == MAGIC[2];
+}
+
+void TreeStream::write_header(const Header& header, std::vector<uint8_t>& output) {
+    output.push_back(MAGIC[0]);
+    output.push_back(MAGIC[1]);
+    output.push_back(MAGIC[2]);
+    output.push_back(header.version);
+    
+    output.push_back(static_cast<uint8_t>(header.width >> 24));
+    output.push_back(static_cast<uint8_t>(header.width >> 16));
+    output.push_back(static_cast<uint8_t>(header.width >> 8));
+    output.push_back(static_cast<uint8_t>(header.width));
+    
+    output.push_back(static_cast<uint8_t>(header.height >> 24));
+    output.push_back(static_cast<uint8_t>(header.height >> 16));
+    output.push_back(static_cast<uint8_t>(header.height >> 8));
+    output.push_back(static_cast<uint8_t>(header.height));
+    
+    write_varint(header.tile_count, output);
+    output.push_back(header.max_depth);
+}
+
+bool TreeStream::read_header(const uint8_t* data, size_t size, Header& header, size_t& offset) {
+    if (!has_magic(data, size) || size < 12) {
+        return false;
+    }
+    
+    header.version = data[3];
+    header.width = (static_cast<uint32_t>(data[4]) << 24) |
+                   (static_cast<uint32_t>(data[5]) << 16) |
+                   (static_cast<uint32_t>(data[6]) << 8) |
+                   static_cast<uint32_t>(data[7]);
+    header.height = (static_cast<uint32_t>(data[8]) << 24) |
+                    (static_cast<uint32_t>(data[9]) << 16) |
+                    (static_cast<uint32_t>(data[10]) << 8) |
+                    static_cast<uint32_t>(data[11]);
+    
+    offset = 12;
+    if (!read_varint(data, size, offset, header.tile_count) || offset >= size) {
+        return false;
+    }
+    header.max_depth = data[offset++];
+    
+    return true;
+}
+
+uint64_t TreeStream::leaf_count(uint64_t tile_count) {
+    if (tile_count == 0) {
+        return 0;
+    }
+    
+    // Each split turns one leaf into CHILDREN_PER_TILE leaves
+    const uint64_t children = TileInflater::CHILDREN_PER_TILE;
+    uint64_t splits = (tile_count - 1) / children;
+    return tile_count - splits;
+}
+
+void TreeStream::write_varint(uint64_t value, std::vector<uint8_t>& output) {
+    while (value >= 0x80) {
+        output.push_back(static_cast<uint8_t>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    output.push_back(static_cast<uint8_t>(value));
+}
+
+bool TreeStream::read_varint(const uint8_t* data, size_t size, size_t& offset, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (offset >= size) {
+            return false;
+        }
+        uint8_t byte = data[offset++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace spectre
@@ -1,4 +1,5 @@
 #include "variance_calculator.h"
+#include "pixel_kernels.h"
 #include <cmath>
 #include <numeric>
 #if ETCA_OPENMP
@@ -20,59 +21,123 @@ void VarianceCalculator::calculate_channel_variance(
     double& var_r,
     double& var_g,
     double& var_b) {
+    calculate_channel_variance(data.view(), var_r, var_g, var_b);
+}
+
+double VarianceCalculator::calculate_variance(const ImageView& view) {
+    double var_r, var_g, var_b;
+    calculate_channel_variance(view, var_r, var_g, var_b);
     
-    const auto& pixels = data.get_pixels();
+    return (var_r + var_g + var_b) / 3.0;
+}
+
+void VarianceCalculator::calculate_channel_variance(
+    const ImageView& view,
+    double& var_r,
+    double& var_g,
+    double& var_b) {
     
-    if (pixels.empty()) {
+    if (view.empty()) {
         var_r = var_g = var_b = 0.0;
         return;
     }
     
-    // Calculate means (parallel reduction)
-    double mean_r = 0, mean_g = 0, mean_b = 0;
+    const uint32_t width = view.get_width();
+    const uint32_t height = view.get_height();
+    
 #if ETCA_OPENMP
-    #pragma omp parallel for reduction(+:mean_r,mean_g,mean_b)
+    // Small regions are summed serially; a parallel region would cost more
+    // than it saves (and the tree build already runs in parallel tasks)
+    const bool parallel = static_cast<uint64_t>(width) * height >= PARALLEL_MIN_PIXELS;
 #endif
-    for (size_t i = 0; i < pixels.size(); ++i) {
-        mean_r += pixels[i].r;
-        mean_g += pixels[i].g;
-        mean_b += pixels[i].b;
-    }
     
-    double count = static_cast<double>(pixels.size());
-    mean_r /= count;
-    mean_g /= count;
-    mean_b /= count;
-    
-    // Calculate variances (parallel reduction)
-    var_r = var_g = var_b = 0.0;
+    // Channel sums and squared sums in one pass (parallel reduction over rows)
+    const PixelKernels& kernels = pixel_kernels();
+    uint64_t sum_r = 0, sum_g = 0, sum_b = 0, sq_r = 0, sq_g = 0, sq_b = 0;
 #if ETCA_OPENMP
-    #pragma omp parallel for reduction(+:var_r,var_g,var_b)
+    #pragma omp parallel for reduction(+:sum_r,sum_g,sum_b,sq_r,sq_g,sq_b) if(parallel)
 #endif
-    for (size_t i = 0; i < pixels.size(); ++i) {
-        double dr = pixels[i].r - mean_r;
-        double dg = pixels[i].g - mean_g;
-        double db = pixels[i].b - mean_b;
-        
-        var_r += dr * dr;
-        var_g += dg * dg;
-        var_b += db * db;
+    for (uint32_t y = 0; y < height; ++y) {
+        uint64_t row_sums[6] = {0, 0, 0, 0, 0, 0};
+        kernels.sum_squares(view.row(y), width, row_sums);
+        sum_r += row_sums[0];
+        sum_g += row_sums[1];
+        sum_b += row_sums[2];
+        sq_r += row_sums[3];
+        sq_g += row_sums[4];
+        sq_b += row_sums[5];
     }
     
-    var_r /= count;
-    var_g /= count;
-    var_b /= count;
+    // Variance as E[x^2] - E[x]^2 from exact integer sums, as in the
+    // IntegralImage overload, clamped against rounding below zero
+    double count = static_cast<double>(width) * static_cast<double>(height);
+    auto channel_variance = [count](uint64_t sum, uint64_t sq) {
+        double mean = static_cast<double>(sum) / count;
+        double variance = static_cast<double>(sq) / count - mean * mean;
+        return variance > 0.0 ? variance : 0.0;
+    };
     
     // Normalize to 0-1 range
-    var_r = std::sqrt(var_r) / 255.0;
-    var_g = std::sqrt(var_g) / 255.0;
-    var_b = std::sqrt(var_b) / 255.0;
+    var_r = std::sqrt(channel_variance(sum_r, sq_r)) / 255.0;
+    var_g = std::sqrt(channel_variance(sum_g, sq_g)) / 255.0;
+    var_b = std::sqrt(channel_variance(sum_b, sq_b)) / 255.0;
+}
+
+bool VarianceCalculator::should_subdivide(const ImageView& view, double threshold) {
+    return calculate_variance(view) > threshold;
 }
 
 bool VarianceCalculator::should_subdivide(const ColorData& data, double threshold) {
     return calculate_variance(data) > threshold;
 }
 
+void VarianceCalculator::calculate_channel_variance(
+    const IntegralImage& integral,
+    uint32_t x, uint32_t y,
+    uint32_t width, uint32_t height,
+    double& var_r,
+    double& var_g,
+    double& var_b) {
+    
+    IntegralImage::RegionSums sums = integral.region_sums(x, y, width, height);
+    
+    if (sums.count == 0) {
+        var_r = var_g = var_b = 0.0;
+        return;
+    }
+    
+    // Variance as E[x^2] - E[x]^2, clamped against rounding below zero
+    double count = static_cast<double>(sums.count);
+    auto channel_variance = [count](uint64_t sum, uint64_t sq) {
+        double mean = static_cast<double>(sum) / count;
+        double variance = static_cast<double>(sq) / count - mean * mean;
+        return variance > 0.0 ? variance : 0.0;
+    };
+    
+    // Normalize to 0-1 range (same scale as the pixel-scanning overload)
+    var_r = std::sqrt(channel_variance(sums.sum_r, sums.sq_r)) / 255.0;
+    var_g = std::sqrt(channel_variance(sums.sum_g, sums.sq_g)) / 255.0;
+    var_b = std::sqrt(channel_variance(sums.sum_b, sums.sq_b)) / 255.0;
+}
+
+double VarianceCalculator::calculate_variance(
+    const IntegralImage& integral,
+    uint32_t x, uint32_t y,
+    uint32_t width, uint32_t height) {
+    double var_r, var_g, var_b;
+    calculate_channel_variance(integral, x, y, width, height, var_r, var_g, var_b);
+    
+    return (var_r + var_g + var_b) / 3.0;
+}
+
+bool VarianceCalculator::should_subdivide(
+    const IntegralImage& integral,
+    uint32_t x, uint32_t y,
+    uint32_t width, uint32_t height,
+    double threshold) {
+    return calculate_variance(integral, x, y, width, height) > threshold;
+}
+
 double VarianceCalculator::calculate_mean(const std::vector<double>& values) {
     if (values.empty()) return 0.0;
     return std::accumulate(values.begin(), values.end(), 0.0) / static_cast<double>(values.size());